@@ -7,6 +7,9 @@
 #include "chain_items.hpp"
 
 #include <handlegraph/algorithms/dijkstra.hpp>
+#include <simde/x86/sse4.1.h>
+
+#include <queue>
 
 //#define debug_chaining
 
@@ -118,6 +121,33 @@ void sort_and_shadow(std::vector<Anchor>& items) {
     items = std::move(kept_items);
 }
 
+/// Add the given item, with the given points for visiting it and the given best
+/// score for a chain ending with it, to a diagram of the chaining problem.
+static void explain_item(DiagramExplainer& diagram, size_t i, const Anchor& here, int item_points, const TracedScore& best_score) {
+    std::string here_gvnode = "i" + std::to_string(i);
+    std::stringstream label_stream;
+    label_stream << "#" << i << " " << here << " = " << item_points << "/" << best_score.score;
+    diagram.add_node(here_gvnode, {
+        {"label", label_stream.str()}
+    });
+    auto graph_start = here.graph_start();
+    std::string graph_gvnode = "n" + std::to_string(id(graph_start)) + (is_rev(graph_start) ? "r" : "f");
+    diagram.ensure_node(graph_gvnode, {
+        {"label", std::to_string(id(graph_start)) + (is_rev(graph_start) ? "-" : "+")},
+        {"shape", "box"}
+    });
+    // Show the item as connected to its source graph node
+    diagram.add_edge(here_gvnode, graph_gvnode, {{"color", "gray"}});
+    // Make the next graph node along the same strand
+    std::string graph_gvnode2 = "n" + std::to_string(id(graph_start) + (is_rev(graph_start) ? -1 : 1)) + (is_rev(graph_start) ? "r" : "f");
+    diagram.ensure_node(graph_gvnode2, {
+        {"label", std::to_string(id(graph_start) + (is_rev(graph_start) ? -1 : 1)) + (is_rev(graph_start) ? "-" : "+")},
+        {"shape", "box"}
+    });
+    // And show them as connected. 
+    diagram.ensure_edge(graph_gvnode, graph_gvnode2, {{"color", "gray"}});
+}
+
 TracedScore chain_items_dp(vector<TracedScore>& best_chain_score,
                            const VectorView<Anchor>& to_chain,
                            const SnarlDistanceIndex& distance_index,
@@ -332,27 +362,7 @@ TracedScore chain_items_dp(vector<TracedScore>& best_chain_score,
         cerr << "\tBest way to reach #" << i << " is " << best_chain_score[i] << endl;
 #endif
         
-        std::stringstream label_stream;
-        label_stream << "#" << i << " " << here << " = " << item_points << "/" << best_chain_score[i].score;
-        diagram.add_node(here_gvnode, {
-            {"label", label_stream.str()}
-        });
-        auto graph_start = here.graph_start();
-        std::string graph_gvnode = "n" + std::to_string(id(graph_start)) + (is_rev(graph_start) ? "r" : "f");
-        diagram.ensure_node(graph_gvnode, {
-            {"label", std::to_string(id(graph_start)) + (is_rev(graph_start) ? "-" : "+")},
-            {"shape", "box"}
-        });
-        // Show the item as connected to its source graph node
-        diagram.add_edge(here_gvnode, graph_gvnode, {{"color", "gray"}});
-        // Make the next graph node along the same strand
-        std::string graph_gvnode2 = "n" + std::to_string(id(graph_start) + (is_rev(graph_start) ? -1 : 1)) + (is_rev(graph_start) ? "r" : "f");
-        diagram.ensure_node(graph_gvnode2, {
-            {"label", std::to_string(id(graph_start) + (is_rev(graph_start) ? -1 : 1)) + (is_rev(graph_start) ? "-" : "+")},
-            {"shape", "box"}
-        });
-        // And show them as connected. 
-        diagram.ensure_edge(graph_gvnode, graph_gvnode2, {{"color", "gray"}});
+        explain_item(diagram, i, here, item_points, best_chain_score[i]);
         
         // See if this is the best overall
         best_score.max_in(best_chain_score, i);
@@ -366,6 +376,385 @@ TracedScore chain_items_dp(vector<TracedScore>& best_chain_score,
     return best_score;
 }
 
+TracedScore chain_items_dp_batched(vector<TracedScore>& best_chain_score,
+                                   const VectorView<Anchor>& to_chain,
+                                   const SnarlDistanceIndex& distance_index,
+                                   const HandleGraph& graph,
+                                   int gap_open,
+                                   int gap_extension,
+                                   size_t max_lookback_bases,
+                                   size_t min_lookback_items,
+                                   size_t lookback_item_hard_cap,
+                                   int item_bonus,
+                                   size_t max_indel_bases) {
+    
+    DiagramExplainer diagram;
+    diagram.add_globals({{"rankdir", "LR"}});
+    
+#ifdef debug_chaining
+    cerr << "Batch-chaining group of " << to_chain.size() << " items" << endl;
+#endif
+
+    // How many 32-bit lanes do we process at once?
+    constexpr size_t LANES = 4;
+    
+    // Work out the predecessor window for each item the same way as the
+    // scalar DP, by sweeping over the items in read end order.
+    vector<size_t> read_end_order = sort_permutation(to_chain.begin(), to_chain.end(), [&](const Anchor& a, const Anchor& b) {
+        return a.read_end() < b.read_end();
+    });
+    auto first_overlapping_it = read_end_order.begin();
+    
+    // Make our DP table big enough
+    best_chain_score.resize(to_chain.size(), TracedScore::unset());
+    
+    // What's the winner so far?
+    TracedScore best_score = TracedScore::unset();
+    
+    // We keep the lookback window in structure-of-arrays form, padded out to
+    // a whole number of vectors, and reuse the storage between items.
+    size_t window_capacity = ((lookback_item_hard_cap + 1 + LANES - 1) / LANES) * LANES;
+    vector<size_t> window_sources;
+    window_sources.reserve(window_capacity);
+    vector<int32_t> window_read_ends(window_capacity);
+    vector<int32_t> window_read_distances(window_capacity);
+    vector<int32_t> window_bounds(window_capacity);
+    // And the order to evaluate the window in.
+    vector<size_t> window_order;
+    window_order.reserve(window_capacity);
+    
+    // Gap scoring constants, broadcast
+    simde__m128i open_vec = simde_mm_set1_epi32(gap_open);
+    simde__m128i extension_vec = simde_mm_set1_epi32(gap_extension);
+    simde__m128i one_vec = simde_mm_set1_epi32(1);
+    simde__m128i zero_vec = simde_mm_setzero_si128();
+    simde__m128i max_indel_vec = simde_mm_set1_epi32((int32_t) std::min<size_t>(max_indel_bases, std::numeric_limits<int32_t>::max()));
+    
+    // We clamp read and graph distances to this, since anything longer than
+    // the max indel can't be chained anyway.
+    const int32_t distance_cap = std::numeric_limits<int32_t>::max() / 4;
+    
+    for (size_t i = 0; i < to_chain.size(); i++) {
+        // For each item
+        auto& here = to_chain[i];
+        
+        while (to_chain[*first_overlapping_it].read_end() <= here.read_start()) {
+            // Scan ahead to the first overlapping item that ends earliest.
+            ++first_overlapping_it;
+            assert(first_overlapping_it != read_end_order.end());
+        }
+        
+        // How many points is it worth to collect?
+        auto item_points = here.score() + item_bonus;
+        
+        // If we come from nowhere, we get those points.
+        best_chain_score[i] = std::max(best_chain_score[i], {item_points, TracedScore::nowhere()});
+        
+        // Gather the whole lookback window: everything that doesn't overlap,
+        // in reverse order by end position, up to the hard cap.
+        window_sources.clear();
+        auto predecessor_index_it = first_overlapping_it;
+        while (predecessor_index_it != read_end_order.begin() && window_sources.size() <= lookback_item_hard_cap) {
+            --predecessor_index_it;
+            size_t source = *predecessor_index_it;
+            window_read_ends[window_sources.size()] = (int32_t) std::min<size_t>(to_chain[source].read_end(), distance_cap);
+            window_bounds[window_sources.size()] = best_chain_score[source].score;
+            window_sources.push_back(source);
+        }
+        size_t padded_size = ((window_sources.size() + LANES - 1) / LANES) * LANES;
+        
+        // Compute read distances and upper bounds on the score for the whole
+        // window. The best a transition can do is cost nothing, so the bound
+        // is just the source's score plus the item's points.
+        simde__m128i here_start_vec = simde_mm_set1_epi32((int32_t) std::min<size_t>(here.read_start(), distance_cap));
+        simde__m128i item_points_vec = simde_mm_set1_epi32(item_points);
+        for (size_t j = 0; j < padded_size; j += LANES) {
+            simde__m128i ends = simde_mm_loadu_si128((simde__m128i*) &window_read_ends[j]);
+            simde__m128i scores = simde_mm_loadu_si128((simde__m128i*) &window_bounds[j]);
+            simde_mm_storeu_si128((simde__m128i*) &window_read_distances[j], simde_mm_sub_epi32(here_start_vec, ends));
+            simde_mm_storeu_si128((simde__m128i*) &window_bounds[j], simde_mm_add_epi32(scores, item_points_vec));
+        }
+        
+        // Cut the window at the read distance limit. Read distances only grow
+        // as we go back, so everything after the first item past the limit
+        // is out too. We always keep min_lookback_items items.
+        size_t window_size = window_sources.size();
+        for (size_t j = min_lookback_items; j < window_size; j++) {
+            if ((size_t) window_read_distances[j] > max_lookback_bases) {
+                window_size = j;
+                break;
+            }
+        }
+        
+        // Evaluate the window best bound first, and break ties the way
+        // TracedScore does, in favor of later sources.
+        window_order.clear();
+        for (size_t j = 0; j < window_size; j++) {
+            window_order.push_back(j);
+        }
+        std::sort(window_order.begin(), window_order.end(), [&](const size_t& a, const size_t& b) {
+            return window_bounds[a] > window_bounds[b] ||
+                (window_bounds[a] == window_bounds[b] && window_sources[a] > window_sources[b]);
+        });
+        
+        size_t next = 0;
+        while (next < window_order.size()) {
+            // Fill a vector's worth of lanes with candidates that can still
+            // beat the best score so far, making distance queries only for
+            // them.
+            alignas(16) int32_t read_distances[LANES];
+            alignas(16) int32_t graph_distances[LANES];
+            alignas(16) int32_t source_scores[LANES];
+            alignas(16) int32_t achieved[LANES];
+            size_t lane_sources[LANES];
+            size_t lanes_used = 0;
+            while (lanes_used < LANES && next < window_order.size()) {
+                size_t j = window_order[next];
+                if (TracedScore {window_bounds[j], window_sources[j]} < best_chain_score[i]) {
+                    // Nothing from here on can win.
+                    next = window_order.size();
+                    break;
+                }
+                auto& source = to_chain[window_sources[j]];
+                size_t graph_distance = get_graph_distance(source, here, distance_index, graph);
+                read_distances[lanes_used] = window_read_distances[j];
+                graph_distances[lanes_used] = (int32_t) std::min<size_t>(graph_distance, distance_cap);
+                source_scores[lanes_used] = best_chain_score[window_sources[j]].score;
+                lane_sources[lanes_used] = window_sources[j];
+                lanes_used++;
+                next++;
+            }
+            if (lanes_used == 0) {
+                break;
+            }
+            for (size_t lane = lanes_used; lane < LANES; lane++) {
+                // Pad with impossible transitions.
+                read_distances[lane] = 0;
+                graph_distances[lane] = distance_cap;
+                source_scores[lane] = 0;
+            }
+            
+            // Score the transitions: charge for the change in length, and
+            // refuse indels that are too long or that come from unreachable
+            // places.
+            simde__m128i read_vec = simde_mm_load_si128((simde__m128i*) read_distances);
+            simde__m128i graph_vec = simde_mm_load_si128((simde__m128i*) graph_distances);
+            simde__m128i indel_vec = simde_mm_abs_epi32(simde_mm_sub_epi32(read_vec, graph_vec));
+            simde__m128i gap_vec = simde_mm_sub_epi32(zero_vec,
+                simde_mm_add_epi32(open_vec, simde_mm_mullo_epi32(simde_mm_sub_epi32(indel_vec, one_vec), extension_vec)));
+            gap_vec = simde_mm_blendv_epi8(gap_vec, zero_vec, simde_mm_cmpeq_epi32(indel_vec, zero_vec));
+            simde__m128i total_vec = simde_mm_add_epi32(simde_mm_add_epi32(simde_mm_load_si128((simde__m128i*) source_scores), gap_vec), item_points_vec);
+            simde__m128i bad_vec = simde_mm_cmpgt_epi32(indel_vec, max_indel_vec);
+            simde_mm_store_si128((simde__m128i*) achieved, simde_mm_blendv_epi8(total_vec, simde_mm_set1_epi32(std::numeric_limits<int32_t>::min()), bad_vec));
+            
+            for (size_t lane = 0; lane < lanes_used; lane++) {
+                if (achieved[lane] == std::numeric_limits<int32_t>::min()) {
+                    // Transition is impossible.
+                    continue;
+                }
+                TracedScore from_source_score {achieved[lane], lane_sources[lane]};
+#ifdef debug_chaining
+                cerr << "\t\tWe can reach #" << i << " with " << from_source_score << " from #" << lane_sources[lane] << endl;
+#endif
+                best_chain_score[i] = std::max(best_chain_score[i], from_source_score);
+                if (from_source_score.score > 0) {
+                    diagram.suggest_edge("i" + std::to_string(lane_sources[lane]), "i" + std::to_string(i), "i" + std::to_string(i), from_source_score.score, {
+                        {"label", std::to_string(achieved[lane] - source_scores[lane] - item_points)},
+                        {"weight", std::to_string(std::max<int>(1, from_source_score.score))}
+                    });
+                }
+            }
+        }
+        
+#ifdef debug_chaining
+        cerr << "\tBest way to reach #" << i << " is " << best_chain_score[i] << endl;
+#endif
+        
+        explain_item(diagram, i, here, item_points, best_chain_score[i]);
+        
+        // See if this is the best overall
+        best_score.max_in(best_chain_score, i);
+    }
+    
+    return best_score;
+}
+
+/**
+ * Range-max query tree over a fixed number of slots, each holding a
+ * TracedScore. Empty slots hold a score that can never win. Supports pulling
+ * out the contents of a range best score first.
+ */
+class RangeMaxTree {
+public:
+    /// Make a tree with the given number of empty slots.
+    RangeMaxTree(size_t slots) : leaf_count(1) {
+        while (leaf_count < slots) {
+            leaf_count *= 2;
+        }
+        nodes.resize(2 * leaf_count, empty());
+    }
+    
+    /// Score held in an empty slot.
+    inline static TracedScore empty() {
+        return {std::numeric_limits<int>::min(), TracedScore::nowhere()};
+    }
+    
+    /// Put the given value in the given slot.
+    void set(size_t slot, const TracedScore& value) {
+        size_t node = slot + leaf_count;
+        nodes[node] = value;
+        for (node /= 2; node > 0; node /= 2) {
+            nodes[node] = std::max(nodes[2 * node], nodes[2 * node + 1]);
+        }
+    }
+    
+    /**
+     * Call the given function with the values in slots [start, end), best
+     * first, until it returns false. Stops as soon as can_win() is false for
+     * the best value left in the range, without looking at anything below it.
+     */
+    void for_each_best_first(size_t start, size_t end,
+                             const std::function<bool(const TracedScore&)>& can_win,
+                             const std::function<bool(const TracedScore&)>& iteratee) const {
+        // Keep a heap of tree nodes to expand, by their maxes.
+        auto compare = [&](const size_t& a, const size_t& b) {
+            return nodes[a] < nodes[b];
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(compare)> queue(compare);
+        // Decompose the range into canonical nodes.
+        for (size_t low = start + leaf_count, high = end + leaf_count; low < high; low /= 2, high /= 2) {
+            if (low & 1) {
+                queue.push(low++);
+            }
+            if (high & 1) {
+                queue.push(--high);
+            }
+        }
+        while (!queue.empty()) {
+            size_t node = queue.top();
+            queue.pop();
+            if (nodes[node] == empty() || !can_win(nodes[node])) {
+                // Nothing more here or anywhere else is worth looking at.
+                break;
+            }
+            if (node >= leaf_count) {
+                // Found a slot.
+                if (!iteratee(nodes[node])) {
+                    break;
+                }
+            } else {
+                queue.push(2 * node);
+                queue.push(2 * node + 1);
+            }
+        }
+    }
+    
+protected:
+    /// Number of leaves, a power of 2
+    size_t leaf_count;
+    /// Implicit binary tree, with the root at 1 and leaves at the end.
+    std::vector<TracedScore> nodes;
+};
+
+TracedScore chain_items_dp_sparse(vector<TracedScore>& best_chain_score,
+                                  const VectorView<Anchor>& to_chain,
+                                  const SnarlDistanceIndex& distance_index,
+                                  const HandleGraph& graph,
+                                  int gap_open,
+                                  int gap_extension,
+                                  size_t max_lookback_bases,
+                                  size_t lookback_item_hard_cap,
+                                  int item_bonus,
+                                  size_t max_indel_bases) {
+    
+#ifdef debug_chaining
+    cerr << "Sparse-chaining group of " << to_chain.size() << " items" << endl;
+#endif
+    
+    // Key the query tree on read end. Slot s holds the item that is s-th by
+    // read end.
+    vector<size_t> read_end_order = sort_permutation(to_chain.begin(), to_chain.end(), [&](const Anchor& a, const Anchor& b) {
+        return a.read_end() < b.read_end();
+    });
+    vector<size_t> slot_of_item(to_chain.size());
+    vector<size_t> slot_read_ends;
+    slot_read_ends.reserve(to_chain.size());
+    for (size_t slot = 0; slot < read_end_order.size(); slot++) {
+        slot_of_item[read_end_order[slot]] = slot;
+        slot_read_ends.push_back(to_chain[read_end_order[slot]].read_end());
+    }
+    
+    RangeMaxTree finished_items(to_chain.size());
+    
+    // Make our DP table big enough
+    best_chain_score.resize(to_chain.size(), TracedScore::unset());
+    
+    // What's the winner so far?
+    TracedScore best_score = TracedScore::unset();
+    
+    for (size_t i = 0; i < to_chain.size(); i++) {
+        // For each item
+        auto& here = to_chain[i];
+        
+        // How many points is it worth to collect?
+        auto item_points = here.score() + item_bonus;
+        
+        // If we come from nowhere, we get those points.
+        best_chain_score[i] = std::max(best_chain_score[i], {item_points, TracedScore::nowhere()});
+        
+        // Predecessors are the items that end at or before here starts in the
+        // read, but not too far before. They all start before here, so they
+        // are already finished.
+        size_t window_end = std::upper_bound(slot_read_ends.begin(), slot_read_ends.end(), here.read_start()) - slot_read_ends.begin();
+        size_t earliest_end = here.read_start() > max_lookback_bases ? here.read_start() - max_lookback_bases : 0;
+        size_t window_start = std::lower_bound(slot_read_ends.begin(), slot_read_ends.end(), earliest_end) - slot_read_ends.begin();
+        
+        // Only the transitions that can actually be made count against the
+        // cap, so a run of unreachable or over-long candidates can't use it up.
+        size_t transitions_made = 0;
+        finished_items.for_each_best_first(window_start, window_end, [&](const TracedScore& max_source_score) {
+            // The best a transition can do is cost nothing, so once the best
+            // source left can't win that way, nothing left can.
+            return !(max_source_score.add_points(item_points) < best_chain_score[i]);
+        }, [&](const TracedScore& source_score) {
+            auto& source = to_chain[source_score.source];
+            size_t read_distance = get_read_distance(source, here);
+            size_t graph_distance = get_graph_distance(source, here, distance_index, graph);
+            if (read_distance == numeric_limits<size_t>::max() || graph_distance == numeric_limits<size_t>::max()) {
+                // Can't make this transition.
+                return true;
+            }
+            size_t indel_length = (read_distance > graph_distance) ? read_distance - graph_distance : graph_distance - read_distance;
+            if (indel_length > max_indel_bases) {
+                // Don't allow an indel this long
+                return true;
+            }
+            int jump_points = score_gap(indel_length, gap_open, gap_extension);
+            
+            TracedScore from_source_score = source_score.add_points(jump_points + item_points);
+#ifdef debug_chaining
+            cerr << "\t\tWe can reach #" << i << " with " << source_score << " + " << jump_points << " from transition + " << item_points << " from item = " << from_source_score << endl;
+#endif
+            best_chain_score[i] = std::max(best_chain_score[i], from_source_score);
+            // Stop once we've made as many transitions as we're allowed.
+            return ++transitions_made < lookback_item_hard_cap;
+        });
+        
+#ifdef debug_chaining
+        cerr << "\tBest way to reach #" << i << " is " << best_chain_score[i] << endl;
+#endif
+        
+        // Make this item available as a predecessor, with its own index as
+        // the source to come from.
+        finished_items.set(slot_of_item[i], {best_chain_score[i].score, i});
+        
+        // See if this is the best overall
+        best_score.max_in(best_chain_score, i);
+    }
+    
+    return best_score;
+}
+
 vector<size_t> chain_items_traceback(const vector<TracedScore>& best_chain_score,
                                      const VectorView<Anchor>& to_chain,
                                      const TracedScore& best_past_ending_score_ever) {
@@ -416,7 +805,8 @@ pair<int, vector<size_t>> find_best_chain(const VectorView<Anchor>& to_chain,
                                           double lookback_scale_factor,
                                           double min_good_transition_score_per_base,
                                           int item_bonus,
-                                          size_t max_indel_bases) {
+                                          size_t max_indel_bases,
+                                          ChainingEngine engine) {
                                                                  
     if (to_chain.empty()) {
         return std::make_pair(0, vector<size_t>());
@@ -424,7 +814,10 @@ pair<int, vector<size_t>> find_best_chain(const VectorView<Anchor>& to_chain,
         
         // We actually need to do DP
         vector<TracedScore> best_chain_score;
-        TracedScore best_past_ending_score_ever = chain_items_dp(best_chain_score,
+        TracedScore best_past_ending_score_ever;
+        switch (engine) {
+        case ChainingEngine::BATCHED_LOOKBACK:
+            best_past_ending_score_ever = chain_items_dp_batched(best_chain_score,
                                                                  to_chain,
                                                                  distance_index,
                                                                  graph,
@@ -433,11 +826,38 @@ pair<int, vector<size_t>> find_best_chain(const VectorView<Anchor>& to_chain,
                                                                  max_lookback_bases,
                                                                  min_lookback_items,
                                                                  lookback_item_hard_cap,
-                                                                 initial_lookback_threshold,
-                                                                 lookback_scale_factor,
-                                                                 min_good_transition_score_per_base,
                                                                  item_bonus,
                                                                  max_indel_bases);
+            break;
+        case ChainingEngine::SPARSE:
+            best_past_ending_score_ever = chain_items_dp_sparse(best_chain_score,
+                                                                to_chain,
+                                                                distance_index,
+                                                                graph,
+                                                                gap_open,
+                                                                gap_extension,
+                                                                max_lookback_bases,
+                                                                lookback_item_hard_cap,
+                                                                item_bonus,
+                                                                max_indel_bases);
+            break;
+        default:
+            best_past_ending_score_ever = chain_items_dp(best_chain_score,
+                                                         to_chain,
+                                                         distance_index,
+                                                         graph,
+                                                         gap_open,
+                                                         gap_extension,
+                                                         max_lookback_bases,
+                                                         min_lookback_items,
+                                                         lookback_item_hard_cap,
+                                                         initial_lookback_threshold,
+                                                         lookback_scale_factor,
+                                                         min_good_transition_score_per_base,
+                                                         item_bonus,
+                                                         max_indel_bases);
+            break;
+        }
         // Then do the traceback and pair it up with the score.
         return std::make_pair(
             best_past_ending_score_ever.score,
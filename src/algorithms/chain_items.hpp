@@ -182,6 +182,21 @@ using vg::operator<<;
 /// Print operator
 ostream& operator<<(ostream& out, const TracedScore& value);
 
+/**
+ * Which dynamic programming implementation should be used to chain items?
+ */
+enum class ChainingEngine {
+    /// Look back through a window of possible predecessors with an adaptive
+    /// threshold, one at a time (chain_items_dp()).
+    LOOKBACK,
+    /// Look back through the whole window as a SIMD batch
+    /// (chain_items_dp_batched()).
+    BATCHED_LOOKBACK,
+    /// Find dominating predecessors with a range-max query structure
+    /// (chain_items_dp_sparse()).
+    SPARSE
+};
+
 /**
  * Get rid of items that are shadowed or contained by (or are identical to) others.
  *
@@ -230,6 +245,63 @@ TracedScore chain_items_dp(vector<TracedScore>& best_chain_score,
                            int item_bonus = 0,
                            size_t max_indel_bases = 100);
 
+/**
+ * Fill in the given DP table for the best chain score ending with each item,
+ * like chain_items_dp(), but evaluating each item's whole lookback window as
+ * a batch.
+ *
+ * Read distances and score upper bounds for the window are computed with
+ * SIMD, and then candidate predecessors are visited best bound first, with
+ * gap scores computed a vector at a time. The distance index is only queried
+ * for candidates that can still beat the best score found so far, so instead
+ * of the adaptive lookback threshold, the whole window out to
+ * max_lookback_bases (or min_lookback_items, and up to
+ * lookback_item_hard_cap) is always considered.
+ */
+TracedScore chain_items_dp_batched(vector<TracedScore>& best_chain_score,
+                                   const VectorView<Anchor>& to_chain,
+                                   const SnarlDistanceIndex& distance_index,
+                                   const HandleGraph& graph,
+                                   int gap_open,
+                                   int gap_extension,
+                                   size_t max_lookback_bases = 150,
+                                   size_t min_lookback_items = 0,
+                                   size_t lookback_item_hard_cap = 100,
+                                   int item_bonus = 0,
+                                   size_t max_indel_bases = 100);
+
+/**
+ * Fill in the given DP table for the best chain score ending with each item,
+ * like chain_items_dp(), but using a range-max query structure to find the
+ * predecessors worth trying.
+ *
+ * Finished items are kept in a range-max query tree keyed on read end
+ * position. For each item, candidate predecessors ending within
+ * max_lookback_bases before it in the read are pulled out of the tree best
+ * score first. The scan stops as soon as the best score left in the window
+ * can't beat the best score found so far even with a free transition, so the
+ * distance index is only consulted for predecessors that dominate. At most
+ * lookback_item_hard_cap transitions are made per item; candidates that are
+ * unreachable or would need an indel longer than max_indel_bases don't count
+ * against that cap.
+ *
+ * When the best remaining predecessor connects, each item costs O(log n) tree
+ * work, and the whole DP takes O(n log n) time in the number of items.
+ * Predecessors that score well but can't be connected still each cost a
+ * distance query and O(log n) tree work before the scan can get past them.
+ */
+ */
+TracedScore chain_items_dp_sparse(vector<TracedScore>& best_chain_score,
+                                  const VectorView<Anchor>& to_chain,
+                                  const SnarlDistanceIndex& distance_index,
+                                  const HandleGraph& graph,
+                                  int gap_open,
+                                  int gap_extension,
+                                  size_t max_lookback_bases = 150,
+                                  size_t lookback_item_hard_cap = 100,
+                                  int item_bonus = 0,
+                                  size_t max_indel_bases = 100);
+
 /**
  * Trace back through in the given DP table from the best chain score.
  */
@@ -243,6 +315,9 @@ vector<size_t> chain_items_traceback(const vector<TracedScore>& best_chain_score
  *
  * Input items must be sorted by start position in the read.
  *
+ * Uses the DP implementation for the given ChainingEngine. Parameters that
+ * don't apply to that engine are ignored.
+ *
  * Returns the score and the list of indexes of items visited to achieve
  * that score, in order.
  */
@@ -258,7 +333,8 @@ pair<int, vector<size_t>> find_best_chain(const VectorView<Anchor>& to_chain,
                                           double lookback_scale_factor = 2.0,
                                           double min_good_transition_score_per_base = -0.1,
                                           int item_bonus = 0,
-                                          size_t max_indel_bases = 100);
+                                          size_t max_indel_bases = 100,
+                                          ChainingEngine engine = ChainingEngine::LOOKBACK);
 
 /**
  * Score the given group of items. Determines the best score that can be
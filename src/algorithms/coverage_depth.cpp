@@ -4,34 +4,89 @@
 #include <vg/io/stream.hpp>
 #include "../path.hpp"
 
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
 namespace vg {
 namespace algorithms {
 
+// bases per chunk when printing per-base depths in parallel
+static const size_t depth_chunk_size = 1 << 16;
+
+// one scan of a path to collect its bins: the start offset and start step of each bin.  also
+// reports the path length
+static vector<pair<size_t, step_handle_t>> get_path_bins(const PathHandleGraph& graph, path_handle_t path_handle,
+                                                         size_t bin_size, size_t& path_length) {
+    vector<pair<size_t, step_handle_t>> bins;
+    size_t offset = 0;
+    size_t cur_bin_size = bin_size;
+    step_handle_t end_step = graph.path_end(path_handle);
+    for (step_handle_t cur_step = graph.path_begin(path_handle); cur_step != end_step; cur_step = graph.get_next_step(cur_step)) {
+        if (cur_bin_size >= bin_size) {
+            bins.push_back(make_pair(offset, cur_step));
+            cur_bin_size = 0;
+        }
+        size_t node_len = graph.get_length(graph.get_handle_of_step(cur_step));
+        offset += node_len;
+        cur_bin_size += node_len;
+    }
+    path_length = offset;
+    return bins;
+}
+
+// split a path into chunks and have print_chunk write each one's output, in parallel.  chunks are
+// done a batch at a time so only a few are held in memory, and are written to out_stream in path order
+static void print_path_chunks_in_parallel(const PathHandleGraph& graph, path_handle_t path_handle, ostream& out_stream,
+                                          const function<void(step_handle_t, step_handle_t, size_t, ostream&)>& print_chunk) {
+    size_t path_length;
+    vector<pair<size_t, step_handle_t>> chunks = get_path_bins(graph, path_handle, depth_chunk_size, path_length);
+    step_handle_t end_step = graph.path_end(path_handle);
+    size_t batch_size = get_thread_count() * 4;
+    vector<string> chunk_output;
+    for (size_t batch_start = 0; batch_start < chunks.size(); batch_start += batch_size) {
+        size_t batch_end = std::min(chunks.size(), batch_start + batch_size);
+        chunk_output.resize(batch_end - batch_start);
+#pragma omp parallel for
+        for (size_t i = batch_start; i < batch_end; ++i) {
+            stringstream chunk_stream;
+            step_handle_t chunk_end_step = i < chunks.size() - 1 ? chunks[i+1].second : end_step;
+            print_chunk(chunks[i].second, chunk_end_step, chunks[i].first, chunk_stream);
+            chunk_output[i - batch_start] = chunk_stream.str();
+        }
+        for (const string& output : chunk_output) {
+            out_stream << output;
+        }
+    }
+}
+
 void packed_depths(const Packer& packer, const string& path_name, size_t min_coverage, ostream& out_stream) {
     const PathHandleGraph& graph = dynamic_cast<const PathHandleGraph&>(*packer.get_graph());
     path_handle_t path_handle = graph.get_path_handle(path_name);
-    step_handle_t start_step = graph.path_begin(path_handle);
-    step_handle_t end_step = graph.path_end(path_handle);
-    Position cur_pos;
     subrange_t subrange;
     string base_name = Paths::strip_subrange(path_name, &subrange);
-    size_t path_offset = subrange == PathMetadata::NO_SUBRANGE ? 1 : 1 + subrange.first;
-    
-    for (step_handle_t cur_step = start_step; cur_step != end_step; cur_step = graph.get_next_step(cur_step)) {
-        handle_t cur_handle = graph.get_handle_of_step(cur_step);
-        nid_t cur_id = graph.get_id(cur_handle);
-        size_t cur_len = graph.get_length(cur_handle);
-        cur_pos.set_node_id(cur_id);
-        cur_pos.set_is_reverse(graph.get_is_reverse(cur_handle));
-        for (size_t i = 0; i < cur_len; ++i) {
-            cur_pos.set_offset(i);
-            size_t pos_coverage = packer.coverage_at_position(packer.position_in_basis(cur_pos));
-            if (pos_coverage >= min_coverage) {
-                out_stream << base_name << "\t" << path_offset << "\t" << pos_coverage << "\n";
+    size_t base_offset = subrange == PathMetadata::NO_SUBRANGE ? 1 : 1 + subrange.first;
+
+    print_path_chunks_in_parallel(graph, path_handle, out_stream, [&](step_handle_t start_step, step_handle_t end_step,
+                                                                      size_t chunk_offset, ostream& chunk_stream) {
+        Position cur_pos;
+        size_t path_offset = base_offset + chunk_offset;
+        for (step_handle_t cur_step = start_step; cur_step != end_step; cur_step = graph.get_next_step(cur_step)) {
+            handle_t cur_handle = graph.get_handle_of_step(cur_step);
+            nid_t cur_id = graph.get_id(cur_handle);
+            size_t cur_len = graph.get_length(cur_handle);
+            cur_pos.set_node_id(cur_id);
+            cur_pos.set_is_reverse(graph.get_is_reverse(cur_handle));
+            for (size_t i = 0; i < cur_len; ++i) {
+                cur_pos.set_offset(i);
+                size_t pos_coverage = packer.coverage_at_position(packer.position_in_basis(cur_pos));
+                if (pos_coverage >= min_coverage) {
+                    chunk_stream << base_name << "\t" << path_offset << "\t" << pos_coverage << "\n";
+                }
+                ++path_offset;
             }
-            ++path_offset;
         }
-    }
+    });
 }
 
 pair<double, double> packed_depth_of_bin(const Packer& packer,
@@ -96,43 +151,60 @@ pair<double, double> packed_depth_of_bin(const Packer& packer,
     return wellford_mean_var(bin_length, mean, M2);
 }
 
-vector<tuple<size_t, size_t, double, double>> binned_packed_depth(const Packer& packer, const string& path_name, size_t bin_size,
-                                                                  size_t min_coverage, bool include_deletions) {
-
-    const PathHandleGraph& graph = dynamic_cast<const PathHandleGraph&>(*packer.get_graph());
-    path_handle_t path_handle = graph.get_path_handle(path_name);
-    
-    // one scan of our path to collect the bins
-    step_handle_t start_step = graph.path_begin(path_handle);
-    step_handle_t end_step = graph.path_end(path_handle);
-    vector<pair<size_t, step_handle_t>> bins; // start offset / start step of each bin
-    size_t offset = 0;
-    size_t cur_bin_size = bin_size;
-    for (step_handle_t cur_step = start_step; cur_step != end_step; cur_step = graph.get_next_step(cur_step)) {
-        if (cur_bin_size >= bin_size) {
-            bins.push_back(make_pair(offset, cur_step));
-            cur_bin_size = 0;
+// compute the bins of all the given paths in one parallel loop, using the given function to get each bin's depth
+static vector<vector<tuple<size_t, size_t, double, double>>> binned_depths_in_parallel(
+    const PathHandleGraph& graph, const vector<string>& path_names, size_t bin_size,
+    const function<pair<double, double>(step_handle_t, step_handle_t)>& depth_of_bin) {
+
+    // one scan of each path to collect the bins
+    vector<vector<pair<size_t, step_handle_t>>> path_bins(path_names.size());
+    vector<size_t> path_lengths(path_names.size());
+    vector<pair<size_t, size_t>> all_bins; // path index / bin index of every bin
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < path_names.size(); ++i) {
+        path_bins[i] = get_path_bins(graph, graph.get_path_handle(path_names[i]), bin_size, path_lengths[i]);
+    }
+    for (size_t i = 0; i < path_bins.size(); ++i) {
+        for (size_t j = 0; j < path_bins[i].size(); ++j) {
+            all_bins.emplace_back(i, j);
         }
-        size_t node_len = graph.get_length(graph.get_handle_of_step(cur_step));
-        offset += node_len;
-        cur_bin_size += node_len;
     }
 
-    // parallel scan to compute the coverages
-    vector<tuple<size_t, size_t, double, double>> binned_depths(bins.size());
-#pragma omp parallel for
-    for (size_t i = 0; i < bins.size(); ++i) {
-        step_handle_t bin_start_step = bins[i].second;
-        step_handle_t bin_end_step = i < bins.size() - 1 ? bins[i+1].second : end_step;
-        size_t bin_start = bins[i].first;
-        size_t bin_end = i < bins.size() - 1 ? bins[i+1].first : offset;
-        pair<double, double> coverage = packed_depth_of_bin(packer, bin_start_step, bin_end_step, min_coverage, include_deletions);
-        binned_depths[i] = make_tuple(bin_start, bin_end, coverage.first, coverage.second);
+    // parallel scan to compute the coverages, across all the paths at once
+    vector<vector<tuple<size_t, size_t, double, double>>> binned_depths(path_names.size());
+    for (size_t i = 0; i < path_bins.size(); ++i) {
+        binned_depths[i].resize(path_bins[i].size());
+    }
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t k = 0; k < all_bins.size(); ++k) {
+        size_t i = all_bins[k].first;
+        size_t j = all_bins[k].second;
+        const vector<pair<size_t, step_handle_t>>& bins = path_bins[i];
+        step_handle_t bin_start_step = bins[j].second;
+        step_handle_t bin_end_step = j < bins.size() - 1 ? bins[j+1].second : graph.path_end(graph.get_path_handle(path_names[i]));
+        size_t bin_start = bins[j].first;
+        size_t bin_end = j < bins.size() - 1 ? bins[j+1].first : path_lengths[i];
+        pair<double, double> coverage = depth_of_bin(bin_start_step, bin_end_step);
+        binned_depths[i][j] = make_tuple(bin_start, bin_end, coverage.first, coverage.second);
     }
 
     return binned_depths;
 }
 
+vector<tuple<size_t, size_t, double, double>> binned_packed_depth(const Packer& packer, const string& path_name, size_t bin_size,
+                                                                  size_t min_coverage, bool include_deletions) {
+    return binned_packed_depths(packer, {path_name}, bin_size, min_coverage, include_deletions).front();
+}
+
+vector<vector<tuple<size_t, size_t, double, double>>> binned_packed_depths(const Packer& packer, const vector<string>& path_names,
+                                                                           size_t bin_size, size_t min_coverage,
+                                                                           bool include_deletions) {
+    const PathHandleGraph& graph = dynamic_cast<const PathHandleGraph&>(*packer.get_graph());
+    return binned_depths_in_parallel(graph, path_names, bin_size, [&](step_handle_t start_step, step_handle_t end_step) {
+            return packed_depth_of_bin(packer, start_step, end_step, min_coverage, include_deletions);
+        });
+}
+
 BinnedDepthIndex binned_packed_depth_index(const Packer& packer,
                                            const vector<string>& path_names,
                                            size_t min_bin_size,
@@ -207,6 +279,145 @@ pair<float, float> get_depth_from_index(const BinnedDepthIndex& depth_index, con
     return total;
 }
 
+// file layout: magic, then the starts and depths of every bin size of every path,
+// then the directory pointing into them, then the offset of the directory
+static const char depth_index_magic[8] = {'v', 'g', 'd', 'e', 'p', 't', 'h', '1'};
+
+void save_binned_depth_index(const BinnedDepthIndex& depth_index, const string& filename) {
+    ofstream out(filename, std::ios_base::binary);
+    if (!out) {
+        throw runtime_error("error[save_binned_depth_index]: unable to write " + filename);
+    }
+    auto write_word = [&](uint64_t word) {
+        out.write((const char*)&word, sizeof(word));
+    };
+    out.write(depth_index_magic, sizeof(depth_index_magic));
+    
+    // sort the paths so the file doesn't depend on hashing
+    vector<string> path_names;
+    for (const auto& path_depths : depth_index) {
+        path_names.push_back(path_depths.first);
+    }
+    std::sort(path_names.begin(), path_names.end());
+    
+    // bin size, bin count, data offset for each bin size of each path
+    vector<vector<tuple<uint64_t, uint64_t, uint64_t>>> directory(path_names.size());
+    for (size_t i = 0; i < path_names.size(); ++i) {
+        for (const auto& scaled_depths : depth_index.at(path_names[i])) {
+            directory[i].emplace_back(scaled_depths.first, scaled_depths.second.size(), out.tellp());
+            for (const auto& bin_depth : scaled_depths.second) {
+                write_word(bin_depth.first);
+            }
+            for (const auto& bin_depth : scaled_depths.second) {
+                out.write((const char*)&bin_depth.second.first, sizeof(float));
+                out.write((const char*)&bin_depth.second.second, sizeof(float));
+            }
+        }
+    }
+    
+    uint64_t directory_offset = out.tellp();
+    write_word(path_names.size());
+    for (size_t i = 0; i < path_names.size(); ++i) {
+        write_word(path_names[i].size());
+        // pad the name out to keep the words aligned
+        string padded_name = path_names[i];
+        padded_name.resize((padded_name.size() + 7) / 8 * 8, '\0');
+        out.write(padded_name.data(), padded_name.size());
+        write_word(directory[i].size());
+        for (const auto& level : directory[i]) {
+            write_word(get<0>(level));
+            write_word(get<1>(level));
+            write_word(get<2>(level));
+        }
+    }
+    write_word(directory_offset);
+    if (!out) {
+        throw runtime_error("error[save_binned_depth_index]: failed writing " + filename);
+    }
+}
+
+MappedBinnedDepthIndex::MappedBinnedDepthIndex(const string& filename) {
+    std::error_code error;
+    mapping.map(filename, error);
+    if (error) {
+        throw runtime_error("error[MappedBinnedDepthIndex]: unable to map " + filename + ": " + error.message());
+    }
+    const char* data = mapping.data();
+    size_t size = mapping.size();
+    if (size < 2 * sizeof(uint64_t) || memcmp(data, depth_index_magic, sizeof(depth_index_magic)) != 0) {
+        throw runtime_error("error[MappedBinnedDepthIndex]: " + filename + " is not a binned depth index");
+    }
+    
+    size_t cursor;
+    auto read_word = [&]() {
+        if (cursor + sizeof(uint64_t) > size) {
+            throw runtime_error("error[MappedBinnedDepthIndex]: " + filename + " is truncated");
+        }
+        uint64_t word;
+        memcpy(&word, data + cursor, sizeof(word));
+        cursor += sizeof(word);
+        return word;
+    };
+    
+    // read the directory, leaving the bins themselves in the mapping
+    cursor = size - sizeof(uint64_t);
+    cursor = read_word();
+    size_t path_count = read_word();
+    for (size_t i = 0; i < path_count; ++i) {
+        size_t name_length = read_word();
+        if (cursor + name_length > size) {
+            throw runtime_error("error[MappedBinnedDepthIndex]: " + filename + " is truncated");
+        }
+        string path_name(data + cursor, name_length);
+        cursor += (name_length + 7) / 8 * 8;
+        vector<Level>& levels = paths[path_name];
+        levels.resize(read_word());
+        for (Level& level : levels) {
+            level.bin_size = read_word();
+            level.bin_count = read_word();
+            size_t data_offset = read_word();
+            if (data_offset + level.bin_count * (sizeof(uint64_t) + 2 * sizeof(float)) > size) {
+                throw runtime_error("error[MappedBinnedDepthIndex]: " + filename + " is truncated");
+            }
+            level.starts = (const uint64_t*)(data + data_offset);
+            level.depths = (const float*)(data + data_offset + level.bin_count * sizeof(uint64_t));
+        }
+    }
+}
+
+bool MappedBinnedDepthIndex::has_path(const string& path_name) const {
+    return paths.count(path_name);
+}
+
+pair<float, float> get_depth_from_index(const MappedBinnedDepthIndex& depth_index, const string& path_name, size_t start_offset, size_t end_offset) {
+    // works just like the in-memory version, but with binary searches in the mapped arrays
+    if (end_offset < start_offset) {
+        swap(start_offset, end_offset);
+    }
+    size_t bin_size = 1 + end_offset - start_offset;
+    bin_size *= 2;
+
+    const vector<MappedBinnedDepthIndex::Level>& levels = depth_index.paths.at(path_name);
+    auto ub1 = std::upper_bound(levels.begin(), levels.end(), bin_size, [](size_t size, const MappedBinnedDepthIndex::Level& level) {
+            return size < level.bin_size;
+        });
+    if (ub1 == levels.end()) {
+        --ub1;
+    }
+    const uint64_t* starts_end = ub1->starts + ub1->bin_count;
+    size_t first_bin = std::upper_bound(ub1->starts, starts_end, (uint64_t)start_offset) - ub1->starts - 1;
+    size_t end_bin = std::upper_bound(ub1->starts, starts_end, (uint64_t)end_offset) - ub1->starts;
+    size_t count = 0;
+    pair<float, float> total = make_pair(0, 0);
+    for (size_t i = first_bin; i < end_bin; ++i, ++count) {
+        total.first += ub1->depths[2 * i];
+        total.second += ub1->depths[2 * i + 1];
+    }
+    total.first /= (double)count;
+    total.second /= (double)count;
+    return total;
+}
+
 // draw (roughly) max_nodes nodes from the graph using the random seed
 static unordered_map<nid_t, size_t> sample_nodes(const HandleGraph& graph, size_t max_nodes, size_t random_seed) {
     default_random_engine generator(random_seed);
@@ -299,14 +510,17 @@ void path_depths(const PathHandleGraph& graph, const string& path_name, size_t m
     assert(graph.has_path(path_name));
 
     path_handle_t path_handle = graph.get_path_handle(path_name);
-    // big speedup
-    unordered_map<path_handle_t, string> path_to_name;
 
     subrange_t subrange;
     string base_name = Paths::strip_subrange(path_name, &subrange);
-    size_t offset = subrange == PathMetadata::NO_SUBRANGE ? 1 : 1 + subrange.first;
-
-    graph.for_each_step_in_path(path_handle, [&](step_handle_t step_handle) {
+    size_t base_offset = subrange == PathMetadata::NO_SUBRANGE ? 1 : 1 + subrange.first;
+
+    print_path_chunks_in_parallel(graph, path_handle, out_stream, [&](step_handle_t start_step, step_handle_t end_step,
+                                                                      size_t chunk_offset, ostream& chunk_stream) {
+        // big speedup
+        unordered_map<path_handle_t, string> path_to_name;
+        size_t offset = base_offset + chunk_offset;
+        for (step_handle_t step_handle = start_step; step_handle != end_step; step_handle = graph.get_next_step(step_handle)) {
             unordered_set<string> path_set;
             size_t step_count = 0;            
             handle_t handle = graph.get_handle_of_step(step_handle);
@@ -328,13 +542,12 @@ void path_depths(const PathHandleGraph& graph, const string& path_name, size_t m
             size_t node_len = graph.get_length(handle);
             if (coverage >= min_coverage) {
                 for (size_t i = 0; i < node_len; ++i) {
-                    if (coverage >= min_coverage) {
-                        out_stream << base_name << "\t" << (offset + i) << "\t" << coverage << "\n";
-                    }
+                    chunk_stream << base_name << "\t" << (offset + i) << "\t" << coverage << "\n";
                 }
             }
             offset += node_len;            
-        });
+        }
+    });
 }
 
 pair<double, double> path_depth_of_bin(const PathHandleGraph& graph,
@@ -387,38 +600,17 @@ vector<tuple<size_t, size_t, double, double>> binned_path_depth(const PathHandle
                                                                 size_t bin_size,
                                                                 size_t min_coverage,
                                                                 bool count_cycles) {
+    return binned_path_depths(graph, {path_name}, bin_size, min_coverage, count_cycles).front();
+}
 
-    path_handle_t path_handle = graph.get_path_handle(path_name);
-    
-    // one scan of our path to collect the bins
-    step_handle_t start_step = graph.path_begin(path_handle);
-    step_handle_t end_step = graph.path_end(path_handle);
-    vector<pair<size_t, step_handle_t>> bins; // start offset / start step of each bin
-    size_t offset = 0;
-    size_t cur_bin_size = bin_size;
-    for (step_handle_t cur_step = start_step; cur_step != end_step; cur_step = graph.get_next_step(cur_step)) {
-        if (cur_bin_size >= bin_size) {
-            bins.push_back(make_pair(offset, cur_step));
-            cur_bin_size = 0;
-        }
-        size_t node_len = graph.get_length(graph.get_handle_of_step(cur_step));
-        offset += node_len;
-        cur_bin_size += node_len;
-    }
-
-    // parallel scan to compute the coverages
-    vector<tuple<size_t, size_t, double, double>> binned_depths(bins.size());
-#pragma omp parallel for
-    for (size_t i = 0; i < bins.size(); ++i) {
-        step_handle_t bin_start_step = bins[i].second;
-        step_handle_t bin_end_step = i < bins.size() - 1 ? bins[i+1].second : end_step;
-        size_t bin_start = bins[i].first;
-        size_t bin_end = i < bins.size() - 1 ? bins[i+1].first : offset;
-        pair<double, double> coverage = path_depth_of_bin(graph, bin_start_step, bin_end_step, min_coverage, count_cycles);
-        binned_depths[i] = make_tuple(bin_start, bin_end, coverage.first, coverage.second);
-    }
-
-    return binned_depths;
+vector<vector<tuple<size_t, size_t, double, double>>> binned_path_depths(const PathHandleGraph& graph,
+                                                                         const vector<string>& path_names,
+                                                                         size_t bin_size,
+                                                                         size_t min_coverage,
+                                                                         bool count_cycles) {
+    return binned_depths_in_parallel(graph, path_names, bin_size, [&](step_handle_t start_step, step_handle_t end_step) {
+            return path_depth_of_bin(graph, start_step, end_step, min_coverage, count_cycles);
+        });
 }
 
 
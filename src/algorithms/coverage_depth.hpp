@@ -11,6 +11,7 @@
 #include "handle.hpp"
 #include "statistics.hpp"
 #include "packer.hpp"
+#include <mio/mmap.hpp>
 
 namespace vg {
 namespace algorithms {
@@ -19,6 +20,7 @@ using namespace std;
 
 /// print path-name offset base-coverage for every base on a path (just like samtools depth)
 /// ignoring things below min_coverage.  offsets are 1-based in output stream
+/// Chunks of the path are computed in parallel with all threads, and printed in order
 void packed_depths(const Packer& packer, const string& path_name, size_t min_coverage, ostream& out_stream);
 
 /// Estimate the coverage along a given reference path interval [start_step, end_plus_one_step)
@@ -37,6 +39,11 @@ pair<double, double> packed_depth_of_bin(const Packer& packer, step_handle_t sta
 vector<tuple<size_t, size_t, double, double>> binned_packed_depth(const Packer& packer, const string& path_name, size_t bin_size,
                                                                   size_t min_coverage, bool include_deletions);
 
+/// As above, but for several paths, with the bins of all of them computed in parallel together
+vector<vector<tuple<size_t, size_t, double, double>>> binned_packed_depths(const Packer& packer, const vector<string>& path_names,
+                                                                           size_t bin_size, size_t min_coverage,
+                                                                           bool include_deletions);
+
 /// Use the above function to retrieve the binned depths of a list of paths, and store them indexed by start
 /// coordinate.  If std_err is true, store <mean, stderr> instead of <mean, variance>
 /// For each path, a series of indexes is computed, for bin sizes from min_bin_size, min_bin_size^(exp_growth_factor), etc.
@@ -53,6 +60,38 @@ BinnedDepthIndex binned_packed_depth_index(const Packer& packer,
 /// Query index created above
 pair<float, float> get_depth_from_index(const BinnedDepthIndex& depth_index, const string& path_name, size_t start_offset, size_t end_offset);
 
+/// Write an index created above to a file that MappedBinnedDepthIndex can map
+void save_binned_depth_index(const BinnedDepthIndex& depth_index, const string& filename);
+
+/// A BinnedDepthIndex saved with save_binned_depth_index, memory-mapped so that it can be queried
+/// without recomputing it from a pack or loading it
+class MappedBinnedDepthIndex {
+public:
+    /// Map the given file. Throws runtime_error if it isn't a binned depth index
+    MappedBinnedDepthIndex(const string& filename);
+    
+    bool has_path(const string& path_name) const;
+
+private:
+    /// The bins of one bin size of one path, in the mapping
+    struct Level {
+        size_t bin_size;
+        size_t bin_count;
+        const uint64_t* starts;
+        /// mean, variance pairs
+        const float* depths;
+    };
+    mio::mmap_source mapping;
+    /// bin sizes of each path, in increasing order
+    unordered_map<string, vector<Level>> paths;
+    
+    friend pair<float, float> get_depth_from_index(const MappedBinnedDepthIndex& depth_index, const string& path_name,
+                                                   size_t start_offset, size_t end_offset);
+};
+
+/// Query a mapped index, with the same results as querying the BinnedDepthIndex it was saved from
+pair<float, float> get_depth_from_index(const MappedBinnedDepthIndex& depth_index, const string& path_name, size_t start_offset, size_t end_offset);
+
 /// Return the mean and variance of coverage of randomly sampled nodes from a mappings file
 /// Nodes with less than min_coverage are ignored
 /// The input_filename can be - for stdin
@@ -76,6 +115,10 @@ pair<double, double> path_depth_of_bin(const PathHandleGraph& graph, step_handle
 vector<tuple<size_t, size_t, double, double>> binned_path_depth(const PathHandleGraph& graph, const string& path_name, size_t bin_size,
                                                                 size_t min_coverage, bool count_cycles);
 
+/// As above, but for several paths, with the bins of all of them computed in parallel together
+vector<vector<tuple<size_t, size_t, double, double>>> binned_path_depths(const PathHandleGraph& graph, const vector<string>& path_names,
+                                                                         size_t bin_size, size_t min_coverage, bool count_cycles);
+
 }
 }
 
@@ -1,7 +1,16 @@
 #include "gfa_to_handle.hpp"
 #include "../path.hpp"
+#include "../utility.hpp"
 
 #include <gbwtgraph/utils.h>
+#include <mio/mmap.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+
+#include <sys/mman.h>
 
 namespace vg {
 namespace algorithms {
@@ -319,20 +328,52 @@ static void add_path_listeners(GFAParser& parser, MutablePathMutableHandleGraph*
     });
 }
 
-void gfa_to_handle_graph(const string& filename, MutableHandleGraph* graph,
-                         GFAIDMapInfo* translation) {
-                         
+/// Parse the named GFA file, or standard input if the name is "-". Files are
+/// memory-mapped and tokenized in parallel.
+static void parse_gfa_file(GFAParser& parser, const string& filename) {
     get_input_file(filename, [&](istream& in) {
-       gfa_to_handle_graph(in, graph, translation);
+        if (filename == "-") {
+            parser.parse(in);
+        } else {
+            // We know we can open the file, so go map it instead.
+            parser.parse_mapped(filename);
+        }
     });
 }
 
+/// Set up a parser to load a graph without paths.
+static void set_up_graph_parser(GFAParser& parser, MutableHandleGraph* graph, GFAIDMapInfo* translation) {
+    if (translation) {
+        // Use the given external translation so the caller can keep it around.
+        parser.external_id_map = translation;
+    }
+    add_graph_listeners(parser, graph);
+}
+
+/// Set up a parser to load a graph with paths.
+static void set_up_path_graph_parser(GFAParser& parser, MutablePathMutableHandleGraph* graph, GFAIDMapInfo* translation, int64_t max_rgfa_rank) {
+    set_up_graph_parser(parser, graph, translation);
+    
+    // Set up for path input
+    parser.max_rgfa_rank = max_rgfa_rank;
+    add_path_listeners(parser, graph);
+}
+
+void gfa_to_handle_graph(const string& filename, MutableHandleGraph* graph,
+                         GFAIDMapInfo* translation, bool show_progress) {
+    
+    GFAParser parser;
+    set_up_graph_parser(parser, graph, translation);
+    parser.show_progress = show_progress;
+    parse_gfa_file(parser, filename);
+}
+
 void gfa_to_handle_graph(const string& filename, MutableHandleGraph* graph,
-                         const string& translation_filename) {
+                         const string& translation_filename, bool show_progress) {
 
     
     GFAIDMapInfo id_map_info;
-    gfa_to_handle_graph(filename, graph, &id_map_info);
+    gfa_to_handle_graph(filename, graph, &id_map_info, show_progress);
     write_gfa_translation(id_map_info, translation_filename);
 }
 
@@ -340,29 +381,25 @@ void gfa_to_handle_graph(istream& in, MutableHandleGraph* graph,
                          GFAIDMapInfo* translation) {
                          
     GFAParser parser;
-    if (translation) {
-        // Use the given external translation so the caller can keep it around.
-        parser.external_id_map = translation;
-    }
-    add_graph_listeners(parser, graph);
-    
+    set_up_graph_parser(parser, graph, translation);
     parser.parse(in);
 }
 
 
 void gfa_to_path_handle_graph(const string& filename, MutablePathMutableHandleGraph* graph,
-                              GFAIDMapInfo* translation, int64_t max_rgfa_rank) {
+                              GFAIDMapInfo* translation, int64_t max_rgfa_rank, bool show_progress) {
     
-    get_input_file(filename, [&](istream& in) {
-        gfa_to_path_handle_graph(in, graph, translation, max_rgfa_rank);
-    });
+    GFAParser parser;
+    set_up_path_graph_parser(parser, graph, translation, max_rgfa_rank);
+    parser.show_progress = show_progress;
+    parse_gfa_file(parser, filename);
 }
 
 void gfa_to_path_handle_graph(const string& filename, MutablePathMutableHandleGraph* graph,
-                              int64_t max_rgfa_rank, const string& translation_filename) {
+                              int64_t max_rgfa_rank, const string& translation_filename, bool show_progress) {
 
     GFAIDMapInfo id_map_info;
-    gfa_to_path_handle_graph(filename, graph, &id_map_info, max_rgfa_rank);
+    gfa_to_path_handle_graph(filename, graph, &id_map_info, max_rgfa_rank, show_progress);
     write_gfa_translation(id_map_info, translation_filename);
 
 }
@@ -372,18 +409,8 @@ void gfa_to_path_handle_graph(istream& in,
                               GFAIDMapInfo* translation,
                               int64_t max_rgfa_rank) {
     
-    // TODO: Deduplicate this setup code with gfa_to_handle_graph more.
     GFAParser parser;
-    if (translation) {
-        // Use the given external translation so the caller can keep it around.
-        parser.external_id_map = translation;
-    }
-    add_graph_listeners(parser, graph);
-    
-    // Set up for path input
-    parser.max_rgfa_rank = max_rgfa_rank;
-    add_path_listeners(parser, graph);
-    
+    set_up_path_graph_parser(parser, graph, translation, max_rgfa_rank);
     parser.parse(in);
 }
 
@@ -845,6 +872,76 @@ nid_t GFAParser::find_existing_sequence_id(const string& str, GFAIDMapInfo& id_m
     return 0;
 }
 
+void GFAParser::handle_rgfa_tags(nid_t id, size_t length, const tag_list_t& tags, rgfa_path_cache_t& rgfa_path_cache) {
+    if (this->max_rgfa_rank >= 0 && tags.size() >= 3) {
+        // We'll check for the 3 rGFA optional tags.
+        string rgfa_path_name;
+        int64_t rgfa_offset_on_path;
+        int64_t rgfa_path_rank;
+        if (decode_rgfa_tags(tags, &rgfa_path_name, &rgfa_offset_on_path, &rgfa_path_rank) &&
+            rgfa_path_rank <= this->max_rgfa_rank) {
+            
+            // We need to remember this rGFA path visit
+            auto found = rgfa_path_cache.find(rgfa_path_name);
+            if (found == rgfa_path_cache.end()) {
+                // This is a completely new path, so record its rank
+                found = rgfa_path_cache.emplace_hint(found, rgfa_path_name, std::make_tuple(rgfa_path_rank, 0, rgfa_visit_queue_t()));
+            } else {
+                // This path existed already. Make sure we aren't showing a conflicting rank
+                if (rgfa_path_rank != get<0>(found->second)) {
+                    throw GFAFormatError("rGFA path " + rgfa_path_name + " has conflicting ranks " + std::to_string(rgfa_path_rank) + " and " + std::to_string(get<0>(found->second)));
+                }
+            }
+            auto& visit_queue = get<2>(found->second);
+            auto& next_offset = get<1>(found->second);
+            if (next_offset == rgfa_offset_on_path) {
+                // It's safe to dispatch this visit right now since it's the next one expected along the path.
+                for (auto& listener : this->rgfa_listeners) {
+                    // Tell all the listener functions about this visit
+                    listener(id, rgfa_offset_on_path, length, rgfa_path_name, rgfa_path_rank);
+                }
+                // Advance the offset by the sequence length;
+                next_offset += length;
+                while (!visit_queue.empty() && next_offset == get<0>(visit_queue.top())) {
+                    // The lowest-offset queued visit can be handled now because it abuts what we just did.
+                    // Grab the visit.
+                    auto& visit = visit_queue.top();
+                    for (auto& listener : this->rgfa_listeners) {
+                        // Tell all the listener functions about this visit
+                        listener(get<1>(visit), get<0>(visit), get<2>(visit), rgfa_path_name, rgfa_path_rank);
+                    }
+                    // Advance the offset by the sequence length;
+                    next_offset += get<2>(visit);
+                    // And pop the visit off
+                    visit_queue.pop();
+                }
+            } else {
+                // Add this visit to the heap so we can handle it when we find the missing visits.
+                visit_queue.emplace(rgfa_offset_on_path, id, length);
+            }
+        }
+    }
+}
+
+void GFAParser::flush_rgfa_visits(rgfa_path_cache_t& rgfa_path_cache) {
+    for (auto& kv : rgfa_path_cache) {
+        auto& rgfa_path_name = kv.first;
+        auto& rgfa_path_rank = get<0>(kv.second);
+        auto& visit_queue = get<2>(kv.second);
+        
+        while (!visit_queue.empty()) {
+            // Grab the visit.
+            auto& visit = visit_queue.top();
+            for (auto& listener : this->rgfa_listeners) {
+                // Tell all the listener functions about this visit
+                listener(get<1>(visit), get<0>(visit), get<2>(visit), rgfa_path_name, rgfa_path_rank);
+            }
+            // And pop the visit off
+            visit_queue.pop();
+        }
+    }
+}
+
 void GFAParser::parse(istream& in) {
     if (!in) {
         throw std::ios_base::failure("error:[GFAParser] Couldn't open input stream");
@@ -969,15 +1066,7 @@ void GFAParser::parse(istream& in) {
     set<char> warned_line_types;
     
     // And we need to buffer all the rGFA visits until we have seen all the nodes.
-    // This is a visit at a path offset to a node. We also need the length so
-    // we can know when it abuts later visits.
-    using rgfa_visit_t = tuple<int64_t, nid_t, size_t>;
-    // This is a heap of those, in order
-    using visit_queue_t = std::priority_queue<rgfa_visit_t, vector<rgfa_visit_t>, std::greater<rgfa_visit_t>>;
-    // This holds rGFA paths we have heard of, mapping from name to rank, start
-    // position of next visit that is safe to announce, and list of buffered
-    // visits in a min-heap
-    unordered_map<string, tuple<int64_t, size_t, visit_queue_t>> rgfa_path_cache;
+    rgfa_path_cache_t rgfa_path_cache;
     
     // We call this to handle the current line if it is ready to be handled, or
     // buffer it if it can't. Return false if we are not ready for the line right
@@ -1017,55 +1106,7 @@ void GFAParser::parse(istream& in) {
                         // Tell all the listener functions
                         listener(assigned_id, sequence_range, tags);
                     }
-                    if (this->max_rgfa_rank >= 0 && tags.size() >= 3) {
-                        // We'll check for the 3 rGFA optional tags.
-                        string rgfa_path_name;
-                        int64_t rgfa_offset_on_path;
-                        int64_t rgfa_path_rank;
-                        if (decode_rgfa_tags(tags, &rgfa_path_name, &rgfa_offset_on_path, &rgfa_path_rank) &&
-                            rgfa_path_rank <= this->max_rgfa_rank) {
-                            
-                            // We need to remember this rGFA path visit
-                            auto found = rgfa_path_cache.find(rgfa_path_name);
-                            if (found == rgfa_path_cache.end()) {
-                                // This is a completely new path, so record its rank
-                                found = rgfa_path_cache.emplace_hint(found, rgfa_path_name, std::make_tuple(rgfa_path_rank, 0, visit_queue_t()));
-                            } else {
-                                // This path existed already. Make sure we aren't showing a conflicting rank
-                                if (rgfa_path_rank != get<0>(found->second)) {
-                                    throw GFAFormatError("rGFA path " + rgfa_path_name + " has conflicting ranks " + std::to_string(rgfa_path_rank) + " and " + std::to_string(get<0>(found->second)));
-                                }
-                            }
-                            auto& visit_queue = get<2>(found->second);
-                            auto& next_offset = get<1>(found->second);
-                            auto node_length = GFAParser::length(sequence_range);
-                            if (next_offset == rgfa_offset_on_path) {
-                                // It's safe to dispatch this visit right now since it's the next one expected along the path.
-                                for (auto& listener : this->rgfa_listeners) {
-                                    // Tell all the listener functions about this visit
-                                    listener(assigned_id, rgfa_offset_on_path, node_length, rgfa_path_name, rgfa_path_rank);
-                                }
-                                // Advance the offset by the sequence length;
-                                next_offset += node_length;
-                                while (!visit_queue.empty() && next_offset == get<0>(visit_queue.top())) {
-                                    // The lowest-offset queued visit can be handled now because it abuts what we just did.
-                                    // Grab the visit.
-                                    auto& visit = visit_queue.top();
-                                    for (auto& listener : this->rgfa_listeners) {
-                                        // Tell all the listener functions about this visit
-                                        listener(get<1>(visit), get<0>(visit), get<2>(visit), rgfa_path_name, rgfa_path_rank);
-                                    }
-                                    // Advance the offset by the sequence length;
-                                    next_offset += get<2>(visit);
-                                    // And pop the visit off
-                                    visit_queue.pop();
-                                }
-                            } else {
-                                // Add this visit to the heap so we can handle it when we find the missing visits.
-                                visit_queue.emplace(rgfa_offset_on_path, assigned_id, node_length);
-                            }
-                        }
-                    }
+                    handle_rgfa_tags(assigned_id, GFAParser::length(sequence_range), tags, rgfa_path_cache);
                     return true;
                 }
                 break;
@@ -1311,22 +1352,7 @@ void GFAParser::parse(istream& in) {
         
         
         // Run through any rGFA paths that don't start at 0 or have gaps. 
-        for (auto& kv : rgfa_path_cache) {
-            auto& rgfa_path_name = kv.first;
-            auto& rgfa_path_rank = get<0>(kv.second);
-            auto& visit_queue = get<2>(kv.second);
-            
-            while (!visit_queue.empty()) {
-                // Grab the visit.
-                auto& visit = visit_queue.top();
-                for (auto& listener : this->rgfa_listeners) {
-                    // Tell all the listener functions about this visit
-                    listener(get<1>(visit), get<0>(visit), get<2>(visit), rgfa_path_name, rgfa_path_rank);
-                }
-                // And pop the visit off
-                visit_queue.pop();
-            }
-        }
+        flush_rgfa_visits(rgfa_path_cache);
     } catch (GFAFormatError& e) {
         // Tell the error where it happened
         annotate_error(e);
@@ -1335,6 +1361,374 @@ void GFAParser::parse(istream& in) {
     }
 }
 
+/// A GFA line tokenized by parse_mapped(). The parse results point into the
+/// line's own string, so a record must not move once it has been parsed.
+struct GFAParsedLine {
+    /// 1-based line number in the file.
+    size_t line_number = 0;
+    string line;
+    tuple<GFAParser::tag_list_t> h_parse;
+    tuple<string, GFAParser::chars_t, GFAParser::tag_list_t> s_parse;
+    tuple<string, bool, string, bool, GFAParser::chars_t, GFAParser::tag_list_t> l_parse;
+    tuple<string, GFAParser::chars_t, GFAParser::chars_t, GFAParser::tag_list_t> p_parse;
+    tuple<string, size_t, string, pair<int64_t, int64_t>, GFAParser::chars_t, GFAParser::tag_list_t> w_parse;
+    /// Node IDs for an L line, once the nodes exist.
+    nid_t from_id = 0;
+    nid_t to_id = 0;
+    /// Name of a node referenced by the line that was never defined, if any.
+    string missing_node;
+    /// Error encountered while tokenizing the line, if any.
+    std::exception_ptr error;
+};
+
+/// Call the given function with the start and length of each line in the
+/// given range of the data, as getline() would split it.
+static void for_each_mapped_line(const char* data, size_t start, size_t end, const function<void(const char*, size_t)>& iteratee) {
+    while (start < end) {
+        const char* newline = (const char*) memchr(data + start, '\n', end - start);
+        size_t line_end = newline ? (newline - data) : end;
+        iteratee(data + start, line_end - start);
+        start = line_end + 1;
+    }
+}
+
+void GFAParser::parse_mapped(const string& filename) {
+    
+    auto start_time = std::chrono::steady_clock::now();
+    
+    // Report how fast we went when we are done.
+    auto report_throughput = [&](size_t bytes) {
+        if (show_progress) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            double megabytes = bytes / (1024.0 * 1024.0);
+            #pragma omp critical (cerr)
+            std::cerr << "[GFAParser] Parsed " << megabytes << " MB in " << seconds << " seconds ("
+                      << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s)" << std::endl;
+        }
+    };
+    
+    // Read the file as a stream instead.
+    auto parse_as_stream = [&]() {
+        ifstream in(filename);
+        parse(in);
+        in.clear();
+        in.seekg(0, std::ios_base::end);
+        report_throughput(in.good() ? (size_t) in.tellg() : 0);
+    };
+    
+    std::error_code error;
+    mio::mmap_source mapping;
+    mapping.map(filename, error);
+    if (error || mapping.size() == 0) {
+        parse_as_stream();
+        return;
+    }
+    madvise(const_cast<char*>(mapping.data()), mapping.size(), MADV_SEQUENTIAL);
+    const char* data = mapping.data();
+    size_t size = mapping.size();
+    
+    // Split the file into chunks that end at line boundaries.
+    vector<pair<size_t, size_t>> chunks;
+    for (size_t chunk_start = 0; chunk_start < size;) {
+        size_t chunk_end = std::min(size, chunk_start + mapped_chunk_size);
+        if (chunk_end < size) {
+            const char* newline = (const char*) memchr(data + chunk_end, '\n', size - chunk_end);
+            chunk_end = newline ? (newline - data) + 1 : size;
+        }
+        chunks.emplace_back(chunk_start, chunk_end);
+        chunk_start = chunk_end;
+    }
+    
+    // Count the lines in each chunk, and see where the different line types
+    // fall, so we can tell if lines would have to be handled out of order.
+    // These are all chunk-local 0-based line indexes.
+    const size_t none = numeric_limits<size_t>::max();
+    vector<size_t> chunk_lines(chunks.size(), 0);
+    vector<size_t> last_segment(chunks.size(), none);
+    vector<size_t> first_reference(chunks.size(), none);
+    vector<size_t> first_path(chunks.size(), none);
+    vector<size_t> last_header(chunks.size(), none);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < chunks.size(); i++) {
+        size_t& line_index = chunk_lines[i];
+        for_each_mapped_line(data, chunks[i].first, chunks[i].second, [&](const char* line, size_t length) {
+            if (length > 0) {
+                switch (line[0]) {
+                case 'S':
+                    last_segment[i] = line_index;
+                    break;
+                case 'P':
+                case 'W':
+                    first_path[i] = std::min(first_path[i], line_index);
+                    first_reference[i] = std::min(first_reference[i], line_index);
+                    break;
+                case 'L':
+                    first_reference[i] = std::min(first_reference[i], line_index);
+                    break;
+                case 'H':
+                    last_header[i] = line_index;
+                    break;
+                }
+            }
+            line_index++;
+        });
+    }
+    
+    // Make everything 0-based in the whole file.
+    vector<size_t> chunk_first_line(chunks.size(), 0);
+    size_t file_last_segment = none, file_first_reference = none, file_first_path = none, file_last_header = none;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (i > 0) {
+            chunk_first_line[i] = chunk_first_line[i - 1] + chunk_lines[i - 1];
+        }
+        if (last_segment[i] != none) {
+            file_last_segment = chunk_first_line[i] + last_segment[i];
+        }
+        if (first_reference[i] != none && file_first_reference == none) {
+            file_first_reference = chunk_first_line[i] + first_reference[i];
+        }
+        if (first_path[i] != none && file_first_path == none) {
+            file_first_path = chunk_first_line[i] + first_path[i];
+        }
+        if (last_header[i] != none) {
+            file_last_header = chunk_first_line[i] + last_header[i];
+        }
+    }
+    
+    if ((file_last_segment != none && file_first_reference != none && file_first_reference < file_last_segment) ||
+        (file_last_header != none && file_first_path != none && file_first_path < file_last_header)) {
+        // The stream parser would defer some lines to a second pass, and we
+        // want to handle them in the same order it would.
+        mapping.unmap();
+        parse_as_stream();
+        return;
+    }
+    
+    // Add file position information to an error about the given line.
+    auto annotate_error = [&](GFAFormatError& e, const GFAParsedLine& record) {
+        e.pass_number = 1;
+        e.line_number = record.line_number;
+    };
+    
+    // Rethrow an error from tokenizing, with position information.
+    auto rethrow_error = [&](const GFAParsedLine& record) {
+        try {
+            std::rethrow_exception(record.error);
+        } catch (GFAFormatError& e) {
+            annotate_error(e, record);
+            throw;
+        }
+    };
+    
+    // We want to warn about unrecognized line types, but each only once.
+    set<char> warned_line_types;
+    
+    // And we need to buffer all the rGFA visits until we have seen all the nodes.
+    rgfa_path_cache_t rgfa_path_cache;
+    
+    // Work through the file a batch of chunks at a time, so we only hold a
+    // bounded number of tokenized lines in memory.
+    size_t chunks_per_batch = get_thread_count();
+    vector<std::deque<GFAParsedLine>> records;
+    for (size_t batch_start = 0; batch_start < chunks.size(); batch_start += chunks_per_batch) {
+        size_t batch_end = std::min(chunks.size(), batch_start + chunks_per_batch);
+        records.clear();
+        records.resize(batch_end - batch_start);
+        
+        // Tokenize all the lines in parallel.
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            auto& chunk_records = records[i - batch_start];
+            size_t line_number = chunk_first_line[i] + 1;
+            for_each_mapped_line(data, chunks[i].first, chunks[i].second, [&](const char* line, size_t length) {
+                if (length > 0) {
+                    chunk_records.emplace_back();
+                    auto& record = chunk_records.back();
+                    record.line_number = line_number;
+                    record.line.assign(line, length);
+                    try {
+                        switch (line[0]) {
+                        case 'H':
+                            record.h_parse = GFAParser::parse_h(record.line);
+                            break;
+                        case 'S':
+                            record.s_parse = GFAParser::parse_s(record.line);
+                            break;
+                        case 'L':
+                            record.l_parse = GFAParser::parse_l(record.line);
+                            break;
+                        case 'P':
+                            record.p_parse = GFAParser::parse_p(record.line);
+                            for (auto it = get<2>(record.p_parse).first; it != get<2>(record.p_parse).second; ++it) {
+                                if (*it != '*' && *it != ',' && *it != 'M' && (*it < '0' || *it > '9')) {
+                                    // This overlap isn't just * or a list of * or a list of matches with numbers.
+                                    // We can't handle it
+                                    throw GFAFormatError("Path " + get<0>(record.p_parse) + " has nontrivial overlaps and can't be handled", it);
+                                }
+                            }
+                            break;
+                        case 'W':
+                            record.w_parse = GFAParser::parse_w(record.line);
+                            break;
+                        }
+                    } catch (GFAFormatError& e) {
+                        if (e.has_position) {
+                            // We can find the column while we still have the line.
+                            e.column_number = 1 + (e.position - record.line.cbegin());
+                        }
+                        record.error = std::current_exception();
+                    }
+                }
+                line_number++;
+            });
+        }
+        
+        // Handle headers and create nodes in order.
+        for (auto& chunk_records : records) {
+            for (auto& record : chunk_records) {
+                char line_type = record.line[0];
+                if (line_type != 'H' && line_type != 'S' && line_type != 'L' && line_type != 'P' && line_type != 'W') {
+                    if (!warned_line_types.count(line_type)) {
+                        // Warn once about this weird line type.
+                        warned_line_types.insert(line_type);
+                        cerr << "warning:[GFAParser] Ignoring unrecognized " << line_type << " line type" << endl;
+                    }
+                    continue;
+                }
+                if (line_type != 'H' && line_type != 'S') {
+                    // Links and paths come after all the nodes.
+                    continue;
+                }
+                if (record.error) {
+                    rethrow_error(record);
+                }
+                try {
+                    if (line_type == 'H') {
+                        for (auto& listener : this->header_listeners) {
+                            // Tell all the listener functions
+                            listener(get<0>(record.h_parse));
+                        }
+                    } else {
+                        auto& node_name = get<0>(record.s_parse);
+                        auto& sequence_range = get<1>(record.s_parse);
+                        auto& tags = get<2>(record.s_parse);
+                        nid_t assigned_id = GFAParser::assign_new_sequence_id(node_name, this->id_map());
+                        if (assigned_id == 0) {
+                            // This name has been used already!
+                            throw GFAFormatError("Duplicate sequence name: " + node_name);
+                        }
+                        for (auto& listener : this->node_listeners) {
+                            // Tell all the listener functions
+                            listener(assigned_id, sequence_range, tags);
+                        }
+                        handle_rgfa_tags(assigned_id, GFAParser::length(sequence_range), tags, rgfa_path_cache);
+                    }
+                } catch (GFAFormatError& e) {
+                    annotate_error(e, record);
+                    throw;
+                }
+            }
+        }
+        
+        // Look up the nodes for the links and paths in parallel. Nothing is
+        // adding to the ID map now.
+        GFAIDMapInfo& id_map_info = this->id_map();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < records.size(); i++) {
+            for (auto& record : records[i]) {
+                if (record.error) {
+                    continue;
+                }
+                switch (record.line[0]) {
+                case 'L':
+                    record.from_id = GFAParser::find_existing_sequence_id(get<0>(record.l_parse), id_map_info);
+                    if (!record.from_id) {
+                        record.missing_node = get<0>(record.l_parse);
+                        break;
+                    }
+                    record.to_id = GFAParser::find_existing_sequence_id(get<2>(record.l_parse), id_map_info);
+                    if (!record.to_id) {
+                        record.missing_node = get<2>(record.l_parse);
+                    }
+                    break;
+                case 'P':
+                case 'W':
+                    GFAParser::scan_visits(record.line[0] == 'P' ? get<1>(record.p_parse) : get<4>(record.w_parse), record.line[0],
+                                           [&](int64_t step_rank, const GFAParser::chars_t& step_id, bool step_is_reverse) {
+                        if (step_rank == -1) {
+                            // Nothing to do for empty paths
+                            return true;
+                        }
+                        string step_string = GFAParser::extract(step_id);
+                        if (!GFAParser::find_existing_sequence_id(step_string, id_map_info)) {
+                            record.missing_node = std::move(step_string);
+                            return false;
+                        }
+                        return true;
+                    });
+                    break;
+                }
+            }
+        }
+        
+        // Now create the edges and paths in order.
+        for (auto& chunk_records : records) {
+            for (auto& record : chunk_records) {
+                char line_type = record.line[0];
+                if (line_type != 'L' && line_type != 'P' && line_type != 'W') {
+                    continue;
+                }
+                if (record.error) {
+                    rethrow_error(record);
+                }
+                try {
+                    if (!record.missing_node.empty()) {
+                        throw GFAFormatError("GFA file references missing node " + record.missing_node);
+                    }
+                    if (line_type == 'L') {
+                        for (auto& listener : this->edge_listeners) {
+                            // Tell all the listener functions
+                            listener(record.from_id, get<1>(record.l_parse), record.to_id, get<3>(record.l_parse),
+                                     get<4>(record.l_parse), get<5>(record.l_parse));
+                        }
+                    } else if (line_type == 'P') {
+                        for (auto& listener : this->path_listeners) {
+                            // Tell all the listener functions
+                            listener(get<0>(record.p_parse), get<1>(record.p_parse), get<2>(record.p_parse), get<3>(record.p_parse));
+                        }
+                    } else {
+                        for (auto& listener : this->walk_listeners) {
+                            // Tell all the listener functions
+                            listener(get<0>(record.w_parse), get<1>(record.w_parse), get<2>(record.w_parse),
+                                     get<3>(record.w_parse), get<4>(record.w_parse), get<5>(record.w_parse));
+                        }
+                    }
+                } catch (GFADuplicatePathError& e) {
+                    // We couldn't do what this line said because we already have this path.
+                    annotate_error(e, record);
+                    if (stop_on_duplicate_paths) {
+                        // That's bad. Stop parsing.
+                        throw;
+                    } else {
+                        // We can tolerate this. Just move on to the next line.
+                        #pragma omp critical (cerr)
+                        std::cerr << "warning:[GFAParser] Skipping GFA " << line_type
+                            << " line: " << e.what() << std::endl;
+                    }
+                } catch (GFAFormatError& e) {
+                    annotate_error(e, record);
+                    throw;
+                }
+            }
+        }
+    }
+    
+    // Run through any rGFA paths that don't start at 0 or have gaps. 
+    flush_rgfa_visits(rgfa_path_cache);
+    
+    report_throughput(size);
+}
+
 GFAIDMapInfo& GFAParser::id_map() {
     if (external_id_map) {
         return *external_id_map;
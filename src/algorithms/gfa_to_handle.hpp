@@ -9,6 +9,7 @@
 
 #include <iostream>
 #include <cctype>
+#include <queue>
 #include <vector>
 
 #include "../handle.hpp"
@@ -55,6 +56,8 @@ struct GFAIDMapInfo : public NamedNodeBackTranslation {
 };
 
 /// Read a GFA file for a blunt-ended graph into a HandleGraph. Give "-" as a filename for stdin.
+/// Files are memory-mapped and tokenized in parallel; see GFAParser::parse_mapped().
+/// If show_progress is set, reports parsing throughput on standard error.
 ///
 /// Throws GFAFormatError if the GFA file is not acceptable, and
 /// std::ios_base::failure if an IO operation fails. Throws invalid_argument if
@@ -62,12 +65,14 @@ struct GFAIDMapInfo : public NamedNodeBackTranslation {
 /// Does not give max ID hints, and so might be very slow when loading into an ODGI graph.
 void gfa_to_handle_graph(const string& filename,
                          MutableHandleGraph* graph,
-                         GFAIDMapInfo* translation = nullptr);
+                         GFAIDMapInfo* translation = nullptr,
+                         bool show_progress = false);
 
 /// Overload which serializes its translation to a file internally.
 void gfa_to_handle_graph(const string& filename,
                          MutableHandleGraph* graph,
-                         const string& translation_filename);
+                         const string& translation_filename,
+                         bool show_progress = false);
 
 /// Load a GFA from a stream (assumed not to be seekable or reopenable) into a HandleGraph.
 void gfa_to_handle_graph(istream& in,
@@ -78,13 +83,15 @@ void gfa_to_handle_graph(istream& in,
 void gfa_to_path_handle_graph(const string& filename,
                               MutablePathMutableHandleGraph* graph,
                               GFAIDMapInfo* translation = nullptr,
-                              int64_t max_rgfa_rank = numeric_limits<int64_t>::max());
+                              int64_t max_rgfa_rank = numeric_limits<int64_t>::max(),
+                              bool show_progress = false);
 
 /// Overload which serializes its translation to a file internally.
 void gfa_to_path_handle_graph(const string& filename,
                               MutablePathMutableHandleGraph* graph,
                               int64_t max_rgfa_rank,
-                              const string& translation_filename);
+                              const string& translation_filename,
+                              bool show_progress = false);
                               
 /// Load a GFA from a stream (assumed not to be seekable or reopenable) into a PathHandleGraph.
 void gfa_to_path_handle_graph(istream& in,
@@ -275,11 +282,56 @@ public:
     /// files, like the first HPRC graph releases, include duplicate paths.
     bool stop_on_duplicate_paths = false;
     
+    /// Set to true to report parsing throughput on standard error.
+    bool show_progress = false;
+    
+    /// Target size in bytes for the line-aligned chunks that parse_mapped()
+    /// tokenizes in parallel. Chunks are extended to end at a line boundary.
+    size_t mapped_chunk_size = 16 * 1024 * 1024;
+    
     /**
      * Parse GFA from the given stream.
      */
     void parse(istream& in);
     
+    /**
+     * Parse GFA from the given file. The file is memory-mapped and split into
+     * line-aligned chunks, and the lines in each chunk are tokenized in
+     * parallel using OpenMP threads. Listeners are then called on the calling
+     * thread, with headers and segments before the links and paths that use
+     * them, and otherwise in file order, so the results are the same as with
+     * parse(istream&).
+     *
+     * Files that reference nodes before defining them, or that have header
+     * lines after path lines, are read with parse(istream&) instead, since
+     * that is what determines the order in which such lines are handled. So
+     * are files that cannot be mapped.
+     */
+    void parse_mapped(const string& filename);
+    
+private:
+    
+    /// An rGFA visit at a path offset to a node, with the node's length so we
+    /// can know when it abuts later visits.
+    using rgfa_visit_t = tuple<int64_t, nid_t, size_t>;
+    /// A min-heap of rGFA visits, in offset order.
+    using rgfa_visit_queue_t = std::priority_queue<rgfa_visit_t, vector<rgfa_visit_t>, std::greater<rgfa_visit_t>>;
+    /// rGFA paths we have heard of, mapping from name to rank, start position
+    /// of next visit that is safe to announce, and buffered visits.
+    using rgfa_path_cache_t = unordered_map<string, tuple<int64_t, size_t, rgfa_visit_queue_t>>;
+    
+    /**
+     * Check the tags of a newly-created node for rGFA path information, and
+     * announce the visit to the rgfa_listeners if it is the next one along
+     * its path, or buffer it in the cache otherwise.
+     */
+    void handle_rgfa_tags(nid_t id, size_t length, const tag_list_t& tags, rgfa_path_cache_t& rgfa_path_cache);
+    
+    /**
+     * Announce all rGFA visits still buffered in the cache, for paths that
+     * don't start at 0 or have gaps.
+     */
+    void flush_rgfa_visits(rgfa_path_cache_t& rgfa_path_cache);
 };
 
 /// This exception will be thrown if the GFA data is not acceptable.
@@ -115,8 +115,11 @@ pair_hash_set<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, si
         }
     }, true);
     
-    // Flush the buffers and return the result.
+    // Merge the buffers into the largest one and return it.
     for (pair_hash_set<edge_t>& buffer : buffers) {
+        if (buffer.size() > result.size()) {
+            std::swap(buffer, result);
+        }
         flush_buffer(buffer);
     }
     return result;
@@ -159,12 +162,31 @@ size_t prune_complex_with_head_tail(DeletableHandleGraph& graph,
 
 size_t prune_short_subgraphs(DeletableHandleGraph& graph, int min_size) {
     
-    unordered_set<handle_t> to_destroy;
+    // Find the nodes that have a tip on either side. We only need the forward handle,
+    // since the traversal ignores orientation.
+    std::vector<std::vector<handle_t>> thread_tips(get_thread_count());
+    graph.for_each_handle([&](const handle_t& handle) {
+        if (graph.get_degree(handle, true) == 0 || graph.get_degree(handle, false) == 0) {
+            thread_tips[omp_get_thread_num()].push_back(handle);
+        }
+    }, true);
+    std::vector<handle_t> tips;
+    for (auto& tips_from_thread : thread_tips) {
+        tips.insert(tips.end(), tips_from_thread.begin(), tips_from_thread.end());
+        std::vector<handle_t>().swap(tips_from_thread);
+    }
+    
+    // Whether a component is small does not depend on which tip we start from, so each
+    // thread can search from its tips independently and only skip the components that
+    // it has already marked itself.
+    std::vector<unordered_set<handle_t>> thread_to_destroy(get_thread_count());
     
     // DFS from all tips
-    for (auto tip : handlealgs::find_tips(&graph)) {
-        //cerr << "begin trav from " << graph.get_id(tip) << " " << graph.get_is_reverse(tip) << endl;
-        auto start = graph.forward(tip);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < tips.size(); ++i) {
+        auto& to_destroy = thread_to_destroy[omp_get_thread_num()];
+        auto start = tips[i];
+        //cerr << "begin trav from " << graph.get_id(start) << endl;
         if (to_destroy.count(start)) {
             // we already found this subgraph from another tip
             //cerr << "skipping" << endl;
@@ -199,6 +221,16 @@ size_t prune_short_subgraphs(DeletableHandleGraph& graph, int min_size) {
         }
     }
     
+    // combine the marks from each thread, since several threads may have found the same component
+    unordered_set<handle_t> to_destroy;
+    for (auto& thread_marks : thread_to_destroy) {
+        if (thread_marks.size() > to_destroy.size()) {
+            std::swap(thread_marks, to_destroy);
+        }
+        to_destroy.insert(thread_marks.begin(), thread_marks.end());
+        unordered_set<handle_t>().swap(thread_marks);
+    }
+    
     // destroy all handles that we marked
     for (auto handle : to_destroy) {
         graph.destroy_handle(handle);
@@ -209,7 +241,7 @@ size_t prune_short_subgraphs(DeletableHandleGraph& graph, int min_size) {
 
 
 size_t remove_high_degree_nodes(DeletableHandleGraph& g, int max_degree) {
-    vector<handle_t> to_remove;
+    std::vector<vector<handle_t>> thread_to_remove(get_thread_count());
     g.for_each_handle([&](const handle_t& h) {
         int edge_count = 0;
         g.follow_edges(h, false, [&](const handle_t& ignored) {
@@ -219,14 +251,18 @@ size_t remove_high_degree_nodes(DeletableHandleGraph& g, int max_degree) {
             ++edge_count;
         });
         if (edge_count > max_degree) {
-            to_remove.push_back(h);
+            thread_to_remove[omp_get_thread_num()].push_back(h);
         }
-    });
+    }, true);
     // now destroy the high degree nodes
-    for (auto& h : to_remove) {
-        g.destroy_handle(h);
+    size_t removed = 0;
+    for (auto& to_remove : thread_to_remove) {
+        for (auto& h : to_remove) {
+            g.destroy_handle(h);
+        }
+        removed += to_remove.size();
     }
-    return to_remove.size();
+    return removed;
 }
 
 }
@@ -200,7 +200,7 @@ bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignmen
     if (!is_fasta) {
         if (0!=gzgets(fp,buffer,len)) {
         } else {
-            cerr << "[vg::alignment.cpp] error: incomplete fastq record " << name << endl; exit(1);
+            throw runtime_error("[vg::alignment.cpp] incomplete fastq record " + name);
         }
         // handle quality
         if (0!=gzgets(fp,buffer,len)) {
@@ -209,7 +209,7 @@ bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignmen
             //cerr << string_quality_short_to_char(quality) << endl;
             alignment.set_quality(quality);
         } else {
-            cerr << "[vg::alignment.cpp] error: fastq record missing base quality " << name << endl; exit(1);
+            throw runtime_error("[vg::alignment.cpp] fastq record missing base quality " + name);
         }
     }
 
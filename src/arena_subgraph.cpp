@@ -0,0 +1,366 @@
+/**
+ * \file arena_subgraph.cpp: contains the implementation of ArenaSubgraph
+ */
+
+#include "arena_subgraph.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+
+namespace vg {
+
+using namespace std;
+
+const uint32_t ArenaSubgraph::NONE = numeric_limits<uint32_t>::max();
+
+// how many released graphs each thread keeps around for reuse
+static const size_t max_pooled_graphs = 64;
+// graphs whose storage has grown beyond this many bases aren't kept, so that one
+// unusually large subgraph doesn't stay resident for the rest of the run
+static const size_t max_pooled_sequence = 1 << 20;
+
+static thread_local vector<unique_ptr<ArenaSubgraph>> released_graphs;
+
+void ArenaSubgraph::Recycler::operator()(ArenaSubgraph* graph) const {
+    unique_ptr<ArenaSubgraph> releasing(graph);
+    if (released_graphs.size() < max_pooled_graphs && graph->sequences.capacity() <= max_pooled_sequence) {
+        graph->clear();
+        released_graphs.emplace_back(move(releasing));
+    }
+}
+
+unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler> ArenaSubgraph::make() {
+    if (released_graphs.empty()) {
+        return unique_ptr<ArenaSubgraph, Recycler>(new ArenaSubgraph());
+    }
+    unique_ptr<ArenaSubgraph, Recycler> graph(released_graphs.back().release());
+    released_graphs.pop_back();
+    return graph;
+}
+
+void ArenaSubgraph::clear() {
+    nodes.clear();
+    edges.clear();
+    sequences.clear();
+    fill(id_table.begin(), id_table.end(), make_pair(id_t(0), NONE));
+    edge_count = 0;
+    min_id = numeric_limits<id_t>::max();
+    max_id = 0;
+}
+
+uint32_t ArenaSubgraph::find_node(id_t node_id) const {
+    if (id_table.empty()) {
+        return NONE;
+    }
+    size_t mask = id_table.size() - 1;
+    for (size_t i = (uint64_t(node_id) * 0x9E3779B97F4A7C15ull) & mask; ; i = (i + 1) & mask) {
+        if (id_table[i].second == NONE || id_table[i].first == node_id) {
+            return id_table[i].second;
+        }
+    }
+}
+
+void ArenaSubgraph::index_node(id_t node_id, uint32_t node_idx) {
+    if (2 * (nodes.size() + 1) > id_table.size()) {
+        // keep the load at most 1/2
+        id_table.resize(max<size_t>(16, 2 * id_table.size()));
+        reindex_nodes();
+    }
+    size_t mask = id_table.size() - 1;
+    size_t i = (uint64_t(node_id) * 0x9E3779B97F4A7C15ull) & mask;
+    while (id_table[i].second != NONE) {
+        i = (i + 1) & mask;
+    }
+    id_table[i] = make_pair(node_id, node_idx);
+}
+
+void ArenaSubgraph::reindex_nodes() {
+    fill(id_table.begin(), id_table.end(), make_pair(id_t(0), NONE));
+    size_t mask = id_table.size() - 1;
+    min_id = numeric_limits<id_t>::max();
+    max_id = 0;
+    for (uint32_t j = 0; j < nodes.size(); ++j) {
+        size_t i = (uint64_t(nodes[j].id) * 0x9E3779B97F4A7C15ull) & mask;
+        while (id_table[i].second != NONE) {
+            i = (i + 1) & mask;
+        }
+        id_table[i] = make_pair(nodes[j].id, j);
+        min_id = min(min_id, nodes[j].id);
+        max_id = max(max_id, nodes[j].id);
+    }
+}
+
+bool ArenaSubgraph::has_node(id_t node_id) const {
+    return find_node(node_id) != NONE;
+}
+
+handle_t ArenaSubgraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    return handlegraph::number_bool_packing::pack(find_node(node_id), is_reverse);
+}
+
+id_t ArenaSubgraph::get_id(const handle_t& handle) const {
+    return nodes[handlegraph::number_bool_packing::unpack_number(handle)].id;
+}
+
+bool ArenaSubgraph::get_is_reverse(const handle_t& handle) const {
+    return handlegraph::number_bool_packing::unpack_bit(handle);
+}
+
+handle_t ArenaSubgraph::flip(const handle_t& handle) const {
+    return handlegraph::number_bool_packing::toggle_bit(handle);
+}
+
+size_t ArenaSubgraph::get_length(const handle_t& handle) const {
+    return nodes[handlegraph::number_bool_packing::unpack_number(handle)].length;
+}
+
+string ArenaSubgraph::get_sequence(const handle_t& handle) const {
+    const auto& node = nodes[handlegraph::number_bool_packing::unpack_number(handle)];
+    string sequence = sequences.substr(node.seq_start, node.length);
+    if (get_is_reverse(handle)) {
+        reverse_complement_in_place(sequence);
+    }
+    return sequence;
+}
+
+char ArenaSubgraph::get_base(const handle_t& handle, size_t index) const {
+    const auto& node = nodes[handlegraph::number_bool_packing::unpack_number(handle)];
+    if (get_is_reverse(handle)) {
+        return reverse_complement(sequences[node.seq_start + node.length - index - 1]);
+    }
+    else {
+        return sequences[node.seq_start + index];
+    }
+}
+
+string ArenaSubgraph::get_subsequence(const handle_t& handle, size_t index, size_t size) const {
+    const auto& node = nodes[handlegraph::number_bool_packing::unpack_number(handle)];
+    size = min(size, node.length - min(index, node.length));
+    if (get_is_reverse(handle)) {
+        string subsequence = sequences.substr(node.seq_start + node.length - index - size, size);
+        reverse_complement_in_place(subsequence);
+        return subsequence;
+    }
+    else {
+        return sequences.substr(node.seq_start + index, size);
+    }
+}
+
+bool ArenaSubgraph::follow_edges_impl(const handle_t& handle, bool go_left,
+                                      const function<bool(const handle_t&)>& iteratee) const {
+    bool is_reverse = get_is_reverse(handle);
+    const auto& node = nodes[handlegraph::number_bool_packing::unpack_number(handle)];
+    for (uint32_t e = node.edges[go_left == is_reverse]; e != NONE; e = edges[e].next) {
+        if (!iteratee(is_reverse ? flip(edges[e].neighbor) : edges[e].neighbor)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArenaSubgraph::for_each_handle_impl(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (!iteratee(handlegraph::number_bool_packing::pack(i, false))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t ArenaSubgraph::get_node_count() const {
+    return nodes.size();
+}
+
+id_t ArenaSubgraph::min_node_id() const {
+    return min_id;
+}
+
+id_t ArenaSubgraph::max_node_id() const {
+    return max_id;
+}
+
+size_t ArenaSubgraph::get_edge_count() const {
+    return edge_count;
+}
+
+handle_t ArenaSubgraph::create_handle(const string& sequence) {
+    return create_handle(sequence, nodes.empty() ? 1 : max_id + 1);
+}
+
+handle_t ArenaSubgraph::create_handle(const string& sequence, const id_t& id) {
+    uint32_t node_idx = nodes.size();
+    index_node(id, node_idx);
+    nodes.emplace_back();
+    auto& node = nodes.back();
+    node.id = id;
+    node.seq_start = sequences.size();
+    node.length = sequence.size();
+    node.edges[0] = node.edges[1] = NONE;
+    sequences.append(sequence);
+    min_id = min(min_id, id);
+    max_id = max(max_id, id);
+    return handlegraph::number_bool_packing::pack(node_idx, false);
+}
+
+void ArenaSubgraph::add_to_side(uint32_t node_idx, bool right_side, const handle_t& neighbor) {
+    edges.emplace_back();
+    edges.back().neighbor = neighbor;
+    edges.back().next = nodes[node_idx].edges[right_side];
+    nodes[node_idx].edges[right_side] = edges.size() - 1;
+}
+
+void ArenaSubgraph::create_edge(const handle_t& left, const handle_t& right) {
+    if (has_edge(left, right)) {
+        return;
+    }
+    // record the edge from both sides, in terms of the nodes' forward orientations
+    bool left_rev = get_is_reverse(left);
+    add_to_side(handlegraph::number_bool_packing::unpack_number(left), !left_rev, left_rev ? flip(right) : right);
+    if (left != flip(right)) {
+        // this isn't a reversing self-loop that only touches one side
+        bool right_rev = get_is_reverse(right);
+        add_to_side(handlegraph::number_bool_packing::unpack_number(right), right_rev, right_rev ? flip(left) : left);
+    }
+    ++edge_count;
+}
+
+vector<edge_t> ArenaSubgraph::take_edges() {
+    vector<edge_t> all_edges;
+    all_edges.reserve(edge_count);
+    for_each_edge([&](const edge_t& edge) {
+        all_edges.push_back(edge);
+    });
+    edges.clear();
+    for (auto& node : nodes) {
+        node.edges[0] = node.edges[1] = NONE;
+    }
+    edge_count = 0;
+    return all_edges;
+}
+
+handle_t ArenaSubgraph::apply_orientation(const handle_t& handle) {
+    if (!get_is_reverse(handle)) {
+        return handle;
+    }
+    // these operations are rare, so we just rebuild the edges
+    auto all_edges = take_edges();
+    auto& node = nodes[handlegraph::number_bool_packing::unpack_number(handle)];
+    reverse(sequences.begin() + node.seq_start, sequences.begin() + node.seq_start + node.length);
+    for (size_t i = node.seq_start, end = node.seq_start + node.length; i < end; ++i) {
+        sequences[i] = reverse_complement(sequences[i]);
+    }
+    handle_t forward = flip(handle);
+    for (const auto& edge : all_edges) {
+        // the old reverse orientation is the new forward orientation and vice versa
+        create_edge(as_integer(edge.first) >> 1 == as_integer(forward) >> 1 ? flip(edge.first) : edge.first,
+                    as_integer(edge.second) >> 1 == as_integer(forward) >> 1 ? flip(edge.second) : edge.second);
+    }
+    return forward;
+}
+
+vector<handle_t> ArenaSubgraph::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+
+    uint32_t node_idx = handlegraph::number_bool_packing::unpack_number(handle);
+    bool is_reverse = get_is_reverse(handle);
+    size_t length = nodes[node_idx].length;
+
+    // convert the offsets to the forward strand
+    vector<size_t> forward_offsets;
+    for (size_t offset : offsets) {
+        forward_offsets.push_back(is_reverse ? length - offset : offset);
+    }
+    sort(forward_offsets.begin(), forward_offsets.end());
+
+    auto all_edges = take_edges();
+
+    // the new parts share the sequence arena with the original node
+    vector<handle_t> parts(1, handlegraph::number_bool_packing::pack(node_idx, false));
+    size_t seq_start = nodes[node_idx].seq_start;
+    nodes[node_idx].length = forward_offsets.front();
+    for (size_t i = 0; i < forward_offsets.size(); ++i) {
+        size_t part_end = i + 1 < forward_offsets.size() ? forward_offsets[i + 1] : length;
+        uint32_t part_idx = nodes.size();
+        id_t part_id = max_id + 1;
+        index_node(part_id, part_idx);
+        nodes.emplace_back();
+        nodes.back().id = part_id;
+        nodes.back().seq_start = seq_start + forward_offsets[i];
+        nodes.back().length = part_end - forward_offsets[i];
+        nodes.back().edges[0] = nodes.back().edges[1] = NONE;
+        max_id = part_id;
+        parts.push_back(handlegraph::number_bool_packing::pack(part_idx, false));
+    }
+
+    // edges on the right side of the original node move to the last part
+    handle_t last = parts.back();
+    for (const auto& edge : all_edges) {
+        handle_t left = edge.first;
+        handle_t right = edge.second;
+        if (left == parts.front()) {
+            left = last;
+        }
+        if (right == flip(parts.front())) {
+            right = flip(last);
+        }
+        create_edge(left, right);
+    }
+    for (size_t i = 1; i < parts.size(); ++i) {
+        create_edge(parts[i - 1], parts[i]);
+    }
+
+    if (is_reverse) {
+        reverse(parts.begin(), parts.end());
+        for (auto& part : parts) {
+            part = flip(part);
+        }
+    }
+    return parts;
+}
+
+void ArenaSubgraph::optimize(bool allow_id_reassignment) {
+    // nothing to do
+}
+
+bool ArenaSubgraph::apply_ordering(const vector<handle_t>& order, bool compact_ids) {
+    auto all_edges = take_edges();
+    vector<uint32_t> new_index(nodes.size());
+    vector<NodeRecord> ordered_nodes;
+    ordered_nodes.reserve(nodes.size());
+    for (const auto& handle : order) {
+        uint32_t node_idx = handlegraph::number_bool_packing::unpack_number(handle);
+        new_index[node_idx] = ordered_nodes.size();
+        ordered_nodes.push_back(nodes[node_idx]);
+        if (compact_ids) {
+            ordered_nodes.back().id = ordered_nodes.size();
+        }
+    }
+    nodes = move(ordered_nodes);
+    reindex_nodes();
+    for (const auto& edge : all_edges) {
+        create_edge(handlegraph::number_bool_packing::pack(new_index[handlegraph::number_bool_packing::unpack_number(edge.first)],
+                                                           get_is_reverse(edge.first)),
+                    handlegraph::number_bool_packing::pack(new_index[handlegraph::number_bool_packing::unpack_number(edge.second)],
+                                                           get_is_reverse(edge.second)));
+    }
+    return compact_ids;
+}
+
+void ArenaSubgraph::set_id_increment(const id_t& min_id) {
+    // nothing to do
+}
+
+void ArenaSubgraph::increment_node_ids(id_t increment) {
+    reassign_node_ids([&](const id_t& node_id) {
+        return node_id + increment;
+    });
+}
+
+void ArenaSubgraph::reassign_node_ids(const function<id_t(const id_t&)>& get_new_id) {
+    // handles don't depend on the IDs, so only the table changes
+    for (auto& node : nodes) {
+        node.id = get_new_id(node.id);
+    }
+    reindex_nodes();
+}
+
+}
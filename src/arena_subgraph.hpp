@@ -0,0 +1,199 @@
+/** \file
+ * arena_subgraph.hpp: defines a lightweight mutable graph for small subgraphs that
+ * are extracted and discarded at a high rate
+ */
+#ifndef VG_ARENA_SUBGRAPH_HPP_INCLUDED
+#define VG_ARENA_SUBGRAPH_HPP_INCLUDED
+
+#include "handle.hpp"
+
+#include <memory>
+#include <limits>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A mutable graph that keeps all of its nodes, sequences and edges in a few flat
+ * arrays, so that building one costs a handful of allocations instead of a couple
+ * per node and edge. Graphs that are released through the Recycler keep their
+ * arrays in a pool on the releasing thread, and make() hands them out again, so a
+ * thread that repeatedly extracts subgraphs stops allocating once it's warmed up.
+ *
+ * Handles are the nodes' indexes in insertion order, which is also the iteration
+ * order. Edges are kept in per-side singly linked lists threaded through one array.
+ */
+class ArenaSubgraph : public MutableHandleGraph {
+public:
+
+    /// Deleter that gives the graph back to the current thread's pool
+    struct Recycler {
+        void operator()(ArenaSubgraph* graph) const;
+    };
+
+    /// Get an empty graph, reusing one from the current thread's pool if possible
+    static unique_ptr<ArenaSubgraph, Recycler> make();
+
+    ArenaSubgraph() = default;
+    ~ArenaSubgraph() = default;
+
+    /// Remove all nodes and edges, but keep the storage
+    void clear();
+
+    //////////////////////////
+    /// HandleGraph interface
+    //////////////////////////
+
+    /// Method to check if a node exists by ID
+    bool has_node(id_t node_id) const;
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    /// Get the ID from a handle
+    id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    string get_sequence(const handle_t& handle) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    bool follow_edges_impl(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in the order they were created. Stop if the iteratee
+    /// returns false. Parallel iteration is not supported, so the nodes are
+    /// always visited in order.
+    bool for_each_handle_impl(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    /// Return the number of nodes in the graph
+    size_t get_node_count() const;
+
+    /// Return the smallest ID in the graph. Return value is unspecified if the graph is empty.
+    id_t min_node_id() const;
+
+    /// Return the largest ID in the graph. Return value is unspecified if the graph is empty.
+    id_t max_node_id() const;
+
+    ///////////////////////////////////
+    /// Optional HandleGraph interface
+    ///////////////////////////////////
+
+    /// Return the total number of edges in the graph.
+    size_t get_edge_count() const;
+
+    /// Returns one base of a handle's sequence, in the orientation of the
+    /// handle.
+    char get_base(const handle_t& handle, size_t index) const;
+
+    /// Returns a substring of a handle's sequence, in the orientation of the
+    /// handle. If the indicated substring would extend beyond the end of the
+    /// handle's sequence, the return value is truncated to the sequence's end.
+    string get_subsequence(const handle_t& handle, size_t index, size_t size) const;
+
+    //////////////////////////////////
+    /// MutableHandleGraph interface
+    //////////////////////////////////
+
+    /// Create a new node with the given sequence and return the handle.
+    handle_t create_handle(const string& sequence);
+
+    /// Create a new node with the given id and sequence, then return the handle.
+    handle_t create_handle(const string& sequence, const id_t& id);
+
+    /// Create an edge connecting the given handles in the given order and orientations.
+    /// Ignores existing edges.
+    void create_edge(const handle_t& left, const handle_t& right);
+
+    /// Alter the node that the given handle corresponds to so the orientation
+    /// indicated by the handle becomes the node's local forward orientation.
+    /// Updates all links to the node. Invalidates all handles to the node.
+    /// Returns a handle to the node in its new forward orientation.
+    handle_t apply_orientation(const handle_t& handle);
+
+    /// Split a handle's underlying node at the given offsets in the handle's
+    /// orientation. Returns the handles to the new parts, in the handle's
+    /// orientation. The original node keeps its ID for the part at the start
+    /// of its forward orientation.
+    vector<handle_t> divide_handle(const handle_t& handle, const vector<size_t>& offsets);
+
+    /// Nothing to do, the storage is already compact
+    void optimize(bool allow_id_reassignment = true);
+
+    /// Reorder the graph's internal structure to match the given ordering, and
+    /// optionally reassign IDs to 1, 2, ... in that order. Returns true if the
+    /// IDs were changed.
+    bool apply_ordering(const vector<handle_t>& order, bool compact_ids = false);
+
+    /// No-op, new IDs are always one past the current maximum
+    void set_id_increment(const id_t& min_id);
+
+    /// Add the given value to all node IDs
+    void increment_node_ids(id_t increment);
+
+    /// Reassign all node IDs as specified by the function
+    void reassign_node_ids(const function<id_t(const id_t&)>& get_new_id);
+
+private:
+
+    /// sentinel for the end of an edge list and for an empty slot in the ID table
+    static const uint32_t NONE;
+
+    struct NodeRecord {
+        id_t id;
+        /// where the sequence starts in the sequence arena, in the forward orientation
+        size_t seq_start;
+        size_t length;
+        /// first entry of the edge lists for the left and the right side of the node
+        uint32_t edges[2];
+    };
+
+    struct EdgeRecord {
+        /// the handle on the other side of the edge, as it is reached leaving the
+        /// node's forward orientation from this side
+        handle_t neighbor;
+        uint32_t next;
+    };
+
+    /// index of the node with this ID, or NONE
+    uint32_t find_node(id_t node_id) const;
+
+    /// add a node to the ID table
+    void index_node(id_t node_id, uint32_t node_idx);
+
+    /// rebuild the ID table from the node records
+    void reindex_nodes();
+
+    /// add an entry to an edge list
+    void add_to_side(uint32_t node_idx, bool right_side, const handle_t& neighbor);
+
+    /// list all edges in a canonical orientation, and then remove them
+    vector<edge_t> take_edges();
+
+    vector<NodeRecord> nodes;
+    vector<EdgeRecord> edges;
+    /// all of the node sequences, back to back
+    string sequences;
+    /// open addressing table from node ID to node index, with a power of 2 size
+    vector<pair<id_t, uint32_t>> id_table;
+
+    size_t edge_count = 0;
+    id_t min_id = numeric_limits<id_t>::max();
+    id_t max_id = 0;
+};
+
+}
+
+#endif // VG_ARENA_SUBGRAPH_HPP_INCLUDED
@@ -202,6 +202,14 @@ void augment_impl(MutablePathMutableHandleGraph* graph,
     assert(!packed_mode || packer != nullptr);
     
     unordered_map<id_t, set<pos_t>> breakpoints;
+
+    // In the STL map mode, each thread collects its own breakpoints, sharded by node ID
+    // so that the shards can be merged in parallel afterward
+    size_t breakpoint_shards = get_thread_count();
+    vector<vector<unordered_map<id_t, set<pos_t>>>> thread_breakpoints;
+    if (!packed_mode) {
+        thread_breakpoints.resize(get_thread_count(), vector<unordered_map<id_t, set<pos_t>>>(breakpoint_shards));
+    }
         
     // First pass: find the breakpoints
     iterate_gam((function<void(Alignment&)>)[&](Alignment& aln) {
@@ -234,14 +242,36 @@ void augment_impl(MutablePathMutableHandleGraph* graph,
             } else {
                 // note: we cannot pass non-zero min_baseq here.  it relies on filter_breakpoints_by_coverage
                 // to work correctly, and must be passed in only via find_packed_breakpoints.
-                find_breakpoints(simplified_path, breakpoints, break_at_ends, "", 0, 1.);
+                unordered_map<id_t, set<pos_t>> read_breakpoints;
+                find_breakpoints(simplified_path, read_breakpoints, break_at_ends, "", 0, 1.);
+                auto& shards = thread_breakpoints[omp_get_thread_num()];
+                for (auto& id_set : read_breakpoints) {
+                    shards[id_set.first % breakpoint_shards][id_set.first].insert(id_set.second.begin(), id_set.second.end());
+                }
             }
-        }, false, packed_mode);
+        }, false, true);
 
     if (packed_mode) {
         // Filter the breakpoints by coverage
         breakpoints = filter_breakpoints_by_coverage(*packer, min_bp_coverage);
     } else {
+        // Merge each shard across the threads in parallel
+        vector<unordered_map<id_t, set<pos_t>>> shard_breakpoints(breakpoint_shards);
+#pragma omp parallel for
+        for (size_t i = 0; i < breakpoint_shards; ++i) {
+            for (auto& shards : thread_breakpoints) {
+                for (auto& id_set : shards[i]) {
+                    shard_breakpoints[i][id_set.first].insert(id_set.second.begin(), id_set.second.end());
+                }
+                unordered_map<id_t, set<pos_t>>().swap(shards[i]);
+            }
+        }
+        thread_breakpoints.clear();
+        // The shards have disjoint node IDs, so we can just move them together
+        for (auto& shard : shard_breakpoints) {
+            breakpoints.insert(make_move_iterator(shard.begin()), make_move_iterator(shard.end()));
+            unordered_map<id_t, set<pos_t>>().swap(shard);
+        }
         // Invert the breakpoints that are on the reverse strand
         breakpoints = forwardize_breakpoints(graph, breakpoints);
     }
@@ -273,12 +303,25 @@ void augment_impl(MutablePathMutableHandleGraph* graph,
     if (!gam_out_path.empty()) {
         aln_emitter = vg::io::get_non_hts_alignment_emitter(gam_out_path, aln_format, {}, get_thread_count(), graph);
     }
-    vector<Alignment> aln_buffer;
 
     // Second pass: add the nodes and edges
-    iterate_gam((function<void(Alignment&)>)[&](Alignment& aln) {
-            if (aln.mapping_quality() < min_mapq || (filter_out_of_graph_alignments && !check_in_graph(aln.path(), orig_node_sizes))) {
-                return;
+    // Only one thread can modify the graph, so we read the alignments in batches, prepare
+    // each batch's paths in parallel, and then apply them to the graph in input order (which
+    // keeps the new node IDs the same no matter how many threads we use)
+    size_t batch_size = get_thread_count() * 256;
+    vector<Alignment> aln_batch;
+    vector<Path> path_batch;
+    vector<char> keep_batch;
+    function<void(void)> apply_batch = [&]() {
+        path_batch.resize(aln_batch.size());
+        keep_batch.resize(aln_batch.size());
+#pragma omp parallel for
+        for (size_t i = 0; i < aln_batch.size(); ++i) {
+            Alignment& aln = aln_batch[i];
+            keep_batch[i] = aln.mapping_quality() >= min_mapq &&
+                (!filter_out_of_graph_alignments || check_in_graph(aln.path(), orig_node_sizes));
+            if (!keep_batch[i]) {
+                continue;
             }
             
             if (remove_softclips) {
@@ -289,17 +332,25 @@ void augment_impl(MutablePathMutableHandleGraph* graph,
             // Mapping (because we don't have or want a breakpoint there)
             // Note: We're electing to re-simplify in a second pass to avoid storing all
             // the input paths in memory
-            Path simplified_path = simplify(aln.path());
+            path_batch[i] = simplify(aln.path());
 
             // Filter out edits corresponding to breakpoints that didn't meet our coverage
             // criteria
             if (min_bp_coverage > 0) {
-                simplify_filtered_edits(graph, aln, simplified_path, node_translation, orig_node_sizes,
+                simplify_filtered_edits(graph, aln, path_batch[i], node_translation, orig_node_sizes,
                                         min_baseq, max_frac_n);
             }
+        }
 
+        vector<Alignment> out_batch;
+        for (size_t i = 0; i < aln_batch.size(); ++i) {
+            if (!keep_batch[i]) {
+                continue;
+            }
+            Alignment& aln = aln_batch[i];
+            
             // Create new nodes/wire things up. Get the added version of the path.
-            Path added = add_nodes_and_edges(graph, simplified_path, node_translation, added_seqs,
+            Path added = add_nodes_and_edges(graph, path_batch[i], node_translation, added_seqs,
                                              added_nodes, orig_node_sizes);
 
             // Copy over the name
@@ -311,9 +362,9 @@ void augment_impl(MutablePathMutableHandleGraph* graph,
 
             // something is off about this check.
             // assuming the GAM path is sorted, let's double-check that its edges are here
-            for (size_t i = 1; i < added.mapping_size(); ++i) {
-                auto& m1 = added.mapping(i-1);
-                auto& m2 = added.mapping(i);
+            for (size_t j = 1; j < added.mapping_size(); ++j) {
+                auto& m1 = added.mapping(j-1);
+                auto& m2 = added.mapping(j);
                 // we're no longer sorting our input paths, so we assume they are sorted
                 assert((m1.rank() == 0 && m2.rank() == 0) || (m1.rank() + 1 == m2.rank()));
                 //if (!adjacent_mappings(m1, m2)) continue; // the path is completely represented here
@@ -326,17 +377,25 @@ void augment_impl(MutablePathMutableHandleGraph* graph,
             // optionally write out the modified path to GAM
             if (!gam_out_path.empty()) {
                 *aln.mutable_path() = added;
-                aln_buffer.push_back(aln);
-                if (aln_buffer.size() >= 100) {
-                    aln_emitter->emit_singles(vector<Alignment>(aln_buffer));
-                    aln_buffer.clear();
-                }
+                out_batch.emplace_back(std::move(aln));
+            }
+        }
+        if (!out_batch.empty()) {
+            aln_emitter->emit_singles(std::move(out_batch));
+        }
+        aln_batch.clear();
+        path_batch.clear();
+        keep_batch.clear();
+    };
+    
+    iterate_gam((function<void(Alignment&)>)[&](Alignment& aln) {
+            aln_batch.emplace_back(std::move(aln));
+            if (aln_batch.size() >= batch_size) {
+                apply_batch();
             }
         }, true, false);
-    if (!aln_buffer.empty()) {
-        // Flush the buffer
-        aln_emitter->emit_singles(vector<Alignment>(aln_buffer));
-    }
+    // Apply the last partial batch
+    apply_batch();
 
     // perform the same check as above, but on the paths that were already in the graph
     // assuming the graph's paths are sorted, let's double-check that the edges are here
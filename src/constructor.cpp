@@ -212,9 +212,11 @@ namespace vg {
             if (warn_on_lowercase) {
                 if (variant) {
                     // We are warning about a variant (alt)
-                    if (!lowercase_warned_alt) {
-                        #pragma omp critical (cerr)
-                        {
+                    #pragma omp critical (cerr)
+                    {
+                        // Note that the pragma also protects this mutable flag,
+                        // since chunks may be constructed in parallel.
+                        if (!lowercase_warned_alt) {
                             cerr << "warning:[vg::Constructor] Lowercase characters found in "
                                  << "variant; coercing to uppercase:\n" << *const_cast<vcflib::Variant*>(variant) << endl;
                             lowercase_warned_alt = true;
@@ -2033,6 +2035,53 @@ namespace vg {
             callback(chunk.graph);
         };
 
+        // Chunks are constructed in parallel, a batch at a time, and then wired
+        // up and emitted in order. All the ID assignment happens in
+        // wire_and_emit, so the output is the same as if we constructed the
+        // chunks one at a time. We read ahead in the VCF and the FASTA while
+        // filling the batch, since neither of those is thread safe.
+        struct PendingChunk {
+            string reference_sequence;
+            vector<vcflib::Variant> variants;
+            size_t start;
+            size_t end;
+        };
+        vector<PendingChunk> pending_chunks;
+        size_t chunks_per_batch = max(chunks_per_thread, (size_t) 1) * get_thread_count();
+        
+        // Construct all the pending chunks and emit them.
+        auto construct_pending_chunks = [&]() {
+            vector<ConstructedChunk> constructed(pending_chunks.size());
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < pending_chunks.size(); i++) {
+                auto& pending = pending_chunks[i];
+                constructed[i] = construct_chunk(std::move(pending.reference_sequence), reference_contig,
+                                                 std::move(pending.variants), pending.start);
+            }
+            for (size_t i = 0; i < constructed.size(); i++) {
+                // Wire up and emit the chunk graph
+                wire_and_emit(constructed[i]);
+                // Say we've completed the chunk
+                update_progress(pending_chunks[i].end - leading_offset);
+            }
+            pending_chunks.clear();
+        };
+        
+        // Queue up the chunk between chunk_start and chunk_end with the current
+        // chunk_variants, and construct the batch if it is full.
+        auto queue_chunk = [&]() {
+            pending_chunks.emplace_back();
+            auto& pending = pending_chunks.back();
+            // Get the ref sequence we need
+            pending.reference_sequence = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
+            pending.variants = std::move(chunk_variants);
+            pending.start = chunk_start;
+            pending.end = chunk_end;
+            if (pending_chunks.size() >= chunks_per_batch) {
+                construct_pending_chunks();
+            }
+        };
+
         bool do_external_insertions = false;
         FastaReference* insertion_fasta;
 
@@ -2227,17 +2276,8 @@ namespace vg {
                             min((size_t) reference_end,
                                 (size_t) (chunk_start + bases_per_chunk))));
 
-                // Get the ref sequence we need
-                auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-                // Call the construction
-                auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-                // Wire up and emit the chunk graph
-                wire_and_emit(result);
-
-                // Say we've completed the chunk
-                update_progress(chunk_end - leading_offset);
+                // Queue the chunk for construction
+                queue_chunk();
 
                 // Set up a new chunk
                 chunk_start = chunk_end;
@@ -2263,17 +2303,8 @@ namespace vg {
                     min((size_t) reference_end,
                         (size_t) (chunk_start + bases_per_chunk)));
 
-            // Get the ref sequence we need
-            auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-            // Call the construction
-            auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-            // Wire up and emit the chunk graph
-            wire_and_emit(result);
-
-            // Say we've completed the chunk
-            update_progress(chunk_end - leading_offset);
+            // Queue the chunk for construction
+            queue_chunk();
 
             // Set up a new chunk
             chunk_start = chunk_end;
@@ -2281,6 +2312,9 @@ namespace vg {
             chunk_variants.clear();
         }
 
+        // Construct whatever is left over.
+        construct_pending_chunks();
+
         // All the chunks have been wired and emitted.
         
         if (last_node_buffer.id() != 0) {
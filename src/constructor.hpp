@@ -128,6 +128,10 @@ public:
     // load all of chr1 into an std::string, even if we have no variants on it.
     size_t bases_per_chunk = 1024 * 1024;
     
+    // How many chunks per thread should we read ahead and construct in
+    // parallel before wiring them up and emitting them in order?
+    size_t chunks_per_thread = 2;
+    
     // This set contains the set of VCF sequence names we want to build the
     // graph for. If empty, we will build the graph for all sequences in the
     // FASTA. If nonempty, we build only for the specified sequences. If
@@ -178,6 +182,9 @@ public:
      *
      * Calls the given callback with constructed graph chunks, in a single
      * thread. Chunks may contain dangling edges into the next chunk.
+     *
+     * Chunks are constructed in parallel using OpenMP threads, but IDs are
+     * assigned in order, so the output does not depend on the thread count.
      */
     void construct_graph(string vcf_contig, FastaReference& reference, VcfBuffer& variant_source,
          const vector<FastaReference*>& insertion, const function<void(Graph&)>& callback);
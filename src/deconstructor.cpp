@@ -668,7 +668,7 @@ bool Deconstructor::deconstruct_site(const Snarl* snarl) const {
     
     vector<int64_t> gbwt_trav_offsets;
     if (gbwt_trav_finder.get() != nullptr) {
-        pair<vector<SnarlTraversal>, vector<gbwt::size_type>> thread_travs = gbwt_trav_finder->find_path_traversals(*snarl);
+        pair<vector<SnarlTraversal>, vector<gbwt::size_type>> thread_travs = get_gbwt_traversals(snarl);
         for (int i = 0; i < thread_travs.first.size(); ++i) {
             // We need to get a bunch of metadata about the path, but the GBWT
             // we have might not even have structured path names stored.
@@ -1094,9 +1094,11 @@ void Deconstructor::deconstruct(vector<string> ref_paths, const PathPositionHand
         gbwt_trav_finder = unique_ptr<GBWTTraversalFinder>(new GBWTTraversalFinder(*graph, *gbwt));
     }
 
-    vector<const Snarl*> snarls_todo;
-    // Do the top-level snarls in parallel
+    // Collect each top-level snarl along with its nested snarls, if we want those
+    vector<vector<const Snarl*>> snarl_trees;
     snarl_manager->for_each_top_level_snarl([&](const Snarl* snarl) {
+            snarl_trees.emplace_back();
+            vector<const Snarl*>& snarls_todo = snarl_trees.back();
             vector<const Snarl*> todo(1, snarl);
             vector<const Snarl*> next;
             while (!todo.empty()) {
@@ -1104,7 +1106,6 @@ void Deconstructor::deconstruct(vector<string> ref_paths, const PathPositionHand
                     // if we can't make a variant from the snarl due to not finding
                     // paths through it, we try again on the children
                     // note: we may want to push the parallelism down a bit
-#pragma omp critical (snarls_todo)
                     snarls_todo.push_back(next_snarl);
                     if (include_nested) {
                         // n.b. we no longer attempt to deconstruct the site to determine if we nest
@@ -1117,22 +1118,303 @@ void Deconstructor::deconstruct(vector<string> ref_paths, const PathPositionHand
             }
         });
 
+    // Find where on the reference each tree's variants can start, so we can do the trees in
+    // windows along the reference and write out the variants as we go. We can't do this for
+    // reference paths that are only in the GBWT, so then we do everything in one window.
+    bool can_place = gbwt_ref_paths.empty();
+    vector<pair<string, size_t>> tree_starts = can_place ? place_snarl_trees(snarl_trees)
+                                                         : vector<pair<string, size_t>>(snarl_trees.size());
+    // trees that don't touch a reference path get an empty contig name
+    auto is_placed = [&](size_t i) {
+        return !tree_starts[i].first.empty();
+    };
+    // do trees we couldn't place first, and then the others in reference order
+    vector<size_t> tree_order(snarl_trees.size());
+    for (size_t i = 0; i < tree_order.size(); ++i) {
+        tree_order[i] = i;
+    }
+    if (can_place) {
+        std::stable_sort(tree_order.begin(), tree_order.end(), [&](size_t i, size_t j) {
+                return (!is_placed(i) && is_placed(j)) || (is_placed(i) && is_placed(j) && tree_starts[i] < tree_starts[j]);
+            });
+    }
+
+    size_t next_tree = 0;
+    vector<const Snarl*> window_snarls;
+    while (next_tree < tree_order.size()) {
+        // Fill the window with whole trees, so that nesting tags can be resolved within it
+        window_snarls.clear();
+        while (next_tree < tree_order.size() && (!can_place || window_snarls.size() < snarls_per_window)) {
+            const vector<const Snarl*>& tree = snarl_trees[tree_order[next_tree]];
+            window_snarls.insert(window_snarls.end(), tree.begin(), tree.end());
+            vector<const Snarl*>().swap(snarl_trees[tree_order[next_tree]]);
+            ++next_tree;
+        }
+
 //#pragma omp parallel
 //#pragma omp single
-    {
+        {
 #pragma omp parallel for schedule(dynamic,1)
-        for (size_t i = 0; i < snarls_todo.size(); i++) {
+            for (size_t i = 0; i < window_snarls.size(); i++) {
 //#pragma omp task firstprivate(i)
-            {
-                auto& snarl = snarls_todo[i];
-                deconstruct_site(snarl);
+                {
+                    auto& snarl = window_snarls[i];
+                    deconstruct_site(snarl);
+                }
             }
         }
-    }
 //#pragma omp taskwait
 
-    // write variants in sorted order
-    write_variants(cout, snarl_manager);
+        // the window had whole snarl trees, so anything left in the GBWT traversal cache won't be used
+        gbwt_trav_cache.clear();
+        gbwt_trav_done.clear();
+
+        if (next_tree == tree_order.size()) {
+            // write all the remaining variants in sorted order
+            write_variants(cout, snarl_manager);
+        } else if (is_placed(tree_order[next_tree])) {
+            // nothing we haven't done yet can come before the start of the next tree
+            write_variants(cout, tree_starts[tree_order[next_tree]], snarl_manager);
+        } else {
+            // don't write anything yet, but resolve the nesting tags for this window
+            write_variants(cout, make_pair(string(), (size_t)0), snarl_manager);
+        }
+    }
+}
+
+vector<pair<string, size_t>> Deconstructor::place_snarl_trees(const vector<vector<const Snarl*>>& snarl_trees) const {
+
+    // find the contig and offset we'd report each reference path's positions on
+    unordered_map<path_handle_t, pair<string, int64_t>> ref_path_contigs;
+    graph->for_each_path_handle([&](const path_handle_t& path_handle) {
+            subrange_t subrange;
+            string path_name = Paths::strip_subrange(graph->get_path_name(path_handle), &subrange);
+            if (ref_paths.count(path_name)) {
+                string contig_name = PathMetadata::parse_locus_name(path_name);
+                ref_path_contigs[path_handle] = make_pair(contig_name != PathMetadata::NO_LOCUS_NAME ? contig_name : path_name,
+                                                          subrange == PathMetadata::NO_SUBRANGE ? 0 : subrange.first);
+            }
+        });
+
+    // a variant's position is always past the start of a reference step on its snarl's boundary,
+    // so the first of those in a tree comes no later than any of its variants
+    vector<pair<string, size_t>> tree_starts(snarl_trees.size());
+#pragma omp parallel for schedule(dynamic,1)
+    for (size_t i = 0; i < snarl_trees.size(); ++i) {
+        for (const Snarl* snarl : snarl_trees[i]) {
+            for (nid_t node_id : {snarl->start().node_id(), snarl->end().node_id()}) {
+                graph->for_each_step_on_handle(graph->get_handle(node_id), [&](const step_handle_t& step) {
+                        auto found = ref_path_contigs.find(graph->get_path_handle_of_step(step));
+                        if (found != ref_path_contigs.end()) {
+                            pair<string, size_t> start(found->second.first,
+                                                       graph->get_position_of_step(step) + found->second.second);
+                            if (tree_starts[i].first.empty() || start < tree_starts[i]) {
+                                tree_starts[i] = std::move(start);
+                            }
+                        }
+                    });
+            }
+        }
+    }
+    return tree_starts;
+}
+
+pair<vector<SnarlTraversal>, vector<gbwt::size_type>> Deconstructor::get_gbwt_traversals(const Snarl* snarl) const {
+
+    pair<handle_t, handle_t> key(graph->get_handle(snarl->start().node_id(), snarl->start().backward()),
+                                 graph->get_handle(snarl->end().node_id(), snarl->end().backward()));
+    pair<vector<SnarlTraversal>, vector<gbwt::size_type>> travs;
+    bool cached = false;
+    {
+        lock_guard<mutex> lock(gbwt_trav_cache_mutex);
+        auto found = gbwt_trav_cache.find(key);
+        if (found != gbwt_trav_cache.end()) {
+            travs = std::move(found->second);
+            gbwt_trav_cache.erase(found);
+            cached = true;
+        }
+        // our parent can't leave anything for us after this
+        gbwt_trav_done.insert(key);
+    }
+    if (cached) {
+        ++gbwt_trav_cache_hits;
+    } else {
+        ++gbwt_trav_cache_misses;
+        travs = gbwt_trav_finder->find_path_traversals(*snarl);
+    }
+
+    if (cache_gbwt_traversals && include_nested && gbwt_trav_finder->get_gbwt().bidirectional() &&
+        !snarl_manager->children_of(snarl).empty()) {
+        cache_child_gbwt_traversals(snarl, travs);
+    }
+    return travs;
+}
+
+void Deconstructor::cache_child_gbwt_traversals(const Snarl* snarl,
+                                                const pair<vector<SnarlTraversal>, vector<gbwt::size_type>>& travs) const {
+
+    const gbwt::GBWT& gbwt = gbwt_trav_finder->get_gbwt();
+
+    // In a bidirectional GBWT, the sequences in the traversals run along the snarl, and each
+    // traversal is a different visit to the snarl unless a haplotype is there more than once
+    vector<vector<gbwt::node_type>> trav_nodes(travs.first.size());
+    unordered_set<gbwt::size_type> seen_sequences;
+    for (size_t i = 0; i < travs.first.size(); ++i) {
+        if (!seen_sequences.insert(travs.second[i]).second || seen_sequences.count(gbwt::Path::reverse(travs.second[i]))) {
+            return;
+        }
+        const SnarlTraversal& trav = travs.first[i];
+        trav_nodes[i].reserve(trav.visit_size());
+        for (size_t j = 0; j < trav.visit_size(); ++j) {
+            trav_nodes[i].push_back(gbwt::Node::encode(trav.visit(j).node_id(), trav.visit(j).backward()));
+        }
+    }
+
+    for (const Snarl* child : snarl_manager->children_of(snarl)) {
+        if (child->type() == UNARY) {
+            // the start and end are the same node
+            continue;
+        }
+        pair<handle_t, handle_t> key(graph->get_handle(child->start().node_id(), child->start().backward()),
+                                     graph->get_handle(child->end().node_id(), child->end().backward()));
+        gbwt::node_type child_start = gbwt::Node::encode(child->start().node_id(), child->start().backward());
+        gbwt::node_type child_end = gbwt::Node::encode(child->end().node_id(), child->end().backward());
+        gbwt::node_type child_start_rev = gbwt::Node::reverse(child_start);
+        gbwt::node_type child_end_rev = gbwt::Node::reverse(child_end);
+
+        // Cut the walk of every haplotype visit to the child start out of our traversals, the same
+        // way the GBWT search from the child start would find it: up to the next child end
+        vector<pair<vector<gbwt::node_type>, gbwt::size_type>> walks;
+        bool complete = true;
+        for (size_t i = 0; i < trav_nodes.size() && complete; ++i) {
+            const vector<gbwt::node_type>& nodes = trav_nodes[i];
+            for (size_t j = 0; j < nodes.size() && complete; ++j) {
+                if (nodes[j] == child_start) {
+                    size_t k = j + 1;
+                    while (k < nodes.size() && nodes[k] != child_end) {
+                        ++k;
+                    }
+                    if (k == nodes.size()) {
+                        complete = false;
+                    } else {
+                        walks.emplace_back(vector<gbwt::node_type>(nodes.begin() + j, nodes.begin() + k + 1),
+                                           travs.second[i]);
+                    }
+                } else if (nodes[j] == child_start_rev) {
+                    // the reverse sequence visits the child start here, and walks back along the traversal
+                    size_t k = j;
+                    while (k > 0 && nodes[k - 1] != child_end_rev) {
+                        --k;
+                    }
+                    if (k == 0) {
+                        complete = false;
+                    } else {
+                        walks.emplace_back(vector<gbwt::node_type>(), gbwt::Path::reverse(travs.second[i]));
+                        for (size_t l = j + 1; l >= k; --l) {
+                            walks.back().first.push_back(gbwt::Node::reverse(nodes[l - 1]));
+                        }
+                    }
+                }
+            }
+        }
+        if (!complete || walks.size() != gbwt.find(child_start).size()) {
+            // some haplotypes visit the child without going through us, so we have to search for them
+            continue;
+        }
+
+        // Put the walks in a trie, and list the unique ones in the order that list_haplotypes() would
+        // find them in, so the child's traversals are exactly what searching the GBWT would give
+        struct TrieNode {
+            gbwt::node_type node;
+            size_t parent;
+            vector<size_t> children;
+            vector<gbwt::size_type> sequences;
+        };
+        vector<TrieNode> trie;
+        if (!walks.empty()) {
+            trie.push_back({child_start, 0, {}, {}});
+        }
+        for (const auto& walk : walks) {
+            size_t here = 0;
+            for (size_t j = 1; j < walk.first.size(); ++j) {
+                size_t next = trie.size();
+                for (size_t child_idx : trie[here].children) {
+                    if (trie[child_idx].node == walk.first[j]) {
+                        next = child_idx;
+                        break;
+                    }
+                }
+                if (next == trie.size()) {
+                    trie[here].children.push_back(next);
+                    trie.push_back({walk.first[j], here, {}, {}});
+                }
+                here = next;
+            }
+            trie[here].sequences.push_back(walk.second);
+        }
+        vector<size_t> found_ends;
+        vector<size_t> stack;
+        if (!trie.empty()) {
+            stack.push_back(0);
+        }
+        while (!stack.empty()) {
+            size_t here = stack.back();
+            stack.pop_back();
+            graph->follow_edges(gbwt_to_handle(*graph, trie[here].node), false, [&](const handle_t& next) {
+                    gbwt::node_type next_node = handle_to_gbwt(*graph, next);
+                    for (size_t child_idx : trie[here].children) {
+                        if (trie[child_idx].node == next_node) {
+                            if (next_node == child_end) {
+                                found_ends.push_back(child_idx);
+                            } else {
+                                stack.push_back(child_idx);
+                            }
+                        }
+                    }
+                });
+        }
+
+        pair<vector<SnarlTraversal>, vector<gbwt::size_type>> child_travs;
+        for (size_t end_idx : found_ends) {
+            vector<gbwt::node_type> walk;
+            for (size_t here = end_idx; here != 0; here = trie[here].parent) {
+                walk.push_back(trie[here].node);
+            }
+            walk.push_back(child_start);
+            SnarlTraversal trav;
+            for (auto it = walk.rbegin(); it != walk.rend(); ++it) {
+                *trav.add_visit() = to_visit(gbwt::Node::id(*it), gbwt::Node::is_reverse(*it));
+            }
+            // the GBWT locates each sequence once, in sorted order
+            vector<gbwt::size_type>& sequences = trie[end_idx].sequences;
+            std::sort(sequences.begin(), sequences.end());
+            sequences.erase(std::unique(sequences.begin(), sequences.end()), sequences.end());
+            for (gbwt::size_type sequence : sequences) {
+                child_travs.first.push_back(trav);
+                child_travs.second.push_back(sequence);
+            }
+        }
+
+        lock_guard<mutex> lock(gbwt_trav_cache_mutex);
+        if (!gbwt_trav_done.count(key)) {
+            gbwt_trav_cache[key] = std::move(child_travs);
+        }
+    }
+}
+
+void Deconstructor::set_snarls_per_window(size_t snarls_per_window) {
+    this->snarls_per_window = std::max(snarls_per_window, (size_t)1);
+}
+
+void Deconstructor::set_cache_gbwt_traversals(bool cache_gbwt_traversals) {
+    this->cache_gbwt_traversals = cache_gbwt_traversals;
+}
+
+void Deconstructor::report_gbwt_traversal_cache(ostream& out) const {
+    size_t hits = gbwt_trav_cache_hits;
+    size_t misses = gbwt_trav_cache_misses;
+    out << "GBWT traversals of " << hits << " of " << (hits + misses) << " snarls ("
+        << (hits + misses == 0 ? 0.0 : 100.0 * hits / (hits + misses)) << "%) were taken from their parent snarls" << endl;
 }
 
 bool Deconstructor::check_max_nodes(const Snarl* snarl) const  {
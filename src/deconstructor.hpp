@@ -5,6 +5,8 @@
 #include <ostream>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include "genotypekit.hpp"
 #include "Variant.h"
 #include "handle.hpp"
@@ -48,6 +50,16 @@ public:
                      const unordered_map<string, pair<string, int>>* path_to_sample_phase = nullptr,
                      const unordered_map<string, int>* sample_ploidy = nullptr,
                      gbwt::GBWT* gbwt = nullptr);
+
+    // deconstruct at least this many snarls at a time (in whole top-level snarl trees) before
+    // writing out the variants that are done
+    void set_snarls_per_window(size_t snarls_per_window);
+
+    // work out the GBWT traversals of child snarls from those of their parents (on by default)
+    void set_cache_gbwt_traversals(bool cache_gbwt_traversals);
+
+    // print how often the GBWT traversals of a snarl could be worked out from its parent's
+    void report_gbwt_traversal_cache(ostream& out) const;
     
 private:
 
@@ -75,6 +87,19 @@ private:
                                               const vector<string>& trav_to_name,
                                               const vector<int>& gbwt_phases) const;
 
+    // find the first reference (contig, position) at which each tree of snarls can have a variant.
+    // trees that no reference path touches get an empty contig name
+    vector<pair<string, size_t>> place_snarl_trees(const vector<vector<const Snarl*>>& snarl_trees) const;
+
+    // get the GBWT traversals of a snarl (as GBWTTraversalFinder::find_path_traversals), from the cache
+    // if they were worked out from the snarl's parent, and work out those of its children
+    pair<vector<SnarlTraversal>, vector<gbwt::size_type>> get_gbwt_traversals(const Snarl* snarl) const;
+
+    // add the GBWT traversals of a snarl's children to the cache, for each child whose every haplotype
+    // visit lies inside the snarl's traversals
+    void cache_child_gbwt_traversals(const Snarl* snarl,
+                                     const pair<vector<SnarlTraversal>, vector<gbwt::size_type>>& travs) const;
+
     // check to see if a snarl is too big to exhaustively traverse
     bool check_max_nodes(const Snarl* snarl) const;
 
@@ -137,6 +162,16 @@ private:
     /// list for, so we can make sure to bail out if we end up trying to use
     /// the wrong level's thread numbers.
     size_t gbwt_pos_caches_level = std::numeric_limits<size_t>::max();
+    // should we take the GBWT traversals of child snarls from their parents' traversals
+    bool cache_gbwt_traversals = true;
+    // GBWT traversals of child snarls, keyed by their boundary handles, that were worked out from
+    // the traversals of their parents and are waiting for the children to be deconstructed
+    mutable unordered_map<pair<handle_t, handle_t>, pair<vector<SnarlTraversal>, vector<gbwt::size_type>>> gbwt_trav_cache;
+    // the snarls that have asked for their GBWT traversals, so we don't cache them after that
+    mutable unordered_set<pair<handle_t, handle_t>> gbwt_trav_done;
+    mutable mutex gbwt_trav_cache_mutex;
+    mutable atomic<size_t> gbwt_trav_cache_hits{0};
+    mutable atomic<size_t> gbwt_trav_cache_misses{0};
     // infer ploidys from gbwt when possible
     unordered_map<string, pair<int, int>> gbwt_sample_to_phase_range;
 
@@ -152,6 +187,9 @@ private:
     // the sample ploidys given in the phases in our path names
     const unordered_map<string, int>* sample_ploidys;
 
+    // size of the windows the snarl trees are deconstructed in
+    size_t snarls_per_window = 64 * 1024;
+
     // upper limit of degree-2+ nodes for exhaustive traversal
     int max_nodes_for_exhaustive = 100;
 
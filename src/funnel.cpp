@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <cstring>
+#include <omp.h>
 
 /**
  * \file funnel.hpp: implementation of the Funnel class
@@ -10,6 +11,155 @@
 namespace vg {
 using namespace std;
 
+size_t LatencyHistogram::bucket_of(uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKET_COUNT) {
+        // Small values get exact buckets
+        return nanoseconds;
+    }
+    // Find the leading 1 bit, and keep SUB_BUCKET_BITS bits after it.
+    size_t magnitude = 63 - __builtin_clzll(nanoseconds);
+    size_t shift = magnitude - SUB_BUCKET_BITS;
+    size_t sub_bucket = (nanoseconds >> shift) & (SUB_BUCKET_COUNT - 1);
+    return (shift + 1) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_start(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    size_t shift = bucket / SUB_BUCKET_COUNT - 1;
+    size_t sub_bucket = bucket % SUB_BUCKET_COUNT;
+    return (SUB_BUCKET_COUNT + sub_bucket) << shift;
+}
+
+void LatencyHistogram::record(double seconds) {
+    uint64_t nanoseconds = seconds > 0 ? (uint64_t) (seconds * 1E9) : 0;
+    size_t bucket = bucket_of(nanoseconds);
+    if (bucket >= buckets.size()) {
+        buckets.resize(bucket + 1, 0);
+    }
+    buckets[bucket]++;
+    value_count++;
+    total_nanoseconds += nanoseconds;
+    max_nanoseconds = std::max(max_nanoseconds, nanoseconds);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.buckets.size() > buckets.size()) {
+        buckets.resize(other.buckets.size(), 0);
+    }
+    for (size_t i = 0; i < other.buckets.size(); i++) {
+        buckets[i] += other.buckets[i];
+    }
+    value_count += other.value_count;
+    total_nanoseconds += other.total_nanoseconds;
+    max_nanoseconds = std::max(max_nanoseconds, other.max_nanoseconds);
+}
+
+size_t LatencyHistogram::count() const {
+    return value_count;
+}
+
+double LatencyHistogram::total() const {
+    return total_nanoseconds / 1E9;
+}
+
+double LatencyHistogram::max() const {
+    return max_nanoseconds / 1E9;
+}
+
+double LatencyHistogram::quantile(double q) const {
+    if (value_count == 0) {
+        return 0;
+    }
+    // Find the rank of the value we want, counting from 1
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t) std::ceil(q * value_count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // Report the middle of the bucket, but never more than the max.
+            uint64_t low = bucket_start(i);
+            uint64_t high = bucket_start(i + 1);
+            return std::min(low + (high - low) / 2, max_nanoseconds) / 1E9;
+        }
+    }
+    return max();
+}
+
+void LatencyHistogram::to_json(ostream& out) const {
+    out << "{\"count\":" << value_count
+        << ",\"total_seconds\":" << total()
+        << ",\"mean_seconds\":" << (value_count == 0 ? 0.0 : total() / value_count)
+        << ",\"p50_seconds\":" << quantile(0.5)
+        << ",\"p90_seconds\":" << quantile(0.9)
+        << ",\"p99_seconds\":" << quantile(0.99)
+        << ",\"p999_seconds\":" << quantile(0.999)
+        << ",\"max_seconds\":" << max()
+        << ",\"buckets\":[";
+    bool first = true;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            out << ",";
+        }
+        out << "[" << bucket_start(i) << "," << buckets[i] << "]";
+        first = false;
+    }
+    out << "]}";
+}
+
+StageLatencyRecorder::StageLatencyRecorder(size_t max_threads) : by_thread(max_threads) {
+    // Nothing to do
+}
+
+void StageLatencyRecorder::record(const string& stage, double seconds) {
+    size_t thread_num = omp_get_thread_num();
+    assert(thread_num < by_thread.size());
+    auto& by_stage = by_thread[thread_num].by_stage;
+    for (auto& entry : by_stage) {
+        if (entry.first == stage) {
+            entry.second.record(seconds);
+            return;
+        }
+    }
+    // This thread hasn't seen this stage yet.
+    by_stage.emplace_back(stage, LatencyHistogram());
+    by_stage.back().second.record(seconds);
+}
+
+vector<pair<string, LatencyHistogram>> StageLatencyRecorder::merged() const {
+    vector<pair<string, LatencyHistogram>> result;
+    unordered_map<string, size_t> index_of;
+    for (auto& thread_histograms : by_thread) {
+        for (auto& entry : thread_histograms.by_stage) {
+            auto found = index_of.find(entry.first);
+            if (found == index_of.end()) {
+                found = index_of.emplace(entry.first, result.size()).first;
+                result.emplace_back(entry.first, LatencyHistogram());
+            }
+            result[found->second].second.merge(entry.second);
+        }
+    }
+    return result;
+}
+
+void StageLatencyRecorder::to_json(ostream& out) const {
+    out << "{";
+    bool first = true;
+    for (auto& entry : merged()) {
+        if (!first) {
+            out << ",";
+        }
+        out << "\"" << entry.first << "\":";
+        entry.second.to_json(out);
+        first = false;
+    }
+    out << "}";
+}
+
 void Funnel::PaintableSpace::paint(size_t start, size_t length) {
     // Find the last interval starting strictly before start
     auto predecessor = regions.lower_bound(start);
@@ -112,9 +262,11 @@ void Funnel::stage(const string& name) {
     // Stop the previous stage if any.
     stage_stop();
 
-    // Allocate new stage structures.
-    stages.emplace_back();
-    stages.back().name = name;
+    if (track_items) {
+        // Allocate new stage structures.
+        stages.emplace_back();
+        stages.back().name = name;
+    }
     
     // Save the name
     stage_name = name;
@@ -133,15 +285,27 @@ void Funnel::stage_stop() {
         processed_input();
         produced_output();
         
-        // Say the stage is stopped 
-        stage_name.clear();
-        
         // Record the duration in seconds
         auto stage_stop_time = clock::now();
-        stages.back().duration = chrono::duration_cast<chrono::duration<double>>(stage_stop_time - stage_start_time).count();
+        double duration = chrono::duration_cast<chrono::duration<double>>(stage_stop_time - stage_start_time).count();
+        if (track_items) {
+            stages.back().duration = duration;
+        }
+        if (latency_recorder) {
+            latency_recorder->record(stage_name, duration);
+        }
+        
+        // Say the stage is stopped 
+        stage_name.clear();
     }
 }
 
+void Funnel::set_latency_recorder(StageLatencyRecorder* recorder, bool track_items) {
+    assert(funnel_name.empty());
+    latency_recorder = recorder;
+    this->track_items = track_items;
+}
+
 void Funnel::substage(const string& name) {
     assert(!funnel_name.empty());
     assert(!stage_name.empty());
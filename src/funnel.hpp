@@ -7,6 +7,7 @@
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -23,6 +24,89 @@ namespace vg {
 
 using namespace std;
 
+/**
+ * Histogram of durations, with log-spaced buckets in the style of an HDR
+ * histogram: each power of two of nanoseconds is split into a fixed number of
+ * linear sub-buckets, so any recorded value is known to within a few percent
+ * no matter how large it is, while recording is just an increment.
+ */
+class LatencyHistogram {
+public:
+    /// Record a duration, in seconds.
+    void record(double seconds);
+    
+    /// Add all the values recorded in another histogram to this one.
+    void merge(const LatencyHistogram& other);
+    
+    /// Get the number of recorded values.
+    size_t count() const;
+    
+    /// Get the total of all recorded durations, in seconds.
+    double total() const;
+    
+    /// Get the largest recorded duration, in seconds.
+    double max() const;
+    
+    /// Get the approximate duration, in seconds, at the given quantile (from
+    /// 0 to 1) of recorded values. Returns 0 if nothing is recorded.
+    double quantile(double q) const;
+    
+    /// Dump the histogram as a JSON object, with summary statistics and the
+    /// nonempty buckets' lower bounds in nanoseconds and counts.
+    void to_json(ostream& out) const;
+    
+protected:
+    /// How many bits of precision do we keep below the leading 1?
+    static constexpr size_t SUB_BUCKET_BITS = 4;
+    /// And so how many sub-buckets are in each power of 2?
+    static constexpr size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    
+    /// Get the bucket that a duration in nanoseconds falls into.
+    static size_t bucket_of(uint64_t nanoseconds);
+    /// Get the smallest duration in nanoseconds that falls into a bucket.
+    static uint64_t bucket_start(size_t bucket);
+    
+    /// Counts of values in each bucket. Grows as needed.
+    vector<uint64_t> buckets;
+    /// Total recorded values
+    uint64_t value_count = 0;
+    /// Sum of recorded values in nanoseconds
+    uint64_t total_nanoseconds = 0;
+    /// Largest recorded value in nanoseconds
+    uint64_t max_nanoseconds = 0;
+};
+
+/**
+ * Collects LatencyHistograms of stage durations, by stage name, from Funnels
+ * running on many OMP threads at once. Each thread records into its own
+ * histograms without locking, and they are merged when reported.
+ */
+class StageLatencyRecorder {
+public:
+    /// Make a recorder to be used from OMP threads numbered below max_threads.
+    StageLatencyRecorder(size_t max_threads);
+    
+    /// Record a duration, in seconds, for the given stage, in the calling
+    /// OMP thread's histograms.
+    void record(const string& stage, double seconds);
+    
+    /// Get the histograms for each stage, merged across threads, in the
+    /// order stages were first seen by any thread.
+    vector<pair<string, LatencyHistogram>> merged() const;
+    
+    /// Dump the merged histograms as a JSON object keyed by stage name.
+    void to_json(ostream& out) const;
+    
+protected:
+    /// Each thread keeps its histograms in a short list, since there are only
+    /// a handful of stages. Aligned so threads don't share cache lines.
+    struct alignas(64) ThreadHistograms {
+        vector<pair<string, LatencyHistogram>> by_stage;
+    };
+    
+    vector<ThreadHistograms> by_thread;
+};
+
 /**
  * Represents a record of an invocation of a pipeline for an input.
  *
@@ -238,6 +322,12 @@ public:
     /// tracking correctness all along
     void annotate_mapped_alignment(Alignment& aln, bool annotate_correctness) const;
     
+    /// Also record the wall time of each stage into the given recorder. If
+    /// track_items is false, the Funnel only does this timing, and only
+    /// start(), stop(), stage(), stage_stop(), substage(), and
+    /// substage_stop() may be used. Must be called before start().
+    void set_latency_recorder(StageLatencyRecorder* recorder, bool track_items = true);
+    
 protected:
     
     /// Pick a clock to use for measuring stage duration
@@ -245,6 +335,12 @@ protected:
     /// And a type to represent stage transition times
     using time_point = clock::time_point;
     
+    /// Where should stage durations be recorded, if anywhere?
+    StageLatencyRecorder* latency_recorder = nullptr;
+    
+    /// Are we tracking items and provenance, or just timing stages?
+    bool track_items = true;
+    
     /// What's the name of the funnel we start()-ed. Will be empty if nothing is running.
     string funnel_name;
     
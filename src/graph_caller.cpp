@@ -222,22 +222,52 @@ void VCFOutputCaller::add_variant(vcflib::Variant& var) const {
 }
 
 void VCFOutputCaller::write_variants(ostream& out_stream, const SnarlManager* snarl_manager) {
+    write_variants_up_to(out_stream, nullptr, snarl_manager);
+}
+
+void VCFOutputCaller::write_variants(ostream& out_stream, const pair<string, size_t>& up_to,
+                                     const SnarlManager* snarl_manager) {
+    write_variants_up_to(out_stream, &up_to, snarl_manager);
+}
+
+void VCFOutputCaller::write_variants_up_to(ostream& out_stream, const pair<string, size_t>* up_to,
+                                           const SnarlManager* snarl_manager) {
     assert(include_nested == false || snarl_manager != nullptr);
     if (include_nested) {
         update_nesting_info_tags(snarl_manager);
     }
     vector<pair<pair<string, size_t>, string>> all_variants;
-    for (const auto& buf : output_variants) {
+    for (auto& buf : output_variants) {
         all_variants.reserve(all_variants.size() + buf.size());
         std::move(buf.begin(), buf.end(), std::back_inserter(all_variants));
+        buf.clear();
     }
-    std::sort(all_variants.begin(), all_variants.end(), [](const pair<pair<string, size_t>, string>& v1,
-                                                           const pair<pair<string, size_t>, string>& v2) {
-            return v1.first.first < v2.first.first || (v1.first.first == v2.first.first && v1.first.second < v2.first.second);
-        });
-    for (auto v : all_variants) {
+    auto variant_less = [](const pair<pair<string, size_t>, string>& v1,
+                           const pair<pair<string, size_t>, string>& v2) {
+        return v1.first.first < v2.first.first || (v1.first.first == v2.first.first && v1.first.second < v2.first.second);
+    };
+    std::sort(all_variants.begin(), all_variants.end(), variant_less);
+    if (!held_variants.empty()) {
+        // merge in what we held back last time
+        vector<pair<pair<string, size_t>, string>> merged;
+        merged.reserve(held_variants.size() + all_variants.size());
+        std::merge(std::make_move_iterator(held_variants.begin()), std::make_move_iterator(held_variants.end()),
+                   std::make_move_iterator(all_variants.begin()), std::make_move_iterator(all_variants.end()),
+                   std::back_inserter(merged), variant_less);
+        held_variants.clear();
+        all_variants = std::move(merged);
+    }
+    auto write_end = all_variants.end();
+    if (up_to != nullptr) {
+        write_end = std::upper_bound(all_variants.begin(), all_variants.end(), *up_to,
+                                     [](const pair<string, size_t>& key, const pair<pair<string, size_t>, string>& v) {
+                                         return key.first < v.first.first || (key.first == v.first.first && key.second < v.first.second);
+                                     });
+        held_variants.assign(std::make_move_iterator(write_end), std::make_move_iterator(all_variants.end()));
+    }
+    for (auto v = all_variants.begin(); v != write_end; ++v) {
         string dest;
-        zstdutil::DecompressString(v.second, dest);
+        zstdutil::DecompressString(v->second, dest);
         out_stream << dest << endl;
     }
 }
@@ -939,18 +969,19 @@ SnarlTraversal GAFOutputCaller::pad_traversal(const PathHandleGraph& graph, cons
 
 void VCFOutputCaller::update_nesting_info_tags(const SnarlManager* snarl_manager) {
 
-    // index the snarl tree by name
-    unordered_map<string, const Snarl*> name_to_snarl;
-    Snarl flipped_snarl;
-    snarl_manager->for_each_snarl_preorder([&](const Snarl* snarl) {
-            name_to_snarl[print_snarl(*snarl)] = snarl;
-            // also add a map from the flipped snarl (as call sometimes messes with orientation)
-            flipped_snarl.mutable_start()->set_node_id(snarl->end().node_id());
-            flipped_snarl.mutable_start()->set_backward(!snarl->end().backward());
-            flipped_snarl.mutable_end()->set_node_id(snarl->start().node_id());
-            flipped_snarl.mutable_end()->set_backward(!snarl->start().backward());
-            name_to_snarl[print_snarl(flipped_snarl)] = snarl;
-        });
+    // index the snarl tree by name, the first time we're called
+    if (name_to_snarl.empty()) {
+        Snarl flipped_snarl;
+        snarl_manager->for_each_snarl_preorder([&](const Snarl* snarl) {
+                name_to_snarl[print_snarl(*snarl)] = snarl;
+                // also add a map from the flipped snarl (as call sometimes messes with orientation)
+                flipped_snarl.mutable_start()->set_node_id(snarl->end().node_id());
+                flipped_snarl.mutable_start()->set_backward(!snarl->end().backward());
+                flipped_snarl.mutable_end()->set_node_id(snarl->start().node_id());
+                flipped_snarl.mutable_end()->set_backward(!snarl->start().backward());
+                name_to_snarl[print_snarl(flipped_snarl)] = snarl;
+            });
+    }
 
     // pass 1) index sites in vcf
     // (todo: this could be done more quickly upstream)
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <iterator>
 #include <functional>
 #include <cmath>
 #include <limits>
@@ -85,6 +86,13 @@ public:
     /// snarl_manager needed if include_nested is true
     void write_variants(ostream& out_stream, const SnarlManager* snarl_manager = nullptr);
 
+    /// Sort then write the variants in the buffer that are on a contig before the given one, or on it
+    /// at or before the given position, and hold on to the rest for the next call.  Nesting tags are
+    /// added to variants the first time they are seen here, so all the variants of a top-level snarl
+    /// must be added before the call following the first one.
+    void write_variants(ostream& out_stream, const pair<string, size_t>& up_to,
+                        const SnarlManager* snarl_manager = nullptr);
+
     /// Run vcffixup from vcflib
     void vcf_fixup(vcflib::Variant& var) const;
 
@@ -135,6 +143,9 @@ protected:
 
     // update the PS and LV tags in the output buffer (called in write_variants if include_nested is true)
     void update_nesting_info_tags(const SnarlManager* snarl_manager);
+
+    /// tag, sort and write the buffered variants up to the given position (or all of them if null)
+    void write_variants_up_to(ostream& out_stream, const pair<string, size_t>* up_to, const SnarlManager* snarl_manager);
     
     /// output vcf
     mutable vcflib::VariantCallFile output_vcf;
@@ -146,6 +157,12 @@ protected:
     /// variants stored as strings (and position key pairs) because vcflib::Variant in-memory struct so huge
     mutable vector<vector<pair<pair<string, size_t>, string>>> output_variants;
 
+    /// sorted variants from output_variants that were past the end of the last partial write
+    vector<pair<pair<string, size_t>, string>> held_variants;
+
+    /// snarls by name (in both orientations), for update_nesting_info_tags
+    unordered_map<string, const Snarl*> name_to_snarl;
+
     /// print up to this many uncalled alleles when doing ref-genotpes in -a mode
     size_t max_uncalled_alleles = 5;
 
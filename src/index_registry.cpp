@@ -10,6 +10,8 @@
 #include <random>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <chrono>
 #include <cctype>
 #include <cstdio>
@@ -32,6 +34,7 @@
 #include <gcsa/gcsa.h>
 #include <gcsa/algorithms.h>
 #include <Fasta.h>
+#include <bdsg/overlays/overlay_helper.hpp>
 #include <htslib/tbx.h>
 
 #include "vg.hpp"
@@ -50,6 +53,7 @@
 #include "transcriptome.hpp"
 #include "integrated_snarl_finder.hpp"
 #include "snarl_distance_index.hpp"
+#include "multipath_mapper.hpp"
 #include "gfa.hpp"
 #include "job_schedule.hpp"
 #include "path.hpp"
@@ -385,8 +389,19 @@ static auto init_mutable_graph() -> unique_ptr<MutablePathDeletableHandleGraph>
     return graph;
 }
 
+// the updates to the IndexingParameters when we rewind after a failure
+static void increase_gbwt_insert_batch_size() {
+    IndexingParameters::gbwt_insert_batch_size *= IndexingParameters::gbwt_insert_batch_size_increase_factor;
+}
+static void prune_more_aggressively() {
+    IndexingParameters::pruning_walk_length *= IndexingParameters::pruning_walk_length_increase_factor;
+    IndexingParameters::pruning_max_node_degree *= IndexingParameters::pruning_max_node_degree_decrease_factor;
+}
+
 // execute a function in another process and return true if successful
 // REMEMBER TO SAVE ANY INDEXES CONSTRUCTED TO DISK WHILE STILL INSIDE THE LAMBDA!!
+// Recipes that call this must be registered as forking, so that make_indexes doesn't
+// execute them while other threads are running recipes.
 bool execute_in_fork(const function<void(void)>& exec) {
     
     // we have to clear out the pool of waiting OMP threads (if any) so that they won't
@@ -505,6 +520,8 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
     registry.register_index("Giraffe Distance Index", "dist");
     registry.register_index("Spliced Distance Index", "spliced.dist");
     
+    registry.register_index("MPMap Calibration", "mpmap.calib");
+    
     registry.register_index("GBWTGraph", "gg");
     registry.register_index("Giraffe GBZ", "giraffe.gbz");
     
@@ -2722,13 +2739,13 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
         }
         
         if (!success) {
-            IndexingParameters::gbwt_insert_batch_size *= IndexingParameters::gbwt_insert_batch_size_increase_factor;
-            throw RewindPlanException("[IndexRegistry]: Exceeded GBWT insert buffer size, expanding and reattempting.", {"Giraffe GBWT"});
+            throw RewindPlanException("[IndexRegistry]: Exceeded GBWT insert buffer size, expanding and reattempting.", {"Giraffe GBWT"},
+                                      increase_gbwt_insert_batch_size);
         }
         
         output_names.push_back(output_name);
         return all_outputs;
-    });
+    }, true);
     
     // do a greedy haplotype cover if we don't have haplotypes
     registry.register_recipe({"Giraffe GBWT"}, {"XG"},
@@ -2784,13 +2801,13 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
         });
         
         if (!success) {
-            IndexingParameters::gbwt_insert_batch_size *= IndexingParameters::gbwt_insert_batch_size_increase_factor;
-            throw RewindPlanException("[IndexRegistry]: Exceeded GBWT insert buffer size, expanding and reattempting.", {"Giraffe GBWT"});
+            throw RewindPlanException("[IndexRegistry]: Exceeded GBWT insert buffer size, expanding and reattempting.", {"Giraffe GBWT"},
+                                      increase_gbwt_insert_batch_size);
         }
         
         output_names.push_back(output_name);
         return all_outputs;
-    });
+    }, true);
     
     // meta-recipe to either add transcripts paths or also make HST collections
     auto do_vg_rna = [merge_gbwts](const vector<const IndexFile*>& inputs,
@@ -2945,9 +2962,8 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
                     save_gbwt(gbwt_builder.index, gbwt_name, IndexingParameters::verbosity == IndexingParameters::Debug);
                 });
                 if (!success) {
-                    IndexingParameters::gbwt_insert_batch_size *= IndexingParameters::gbwt_insert_batch_size_increase_factor;
                     throw RewindPlanException("[IndexRegistry]: Exceeded GBWT insert buffer size, expanding and reattempting.",
-                                              {"Haplotype-Transcript GBWT"});
+                                              {"Haplotype-Transcript GBWT"}, increase_gbwt_insert_batch_size);
                 }
                 
                 // write transcript origin info table
@@ -3012,7 +3028,7 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
                                          const IndexGroup& constructing) {
         
         return do_vg_rna(inputs, plan, alias_graph, constructing);
-    });
+    }, true);
     
     // if both the full and graph-only are required, only do the full
     registry.register_generalization(vg_rna_full, vg_rna_graph_only);
@@ -3354,16 +3370,35 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
         VGset graph_set(graph_filenames);
         size_t kmer_bytes = params.getLimitBytes();
         vector<string> dbg_names;
+        vector<KmerPartitionCount> partition_counts;
+        
+        // list the node ranges that produced the most k-mers
+        auto report_largest_partitions = [&]() {
+            size_t num_reported = min<size_t>(partition_counts.size(), 5);
+            partial_sort(partition_counts.begin(), partition_counts.begin() + num_reported, partition_counts.end(),
+                         [](const KmerPartitionCount& a, const KmerPartitionCount& b) {
+                return a.kmer_count > b.kmer_count;
+            });
+            for (size_t i = 0; i < num_reported; ++i) {
+                cerr << "[IndexRegistry]: Nodes " << partition_counts[i].first_id << "-" << partition_counts[i].last_id
+                     << " produced " << partition_counts[i].kmer_count << " k-mers." << endl;
+            }
+        };
+        
         try {
-            dbg_names = graph_set.write_gcsa_kmers_binary(IndexingParameters::gcsa_initial_kmer_length, kmer_bytes);
+            dbg_names = graph_set.write_gcsa_kmers_binary(IndexingParameters::gcsa_initial_kmer_length, kmer_bytes,
+                                                          0, 0, &partition_counts);
         }
         catch (SizeLimitExceededException& ex) {
-            // update pruning params
-            IndexingParameters::pruning_walk_length *= IndexingParameters::pruning_walk_length_increase_factor;
-            IndexingParameters::pruning_max_node_degree *= IndexingParameters::pruning_max_node_degree_decrease_factor;
+            if (IndexingParameters::verbosity != IndexingParameters::None) {
+                report_largest_partitions();
+            }
             string msg = "[IndexRegistry]: Exceeded disk use limit while generating k-mers. "
                          "Rewinding to pruning step with more aggressive pruning to simplify the graph.";
-            throw RewindPlanException(msg, pruned_graphs);
+            throw RewindPlanException(msg, pruned_graphs, prune_more_aggressively);
+        }
+        if (IndexingParameters::verbosity >= IndexingParameters::Debug) {
+            report_largest_partitions();
         }
         
         bool success = execute_in_fork([&]() {
@@ -3397,12 +3432,9 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
         if (!success) {
             // the indexing was not successful, presumably because of exponential disk explosion
             
-            // update pruning params
-            IndexingParameters::pruning_walk_length *= IndexingParameters::pruning_walk_length_increase_factor;
-            IndexingParameters::pruning_max_node_degree *= IndexingParameters::pruning_max_node_degree_decrease_factor;
             string msg = "[IndexRegistry]: Exceeded disk use limit while performing k-mer doubling steps. "
                          "Rewinding to pruning step with more aggressive pruning to simplify the graph.";
-            throw RewindPlanException(msg, pruned_graphs);
+            throw RewindPlanException(msg, pruned_graphs, prune_more_aggressively);
         }
         
         gcsa_names.push_back(gcsa_output_name);
@@ -3417,7 +3449,7 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
                                  const IndexGroup& constructing) {
         // execute meta recipe
         return construct_gcsa(inputs, plan, constructing);
-    });
+    }, true);
     
     registry.register_recipe({"GCSA", "LCP"}, {"Pruned VG"},
                              [construct_gcsa](const vector<const IndexFile*>& inputs,
@@ -3426,7 +3458,7 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
                                  const IndexGroup& constructing) {
         // execute meta recipe
         return construct_gcsa(inputs, plan, constructing);
-    });
+    }, true);
     
     registry.register_recipe({"Spliced GCSA", "Spliced LCP"}, {"Haplotype-Pruned Spliced VG", "Unfolded Spliced NodeMapping"},
                              [construct_gcsa](const vector<const IndexFile*>& inputs,
@@ -3435,7 +3467,7 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
                                  const IndexGroup& constructing) {
         // execute meta recipe
         return construct_gcsa(inputs, plan, constructing);
-    });
+    }, true);
     
     registry.register_recipe({"Spliced GCSA", "Spliced LCP"}, {"Pruned Spliced VG"},
                              [construct_gcsa](const vector<const IndexFile*>& inputs,
@@ -3444,7 +3476,7 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
                                  const IndexGroup& constructing) {
         // execute meta recipe
         return construct_gcsa(inputs, plan, constructing);
-    });
+    }, true);
     
     ////////////////////////////////////
     // Snarls Recipes
@@ -3599,6 +3631,65 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
         return make_distance_index(*graph, plan, constructing);
     });
     
+    ////////////////////////////////////
+    // MPMap Calibration Recipes
+    ////////////////////////////////////
+    
+    registry.register_recipe({"MPMap Calibration"},
+                             {"Spliced Distance Index", "Spliced GCSA", "Spliced LCP", "Spliced XG"},
+                             [](const vector<const IndexFile*>& inputs,
+                                const IndexingPlan* plan,
+                                AliasGraph& alias_graph,
+                                const IndexGroup& constructing) {
+        if (IndexingParameters::verbosity != IndexingParameters::None) {
+            cerr << "[IndexRegistry]: Calibrating mismapping detection for vg mpmap." << endl;
+        }
+        
+        assert(inputs.size() == 4);
+        for (auto input : inputs) {
+            assert(input->get_filenames().size() == 1);
+        }
+        auto dist_filename = inputs[0]->get_filenames().front();
+        auto gcsa_filename = inputs[1]->get_filenames().front();
+        auto lcp_filename = inputs[2]->get_filenames().front();
+        auto graph_filename = inputs[3]->get_filenames().front();
+        
+        assert(constructing.size() == 1);
+        vector<vector<string>> all_outputs(constructing.size());
+        auto calibration_output = *constructing.begin();
+        auto& output_names = all_outputs[0];
+        
+        ifstream infile_graph;
+        init_in(infile_graph, graph_filename);
+        unique_ptr<PathHandleGraph> graph = vg::io::VPKG::load_one<PathHandleGraph>(infile_graph);
+        bdsg::ReferencePathOverlayHelper overlay_helper;
+        PathPositionHandleGraph* path_position_graph = overlay_helper.apply(graph.get());
+        
+        auto gcsa_index = vg::io::VPKG::load_one<gcsa::GCSA>(gcsa_filename);
+        auto lcp_array = vg::io::VPKG::load_one<gcsa::LCPArray>(lcp_filename);
+        auto distance_index = vg::io::VPKG::load_one<SnarlDistanceIndex>(dist_filename);
+        
+        // set the mapper up the way vg mpmap does with its default options (we skip the
+        // MEMAccelerator, which only memoizes GCSA queries and doesn't change the results)
+        MultipathMapper mapper(path_position_graph, gcsa_index.get(), lcp_array.get(), nullptr, nullptr,
+                               distance_index.get());
+        MultipathMapperSettings settings;
+        settings.apply(mapper, path_position_graph->get_total_length());
+        mapper.do_spliced_alignment = false;
+        mapper.calibrate_mismapping_detection(settings.calibration_simulations, settings.calibration_read_lengths);
+        
+        // list the indexes in the same order that vg mpmap does in its key
+        string key = settings.calibration_key({graph_filename, gcsa_filename, lcp_filename, dist_filename});
+        
+        string output_name = plan->output_filepath(calibration_output);
+        ofstream outfile;
+        init_out(outfile, output_name);
+        mapper.save_mismapping_calibration(outfile, key);
+        
+        output_names.push_back(output_name);
+        return all_outputs;
+    });
+    
     ////////////////////////////////////
     // GBZ Recipes
     ////////////////////////////////////
@@ -3648,14 +3739,13 @@ IndexRegistry VGIndexes::get_vg_index_registry() {
             save_gbz(*gbwt_index, gbwt_graph, output_name, IndexingParameters::verbosity == IndexingParameters::Debug);
         });
         if (!success) {
-            IndexingParameters::gbwt_insert_batch_size *= IndexingParameters::gbwt_insert_batch_size_increase_factor;
             throw RewindPlanException("[IndexRegistry]: Exceeded GBWT insert buffer size, expanding and reattempting.",
-                                      {"Giraffe GBZ"});
+                                      {"Giraffe GBZ"}, increase_gbwt_insert_batch_size);
         }
         
         output_names.push_back(output_name);
         return all_outputs;
-    });
+    }, true);
 
     registry.register_recipe({"Giraffe GBZ"}, {"GBWTGraph", "Giraffe GBWT"},
                              [](const vector<const IndexFile*>& inputs,
@@ -3848,7 +3938,8 @@ vector<IndexName> VGIndexes::get_default_mpmap_indexes() {
         "Spliced XG",
         "Spliced Distance Index",
         "Spliced GCSA",
-        "Spliced LCP"
+        "Spliced LCP",
+        "MPMap Calibration"
     };
     return indexes;
 }
@@ -3881,7 +3972,7 @@ bool IndexingPlan::is_intermediate(const IndexName& identifier) const {
 }
 
 int64_t IndexingPlan::target_memory_usage() const {
-    return IndexingParameters::max_memory_proportion * registry->get_target_memory_usage();
+    return memory_share * IndexingParameters::max_memory_proportion * registry->get_target_memory_usage();
 }
     
 string IndexingPlan::output_filepath(const IndexName& identifier) const {
@@ -3943,7 +4034,7 @@ set<RecipeName> IndexingPlan::dependents(const IndexName& identifier) const {
 }
 
 IndexRegistry::~IndexRegistry() {
-    if (!work_dir.empty()) {
+    if (!work_dir.empty() && !checkpointing) {
         // Clean up our work directory with its temporary indexes.
         temp_file::remove(work_dir);
         work_dir.clear();
@@ -3956,7 +4047,8 @@ IndexRegistry::IndexRegistry(IndexRegistry&& other) :
     registered_suffixes(std::move(other.registered_suffixes)),
     work_dir(std::move(other.work_dir)),
     output_prefix(std::move(other.output_prefix)),
-    keep_intermediates(std::move(other.keep_intermediates)) {
+    keep_intermediates(std::move(other.keep_intermediates)),
+    checkpointing(std::move(other.checkpointing)) {
     
     // Make sure other doesn't delete our work dir when it goes away
     other.work_dir.clear();
@@ -3969,6 +4061,7 @@ IndexRegistry& IndexRegistry::operator=(IndexRegistry&& other) {
     work_dir = std::move(other.work_dir);
     output_prefix = std::move(other.output_prefix);
     keep_intermediates = std::move(other.keep_intermediates);
+    checkpointing = std::move(other.checkpointing);
     
     // Make sure other doesn't delete our work dir when it goes away
     other.work_dir.clear();
@@ -3988,6 +4081,132 @@ void IndexRegistry::set_intermediate_file_keeping(bool keep_intermediates) {
     this->keep_intermediates = keep_intermediates;
 }
 
+void IndexRegistry::set_checkpoint_directory(const string& directory) {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        cerr << "error:[IndexRegistry] Couldn't create checkpoint directory " << directory << endl;
+        exit(1);
+    }
+    if (!work_dir.empty() && !checkpointing) {
+        temp_file::remove(work_dir);
+    }
+    work_dir = directory;
+    checkpointing = true;
+}
+
+// the name of the manifest of completed indexes in a checkpoint directory
+static const string checkpoint_manifest_name = "checkpoint_manifest.tsv";
+
+// return the SHA1 of the contents of a file
+static string file_checksum(const string& filename) {
+    ifstream infile(filename, std::ios::binary);
+    SHA1 checksum;
+    vector<char> buffer(1 << 20);
+    while (infile) {
+        infile.read(buffer.data(), buffer.size());
+        checksum.update(string(buffer.data(), infile.gcount()));
+    }
+    return checksum.final();
+}
+
+// a line for the checkpoint manifest recording the files of a completed index
+static string checkpoint_record(const IndexName& identifier, const vector<string>& filenames) {
+    stringstream strm;
+    strm << identifier << "\t" << filenames.size();
+    for (const auto& filename : filenames) {
+        strm << "\t" << filename << "\t" << get_file_size(filename) << "\t" << file_checksum(filename);
+    }
+    return strm.str();
+}
+
+string IndexRegistry::checkpoint_fingerprint() const {
+    stringstream strm;
+    for (const auto& index : index_registry) {
+        if (index.second->was_provided_directly()) {
+            strm << index.first;
+            for (const auto& filename : index.second->get_filenames()) {
+                // the modification time catches inputs that were edited without changing size
+                struct stat file_stat;
+                time_t modified = stat(filename.c_str(), &file_stat) == 0 ? file_stat.st_mtime : 0;
+                strm << "\t" << filename << "\t" << get_file_size(filename) << "\t" << modified;
+            }
+            strm << "\n";
+        }
+    }
+    // the final indexes are named after the prefix, and intermediates can be aliased to them
+    strm << output_prefix << "\n";
+    // everything that changes the contents of the indexes (but not how they're computed)
+    strm << IndexingParameters::mut_graph_impl << " " << IndexingParameters::max_node_size
+         << " " << IndexingParameters::pruning_max_node_degree << " " << IndexingParameters::pruning_walk_length
+         << " " << IndexingParameters::pruning_max_edge_count << " " << IndexingParameters::pruning_min_component_size
+         << " " << IndexingParameters::gcsa_initial_kmer_length << " " << IndexingParameters::gcsa_doubling_steps
+         << " " << IndexingParameters::gbwt_sampling_interval << " " << IndexingParameters::bidirectional_haplo_tx_gbwt
+         << " " << IndexingParameters::gff_feature_name << " " << IndexingParameters::gff_transcript_tag
+         << " " << IndexingParameters::use_bounded_syncmers << " " << IndexingParameters::minimizer_k
+         << " " << IndexingParameters::minimizer_w << " " << IndexingParameters::minimizer_s
+         << " " << IndexingParameters::path_cover_depth << " " << IndexingParameters::giraffe_gbwt_downsample
+         << " " << IndexingParameters::downsample_context_length << " " << IndexingParameters::downsample_threshold;
+    return sha1sum(strm.str());
+}
+
+map<IndexName, vector<string>> IndexRegistry::read_checkpoint_manifest(const string& fingerprint,
+                                                                        map<IndexName, string>* records) const {
+    
+    map<IndexName, vector<string>> checkpointed;
+    
+    ifstream infile(work_dir + "/" + checkpoint_manifest_name);
+    string line;
+    if (!infile || !getline(infile, line) || line != "#fingerprint\t" + fingerprint) {
+        // there's nothing from this set of inputs
+        return checkpointed;
+    }
+    
+    while (getline(infile, line)) {
+        // an interrupted write can leave a truncated line, which we'll just ignore
+        auto fields = split_delims(line, "\t");
+        if (fields.size() < 2 || !index_registry.count(fields[0])) {
+            continue;
+        }
+        size_t num_files = parse<size_t>(fields[1]);
+        if (fields.size() != 2 + 3 * num_files) {
+            continue;
+        }
+        vector<string> filenames;
+        for (size_t i = 0; i < num_files; ++i) {
+            const auto& filename = fields[2 + 3 * i];
+            if (get_file_size(filename) != parse<int64_t>(fields[3 + 3 * i]) ||
+                file_checksum(filename) != fields[4 + 3 * i]) {
+                // the file has been changed or removed since it was recorded
+                break;
+            }
+            filenames.push_back(filename);
+        }
+        if (filenames.size() == num_files) {
+            // later records supersede earlier ones (e.g. after a rewind)
+            checkpointed[fields[0]] = move(filenames);
+            if (records) {
+                (*records)[fields[0]] = line;
+            }
+        }
+        else {
+            checkpointed.erase(fields[0]);
+            if (records) {
+                records->erase(fields[0]);
+            }
+        }
+    }
+    return checkpointed;
+}
+
+// does an index appear in both groups?
+static bool groups_intersect(const IndexGroup& a, const IndexGroup& b) {
+    for (const auto& index : a) {
+        if (b.count(index)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void IndexRegistry::make_indexes(const vector<IndexName>& identifiers) {
     
     // figure out the best plan to make the objectives from the inputs
@@ -3997,64 +4216,297 @@ void IndexRegistry::make_indexes(const vector<IndexName>& identifiers) {
     // to keep track of which indexes are aliases of others
     AliasGraph alias_graph;
     
-    list<RecipeName> steps_remaining(plan.get_steps().begin(), plan.get_steps().end());
-    list<RecipeName> steps_completed;
+    const auto& steps = plan.get_steps();
+    
+    // a step has to wait for the earlier steps that create the indexes it uses, and for
+    // the earlier steps that use or create the indexes it creates. anything else can
+    // execute concurrently
+    vector<vector<size_t>> prerequisites(steps.size());
+    vector<IndexGroup> step_inputs(steps.size());
+    map<RecipeName, size_t> step_number;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        step_inputs[i] = get_recipe(steps[i]).input_group();
+        step_number[steps[i]] = i;
+        for (size_t j = 0; j < i; ++j) {
+            if (groups_intersect(steps[j].first, step_inputs[i]) ||
+                groups_intersect(steps[j].first, steps[i].first) ||
+                groups_intersect(step_inputs[j], steps[i].first)) {
+                prerequisites[i].push_back(j);
+            }
+        }
+    }
+    
+    enum StepState {Waiting, Running, Completed};
+    vector<StepState> step_states(steps.size(), Waiting);
+    size_t num_completed = 0;
+    size_t num_running = 0;
+    
+    // the indexes that are completed get recorded here as we go
+    ofstream manifest;
+    if (checkpointing) {
+        string fingerprint = checkpoint_fingerprint();
+        map<IndexName, string> records;
+        auto checkpointed = read_checkpoint_manifest(fingerprint, &records);
+        
+        // start the manifest over with just the records of the steps we reuse, which we
+        // have already validated
+        init_out(manifest, work_dir + "/" + checkpoint_manifest_name);
+        manifest << "#fingerprint\t" << fingerprint << endl;
+        
+        // skip the steps whose outputs were completed by an earlier attempt, as long as
+        // the steps that they depended on were skipped too
+        for (size_t i = 0; i < steps.size(); ++i) {
+            bool reusable = true;
+            for (size_t j : prerequisites[i]) {
+                reusable = reusable && step_states[j] == Completed;
+            }
+            for (const auto& index_name : steps[i].first) {
+                reusable = reusable && (get_index(index_name)->was_provided_directly() || checkpointed.count(index_name));
+            }
+            if (!reusable) {
+                continue;
+            }
+            for (const auto& index_name : steps[i].first) {
+                auto index = get_index(index_name);
+                if (!index->was_provided_directly()) {
+                    index->assign_constructed(checkpointed.at(index_name));
+                    manifest << records.at(index_name) << endl;
+                }
+            }
+            if (IndexingParameters::verbosity != IndexingParameters::None) {
+                cerr << "[IndexRegistry]: Reusing " << to_string(steps[i].first) << " from checkpoint." << endl;
+            }
+            step_states[i] = Completed;
+            ++num_completed;
+        }
+    }
+    
+    // the threads that aren't being used by a running recipe, which also ration the memory
+    int num_threads = get_thread_count();
+    int free_threads = num_threads;
+    
+    // the recipes report back to the executor through these
+    struct StepOutcome {
+        size_t step;
+        vector<vector<string>> results;
+        unique_ptr<IndexGroup> rewind_to;
+        function<void(void)> update_parameters;
+        exception_ptr error;
+        vector<string> manifest_records;
+    };
+    mutex executor_mutex;
+    condition_variable executor_cv;
+    vector<StepOutcome> outcomes;
+    vector<thread> workers;
+    
+    // where we are in the timeline of each running step
+    vector<size_t> timeline_entry(steps.size());
+    timeline.clear();
+    auto start_time = chrono::steady_clock::now();
+    auto seconds_elapsed = [&]() {
+        return chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    };
+    
+    // rewinds (and their parameter updates) that are waiting for the running recipes to finish
+    vector<IndexGroup> rewinds;
+    vector<function<void(void)>> parameter_updates;
+    exception_ptr error;
+    
+    unique_lock<mutex> lock(executor_mutex);
     
     // execute the plan
-    while (!steps_remaining.empty()) {
-        // get the next step
-        auto step = move(steps_remaining.front());
-        steps_remaining.pop_front();
-        steps_completed.push_back(step);
+    while (num_completed < steps.size()) {
         
-        // do the recipe
-        try {
-            auto recipe_results = execute_recipe(step, &plan, alias_graph);
+        if (rewinds.empty() && !error) {
+            // find the steps that are ready to go
+            vector<pair<int64_t, size_t>> ready;
+            for (size_t i = 0; i < steps.size(); ++i) {
+                if (step_states[i] != Waiting) {
+                    continue;
+                }
+                bool is_ready = true;
+                for (size_t j : prerequisites[i]) {
+                    if (step_states[j] != Completed) {
+                        is_ready = false;
+                        break;
+                    }
+                }
+                if (is_ready) {
+                    // as in JobSchedule, use the size of the inputs to estimate the time
+                    int64_t approx_time = 0;
+                    for (auto input : get_recipe(steps[i]).inputs) {
+                        for (const auto& filename : input->get_filenames()) {
+                            approx_time += max<int64_t>(get_file_size(filename), 0);
+                        }
+                    }
+                    ready.emplace_back(-approx_time, i);
+                }
+            }
+            // the longest steps go first, and otherwise we keep the plan's order
+            sort(ready.begin(), ready.end());
             
-            // the recipe executed successfully
-            assert(recipe_results.size() == step.first.size());
+            // a recipe that forks can only execute when nothing else is, since the other threads
+            // could be holding locks that the child process would inherit. it takes all of the
+            // threads so that nothing else can start until it's finished
+            if (num_running == 0) {
+                for (size_t k = 0; k < ready.size(); ++k) {
+                    if (get_recipe(steps[ready[k].second]).forks) {
+                        ready = vector<pair<int64_t, size_t>>(1, ready[k]);
+                        break;
+                    }
+                }
+            }
+            else {
+                ready.erase(remove_if(ready.begin(), ready.end(), [&](const pair<int64_t, size_t>& step) {
+                    return get_recipe(steps[step.second]).forks;
+                }), ready.end());
+            }
             
-            // record the results
-            auto it = step.first.begin();
-            for (const auto& results : recipe_results) {
-                auto index = get_index(*it);
-                // don't overwrite directly-provided inputs
-                if (!index->was_provided_directly()) {
-                    // and assign the new (or first) ones
-                    index->assign_constructed(results);
+            // split the free threads and their share of the memory between the ready steps
+            for (size_t k = 0; k < ready.size() && free_threads > 0; ++k) {
+                size_t i = ready[k].second;
+                int step_threads = max<int>(1, free_threads / (ready.size() - k));
+                free_threads -= step_threads;
+                
+                timeline_entry[i] = timeline.size();
+                timeline.emplace_back();
+                auto& execution = timeline.back();
+                execution.recipe = steps[i];
+                execution.start = seconds_elapsed();
+                execution.threads = step_threads;
+                
+                // the recipe learns its memory budget from its copy of the plan
+                IndexingPlan step_plan = plan;
+                step_plan.memory_share = double(step_threads) / num_threads;
+                execution.memory = step_plan.target_memory_usage();
+                
+                if (IndexingParameters::verbosity >= IndexingParameters::Debug) {
+                    cerr << "[IndexRegistry]: Starting recipe " << steps[i].second << " for " << to_string(steps[i].first)
+                         << " with " << step_threads << " thread(s) and " << execution.memory << " bytes of memory." << endl;
                 }
-                ++it;
+                
+                step_states[i] = Running;
+                ++num_running;
+                workers.emplace_back([&, i, step_threads, step_plan]() {
+                    omp_set_num_threads(step_threads);
+                    StepOutcome outcome;
+                    outcome.step = i;
+                    try {
+                        outcome.results = execute_recipe(steps[i], &step_plan, alias_graph);
+                        if (checkpointing) {
+                            // checksum the results here rather than holding up the executor
+                            auto it = steps[i].first.begin();
+                            for (const auto& results : outcome.results) {
+                                if (!get_index(*it)->was_provided_directly()) {
+                                    outcome.manifest_records.push_back(checkpoint_record(*it, results));
+                                }
+                                ++it;
+                            }
+                        }
+                    }
+                    catch (RewindPlanException& ex) {
+                        // the recipe failed, but we can rewind and retry following the recipe with
+                        // modified parameters (which the executor sets once the other recipes are done)
+                        if (IndexingParameters::verbosity != IndexingParameters::None) {
+                            cerr << ex.what() << endl;
+                        }
+                        outcome.rewind_to.reset(new IndexGroup(ex.get_indexes()));
+                        outcome.update_parameters = ex.get_parameter_update();
+                    }
+                    catch (...) {
+                        outcome.error = current_exception();
+                    }
+                    lock_guard<mutex> outcome_lock(executor_mutex);
+                    outcomes.emplace_back(move(outcome));
+                    executor_cv.notify_one();
+                });
             }
         }
-        catch (RewindPlanException& ex) {
-            
-            // the recipe failed, but we can rewind and retry following the recipe with
-            // modified parameters (which should have been set by the exception-throwing code)
-            if (IndexingParameters::verbosity != IndexingParameters::None) {
-                cerr << ex.what() << endl;
-            }
-            // gather the recipes we're going to need to re-attempt
-            const auto& rewinding_indexes = ex.get_indexes();
-            set<RecipeName> dependent_recipes;
-            for (const auto& index_name : rewinding_indexes) {
-                assert(index_registry.count(index_name));
-                for (const auto& recipe : plan.dependents(index_name)) {
-                    dependent_recipes.insert(recipe);
+        
+        if (num_running == 0) {
+            if (error) {
+                for (auto& worker : workers) {
+                    worker.join();
                 }
+                rethrow_exception(error);
+            }
+            // nothing is executing anymore, so it's safe to change the parameters and rewind
+            for (const auto& update_parameters : parameter_updates) {
+                update_parameters();
             }
+            parameter_updates.clear();
+            for (const auto& rewinding_indexes : rewinds) {
+                // gather the recipes we're going to need to re-attempt
+                for (const auto& index_name : rewinding_indexes) {
+                    assert(index_registry.count(index_name));
+                    for (const auto& recipe : plan.dependents(index_name)) {
+                        size_t i = step_number.at(recipe);
+                        if (step_states[i] == Completed) {
+                            step_states[i] = Waiting;
+                            --num_completed;
+                        }
+                    }
+                }
+            }
+            rewinds.clear();
+            continue;
+        }
+        
+        // wait for something to finish
+        executor_cv.wait(lock, [&]() { return !outcomes.empty(); });
+        
+        for (auto& outcome : outcomes) {
+            size_t i = outcome.step;
+            auto& execution = timeline[timeline_entry[i]];
+            execution.end = seconds_elapsed();
+            free_threads += execution.threads;
+            --num_running;
             
-            // move rewound steps back onto the queue
-            vector<list<RecipeName>::iterator> to_move;
-            for (auto it = steps_completed.rbegin(); it != steps_completed.rend(); ++it) {
-                if (dependent_recipes.count(*it)) {
-                    to_move.push_back(--it.base());
+            if (outcome.error) {
+                step_states[i] = Waiting;
+                error = outcome.error;
+            }
+            else if (outcome.rewind_to) {
+                step_states[i] = Waiting;
+                execution.rewound = true;
+                rewinds.emplace_back(move(*outcome.rewind_to));
+                if (outcome.update_parameters) {
+                    parameter_updates.emplace_back(move(outcome.update_parameters));
                 }
             }
-            for (auto& it : to_move) {
-                steps_remaining.emplace_front(*it);
-                steps_completed.erase(it);
+            else {
+                // the recipe executed successfully
+                assert(outcome.results.size() == steps[i].first.size());
+                
+                // record the results
+                auto it = steps[i].first.begin();
+                for (const auto& results : outcome.results) {
+                    auto index = get_index(*it);
+                    // don't overwrite directly-provided inputs
+                    if (!index->was_provided_directly()) {
+                        // and assign the new (or first) ones
+                        index->assign_constructed(results);
+                    }
+                    ++it;
+                }
+                for (const auto& record : outcome.manifest_records) {
+                    // flush so that the record survives if we're killed
+                    manifest << record << endl;
+                }
+                step_states[i] = Completed;
+                ++num_completed;
             }
         }
+        outcomes.clear();
+    }
+    lock.unlock();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    
+    if (IndexingParameters::verbosity >= IndexingParameters::Debug) {
+        cerr << "[IndexRegistry]: Recipe timeline:" << endl;
+        write_timeline(cerr);
     }
 #ifdef debug_index_registry
     cerr << "finished executing recipes, resolving aliases" << endl;
@@ -4074,10 +4526,12 @@ void IndexRegistry::make_indexes(const vector<IndexName>& identifiers) {
 #endif
         
         // if the index is itself non-intermediate, it will be in the list of aliases.
-        // otherwise, we can alias one index by moving instead of copying
+        // otherwise, we can alias one index by moving instead of copying, unless it
+        // needs to stay in the checkpoint directory to be reused
         auto f = find(aliasors.begin(), aliasors.end(), aliasee);
-        bool can_move = f == aliasors.end() && !get_index(aliasee)->was_provided_directly();
-        if (!can_move) {
+        bool is_aliasor = f != aliasors.end();
+        bool can_move = !is_aliasor && !get_index(aliasee)->was_provided_directly() && !checkpointing;
+        if (is_aliasor) {
             // just remove the "alias" so we don't need to deal with it
             std::swap(*f, aliasors.back());
             aliasors.pop_back();
@@ -4111,6 +4565,19 @@ void IndexRegistry::make_indexes(const vector<IndexName>& identifiers) {
     // different set of indexes, you will need to call reset() yourself.
 }
 
+const vector<RecipeExecution>& IndexRegistry::get_timeline() const {
+    return timeline;
+}
+
+void IndexRegistry::write_timeline(ostream& out) const {
+    out << "#recipe\tpriority\tstart\tend\tthreads\tmemory\toutcome" << endl;
+    for (const auto& execution : timeline) {
+        out << to_string(execution.recipe.first) << "\t" << execution.recipe.second << "\t"
+            << execution.start << "\t" << execution.end << "\t" << execution.threads << "\t"
+            << execution.memory << "\t" << (execution.rewound ? "rewound" : "completed") << endl;
+    }
+}
+
 void IndexRegistry::register_index(const IndexName& identifier, const string& suffix) {
     // Add this index to the registry
     if (identifier.empty()) {
@@ -4208,7 +4675,8 @@ vector<IndexName> IndexRegistry::completed_indexes() const {
 
 RecipeName IndexRegistry::register_recipe(const vector<IndexName>& identifiers,
                                           const vector<IndexName>& input_identifiers,
-                                          const RecipeFunc& exec) {
+                                          const RecipeFunc& exec,
+                                          bool forks) {
     
     for (const IndexName& identifier : identifiers) {
         if (!index_registry.count(identifier)) {
@@ -4269,7 +4737,7 @@ RecipeName IndexRegistry::register_recipe(const vector<IndexName>& identifiers,
 #endif
     
     bool first_group_entry = !recipe_registry.count(output_group);
-    recipe_registry[output_group].emplace_back(inputs, exec);
+    recipe_registry[output_group].emplace_back(inputs, exec, forks);
     RecipeName name(output_group, recipe_registry[output_group].size() - 1);
         
     if (output_group.size() > 1 && first_group_entry) {
@@ -4346,6 +4814,9 @@ void IndexRegistry::reset() {
 }
 
 string IndexRegistry::get_work_dir() {
+    // recipes executing concurrently can all ask for it
+    static mutex work_dir_mutex;
+    lock_guard<mutex> lock(work_dir_mutex);
     if (work_dir.empty()) {
         // Ensure the directory exists
         work_dir = temp_file::create_directory();
@@ -5117,8 +5588,8 @@ void IndexFile::reset() {
 }
 
 IndexRecipe::IndexRecipe(const vector<const IndexFile*>& inputs,
-                         const RecipeFunc& exec) :
-    exec(exec), inputs(inputs)
+                         const RecipeFunc& exec, bool forks) :
+    exec(exec), inputs(inputs), forks(forks)
 {
     // nothing more to do
 }
@@ -5138,6 +5609,7 @@ IndexGroup IndexRecipe::input_group() const {
 
 void AliasGraph::register_alias(const IndexName& aliasor, const IndexFile* aliasee) {
     assert(aliasee->get_identifier() != aliasor);
+    lock_guard<mutex> lock(graph_mutex);
     graph[aliasee->get_identifier()].emplace_back(aliasor);
 }
 
@@ -5230,7 +5702,9 @@ const char* InsufficientInputException::what() const noexcept {
 }
 
 
-RewindPlanException::RewindPlanException(const string& msg, const IndexGroup& rewind_to) noexcept : msg(msg), indexes(rewind_to) {
+RewindPlanException::RewindPlanException(const string& msg, const IndexGroup& rewind_to,
+                                         const function<void(void)>& update_parameters) noexcept :
+    msg(msg), indexes(rewind_to), update_parameters(update_parameters) {
     // nothing else to do
 }
 
@@ -5242,5 +5716,9 @@ const IndexGroup& RewindPlanException::get_indexes() const noexcept {
     return indexes;
 }
 
+const function<void(void)>& RewindPlanException::get_parameter_update() const noexcept {
+    return update_parameters;
+}
+
 }
 
@@ -9,8 +9,10 @@
 #include <functional>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <limits>
+#include <ostream>
 
 namespace vg {
 
@@ -49,6 +51,23 @@ using RecipeFunc = function<vector<vector<string>>(const vector<const IndexFile*
                                                    AliasGraph&,
                                                    const IndexGroup&)>;
 
+/**
+ * A record of one attempt to execute a recipe in IndexRegistry::make_indexes
+ */
+struct RecipeExecution {
+    /// the recipe that was executed
+    RecipeName recipe;
+    /// when it started and ended, in seconds since make_indexes was called
+    double start = 0.0;
+    double end = 0.0;
+    /// the number of threads it was given
+    int threads = 0;
+    /// the memory budget it was given, in bytes
+    int64_t memory = 0;
+    /// did it throw a RewindPlanException so that it had to be reattempted
+    bool rewound = false;
+};
+
 /**
  * A struct namespace for global handling of parameters used by
  * the IndexRegistry
@@ -161,6 +180,8 @@ public:
     bool is_intermediate(const IndexName& identifier) const;
     
     /// TODO: is this where this function wants to live?
+    /// Recipes that run concurrently with other recipes only get a share of the
+    /// target, which this accounts for.
     int64_t target_memory_usage() const;
     
     /// Returns the recipes in the plan that depend on this index, including the one in which
@@ -174,6 +195,9 @@ protected:
     vector<RecipeName> steps;
     /// The indexes to create as outputs.
     set<IndexName> targets;
+    /// The proportion of the memory target that the recipe executing with this
+    /// copy of the plan may use
+    double memory_share = 1.0;
     
     /// The registry that the plan is using.
     /// The registry must not move while the plan is in use.
@@ -219,14 +243,23 @@ public:
     /// or the temp directory?
     void set_intermediate_file_keeping(bool keep_intermediates);
     
+    /// Keep intermediate files in this directory instead of a temporary one, along
+    /// with a manifest of the indexes that have been completed. If make_indexes is
+    /// interrupted, calling it again with the same directory and inputs will reuse
+    /// the completed indexes instead of remaking them. The directory is not removed.
+    void set_checkpoint_directory(const string& directory);
+    
     /// Register an index containing the given identifier
     void register_index(const IndexName& identifier, const string& suffix);
     
     /// Register a recipe to produce an index using other indexes
     /// or input files. Recipes registered earlier will have higher priority.
+    /// Recipes that fork child processes must say so, because they cannot
+    /// execute concurrently with other recipes.
     RecipeName register_recipe(const vector<IndexName>& identifiers,
                                const vector<IndexName>& input_identifiers,
-                               const RecipeFunc& exec);
+                               const RecipeFunc& exec,
+                               bool forks = false);
                         
     /// Indicate one recipe is a broadened version of another. The indexes consumed and produced
     /// by the generalization must be semantically identical to those of the generalizee
@@ -265,6 +298,13 @@ public:
     /// When completed, all requested index files will be available via require().
     void make_indexes(const vector<IndexName>& identifiers);
     
+    /// Get the recipes that were executed by the last call to make_indexes, in the
+    /// order that they started
+    const vector<RecipeExecution>& get_timeline() const;
+    
+    /// Write the timeline of the last call to make_indexes as a table
+    void write_timeline(ostream& out) const;
+    
     /// Returns the recipe graph in dot format
     string to_dot() const;
     
@@ -309,6 +349,15 @@ protected:
     /// Function to get and/or initialize the temporary directory in which indexes will live
     string get_work_dir();
     
+    /// Summarize the provided inputs and the parameters, which must match for
+    /// checkpointed indexes to be reused
+    string checkpoint_fingerprint() const;
+    
+    /// Get the indexes recorded in the checkpoint manifest under this fingerprint whose
+    /// files are still intact, and optionally the manifest lines that recorded them
+    map<IndexName, vector<string>> read_checkpoint_manifest(const string& fingerprint,
+                                                            map<IndexName, string>* records = nullptr) const;
+    
     /// The storage struct for named indexes. Ordered so it is easier to key on index names.
     map<IndexName, unique_ptr<IndexFile>> index_registry;
     
@@ -330,8 +379,14 @@ protected:
     /// should intermediate files end up in the scratch or the output directory?
     bool keep_intermediates = false;
     
+    /// is the work directory a checkpoint directory that should outlive us?
+    bool checkpointing = false;
+    
     /// the max memory we will *attempt* to use
     int64_t target_memory_usage = numeric_limits<int64_t>::max();
+    
+    /// the recipes executed by the last plan
+    vector<RecipeExecution> timeline;
 };
 
 /**
@@ -387,13 +442,15 @@ private:
  */
 struct IndexRecipe {
     IndexRecipe(const vector<const IndexFile*>& inputs,
-                const RecipeFunc& exec);
+                const RecipeFunc& exec, bool forks = false);
     // execute the recipe and return the filename(s) of the indexes created
     vector<vector<string>> execute(const IndexingPlan* plan, AliasGraph& alias_graph,
                                    const IndexGroup& constructing) const;
     IndexGroup input_group() const;
     vector<const IndexFile*> inputs;
     RecipeFunc exec;
+    // does the recipe fork child processes
+    bool forks;
 };
 
 /**
@@ -418,6 +475,9 @@ private:
     // graph aliasees to their aliasors
     unordered_map<IndexName, vector<IndexName>> graph;
     
+    // recipes that are executing concurrently may register aliases at the same time
+    mutex graph_mutex;
+    
 };
 
 
@@ -445,16 +505,21 @@ class RewindPlanException : public std::exception {
 public:
     
     RewindPlanException() = delete;
-    RewindPlanException(const string& msg, const IndexGroup& rewind_to) noexcept;
+    /// The update to the IndexingParameters for the next attempt is made by the executor
+    /// once no other recipes are executing, so that it doesn't race with them
+    RewindPlanException(const string& msg, const IndexGroup& rewind_to,
+                        const function<void(void)>& update_parameters = nullptr) noexcept;
     ~RewindPlanException() noexcept = default;
     
     const char* what() const noexcept;
     const IndexGroup& get_indexes() const noexcept;
+    const function<void(void)>& get_parameter_update() const noexcept;
     
 private:
     
     const string msg;
     IndexGroup indexes;
+    function<void(void)> update_parameters;
     
 };
 
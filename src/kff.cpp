@@ -1,5 +1,8 @@
 #include "kff.hpp"
 
+#include <algorithm>
+#include <limits>
+
 namespace vg {
 
 //------------------------------------------------------------------------------
@@ -222,6 +225,59 @@ gbwtgraph::Key64::value_type minimizer_reverse_complement(gbwtgraph::Key64::valu
 
 //------------------------------------------------------------------------------
 
+void kff_write_counts(const std::string& filename, size_t k,
+    const std::vector<std::pair<gbwtgraph::Key64::value_type, size_t>>& counts) {
+
+    constexpr size_t DATA_BYTES = 4;
+    std::uint8_t encoding[4] = { 0, 1, 2, 3 };
+
+    // The file is canonical, so we store the smaller of each kmer and its
+    // reverse complement. If both orientations are present, merge the counts.
+    std::vector<std::pair<gbwtgraph::Key64::value_type, size_t>> canonical;
+    canonical.reserve(counts.size());
+    for (auto& kmer : counts) {
+        canonical.emplace_back(std::min(kmer.first, minimizer_reverse_complement(kmer.first, k)), kmer.second);
+    }
+    std::sort(canonical.begin(), canonical.end());
+    size_t tail = 0;
+    for (size_t i = 0; i < canonical.size(); i++) {
+        if (tail > 0 && canonical[tail - 1].first == canonical[i].first) {
+            canonical[tail - 1].second += canonical[i].second;
+        } else {
+            canonical[tail++] = canonical[i];
+        }
+    }
+    canonical.resize(tail);
+
+    Kff_file file(filename, "w");
+    file.write_encoding(encoding);
+    file.set_uniqueness(true);
+    file.set_canonicity(true);
+    file.write_metadata(0, nullptr);
+
+    Section_GV variables(&file);
+    variables.write_var("k", k);
+    variables.write_var("max", 1);
+    variables.write_var("data_size", DATA_BYTES);
+    variables.close();
+
+    Section_Raw section(&file);
+    for (auto& kmer : canonical) {
+        std::vector<uint8_t> encoded = kff_recode(kmer.first, k, encoding);
+        size_t count = std::min<size_t>(kmer.second, std::numeric_limits<std::uint32_t>::max());
+        uint8_t data[DATA_BYTES];
+        for (size_t i = 0; i < DATA_BYTES; i++) {
+            data[DATA_BYTES - 1 - i] = (count >> (8 * i)) & 0xFF;
+        }
+        section.write_compacted_sequence(encoded.data(), k, data);
+    }
+    section.close();
+
+    file.close();
+}
+
+//------------------------------------------------------------------------------
+
 ParallelKFFReader::ParallelKFFReader(const std::string& filename) :
     reader(filename)
 {
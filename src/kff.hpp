@@ -74,6 +74,18 @@ gbwtgraph::Key64::value_type minimizer_reverse_complement(gbwtgraph::Key64::valu
 
 //------------------------------------------------------------------------------
 
+/// Writes the given kmers in the minimizer index format and their counts to a
+/// new KFF file, with the trivial encoding and one kmer per block. Counts are
+/// stored in 4 bytes, saturating at the maximum.
+///
+/// The file is marked canonical, so each kmer is written as the smaller of
+/// itself and its reverse complement, and the counts of a kmer and its reverse
+/// complement are merged if both are given.
+void kff_write_counts(const std::string& filename, size_t k,
+    const std::vector<std::pair<gbwtgraph::Key64::value_type, size_t>>& counts);
+
+//------------------------------------------------------------------------------
+
 /**
  * A wrapper over `Kff_reader` that allows reading kmers safely from multiple threads.
  */
@@ -1,6 +1,7 @@
 #include "kmer.hpp"
 
 #include <atomic>
+#include <algorithm>
 
 //#define debug
 
@@ -13,16 +14,17 @@ const char* SizeLimitExceededException::what() const throw() {
     return msg.c_str();
 }
 
-void for_each_kmer(const HandleGraph& graph, size_t k,
-                   const function<void(const kmer_t&)>& lambda,
-                   id_t head_id, id_t tail_id, atomic<int>* stop_flag) {
+// enumerate the kmers that start on the handles visited by for_each_start
+static void for_each_kmer_starting_on(const HandleGraph& graph, size_t k,
+                                      const function<void(const kmer_t&)>& lambda,
+                                      id_t head_id, id_t tail_id, atomic<int>* stop_flag,
+                                      const function<void(const function<bool(const handle_t&)>&)>& for_each_start) {
     // for each position on the forward and reverse of the graph
-    // TODO -- add parallel interface in handlegraph
     bool using_head_tail = head_id + tail_id > 0;
 #ifdef debug
     cerr << "Looping over kmers" << endl;
 #endif
-    graph.for_each_handle([&](const handle_t& h) {
+    for_each_start([&](const handle_t& h) {
 #ifdef debug
         cerr << "Process handle " << graph.get_id(h) << endl;
 #endif
@@ -217,7 +219,16 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
             // always keep going
             return true;
         }
-    }, true);
+    });
+}
+
+void for_each_kmer(const HandleGraph& graph, size_t k,
+                   const function<void(const kmer_t&)>& lambda,
+                   id_t head_id, id_t tail_id, atomic<int>* stop_flag) {
+    for_each_kmer_starting_on(graph, k, lambda, head_id, tail_id, stop_flag,
+                              [&](const function<bool(const handle_t&)>& iteratee) {
+        graph.for_each_handle(iteratee, true);
+    });
 }
 
 ostream& operator<<(ostream& out, const kmer_t& kmer) {
@@ -269,79 +280,169 @@ gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& al
     return val;
 }
 
-void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id) {
+const size_t default_kmer_partition_size = 1 << 14;
+const size_t default_kmer_run_size = 1 << 20;
+
+void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id,
+                      vector<KmerPartitionCount>* partition_counts, size_t partition_size, size_t run_size) {
 
     // We need an alphabet to parse the internal string format
     const gcsa::Alphabet alpha;
-    // Each thread is going to make its own KMers, then we'll concatenate these all together at the end.
-    vector<vector<gcsa::KMer> > thread_outputs;
-#pragma omp parallel
-    {
-#pragma omp single
-        {
-            // Set up our write buffers at the given parallelism we expect
-            thread_outputs.resize(omp_get_num_threads());
-        }
-    }
+    
+    // Partition the graph into ranges of node IDs. Each thread takes a partition at a time, enumerates the
+    // kmers that start on it, and writes them out as sorted and deduplicated runs. A partition that turns
+    // out to have a lot of kmers hands half of its remaining nodes off to another thread.
+    vector<id_t> node_ids;
+    node_ids.reserve(graph.get_node_count());
+    graph.for_each_handle([&](const handle_t& handle) {
+        node_ids.push_back(graph.get_id(handle));
+    });
+    sort(node_ids.begin(), node_ids.end());
+    partition_size = max<size_t>(partition_size, 1);
+    run_size = max<size_t>(run_size, 1);
+    size_t num_partitions = (node_ids.size() + partition_size - 1) / partition_size;
+    vector<KmerPartitionCount> counts;
     
     // we can't throw from within an OMP block, so instead we have to use some machinery to flag when
     // we need to throw
     atomic<int> size_limit_exceeded(0);
     
-    // This handles the buffered writing for each thread
-    size_t buffer_limit = 1e5; // max 100k kmers per buffer
-    size_t total_bytes = 0;
-    auto handle_kmers = [&](vector<gcsa::KMer>& kmers, bool more) {
-        if (!more || kmers.size() > buffer_limit) {
-            size_t bytes_required = kmers.size() * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader);
-#pragma omp critical
-            {
-                if (!size_limit_exceeded.load()) {
-                    // we didn't exceed the size limit while waiting for the critical block
-                    if (total_bytes + bytes_required > size_limit) {
-                        cerr << "error: [write_gcsa_kmers()] size limit of " << size_limit << " bytes exceeded" << endl;
-                        size_limit_exceeded.store(1);
-                    }
-                    else {
-                        gcsa::writeBinary(out, kmers, kmer_size);
-                        total_bytes += bytes_required;
-                    }
+    // bytes that have been claimed by a run, whether or not it's been written yet
+    atomic<size_t> total_bytes(0);
+    auto run_bytes = [](size_t num_kmers) {
+        return num_kmers * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader);
+    };
+    
+    // sort and deduplicate a run, then write it if it fits in the size limit
+    auto write_run = [&](vector<gcsa::KMer>& kmers, KmerPartitionCount& count) {
+        sort(kmers.begin(), kmers.end(), [](const gcsa::KMer& a, const gcsa::KMer& b) {
+            return (a.key < b.key || (a.key == b.key && (a.from < b.from || (a.from == b.from && a.to < b.to))));
+        });
+        kmers.resize(unique(kmers.begin(), kmers.end(), [](const gcsa::KMer& a, const gcsa::KMer& b) {
+            return a.key == b.key && a.from == b.from && a.to == b.to;
+        }) - kmers.begin());
+        
+        size_t bytes_required = run_bytes(kmers.size());
+        if (total_bytes.fetch_add(bytes_required) + bytes_required > size_limit) {
+            size_limit_exceeded.store(1);
+        }
+        else {
+#pragma omp critical (write_gcsa_kmers)
+            gcsa::writeBinary(out, kmers, kmer_size);
+        }
+        count.kmer_count += kmers.size();
+        kmers.clear();
+    };
+    
+    // enumerate the kmers that start on the nodes in a range of indexes in node_ids
+    function<void(size_t, size_t)> do_partition = [&](size_t begin, size_t end) {
+        if (size_limit_exceeded.load()) {
+            return;
+        }
+        KmerPartitionCount count;
+        count.first_id = node_ids[begin];
+        
+        vector<gcsa::KMer> kmers;
+        auto convert_kmer = [&](const kmer_t& kmer) {
+            // Convert this KmerPosition to several gcsa::KMers
+            kmer_to_gcsa_kmers(kmer, alpha, [&kmers](const gcsa::KMer& k) { kmers.push_back(k); });
+            if (total_bytes.load() + run_bytes(kmers.size()) > size_limit) {
+                // this region alone would go over the limit, so don't wait until we're done with it to stop
+                size_limit_exceeded.store(1);
+            }
+            else if (kmers.size() >= run_size) {
+                // keep the memory bounded in regions that explode
+                write_run(kmers, count);
+            }
+        };
+        size_t next = begin;
+        size_t split_at = run_size;
+        for_each_kmer_starting_on(graph, kmer_size, convert_kmer, head_id, tail_id, &size_limit_exceeded,
+                                  [&](const function<bool(const handle_t&)>& iteratee) {
+            while (next < end) {
+                if (count.kmer_count + kmers.size() >= split_at && end - next > 1) {
+                    // this range is exploding, so let another thread take the second half of what's left.
+                    // the kmers starting on a single node can't be split up this way
+                    size_t middle = next + (end - next) / 2;
+                    size_t rest_end = end;
+#pragma omp task firstprivate(middle, rest_end)
+                    do_partition(middle, rest_end);
+                    end = middle;
+                    split_at += run_size;
+                }
+                if (!iteratee(graph.get_handle(node_ids[next++]))) {
+                    break;
                 }
             }
-            kmers.clear();
+        });
+        count.last_id = node_ids[end - 1];
+        if (size_limit_exceeded.load()) {
+            // count what we didn't write too, so we can see where we went over
+            count.kmer_count += kmers.size();
         }
+        else if (!kmers.empty()) {
+            write_run(kmers, count);
+        }
+#pragma omp critical (write_gcsa_kmers_counts)
+        counts.push_back(count);
     };
-    // Here we convert our kmer_t to gcsa::KMer
-    auto convert_kmer = [&thread_outputs, &alpha, &head_id, &tail_id, &handle_kmers](const kmer_t& kmer) {
-        // Convert this KmerPosition to several gcsa::KMers, and save them in thread_outputs
-        vector<gcsa::KMer>& thread_output = thread_outputs[omp_get_thread_num()];
-        kmer_to_gcsa_kmers(kmer, alpha, [&thread_output](const gcsa::KMer& k) { thread_output.push_back(k); });
-        // Handle kmer buffered writes, indicating we're not yet done
-        handle_kmers(thread_output, true);
-    };
-    // Run on each KmerPosition. This populates start_end_id, if it was 0, before calling convert_kmer.
-    for_each_kmer(graph, kmer_size, convert_kmer, head_id, tail_id, &size_limit_exceeded);
-    for(auto& thread_output : thread_outputs) {
-        // Flush our buffers
-        handle_kmers(thread_output, false);
+    
+#pragma omp parallel
+    {
+#pragma omp single
+        {
+            for (size_t i = 0; i < num_partitions; ++i) {
+#pragma omp task firstprivate(i)
+                do_partition(i * partition_size, min(node_ids.size(), (i + 1) * partition_size));
+            }
+        }
     }
+    // the ranges finish in any order
+    sort(counts.begin(), counts.end(), [](const KmerPartitionCount& a, const KmerPartitionCount& b) {
+        return a.first_id < b.first_id;
+    });
+    
     // did we end execution because we hit the size limit
     if (size_limit_exceeded.load()) {
+        // report the region that has the most kmers, which is probably what went over
+        auto largest = max_element(counts.begin(), counts.end(), [](const KmerPartitionCount& a, const KmerPartitionCount& b) {
+            return a.kmer_count < b.kmer_count;
+        });
+        cerr << "error: [write_gcsa_kmers()] size limit of " << size_limit << " bytes exceeded";
+        if (largest != counts.end()) {
+            cerr << ", largest region was nodes " << largest->first_id << "-" << largest->last_id
+                 << " with at least " << largest->kmer_count << " kmers";
+        }
+        cerr << endl;
+        if (partition_counts) {
+            *partition_counts = move(counts);
+        }
         throw SizeLimitExceededException();
     }
     
+    if (total_bytes.load() == 0) {
+        // write an empty run so that the file is still valid input for GCSA2
+        vector<gcsa::KMer> no_kmers;
+        gcsa::writeBinary(out, no_kmers, kmer_size);
+        total_bytes += run_bytes(0);
+    }
+    
+    if (partition_counts) {
+        *partition_counts = move(counts);
+    }
+    
     // FIXME: we seem to use this behavior in VGset, but this is not good semantics
-    size_limit = total_bytes;
+    size_limit = total_bytes.load();
 }
 
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
-                                   const string& base_file_name) {
+                                   const string& base_file_name, vector<KmerPartitionCount>* partition_counts) {
     // open a temporary file for the kmers
     string tmpfile = temp_file::create(base_file_name);
     ofstream out(tmpfile);
     // write the kmers to the temporary file
     try {
-        write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id);
+        write_gcsa_kmers(graph, kmer_size, out, size_limit, head_id, tail_id, partition_counts);
     }
     catch (SizeLimitExceededException& ex) {
         out.close();
@@ -56,6 +56,13 @@ private:
     static const string msg;
 };
 
+/// The number of GCSA2 kmers that start on a range of node IDs
+struct KmerPartitionCount {
+    id_t first_id = 0;
+    id_t last_id = 0;
+    size_t kmer_count = 0;
+};
+
 /// Iterate over all the kmers in the graph, running lambda on each
 /// If the stop flag is included, stop execution if it ever evaluates to true
 void for_each_kmer(const HandleGraph& graph, size_t k,
@@ -72,18 +79,34 @@ void kmer_to_gcsa_kmers(const kmer_t& kmer, const gcsa::Alphabet& alpha, const f
 /// Encode the chars into the gcsa2 byte
 gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& alpha);
 
+/// The number of nodes whose kmers write_gcsa_kmers enumerates together by default
+extern const size_t default_kmer_partition_size;
+/// The most kmers that write_gcsa_kmers holds in memory for one range by default
+extern const size_t default_kmer_run_size;
+
 /**
  * Write GCSA2 formatted binary KMers to the given ostream.
  * size_limit is the maximum size of the kmer file in bytes. When the function
  * returns, size_limit is the size of the kmer file in bytes.
+ * The nodes are split into ranges of partition_size IDs that are processed in
+ * parallel, and the kmers starting on each range are written as sorted,
+ * deduplicated runs of about run_size kmers. A range that produces more than
+ * run_size kmers is split again between threads, but all the kmers starting on
+ * one node are still found by one thread.
+ * If partition_counts is given, it is filled with the number of kmers from each
+ * range that was processed, in ID order, even if the size limit is exceeded.
  */
-void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id);
+void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id,
+                      vector<KmerPartitionCount>* partition_counts = nullptr,
+                      size_t partition_size = default_kmer_partition_size,
+                      size_t run_size = default_kmer_run_size);
 
 /// Open a tempfile and write the kmers to it. The calling context should remove it
 /// with temp_file::remove(). In the case that the size limit is exceeded, throws a
 /// SizeLimitExceededException and deletes the temp file.
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
-                                   const string& base_file_name = "vg-kmers-tmp-");
+                                   const string& base_file_name = "vg-kmers-tmp-",
+                                   vector<KmerPartitionCount>* partition_counts = nullptr);
 
 }
 
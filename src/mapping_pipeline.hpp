@@ -0,0 +1,354 @@
+#ifndef VG_MAPPING_PIPELINE_HPP_INCLUDED
+#define VG_MAPPING_PIPELINE_HPP_INCLUDED
+
+/**
+ * \file mapping_pipeline.hpp
+ * Defines a three-stage read-ingest / map / emit pipeline connected by
+ * bounded lock-free queues.
+ */
+
+#include <omp.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "atomic_queue.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Runs reads through a pipeline of three stages:
+ *
+ *  1. A dedicated reader thread, which decompresses and parses input records
+ *     and packs them into batches.
+ *  2. A pool of mapping worker threads, which turn each batch of input
+ *     records into a batch of results.
+ *  3. A pool of emit threads, which serialize, compress and write the
+ *     results.
+ *
+ * Stages are connected by bounded lock-free queues of batches, so a slow
+ * stage applies backpressure to the stages before it instead of letting
+ * memory grow without bound.
+ *
+ * All stages run as threads of a single OMP parallel region. Mapping workers
+ * get OMP thread numbers [0, mapping_threads), the reader gets
+ * mapping_threads, and the emit threads get the numbers after that. So
+ * per-thread state sized for the mapping threads stays valid in the mapping
+ * stage, and emitters that buffer per OMP thread need to be set up for
+ * get_total_threads() threads.
+ *
+ * Per-stage and per-queue occupancy counters are kept so that the stage that
+ * is the bottleneck can be identified with report().
+ */
+template<typename Input, typename Output>
+class MappingPipeline {
+public:
+
+    /// Function that produces all the input records, handing each to the
+    /// given callback in order. Runs on the reader thread.
+    using reader_t = function<void(const function<void(Input&)>&)>;
+    /// Function that maps one input record into one output record. Runs on a
+    /// mapping thread.
+    using mapper_t = function<void(Input&, Output&)>;
+    /// Function that emits one output record. Runs on an emit thread.
+    using emitter_t = function<void(Output&)>;
+
+    /**
+     * Make a pipeline with the given number of mapping and emit threads,
+     * moving records in batches of the given size, with at most
+     * queue_batches batches waiting between each pair of stages.
+     */
+    MappingPipeline(size_t mapping_threads, size_t emit_threads, size_t batch_size, size_t queue_batches = 0);
+
+    /// Get the number of OMP threads that run() will use across all stages.
+    size_t get_total_threads() const;
+
+    /**
+     * Run the pipeline to completion. Until single_threaded_until_true
+     * returns true, only mapping thread 0 maps reads, and only it calls
+     * single_threaded_until_true, between batches.
+     */
+    void run(const reader_t& read_all, const mapper_t& map_one, const emitter_t& emit_one,
+             const function<bool(void)>& single_threaded_until_true = []() { return true; });
+
+    /// Describe how busy each stage and queue was, to find the bottleneck.
+    void report(ostream& out) const;
+
+protected:
+
+    using input_batch_t = vector<Input>;
+    using output_batch_t = vector<Output>;
+
+    /// Counters for one bounded queue between stages.
+    struct queue_stats_t {
+        /// How many batches were pushed.
+        atomic<size_t> pushes {0};
+        /// Sum of the queue sizes seen at each push, for the mean occupancy.
+        atomic<size_t> occupancy_total {0};
+        /// How many times did the producer find the queue full and wait?
+        atomic<size_t> full_waits {0};
+        /// How many times did a consumer find the queue empty and wait?
+        atomic<size_t> empty_waits {0};
+    };
+
+    /// Counters for one stage.
+    struct stage_stats_t {
+        /// Total nanoseconds spent doing work, across all the stage's threads.
+        atomic<size_t> busy_ns {0};
+        /// Total nanoseconds spent waiting on a queue, across all the stage's threads.
+        atomic<size_t> waiting_ns {0};
+        /// Number of records that passed through the stage.
+        atomic<size_t> records {0};
+    };
+
+    size_t mapping_threads;
+    size_t emit_threads;
+    size_t batch_size;
+    size_t queue_batches;
+
+    queue_stats_t input_queue_stats;
+    queue_stats_t output_queue_stats;
+    stage_stats_t read_stats;
+    stage_stats_t map_stats;
+    stage_stats_t emit_stats;
+
+    /// Wait a little while before retrying a queue operation, escalating
+    /// from yielding to sleeping as attempts pile up.
+    static void backoff(size_t& attempts);
+
+    /// Push a batch onto a queue, waiting while it is full.
+    template<typename Queue, typename Batch>
+    void push_batch(Queue& queue, Batch* batch, queue_stats_t& stats, stage_stats_t& stage);
+
+    /// Pop a batch from a queue, waiting while it is empty. Returns nullptr
+    /// once the queue is empty and producers_done is set.
+    template<typename Queue, typename Batch>
+    Batch* pop_batch(Queue& queue, const atomic<bool>& producers_done, queue_stats_t& stats, stage_stats_t& stage);
+
+    /// Count nanoseconds since the given time point.
+    static size_t nanoseconds_since(const chrono::steady_clock::time_point& start);
+};
+
+/////////////////////////////////
+// Template implementations
+/////////////////////////////////
+
+template<typename Input, typename Output>
+MappingPipeline<Input, Output>::MappingPipeline(size_t mapping_threads, size_t emit_threads, size_t batch_size, size_t queue_batches) :
+    mapping_threads(max<size_t>(mapping_threads, 1)), emit_threads(max<size_t>(emit_threads, 1)),
+    batch_size(max<size_t>(batch_size, 1)), queue_batches(queue_batches) {
+
+    if (this->queue_batches == 0) {
+        // Default to enough batches to keep every mapping thread fed with one
+        // waiting behind it.
+        this->queue_batches = 2 * this->mapping_threads;
+    }
+}
+
+template<typename Input, typename Output>
+size_t MappingPipeline<Input, Output>::get_total_threads() const {
+    return mapping_threads + 1 + emit_threads;
+}
+
+template<typename Input, typename Output>
+void MappingPipeline<Input, Output>::backoff(size_t& attempts) {
+    attempts++;
+    if (attempts < 64) {
+        this_thread::yield();
+    } else {
+        this_thread::sleep_for(chrono::microseconds(50));
+    }
+}
+
+template<typename Input, typename Output>
+size_t MappingPipeline<Input, Output>::nanoseconds_since(const chrono::steady_clock::time_point& start) {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+template<typename Input, typename Output>
+template<typename Queue, typename Batch>
+void MappingPipeline<Input, Output>::push_batch(Queue& queue, Batch* batch, queue_stats_t& stats, stage_stats_t& stage) {
+    stats.occupancy_total += queue.was_size();
+    stats.pushes++;
+    if (!queue.try_push(batch)) {
+        // The next stage can't keep up.
+        stats.full_waits++;
+        auto wait_start = chrono::steady_clock::now();
+        size_t attempts = 0;
+        do {
+            backoff(attempts);
+        } while (!queue.try_push(batch));
+        stage.waiting_ns += nanoseconds_since(wait_start);
+    }
+}
+
+template<typename Input, typename Output>
+template<typename Queue, typename Batch>
+Batch* MappingPipeline<Input, Output>::pop_batch(Queue& queue, const atomic<bool>& producers_done, queue_stats_t& stats, stage_stats_t& stage) {
+    Batch* batch = nullptr;
+    if (queue.try_pop(batch)) {
+        return batch;
+    }
+    // The previous stage can't keep up, or is finished.
+    stats.empty_waits++;
+    auto wait_start = chrono::steady_clock::now();
+    size_t attempts = 0;
+    while (true) {
+        // Check for being done before trying the queue, so we can't miss a
+        // batch pushed just before the producers finished.
+        bool done = producers_done.load();
+        if (queue.try_pop(batch)) {
+            break;
+        }
+        if (done) {
+            batch = nullptr;
+            break;
+        }
+        backoff(attempts);
+    }
+    stage.waiting_ns += nanoseconds_since(wait_start);
+    return batch;
+}
+
+template<typename Input, typename Output>
+void MappingPipeline<Input, Output>::run(const reader_t& read_all, const mapper_t& map_one, const emitter_t& emit_one,
+                                         const function<bool(void)>& single_threaded_until_true) {
+
+    atomic_queue::AtomicQueueB<input_batch_t*> input_queue(queue_batches);
+    atomic_queue::AtomicQueueB<output_batch_t*> output_queue(queue_batches);
+
+    // Set when the reader has queued its last batch.
+    atomic<bool> reading_done(false);
+    // Counts down as mapping threads finish, so the emitters know when to stop.
+    atomic<size_t> mappers_running(mapping_threads);
+    atomic<bool> mapping_done(false);
+    // Set once we may map with all the mapping threads.
+    atomic<bool> all_threads_ready(false);
+    // Set when mapping thread 0 runs out of work, in case that happens first.
+    atomic<bool> first_mapper_done(false);
+
+    size_t total_threads = get_total_threads();
+
+    #pragma omp parallel num_threads(total_threads)
+    {
+        if ((size_t) omp_get_num_threads() != total_threads) {
+            // Every stage needs its threads or the pipeline can't drain.
+            #pragma omp critical (cerr)
+            cerr << "error[vg::MappingPipeline]: needed " << total_threads << " threads but got " << omp_get_num_threads() << endl;
+            exit(1);
+        }
+
+        size_t thread_num = omp_get_thread_num();
+        if (thread_num < mapping_threads) {
+            // We are a mapping thread.
+            if (thread_num != 0) {
+                // Wait to be allowed to work.
+                size_t attempts = 0;
+                while (!all_threads_ready.load() && !first_mapper_done.load()) {
+                    backoff(attempts);
+                }
+            }
+
+            while (true) {
+                if (thread_num == 0 && !all_threads_ready.load() && single_threaded_until_true()) {
+                    // Let everyone else in.
+                    all_threads_ready.store(true);
+                }
+
+                input_batch_t* in_batch = pop_batch<decltype(input_queue), input_batch_t>(input_queue, reading_done, input_queue_stats, map_stats);
+                if (in_batch == nullptr) {
+                    break;
+                }
+
+                auto work_start = chrono::steady_clock::now();
+                output_batch_t* out_batch = new output_batch_t(in_batch->size());
+                for (size_t i = 0; i < in_batch->size(); i++) {
+                    map_one(in_batch->at(i), out_batch->at(i));
+                }
+                map_stats.records += in_batch->size();
+                delete in_batch;
+                map_stats.busy_ns += nanoseconds_since(work_start);
+
+                push_batch(output_queue, out_batch, output_queue_stats, map_stats);
+            }
+
+            if (thread_num == 0) {
+                first_mapper_done.store(true);
+            }
+            if (--mappers_running == 0) {
+                mapping_done.store(true);
+            }
+        } else if (thread_num == mapping_threads) {
+            // We are the reader thread.
+            auto work_start = chrono::steady_clock::now();
+            input_batch_t* batch = new input_batch_t();
+            batch->reserve(batch_size);
+            read_all([&](Input& record) {
+                batch->emplace_back(std::move(record));
+                if (batch->size() == batch_size) {
+                    read_stats.records += batch->size();
+                    read_stats.busy_ns += nanoseconds_since(work_start);
+                    push_batch(input_queue, batch, input_queue_stats, read_stats);
+                    work_start = chrono::steady_clock::now();
+                    batch = new input_batch_t();
+                    batch->reserve(batch_size);
+                }
+            });
+            if (batch->empty()) {
+                delete batch;
+            } else {
+                read_stats.records += batch->size();
+                push_batch(input_queue, batch, input_queue_stats, read_stats);
+            }
+            read_stats.busy_ns += nanoseconds_since(work_start);
+            reading_done.store(true);
+        } else {
+            // We are an emit thread.
+            while (true) {
+                output_batch_t* out_batch = pop_batch<decltype(output_queue), output_batch_t>(output_queue, mapping_done, output_queue_stats, emit_stats);
+                if (out_batch == nullptr) {
+                    break;
+                }
+                auto work_start = chrono::steady_clock::now();
+                for (auto& result : *out_batch) {
+                    emit_one(result);
+                }
+                emit_stats.records += out_batch->size();
+                delete out_batch;
+                emit_stats.busy_ns += nanoseconds_since(work_start);
+            }
+        }
+    }
+}
+
+template<typename Input, typename Output>
+void MappingPipeline<Input, Output>::report(ostream& out) const {
+    auto report_stage = [&](const string& name, const stage_stats_t& stats, size_t threads) {
+        double busy = stats.busy_ns.load() / 1E9;
+        double waiting = stats.waiting_ns.load() / 1E9;
+        double occupancy = (busy + waiting) == 0 ? 0 : busy / (busy + waiting);
+        out << "Pipeline stage " << name << ": " << stats.records.load() << " records on " << threads << " threads, "
+            << busy << " s busy, " << waiting << " s waiting on queues (" << occupancy * 100 << "% occupied)" << endl;
+    };
+    auto report_queue = [&](const string& name, const queue_stats_t& stats) {
+        double mean = stats.pushes.load() == 0 ? 0 : (double) stats.occupancy_total.load() / stats.pushes.load();
+        out << "Pipeline queue " << name << ": mean " << mean << " of " << queue_batches << " batches queued, "
+            << stats.full_waits.load() << " waits when full, " << stats.empty_waits.load() << " waits when empty" << endl;
+    };
+
+    report_stage("read", read_stats, 1);
+    report_queue("read->map", input_queue_stats);
+    report_stage("map", map_stats, mapping_threads);
+    report_queue("map->emit", output_queue_stats);
+    report_stage("emit", emit_stats, emit_threads);
+}
+
+}
+
+#endif
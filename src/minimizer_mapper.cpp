@@ -573,6 +573,9 @@ vector<Alignment> MinimizerMapper::map_from_extensions(Alignment& aln) {
     
     // Make a new funnel instrumenter to watch us map this read.
     Funnel funnel;
+    if (stage_latency_recorder) {
+        funnel.set_latency_recorder(stage_latency_recorder, track_provenance);
+    }
     funnel.start(aln.name());
     
     // Prepare the RNG for shuffling ties, if needed
@@ -588,7 +591,7 @@ vector<Alignment> MinimizerMapper::map_from_extensions(Alignment& aln) {
     vector<Seed> seeds = this->find_seeds(minimizers, aln, funnel);
 
     // Cluster the seeds. Get sets of input seed indexes that go together.
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         funnel.stage("cluster");
     }
 
@@ -637,7 +640,7 @@ vector<Alignment> MinimizerMapper::map_from_extensions(Alignment& aln) {
         cluster_score_cutoff = std::min(cluster_score_cutoff, second_best_cluster_score);
     }
 
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         // Now we go from clusters to gapless extensions
         funnel.stage("extend");
     }
@@ -750,7 +753,7 @@ vector<Alignment> MinimizerMapper::map_from_extensions(Alignment& aln) {
         });
         
     std::vector<int> cluster_extension_scores = this->score_extensions(cluster_extensions, aln, funnel);
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         funnel.stage("align");
     }
 
@@ -970,7 +973,7 @@ vector<Alignment> MinimizerMapper::map_from_extensions(Alignment& aln) {
         }
     }
     
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         // Now say we are finding the winner(s)
         funnel.stage("winner");
     }
@@ -1376,6 +1379,9 @@ pair<vector<Alignment>, vector<Alignment>> MinimizerMapper::map_paired(Alignment
     std::array<Funnel, 2> funnels;
     // Start this alignment 
     for (auto r : {0, 1}) {
+        if (stage_latency_recorder) {
+            funnels[r].set_latency_recorder(stage_latency_recorder, track_provenance);
+        }
         funnels[r].start(alns[r]->name());
     }
     
@@ -1416,7 +1422,7 @@ pair<vector<Alignment>, vector<Alignment>> MinimizerMapper::map_paired(Alignment
     }
 
     // Cluster the seeds. Get sets of input seed indexes that go together.
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         for (auto r : {0, 1}) {
             funnels[r].stage("cluster");
         }
@@ -1619,7 +1625,7 @@ pair<vector<Alignment>, vector<Alignment>> MinimizerMapper::map_paired(Alignment
             cluster_score_cutoff = std::min(cluster_score_cutoff, second_best_cluster_score);
         }
 
-        if (track_provenance) {
+        if (track_provenance || stage_latency_recorder) {
             // Now we go from clusters to gapless extensions
             funnels[read_num].stage("extend");
         }
@@ -1738,7 +1744,7 @@ pair<vector<Alignment>, vector<Alignment>> MinimizerMapper::map_paired(Alignment
         // We now estimate the best possible alignment score for each cluster.
         std::vector<int> cluster_alignment_score_estimates = this->score_extensions(cluster_extensions, aln, funnels[read_num]);
         
-        if (track_provenance) {
+        if (track_provenance || stage_latency_recorder) {
             funnels[read_num].stage("align");
         }
         
@@ -1897,7 +1903,7 @@ pair<vector<Alignment>, vector<Alignment>> MinimizerMapper::map_paired(Alignment
 
     //Now that we have alignments, figure out how to pair them up
     
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         // Now say we are finding the pairs
         for (auto r : {0, 1}) {
             funnels[r].stage("pairing");
@@ -2157,6 +2163,9 @@ pair<vector<Alignment>, vector<Alignment>> MinimizerMapper::map_paired(Alignment
 
         if (max_rescue_attempts != 0) {
             //Attempt rescue on unpaired alignments if either we didn't find any pairs or if the unpaired alignments are very good
+            
+            // Rescue happens within the pairing stage, so time it separately.
+            auto rescue_start = std::chrono::high_resolution_clock::now();
 
             process_until_threshold_a(unpaired_alignments.size(), (std::function<double(size_t)>) [&](size_t i) -> double{
                 return (double) unpaired_alignments.at(i).lookup_in(alignments).score();
@@ -2257,12 +2266,16 @@ pair<vector<Alignment>, vector<Alignment>> MinimizerMapper::map_paired(Alignment
                 }
                 return;
             });
+            
+            if (stage_latency_recorder) {
+                stage_latency_recorder->record("rescue", std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - rescue_start).count());
+            }
         }
     }
 
     
     
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         // Now say we are finding the winner(s)
         for (auto r : {0, 1}) {
             funnels[r].stage("winner");
@@ -3233,7 +3246,7 @@ void MinimizerMapper::extension_to_alignment(const GaplessExtension& extension,
 
 std::vector<MinimizerMapper::Minimizer> MinimizerMapper::find_minimizers(const std::string& sequence, Funnel& funnel) const {
 
-    if (this->track_provenance) {
+    if (this->track_provenance || this->stage_latency_recorder) {
         // Start the minimizer finding stage
         funnel.stage("minimizer");
     }
@@ -3290,7 +3303,7 @@ std::vector<size_t> MinimizerMapper::sort_minimizers_by_score(const std::vector<
 
 std::vector<MinimizerMapper::Seed> MinimizerMapper::find_seeds(const VectorView<Minimizer>& minimizers, const Alignment& aln, Funnel& funnel) const {
 
-    if (this->track_provenance) {
+    if (this->track_provenance || this->stage_latency_recorder) {
         // Start the minimizer locating stage
         funnel.stage("seed");
     }
@@ -259,6 +259,15 @@ public:
     /// How many bases of indel should we allow in chaining?
     static constexpr size_t default_max_indel_bases = 50;
     size_t max_indel_bases = default_max_indel_bases;
+    /// Should we evaluate each chaining lookback window as a SIMD batch,
+    /// pruning candidates by score bound instead of by adaptive lookback?
+    static constexpr bool default_batched_chaining = false;
+    bool batched_chaining = default_batched_chaining;
+    /// Should we chain with a range-max query structure, in time that scales
+    /// with the number of anchors rather than anchors times lookback window?
+    /// Takes precedence over batched_chaining.
+    static constexpr bool default_sparse_chaining = false;
+    bool sparse_chaining = default_sparse_chaining;
     
     /// If a chain's score is smaller than the best 
     /// chain's score by more than this much, don't align it
@@ -308,6 +317,10 @@ public:
     static constexpr bool default_track_correctness = false;
     bool track_correctness = default_track_correctness;
     
+    /// If set, record the wall time taken by each mapping stage into this,
+    /// without needing to track provenance.
+    StageLatencyRecorder* stage_latency_recorder = nullptr;
+    
     /// If set, log what the mapper is thinking in its mapping of each read.
     static constexpr bool default_show_work = false;
     bool show_work = default_show_work;
@@ -271,6 +271,9 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
     
     // Make a new funnel instrumenter to watch us map this read.
     Funnel funnel;
+    if (stage_latency_recorder) {
+        funnel.set_latency_recorder(stage_latency_recorder, track_provenance);
+    }
     funnel.start(aln.name());
     
     // Prepare the RNG for shuffling ties, if needed
@@ -293,7 +296,7 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
     vector<Seed> seeds = this->find_seeds(minimizers, aln, funnel);
     
     // Pre-cluster just the seeds we have. Get sets of input seed indexes that go together.
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         funnel.stage("precluster");
         funnel.substage("compute-preclusters");
     }
@@ -407,7 +410,7 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
         precluster_connections.emplace_back(std::numeric_limits<size_t>::max(), unconnected);
     }
     
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         funnel.stage("reseed");
     }
     
@@ -588,7 +591,7 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
     }
     
     // Make the main clusters that include the recovered seeds
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         funnel.stage("cluster");
     }
     
@@ -640,7 +643,7 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
         cluster_score_cutoff = std::min(cluster_score_cutoff, second_best_cluster_score);
     }
 
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         // Now we go from clusters to chains
         funnel.stage("chain");
     }
@@ -790,7 +793,10 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
                                                                lookback_scale_factor,
                                                                min_good_transition_score_per_base,
                                                                item_bonus,
-                                                               max_indel_bases);
+                                                               max_indel_bases,
+                                                               sparse_chaining ? algorithms::ChainingEngine::SPARSE :
+                                                               batched_chaining ? algorithms::ChainingEngine::BATCHED_LOOKBACK :
+                                                               algorithms::ChainingEngine::LOOKBACK);
             if (show_work && !candidate_chain.second.empty()) {
                 #pragma omp critical (cerr)
                 {
@@ -888,7 +894,7 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
         cluster_alignment_score_estimates[i] = cluster_chains[i].first;
     }
     
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         funnel.stage("align");
     }
 
@@ -1063,7 +1069,7 @@ vector<Alignment> MinimizerMapper::map_from_chains(Alignment& aln) {
         }
     }
     
-    if (track_provenance) {
+    if (track_provenance || stage_latency_recorder) {
         // Now say we are finding the winner(s)
         funnel.stage("winner");
     }
@@ -22,6 +22,8 @@
 #include "ssw_aligner.hpp"
 #endif
 
+#include <fstream>
+
 #include "multipath_mapper.hpp"
 
 #include "multipath_alignment_graph.hpp"
@@ -1088,6 +1090,242 @@ namespace vg {
         suppress_mismapping_detection = reset_suppress_mismapping_detection;
     }
 
+    const size_t MultipathMapper::default_calibration_simulations = 100;
+    const vector<size_t> MultipathMapper::default_calibration_read_lengths{50, 100, 150, 250, 450};
+
+    // identifies an index file by its size and the checksums of its ends, which is enough to tell
+    // apart different builds without reading the whole thing
+    static string index_fingerprint(const string& filename) {
+        ifstream infile(filename, std::ios::binary);
+        if (!infile) {
+            return "missing";
+        }
+        infile.seekg(0, std::ios::end);
+        size_t file_size = infile.tellg();
+        size_t chunk_size = min<size_t>(file_size, 1 << 20);
+        string chunk(chunk_size, '\0');
+        SHA1 checksum;
+        infile.seekg(0);
+        infile.read(&chunk[0], chunk_size);
+        checksum.update(chunk);
+        infile.seekg(file_size - chunk_size);
+        infile.read(&chunk[0], chunk_size);
+        checksum.update(chunk);
+        return to_string(file_size) + ":" + checksum.final();
+    }
+
+    void MultipathMapperSettings::apply(MultipathMapper& mapper, size_t total_seq_length) const {
+        
+        int log4_seq_length = int(ceil(log(total_seq_length) / log(4.0)));
+        
+        // set alignment parameters
+        if (match_score != default_match
+            || mismatch_score != default_mismatch
+            || gap_open_score != default_gap_open
+            || gap_extension_score != default_gap_extension
+            || full_length_bonus != default_full_length_bonus) {
+            mapper.set_alignment_scores(match_score, mismatch_score, gap_open_score, gap_extension_score, full_length_bonus);
+        }
+        mapper.adjust_alignments_for_base_quality = adjust_alignments_for_base_quality;
+        mapper.strip_bonuses = strip_bonuses;
+        mapper.band_padding_multiplier = band_padding_multiplier;
+        mapper.init_band_padding_memo();
+        
+        // set mem finding parameters
+        mapper.hit_max = hit_max;
+        mapper.hard_hit_max = hard_hit_max;
+        mapper.mem_reseed_length = mem_reseed_length;
+        mapper.fast_reseed = true;
+        mapper.fast_reseed_length_diff = fast_reseed_length_diff;
+        mapper.sub_mem_count_thinning = sub_mem_count_thinning;
+        mapper.sub_mem_thinning_burn_in = log4_seq_length + sub_mem_thinning_burn_in_diff;
+        mapper.order_length_repeat_hit_max = order_length_repeat_hit_max;
+        mapper.min_mem_length = min_mem_length;
+        mapper.stripped_match_alg_strip_length = stripped_match_alg_strip_length;
+        mapper.stripped_match_alg_max_length = stripped_match_alg_max_length;
+        mapper.stripped_match_alg_target_count = stripped_match_alg_target_count;
+        mapper.use_greedy_mem_restarts = use_greedy_mem_restarts;
+        mapper.greedy_restart_min_length = greedy_restart_min_length;
+        mapper.greedy_restart_max_count = greedy_restart_max_count;
+        mapper.greedy_restart_max_lcp = greedy_restart_max_lcp;
+        mapper.greedy_restart_assume_substitution = greedy_restart_assume_substitution;
+        mapper.use_stripped_match_alg = use_stripped_match_alg;
+        mapper.filter_short_mems = filter_short_mems;
+        mapper.short_mem_filter_factor = short_mem_filter_factor;
+        mapper.use_fanout_match_alg = use_fanout_match_alg;
+        mapper.max_fanout_base_quality = max_fanout_base_quality;
+        mapper.max_fans_out = max_fans_out;
+        mapper.fanout_length_threshold = log4_seq_length + fanout_pruning_diff;
+        mapper.adaptive_reseed_diff = adaptive_reseed_diff;
+        mapper.adaptive_diff_exponent = adaptive_diff_exponent;
+        mapper.use_approx_sub_mem_count = false;
+        mapper.prefilter_redundant_hits = prefilter_redundant_hits;
+        mapper.precollapse_order_length_hits = precollapse_order_length_hits;
+        mapper.max_sub_mem_recursion_depth = max_sub_mem_recursion_depth;
+        mapper.max_mapping_p_value = max_mapping_p_value;
+        mapper.max_rescue_p_value = max_rescue_p_value;
+        mapper.suppress_mismapping_detection = suppress_mismapping_detection;
+        if (min_clustering_mem_length) {
+            mapper.min_clustering_mem_length = min_clustering_mem_length;
+        }
+        else {
+            mapper.set_automatic_min_clustering_length();
+        }
+        
+        // set mapping quality parameters
+        mapper.mapping_quality_method = mapping_quality_method;
+        mapper.max_mapping_quality = max_mapping_quality;
+        mapper.mapq_scaling_factor = mapq_scaling_factor;
+        mapper.report_group_mapq = report_group_mapq;
+        mapper.report_allelic_mapq = report_allelic_mapq;
+        // Use population MAPQs when we have the right option combination to make that sensible.
+        mapper.use_population_mapqs = (mapper.haplo_score_provider != nullptr && population_max_paths > 0);
+        mapper.population_max_paths = population_max_paths;
+        mapper.population_paths_hard_cap = population_paths_hard_cap;
+        mapper.top_tracebacks = top_tracebacks;
+        mapper.recombination_penalty = recombination_penalty;
+        mapper.always_check_population = always_check_population;
+        mapper.force_haplotype_count = force_haplotype_count;
+        
+        // set pruning and clustering parameters
+        mapper.no_clustering = no_clustering;
+        mapper.use_tvs_clusterer = use_tvs_clusterer;
+        mapper.use_min_dist_clusterer = use_min_dist_clusterer;
+        mapper.greedy_min_dist = greedy_min_dist;
+        mapper.component_min_dist = component_min_dist;
+        mapper.max_expected_dist_approx_error = max_expected_dist_approx_error;
+        mapper.mem_coverage_min_ratio = mem_coverage_min_ratio;
+        mapper.log_likelihood_approx_factor = log_likelihood_approx_factor;
+        mapper.num_mapping_attempts = num_mapping_attempts;
+        mapper.min_median_mem_coverage_for_split = min_median_mem_coverage_for_split;
+        mapper.suppress_cluster_merging = suppress_cluster_merging;
+        mapper.suppress_multicomponent_splitting = suppress_multicomponent_splitting;
+        mapper.reversing_walk_length = reversing_walk_length;
+        mapper.max_alt_mappings = max_alt_mappings;
+        mapper.max_alignment_gap = max_alignment_gap;
+        mapper.use_pessimistic_tail_alignment = use_pessimistic_tail_alignment;
+        mapper.pessimistic_gap_multiplier = pessimistic_gap_multiplier;
+        mapper.restrained_graph_extraction = restrained_graph_extraction;
+        
+        // set pair rescue parameters
+        mapper.max_rescue_attempts = max_rescue_attempts;
+        mapper.max_single_end_mappings_for_rescue = max(max_single_end_mappings_for_rescue, max_rescue_attempts);
+        mapper.secondary_rescue_subopt_diff = secondary_rescue_subopt_diff;
+        mapper.secondary_rescue_score_diff = secondary_rescue_score_diff;
+        mapper.secondary_rescue_attempts = secondary_rescue_attempts;
+        mapper.rescue_only_min = rescue_only_min;
+        mapper.rescue_only_anchor_max = rescue_only_anchor_max;
+        mapper.fragment_length_warning_factor = fragment_length_warning_factor;
+        mapper.get_rescue_graph_from_paths = get_rescue_graph_from_paths;
+        mapper.rescue_graph_std_devs = rescue_graph_std_devs;
+        
+        // set multipath alignment topology parameters
+        mapper.max_snarl_cut_size = max_snarl_cut_size;
+        mapper.max_branch_trim_length = max_branch_trim_length;
+        mapper.suppress_tail_anchors = suppress_tail_anchors;
+        mapper.num_alt_alns = num_alt_alns;
+        mapper.dynamic_max_alt_alns = dynamic_max_alt_alns;
+        mapper.simplify_topologies = simplify_topologies;
+        mapper.max_suboptimal_path_score_ratio = max_suboptimal_path_score_ratio;
+        mapper.agglomerate_multipath_alns = agglomerate_multipath_alns;
+        
+        // splicing parameters
+        mapper.set_min_softclip_length_for_splice(max<int>(log4_seq_length - max_softclip_overlap, 1));
+        mapper.set_log_odds_against_splice(no_splice_log_odds);
+        mapper.max_softclip_overlap = max_softclip_overlap;
+        mapper.max_splice_overhang = max_splice_overhang;
+        mapper.splice_rescue_graph_std_devs = splice_rescue_graph_std_devs;
+        mapper.max_motif_pairs = max_motif_pairs;
+        mapper.set_read_1_adapter(read_1_adapter);
+        mapper.set_read_2_adapter(read_2_adapter);
+    }
+    
+    void MultipathMapperSettings::serialize(ostream& out) const {
+        auto precision = out.precision(17);
+        out << match_score << " " << mismatch_score << " " << gap_open_score << " " << gap_extension_score
+            << " " << full_length_bonus << " " << adjust_alignments_for_base_quality << " " << strip_bonuses
+            << " " << band_padding_multiplier << "\n";
+        out << hit_max << " " << hard_hit_max << " " << mem_reseed_length << " " << fast_reseed_length_diff
+            << " " << sub_mem_count_thinning << " " << sub_mem_thinning_burn_in_diff << " " << order_length_repeat_hit_max
+            << " " << min_mem_length << " " << min_clustering_mem_length << " " << use_stripped_match_alg
+            << " " << stripped_match_alg_strip_length << " " << stripped_match_alg_max_length
+            << " " << stripped_match_alg_target_count << " " << use_greedy_mem_restarts << " " << greedy_restart_min_length
+            << " " << greedy_restart_max_count << " " << greedy_restart_max_lcp << " " << greedy_restart_assume_substitution
+            << " " << filter_short_mems << " " << short_mem_filter_factor << " " << use_fanout_match_alg
+            << " " << max_fanout_base_quality << " " << max_fans_out << " " << fanout_pruning_diff
+            << " " << adaptive_reseed_diff << " " << adaptive_diff_exponent << " " << prefilter_redundant_hits
+            << " " << precollapse_order_length_hits << " " << max_sub_mem_recursion_depth << " " << max_mapping_p_value
+            << " " << max_rescue_p_value << " " << suppress_mismapping_detection << "\n";
+        out << (int) mapping_quality_method << " " << max_mapping_quality << " " << mapq_scaling_factor
+            << " " << report_group_mapq << " " << report_allelic_mapq << " " << population_max_paths
+            << " " << population_paths_hard_cap << " " << top_tracebacks << " " << recombination_penalty
+            << " " << always_check_population << " " << force_haplotype_count << "\n";
+        out << no_clustering << " " << use_tvs_clusterer << " " << use_min_dist_clusterer << " " << greedy_min_dist
+            << " " << component_min_dist << " " << max_expected_dist_approx_error << " " << mem_coverage_min_ratio
+            << " " << log_likelihood_approx_factor << " " << num_mapping_attempts << " " << min_median_mem_coverage_for_split
+            << " " << suppress_cluster_merging << " " << suppress_multicomponent_splitting << " " << reversing_walk_length
+            << " " << max_alt_mappings << " " << max_alignment_gap << " " << use_pessimistic_tail_alignment
+            << " " << pessimistic_gap_multiplier << " " << restrained_graph_extraction << "\n";
+        out << max_rescue_attempts << " " << max_single_end_mappings_for_rescue << " " << secondary_rescue_subopt_diff
+            << " " << secondary_rescue_score_diff << " " << secondary_rescue_attempts << " " << rescue_only_min
+            << " " << rescue_only_anchor_max << " " << fragment_length_warning_factor << " " << get_rescue_graph_from_paths
+            << " " << rescue_graph_std_devs << "\n";
+        out << max_snarl_cut_size << " " << max_branch_trim_length << " " << suppress_tail_anchors << " " << num_alt_alns
+            << " " << dynamic_max_alt_alns << " " << simplify_topologies << " " << max_suboptimal_path_score_ratio
+            << " " << agglomerate_multipath_alns << "\n";
+        out << max_softclip_overlap << " " << max_splice_overhang << " " << no_splice_log_odds
+            << " " << splice_rescue_graph_std_devs << " " << max_motif_pairs << " " << read_1_adapter
+            << " " << read_2_adapter << "\n";
+        out << calibration_simulations;
+        for (auto read_length : calibration_read_lengths) {
+            out << " " << read_length;
+        }
+        out << "\n";
+        out.precision(precision);
+    }
+    
+    string MultipathMapperSettings::calibration_key(const vector<string>& filenames) const {
+        stringstream strm;
+        for (const auto& filename : filenames) {
+            strm << index_fingerprint(filename) << "\n";
+        }
+        serialize(strm);
+        return sha1sum(strm.str());
+    }
+
+    void MultipathMapper::save_mismapping_calibration(ostream& out, const string& key) const {
+        out << "#mismapping_calibration\t" << key << "\n";
+        out.precision(17);
+        out << "max_exponential_rate_intercept\t" << max_exponential_rate_intercept << "\n";
+        out << "max_exponential_rate_slope\t" << max_exponential_rate_slope << "\n";
+        out << "max_exponential_shape_intercept\t" << max_exponential_shape_intercept << "\n";
+        out << "max_exponential_shape_slope\t" << max_exponential_shape_slope << "\n";
+    }
+
+    bool MultipathMapper::load_mismapping_calibration(istream& in, const string& key) {
+        string header, saved_key;
+        if (!(in >> header >> saved_key) || header != "#mismapping_calibration" || saved_key != key) {
+            return false;
+        }
+        unordered_map<string, double> params;
+        string name;
+        double value;
+        while (in >> name >> value) {
+            params[name] = value;
+        }
+        if (!params.count("max_exponential_rate_intercept") || !params.count("max_exponential_rate_slope")
+            || !params.count("max_exponential_shape_intercept") || !params.count("max_exponential_shape_slope")) {
+            return false;
+        }
+        max_exponential_rate_intercept = params["max_exponential_rate_intercept"];
+        max_exponential_rate_slope = params["max_exponential_rate_slope"];
+        max_exponential_shape_intercept = params["max_exponential_shape_intercept"];
+        max_exponential_shape_slope = params["max_exponential_shape_slope"];
+        // forget any p-values computed with the old parameters
+        p_value_memo.clear();
+        return true;
+    }
+
     void MultipathMapper::determine_distance_correlation() {
         
         // FIXME: very experimental, not sure if i actually want to do this
@@ -4819,7 +5057,7 @@ namespace vg {
                     // and now make the cluster graph itself
                     cluster_graphs.emplace_back();
                     auto& cluster_graph = cluster_graphs.back();
-                    get<0>(cluster_graph) = unique_ptr<bdsg::HashGraph>(new bdsg::HashGraph());
+                    get<0>(cluster_graph) = ArenaSubgraph::make();
                     handlealgs::copy_handle_graph(get<0>(cluster_graphs[record.first]).get(),
                                                   get<0>(cluster_graph).get());
                     
@@ -5481,7 +5719,7 @@ namespace vg {
         
     }
 
-    pair<unique_ptr<bdsg::HashGraph>, bool> MultipathMapper::extract_maximal_graph(const Alignment& alignment,
+    pair<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool> MultipathMapper::extract_maximal_graph(const Alignment& alignment,
                                                                                    const memcluster_t& mem_cluster) const {
         
         // Figure out the aligner to use
@@ -5512,7 +5750,7 @@ namespace vg {
         
         // extract the subgraph within the search distance
         
-        unique_ptr<bdsg::HashGraph> cluster_graph(new bdsg::HashGraph());
+        auto cluster_graph = ArenaSubgraph::make();
         
         algorithms::extract_containing_graph(xindex, cluster_graph.get(), positions, forward_max_dist, backward_max_dist,
                                              num_alt_alns > 1 ? reversing_walk_length : 0);
@@ -5538,7 +5776,7 @@ namespace vg {
         return gap_length;
     }
 
-    pair<unique_ptr<bdsg::HashGraph>, bool> MultipathMapper::extract_restrained_graph(const Alignment& alignment,
+    pair<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool> MultipathMapper::extract_restrained_graph(const Alignment& alignment,
                                                                                       const memcluster_t& mem_cluster) const {
         
         // Figure out the aligner to use
@@ -5606,13 +5844,18 @@ namespace vg {
         // expand the restrained search distances until we extract a connected graph or
         // expand the distances up to the maximum detectable length
         
-        unique_ptr<bdsg::HashGraph> cluster_graph;
+        unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler> cluster_graph;
         bool do_extract = true;
         bool connected = false;
         while (do_extract) {
             
-            // get rid of the old graph (if there is one)
-            cluster_graph = unique_ptr<bdsg::HashGraph>(new bdsg::HashGraph());
+            // get rid of the old graph (if there is one), reusing its storage
+            if (cluster_graph) {
+                cluster_graph->clear();
+            }
+            else {
+                cluster_graph = ArenaSubgraph::make();
+            }
             
             // extract according to the current search distances
             algorithms::extract_containing_graph(xindex, cluster_graph.get(), positions, forward_dist, backward_dist,
@@ -5650,7 +5893,7 @@ namespace vg {
         return move(make_pair(move(cluster_graph), connected));
     }
 
-    pair<unique_ptr<bdsg::HashGraph>, bool> MultipathMapper::extract_cluster_graph(const Alignment& alignment,
+    pair<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool> MultipathMapper::extract_cluster_graph(const Alignment& alignment,
                                                                                    const memcluster_t& mem_cluster) const {
         if (restrained_graph_extraction) {
             return extract_restrained_graph(alignment, mem_cluster);
@@ -5679,7 +5922,7 @@ namespace vg {
         // to hold the clusters as they are (possibly) merged, bools indicate
         // whether we've verified that the graph is connected
         // doubles are the cluster graph's multiplicity
-        unordered_map<size_t, tuple<unique_ptr<bdsg::HashGraph>, bool, double>> cluster_graphs;
+        unordered_map<size_t, tuple<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool, double>> cluster_graphs;
         
         // to keep track of which clusters have been merged
         UnionFind union_find(clusters.size(), false);
@@ -5697,7 +5940,7 @@ namespace vg {
             // gather the parameters for subgraph extraction from the MEM hits
             auto& cluster = clusters[i];
             auto extracted = extract_cluster_graph(alignment, cluster);
-            tuple<unique_ptr<bdsg::HashGraph>, bool, double> cluster_graph(move(extracted.first), extracted.second, cluster.second);
+            tuple<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool, double> cluster_graph(move(extracted.first), extracted.second, cluster.second);
             
             // check if this subgraph overlaps with any previous subgraph (indicates a probable clustering failure where
             // one cluster was split into multiple clusters)
@@ -5750,7 +5993,7 @@ namespace vg {
                 cerr << "merging as cluster " << remaining_idx << endl;
 #endif
                 
-                bdsg::HashGraph* merging_graph;
+                ArenaSubgraph* merging_graph;
                 bool all_connected;
                 double multiplicity;
                 if (remaining_idx == i) {
@@ -5825,7 +6068,7 @@ namespace vg {
 #endif
             
             for (size_t i = 0; i < multicomponent_graph.second.size(); i++) {
-                cluster_graphs[max_graph_idx + i] = make_tuple(unique_ptr<bdsg::HashGraph>(new bdsg::HashGraph()), true,
+                cluster_graphs[max_graph_idx + i] = make_tuple(ArenaSubgraph::make(), true,
                                                                get<2>(cluster_graphs[multicomponent_graph.first]));
             }
             
@@ -5883,7 +6126,7 @@ namespace vg {
         // vector each MEM cluster ended up in
         cluster_graphs_out.reserve(cluster_graphs.size());
         unordered_map<size_t, size_t> cluster_to_idx;
-        for (pair<const size_t, tuple<unique_ptr<bdsg::HashGraph>, bool, double>>& cluster_graph : cluster_graphs) {
+        for (pair<const size_t, tuple<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool, double>>& cluster_graph : cluster_graphs) {
             cluster_to_idx[cluster_graph.first] = cluster_graphs_out.size();
             cluster_graphs_out.emplace_back();
             get<0>(cluster_graphs_out.back()) = move(get<0>(cluster_graph.second));
@@ -5970,7 +6213,7 @@ namespace vg {
             
         // find the node ID range for the cluster graphs to help set up a stable, system-independent ordering
         // note: technically this is not quite a total ordering, but it should be close to one
-        unordered_map<bdsg::HashGraph*, uint64_t> graph_hash;
+        unordered_map<ArenaSubgraph*, uint64_t> graph_hash;
         graph_hash.reserve(cluster_graphs_out.size());
         for (const auto& cluster_graph : cluster_graphs_out) {
             graph_hash[get<0>(cluster_graph).get()] = wang_hash<pair<nid_t, nid_t>>()(make_pair(get<0>(cluster_graph)->min_node_id(),
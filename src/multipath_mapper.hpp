@@ -24,6 +24,7 @@
 #include "path_component_index.hpp"
 #include "splicing.hpp"
 #include "memoizing_graph.hpp"
+#include "arena_subgraph.hpp"
 
 
 // note: only activated for single end mapping
@@ -74,7 +75,18 @@ namespace vg {
         /// Map random sequences against the graph to calibrate a parameterized distribution that detects
         /// when mappings are likely to have occurred by chance
         void calibrate_mismapping_detection(size_t num_simulations, const vector<size_t>& simulated_read_lengths);
-        
+
+        /// The simulation parameters that vg mpmap calibrates with
+        static const size_t default_calibration_simulations;
+        static const vector<size_t> default_calibration_read_lengths;
+
+        /// Write the parameters learned by calibrate_mismapping_detection, labeled with a key
+        void save_mismapping_calibration(ostream& out, const string& key) const;
+
+        /// Load parameters written by save_mismapping_calibration. Returns false and leaves the
+        /// parameters unchanged if they are labeled with a different key or can't be read.
+        bool load_mismapping_calibration(istream& in, const string& key);
+
         /// Experimental: skeleton code for predicting path distance from minimum distance
         void determine_distance_correlation();
         
@@ -223,7 +235,7 @@ namespace vg {
         /// actual extracted graph, a list of assigned MEMs, and the number of
         /// bases of read coverage that that MEM cluster provides (which serves
         /// as a priority).
-        using clustergraph_t = tuple<unique_ptr<bdsg::HashGraph>, memcluster_t, size_t>;
+        using clustergraph_t = tuple<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, memcluster_t, size_t>;
         
         /// Represents the mismatches that were allowed in "MEMs" from the fanout
         /// match algorithm
@@ -350,14 +362,14 @@ namespace vg {
         /// Return a graph (on the heap) that contains a cluster. The paired bool
         /// indicates whether the graph is known to be connected (but it is possible
         /// for the graph to be connected and have it return false)
-        pair<unique_ptr<bdsg::HashGraph>, bool> extract_cluster_graph(const Alignment& alignment,
+        pair<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool> extract_cluster_graph(const Alignment& alignment,
                                                                       const memcluster_t& mem_cluster) const;
         
         /// Extract a graph that is guaranteed to contain all local alignments that include
         /// the MEMs of the cluster.  The paired bool indicates whether the graph is
         /// known to be connected (but it is possible for the graph to be connected and have
         /// it return false)
-        pair<unique_ptr<bdsg::HashGraph>, bool> extract_maximal_graph(const Alignment& alignment,
+        pair<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool> extract_maximal_graph(const Alignment& alignment,
                                                                       const memcluster_t& mem_cluster) const;
         
         /// Extract a graph with an algorithm that tries to extract not much more than what
@@ -365,7 +377,7 @@ namespace vg {
         /// than the maximal algorithm for alignments that require large indels),  The paired bool
         /// indicates whether the graph is known to be connected (but it is possible
         /// for the graph to be connected and have it return false)
-        pair<unique_ptr<bdsg::HashGraph>, bool> extract_restrained_graph(const Alignment& alignment,
+        pair<unique_ptr<ArenaSubgraph, ArenaSubgraph::Recycler>, bool> extract_restrained_graph(const Alignment& alignment,
                                                                          const memcluster_t& mem_cluster) const;
         
         /// Returns the union of the intervals on the read that a cluster cover in sorted order
@@ -703,6 +715,142 @@ namespace vg {
         bool _wrote_mem_stats_header = false;
 #endif
     };
+    
+    /**
+     * The parameters that vg mpmap sets on a MultipathMapper, apart from the indexes and the scoring
+     * matrix, intron length distribution and reference paths that it reads from files or finds in the
+     * graph. The defaults are the values that vg mpmap ends up with under its default presets (RNA,
+     * short reads, low error rate) when it maps unpaired reads to multipath output.
+     *
+     * These are also what identify a mismapping detection calibration, so anything that changes how
+     * the mapper maps reads must be a member here and must be written by serialize().
+     */
+    struct MultipathMapperSettings {
+        
+        // scoring
+        int match_score = default_match;
+        int mismatch_score = default_mismatch;
+        int gap_open_score = default_gap_open;
+        int gap_extension_score = default_gap_extension;
+        int full_length_bonus = default_full_length_bonus;
+        bool adjust_alignments_for_base_quality = true;
+        bool strip_bonuses = false;
+        double band_padding_multiplier = 1.0;
+        
+        // MEM finding (the burn-in and fan-out thresholds are offsets from log4 of the graph's length,
+        // and a minimum clustering MEM length of 0 means to choose it automatically)
+        int hit_max = 100;
+        int hard_hit_max = 300;
+        int mem_reseed_length = 28;
+        double fast_reseed_length_diff = 0.6;
+        size_t sub_mem_count_thinning = 4;
+        size_t sub_mem_thinning_burn_in_diff = 1;
+        size_t order_length_repeat_hit_max = 3000;
+        int min_mem_length = 1;
+        int min_clustering_mem_length = 0;
+        bool use_stripped_match_alg = false;
+        int stripped_match_alg_strip_length = 10;
+        int stripped_match_alg_max_length = 0;
+        int stripped_match_alg_target_count = 10;
+        bool use_greedy_mem_restarts = true;
+        int greedy_restart_min_length = 30;
+        int greedy_restart_max_count = 2;
+        int greedy_restart_max_lcp = 25;
+        bool greedy_restart_assume_substitution = false;
+        bool filter_short_mems = false;
+        double short_mem_filter_factor = 0.45;
+        bool use_fanout_match_alg = false;
+        int max_fanout_base_quality = 20;
+        int max_fans_out = 3;
+        int fanout_pruning_diff = 3;
+        bool adaptive_reseed_diff = true;
+        double adaptive_diff_exponent = 0.065;
+        bool prefilter_redundant_hits = true;
+        bool precollapse_order_length_hits = true;
+        int max_sub_mem_recursion_depth = 1;
+        double max_mapping_p_value = 0.0001;
+        double max_rescue_p_value = 0.03;
+        bool suppress_mismapping_detection = false;
+        
+        // mapping quality
+        MappingQualityMethod mapping_quality_method = Exact;
+        int max_mapping_quality = 60;
+        double mapq_scaling_factor = 0.5;
+        bool report_group_mapq = true;
+        bool report_allelic_mapq = false;
+        int population_max_paths = 10;
+        int population_paths_hard_cap = 1000;
+        bool top_tracebacks = false;
+        double recombination_penalty = 20.7;
+        bool always_check_population = false;
+        size_t force_haplotype_count = 0;
+        
+        // clustering and pruning
+        bool no_clustering = false;
+        bool use_tvs_clusterer = false;
+        bool use_min_dist_clusterer = false;
+        bool greedy_min_dist = false;
+        bool component_min_dist = true;
+        int max_expected_dist_approx_error = 12;
+        double mem_coverage_min_ratio = 0.2;
+        double log_likelihood_approx_factor = 3.5;
+        int num_mapping_attempts = 64;
+        int min_median_mem_coverage_for_split = 0;
+        bool suppress_cluster_merging = false;
+        bool suppress_multicomponent_splitting = false;
+        int reversing_walk_length = 1;
+        int max_alt_mappings = 10;
+        int max_alignment_gap = 5000;
+        bool use_pessimistic_tail_alignment = false;
+        double pessimistic_gap_multiplier = 3.0;
+        bool restrained_graph_extraction = false;
+        
+        // pair rescue
+        int max_rescue_attempts = 10;
+        int max_single_end_mappings_for_rescue = 32;
+        int secondary_rescue_subopt_diff = 35;
+        double secondary_rescue_score_diff = 0.8;
+        size_t secondary_rescue_attempts = 1;
+        size_t rescue_only_min = numeric_limits<size_t>::max();
+        size_t rescue_only_anchor_max = 16;
+        int fragment_length_warning_factor = 25;
+        bool get_rescue_graph_from_paths = false;
+        double rescue_graph_std_devs = 6.0;
+        
+        // multipath alignment topology
+        int max_snarl_cut_size = 5;
+        int max_branch_trim_length = 5;
+        bool suppress_tail_anchors = true;
+        int num_alt_alns = 16;
+        bool dynamic_max_alt_alns = true;
+        bool simplify_topologies = true;
+        double max_suboptimal_path_score_ratio = 1.25;
+        bool agglomerate_multipath_alns = false;
+        
+        // splicing (the minimum soft-clip length is derived from the overlap and the graph's length)
+        int max_softclip_overlap = 8;
+        int max_splice_overhang = 16;
+        double no_splice_log_odds = 2.0;
+        double splice_rescue_graph_std_devs = 3.0;
+        int max_motif_pairs = 200;
+        string read_1_adapter = "AGATCGGAAGAG";
+        string read_2_adapter = "AGATCGGAAGAG";
+        
+        // mismapping detection calibration
+        size_t calibration_simulations = MultipathMapper::default_calibration_simulations;
+        vector<size_t> calibration_read_lengths = MultipathMapper::default_calibration_read_lengths;
+        
+        /// Set the parameters on a mapper for a graph with this total sequence length, as vg mpmap
+        /// does. Spliced alignment is left as it is, since it should be off while calibrating.
+        void apply(MultipathMapper& mapper, size_t total_seq_length) const;
+        
+        /// Write all of the parameters to a stream
+        void serialize(ostream& out) const;
+        
+        /// Make a key that identifies the results of calibrate_mismapping_detection with these
+        /// parameters and the given index and input files
+        string calibration_key(const vector<string>& filenames) const;
+    };
         
 }
 
@@ -1,4 +1,5 @@
 #include <thread>
+#include <limits>
 #include <vg/io/protobuf_iterator.hpp>
 #include "packer.hpp"
 #include "statistics.hpp"
@@ -11,6 +12,8 @@ namespace vg {
 
 const int Packer::maximum_quality = 60;
 const int Packer::lru_cache_size = 4096;
+// no real pack has this bin size
+const size_t Packer::blocked_format_tag = numeric_limits<size_t>::max();
 
 size_t Packer::estimate_data_width(size_t expected_coverage) {
     return std::ceil(std::log2(2 * expected_coverage));
@@ -28,10 +31,16 @@ size_t Packer::estimate_bin_count(size_t num_threads) {
     return pow(2, log2(num_threads) + 14);
 }
 
+size_t Packer::estimate_coverage_buffer_size(size_t num_threads) {
+    // nobody to contend with on one thread
+    return num_threads > 1 ? 1 << 16 : 0;
+}
+
 Packer::Packer(const HandleGraph* graph) : graph(graph), data_width(8), cov_bin_size(0), edge_cov_bin_size(0), num_bases_dynamic(0), base_locks(nullptr), num_edges_dynamic(0), edge_locks(nullptr), node_quality_locks(nullptr), tmpfstream_locks(nullptr) { }
 
-Packer::Packer(const HandleGraph* graph, bool record_bases, bool record_edges, bool record_edits, bool record_qualities, size_t bin_size, size_t coverage_bins, size_t data_width) :
-    graph(graph), data_width(data_width), bin_size(bin_size), record_bases(record_bases), record_edges(record_edges), record_edits(record_edits), record_qualities(record_qualities) {
+Packer::Packer(const HandleGraph* graph, bool record_bases, bool record_edges, bool record_edits, bool record_qualities, size_t bin_size, size_t coverage_bins, size_t data_width,
+               size_t coverage_buffer_size) :
+    graph(graph), data_width(data_width), coverage_buffer_size(coverage_buffer_size), bin_size(bin_size), record_bases(record_bases), record_edges(record_edges), record_edits(record_edits), record_qualities(record_qualities) {
     // get the size of the base coverage counter
     num_bases_dynamic = 0;
     if (record_bases) {
@@ -101,6 +110,13 @@ Packer::Packer(const HandleGraph* graph, bool record_bases, bool record_edges, b
     for (size_t i = 0; i < get_thread_count(); ++i) {
         quality_cache.push_back(new LRUCache<pair<int, int>, int>(lru_cache_size));
     }
+
+    // per-thread increment buffers, if we're batching
+    if (coverage_buffer_size) {
+        base_buffers.resize(get_thread_count());
+        edge_buffers.resize(get_thread_count());
+        node_quality_buffers.resize(get_thread_count());
+    }
     
 #ifdef debug
     cerr << "Packing across " << num_edges_dynamic << " edge slots and " << num_bases_dynamic << " base slots in " << coverage_bins << " bins" << endl;
@@ -134,6 +150,9 @@ void Packer::clear() {
         delete lru_cache;
         lru_cache = nullptr;
     }
+    base_buffers.clear();
+    edge_buffers.clear();
+    node_quality_buffers.clear();
 }
 
 Packer::~Packer() {
@@ -157,6 +176,22 @@ void Packer::save_to_file(const string& file_name) {
 
 void Packer::load(istream& in) {
     sdsl::read_member(bin_size, in);
+    if (bin_size == blocked_format_tag) {
+        // streamed pack: base coverage is in blocks, and there are no edits
+        sdsl::read_member(num_bases_blocked, in);
+        sdsl::read_member(coverage_block_size, in);
+        coverage_blocks.resize((num_bases_blocked + coverage_block_size - 1) / coverage_block_size);
+        for (auto& coverage_block : coverage_blocks) {
+            coverage_block.load(in);
+        }
+        edge_coverage_civ.load(in);
+        node_quality_civ.load(in);
+        bin_size = 0;
+        n_bins = 0;
+        edit_csas.clear();
+        is_compacted = true;
+        return;
+    }
     sdsl::read_member(n_bins, in);
     coverage_civ.load(in);
     edge_coverage_civ.load(in);
@@ -180,6 +215,11 @@ void Packer::merge_from_files(const vector<string>& file_names) {
         Packer c;
         ifstream f(file_name);
         c.load(f);
+        if (c.get_n_bins() == 0) {
+            // streamed pack, which has no edits to merge
+            collect_coverage({&c});
+            continue;
+        }
         // take bin size and counts from the first, assume they are all the same
         if (first) {
             bin_size = c.get_bin_size();
@@ -253,6 +293,9 @@ void Packer::write_edits(ostream& out, size_t bin) const {
 void Packer::collect_coverage(const vector<Packer*>& packers) {
     // assume the same basis vector
     assert(!is_compacted);
+    for (Packer* packer : packers) {
+        packer->flush_coverage_buffers();
+    }
     if (record_bases) {
 #pragma omp parallel for
         for (size_t i = 0; i < coverage_dynamic.size(); ++i) {
@@ -303,6 +346,19 @@ size_t Packer::serialize(std::ostream& out,
     make_compact();
     sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(s, name, sdsl::util::class_name(*this));
     size_t written = 0;
+    if (coverage_block_size) {
+        // we were loaded from a streamed pack, so write it back the same way
+        written += sdsl::write_member(blocked_format_tag, out, child, "format_" + name);
+        written += sdsl::write_member(num_bases_blocked, out, child, "num_bases_" + name);
+        written += sdsl::write_member(coverage_block_size, out, child, "block_size_" + name);
+        for (auto& coverage_block : coverage_blocks) {
+            written += coverage_block.serialize(out, child, "graph_coverage_" + name);
+        }
+        written += edge_coverage_civ.serialize(out, child, "edge_coverage_" + name);
+        written += node_quality_civ.serialize(out, child, "node_quality_" + name);
+        sdsl::structure_tree::add_size(child, written);
+        return written;
+    }
     written += sdsl::write_member(bin_size, out, child, "bin_size_" + name);
     written += sdsl::write_member(edit_csas.size(), out, child, "n_bins_" + name);
     written += coverage_civ.serialize(out, child, "graph_coverage_" + name);
@@ -329,6 +385,8 @@ void Packer::make_compact(void) {
     }
     // sync edit file
     close_edit_tmpfiles();
+    // and apply any buffered coverage
+    flush_coverage_buffers();
     
     // temporaries for construction
     size_t basis_length = coverage_size();
@@ -477,6 +535,25 @@ void Packer::add(const Alignment& aln, int min_mapq, int min_baseq, int trim_end
         }
     }
     size_t trim_last = read_length + 1 < trim_ends ? 0 : read_length - trim_ends - 1;
+
+    // if batching, we buffer increments here instead of locking bins one base at a time
+    size_t thread = omp_get_thread_num();
+    vector<size_t>* base_buffer = coverage_buffer_size ? &base_buffers[thread] : nullptr;
+    vector<size_t>* edge_buffer = coverage_buffer_size ? &edge_buffers[thread] : nullptr;
+    vector<pair<size_t, size_t>>* node_quality_buffer = coverage_buffer_size ? &node_quality_buffers[thread] : nullptr;
+
+    if (stream_out != nullptr) {
+        // sorted input means nothing before the first node this read touches can get more coverage
+        size_t read_start = numeric_limits<size_t>::max();
+        for (auto& mapping : aln.path().mapping()) {
+            if (mapping.has_position() && graph->has_node(mapping.position().node_id())) {
+                read_start = min(read_start, dynamic_cast<const VectorizableHandleGraph*>(graph)->node_vector_offset(mapping.position().node_id()));
+            }
+        }
+        if (read_start != numeric_limits<size_t>::max()) {
+            advance_stream(read_start);
+        }
+    }
     
     size_t cur_pos = 0;
     for (size_t mi = 0; mi < aln.path().mapping_size(); ++mi) {
@@ -516,7 +593,13 @@ void Packer::add(const Alignment& aln, int min_mapq, int min_baseq, int trim_end
                         // base quality threshold filter (only if we found some kind of quality)
                         if (record_bases && (base_quality < 0 || base_quality >= min_baseq) &&
                             position_in_read >= trim_ends && position_in_read <= trim_last) {
-                            increment_coverage(coverage_idx);
+                            if (stream_out != nullptr) {
+                                increment_stream_coverage(coverage_idx);
+                            } else if (base_buffer) {
+                                base_buffer->push_back(coverage_idx);
+                            } else {
+                                increment_coverage(coverage_idx);
+                            }
                             if (record_qualities && mapping_quality > 0) {
                                 total_node_quality += mapping_quality;
                             }
@@ -541,7 +624,11 @@ void Packer::add(const Alignment& aln, int min_mapq, int min_baseq, int trim_end
                 ++ei;
             }
             if (total_node_quality > 0) {
-                increment_node_quality(node_quality_index, total_node_quality);
+                if (node_quality_buffer) {
+                    node_quality_buffer->emplace_back(node_quality_index, total_node_quality);
+                } else {
+                    increment_node_quality(node_quality_index, total_node_quality);
+                }
             }
         }
         
@@ -570,7 +657,11 @@ void Packer::add(const Alignment& aln, int min_mapq, int min_baseq, int trim_end
                 }
                 // base quality threshold filter (only if we found some kind of quality)
                 if (avg_base_quality < 0 || avg_base_quality >= min_baseq) {
-                    increment_edge_coverage(edge_idx);
+                    if (edge_buffer) {
+                        edge_buffer->push_back(edge_idx);
+                    } else {
+                        increment_edge_coverage(edge_idx);
+                    }
                 }
             }
         }
@@ -578,6 +669,189 @@ void Packer::add(const Alignment& aln, int min_mapq, int min_baseq, int trim_end
         prev_mapping = mapping;
         has_prev_mapping = true;
     }
+
+    if (coverage_buffer_size && (base_buffer->size() >= coverage_buffer_size ||
+                                 edge_buffer->size() >= coverage_buffer_size ||
+                                 node_quality_buffer->size() >= coverage_buffer_size)) {
+        flush_coverage_buffer(thread);
+    }
+}
+
+void Packer::start_streaming(ostream& out, size_t block_size) {
+    assert(!is_compacted && record_bases && !record_edits && block_size > 0);
+    stream_out = &out;
+    coverage_block_size = block_size;
+    num_bases_blocked = num_bases_dynamic;
+    stream_first_block = 0;
+    stream_blocks.clear();
+    sdsl::write_member(blocked_format_tag, out);
+    sdsl::write_member(num_bases_blocked, out);
+    sdsl::write_member(coverage_block_size, out);
+    if (record_qualities) {
+        // we average out node qualities as their coverage gets written
+        util::assign(stream_node_quality, int_vector<>(num_nodes_dynamic, 0, 16));
+        stream_node_rank = 0;
+        stream_node_end = 0;
+        stream_node_coverage = 0;
+    }
+}
+
+void Packer::finish_streaming() {
+    assert(stream_out != nullptr);
+    while (stream_first_block * coverage_block_size < num_bases_blocked) {
+        flush_stream_block();
+    }
+    if (record_qualities) {
+        while (stream_node_rank < num_nodes_dynamic) {
+            next_stream_node();
+        }
+    }
+    
+    // edges are few enough that we kept them all
+    size_t edge_coverage_length = edge_vector_size();
+    int_vector<> edge_coverage_iv(edge_coverage_length);
+#pragma omp parallel for
+    for (size_t i = 0; i < edge_coverage_length; ++i) {
+        edge_coverage_iv[i] = edge_coverage(i);
+    }
+    vlc_vector<>(edge_coverage_iv).serialize(*stream_out);
+    vlc_vector<>(stream_node_quality).serialize(*stream_out);
+    stream_out->flush();
+    
+    stream_out = nullptr;
+    stream_blocks.clear();
+    util::clear(stream_node_quality);
+}
+
+void Packer::increment_stream_coverage(size_t i) {
+    size_t block = i / coverage_block_size;
+    if (block < stream_first_block) {
+        stringstream ss;
+        ss << "Error [Packer]: alignment covers base " << i << " after its coverage was written. "
+           << "Streaming requires alignments sorted by vg gamsort on a graph with node ranks in ID order.";
+        throw runtime_error(ss.str());
+    }
+    while (stream_first_block + stream_blocks.size() <= block) {
+        stream_blocks.emplace_back();
+    }
+    vector<uint32_t>& counts = stream_blocks[block - stream_first_block];
+    if (counts.empty()) {
+        // blocks only get memory once something lands in them
+        counts.resize(min(coverage_block_size, num_bases_blocked - block * coverage_block_size), 0);
+    }
+    ++counts[i - block * coverage_block_size];
+}
+
+void Packer::advance_stream(size_t i) {
+    while ((stream_first_block + 1) * coverage_block_size <= i) {
+        flush_stream_block();
+    }
+}
+
+void Packer::flush_stream_block() {
+    size_t block_start = stream_first_block * coverage_block_size;
+    size_t block_length = min(coverage_block_size, num_bases_blocked - block_start);
+    int_vector<> coverage_iv(block_length, 0, 32);
+    if (!stream_blocks.empty()) {
+        vector<uint32_t>& counts = stream_blocks.front();
+        for (size_t j = 0; j < counts.size(); ++j) {
+            coverage_iv[j] = counts[j];
+        }
+    }
+    if (record_qualities) {
+        for (size_t j = 0; j < block_length; ++j) {
+            while (stream_node_rank < num_nodes_dynamic && block_start + j >= stream_node_end) {
+                next_stream_node();
+            }
+            stream_node_coverage += coverage_iv[j];
+        }
+    }
+    util::bit_compress(coverage_iv);
+    dac_vector<>(coverage_iv).serialize(*stream_out);
+    
+    if (!stream_blocks.empty()) {
+        stream_blocks.pop_front();
+    }
+    ++stream_first_block;
+}
+
+void Packer::next_stream_node() {
+    if (stream_node_rank > 0 && stream_node_coverage > 0) {
+        // same as average_node_quality()
+        stream_node_quality[stream_node_rank] = total_node_quality(stream_node_rank) / stream_node_coverage;
+    }
+    stream_node_coverage = 0;
+    ++stream_node_rank;
+    if (stream_node_rank < num_nodes_dynamic) {
+        nid_t node_id = index_to_node(stream_node_rank);
+        stream_node_end = dynamic_cast<const VectorizableHandleGraph*>(graph)->node_vector_offset(node_id)
+            + graph->get_length(graph->get_handle(node_id));
+    }
+}
+
+void Packer::flush_coverage_buffers() {
+    for (size_t i = 0; i < base_buffers.size(); ++i) {
+        flush_coverage_buffer(i);
+    }
+}
+
+void Packer::flush_coverage_buffer(size_t thread) {
+    // sorting groups the increments by bin, so we lock each bin once and
+    // collapse repeated positions into a single counter update
+    vector<size_t>& base_buffer = base_buffers[thread];
+    std::sort(base_buffer.begin(), base_buffer.end());
+    for (size_t i = 0; i < base_buffer.size();) {
+        size_t bin = coverage_bin_offset(base_buffer[i]).first;
+        std::lock_guard<std::mutex> guard(base_locks[bin]);
+        init_coverage_bin(bin);
+        gcsa::CounterArray& counter = *coverage_dynamic[bin];
+        while (i < base_buffer.size() && coverage_bin_offset(base_buffer[i]).first == bin) {
+            size_t j = i + 1;
+            while (j < base_buffer.size() && base_buffer[j] == base_buffer[i]) {
+                ++j;
+            }
+            counter.increment(coverage_bin_offset(base_buffer[i]).second, j - i);
+            i = j;
+        }
+    }
+    base_buffer.clear();
+
+    vector<size_t>& edge_buffer = edge_buffers[thread];
+    std::sort(edge_buffer.begin(), edge_buffer.end());
+    for (size_t i = 0; i < edge_buffer.size();) {
+        size_t bin = edge_coverage_bin_offset(edge_buffer[i]).first;
+        std::lock_guard<std::mutex> guard(edge_locks[bin]);
+        init_edge_coverage_bin(bin);
+        gcsa::CounterArray& counter = *edge_coverage_dynamic[bin];
+        while (i < edge_buffer.size() && edge_coverage_bin_offset(edge_buffer[i]).first == bin) {
+            size_t j = i + 1;
+            while (j < edge_buffer.size() && edge_buffer[j] == edge_buffer[i]) {
+                ++j;
+            }
+            counter.increment(edge_coverage_bin_offset(edge_buffer[i]).second, j - i);
+            i = j;
+        }
+    }
+    edge_buffer.clear();
+
+    vector<pair<size_t, size_t>>& node_quality_buffer = node_quality_buffers[thread];
+    std::sort(node_quality_buffer.begin(), node_quality_buffer.end());
+    for (size_t i = 0; i < node_quality_buffer.size();) {
+        size_t bin = node_quality_bin_offset(node_quality_buffer[i].first).first;
+        std::lock_guard<std::mutex> guard(node_quality_locks[bin]);
+        init_node_quality_bin(bin);
+        gcsa::CounterArray& counter = *node_quality_dynamic[bin];
+        while (i < node_quality_buffer.size() && node_quality_bin_offset(node_quality_buffer[i].first).first == bin) {
+            size_t total = 0;
+            size_t j = i;
+            for (; j < node_quality_buffer.size() && node_quality_buffer[j].first == node_quality_buffer[i].first; ++j) {
+                total += node_quality_buffer[j].second;
+            }
+            counter.increment(node_quality_bin_offset(node_quality_buffer[i].first).second, total);
+            i = j;
+        }
+    }
+    node_quality_buffer.clear();
 }
 
 // find the position on the forward strand in the sequence vector
@@ -650,7 +924,7 @@ string Packer::unescape_delim(const string& s, char d) const {
 
 size_t Packer::coverage_size(void) const {
     if (is_compacted){
-        return coverage_civ.size();
+        return coverage_block_size ? num_bases_blocked : coverage_civ.size();
     }
     else{
         return num_bases_dynamic;
@@ -811,6 +1085,9 @@ bool Packer::has_qualities() const {
 
 size_t Packer::coverage_at_position(size_t i) const {
     if (is_compacted) {
+        if (coverage_block_size) {
+            return coverage_blocks[i / coverage_block_size][i % coverage_block_size];
+        }
         return coverage_civ[i];
     } else {
         pair<size_t, size_t> bin_offset = coverage_bin_offset(i);
@@ -890,7 +1167,7 @@ size_t Packer::average_node_quality(size_t i) const {
 
 vector<Edit> Packer::edits_at_position(size_t i) const {
     vector<Edit> edits;
-    if (i == 0) return edits;
+    if (i == 0 || edit_csas.empty()) return edits;
     string key = pos_key(i);
     size_t bin = bin_for_position(i);
     auto& edit_csa = edit_csas[bin];
@@ -939,6 +1216,17 @@ size_t Packer::node_index(nid_t node_id) const {
     return dynamic_cast<const VectorizableHandleGraph*>(graph)->id_to_rank(node_id);
 }
 
+bool Packer::node_ranks_follow_ids() const {
+    auto vectorizable = dynamic_cast<const VectorizableHandleGraph*>(graph);
+    // ranks are 1-based
+    for (size_t rank = 2; rank <= graph->get_node_count(); ++rank) {
+        if (vectorizable->rank_to_id(rank) <= vectorizable->rank_to_id(rank - 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 nid_t Packer::index_to_node(size_t i) const {
     return dynamic_cast<const VectorizableHandleGraph*>(graph)->rank_to_id(i);
 }
@@ -955,15 +1243,16 @@ ostream& Packer::as_table(ostream& out, bool show_edits, vector<vg::id_t> node_i
     if (show_edits) out << "\t" << "edits";
     out << endl;
     // write the coverage as a vector
-    for (size_t i = 0; i < coverage_civ.size(); ++i) {
+    size_t basis_length = coverage_size();
+    for (size_t i = 0; i < basis_length; ++i) {
         nid_t node_id = dynamic_cast<const VectorizableHandleGraph*>(graph)->node_at_vector_offset(i+1);
         if (!node_ids.empty() && find(node_ids.begin(), node_ids.end(), node_id) == node_ids.end()) {
             continue;
         }
         size_t offset = i - dynamic_cast<const VectorizableHandleGraph*>(graph)->node_vector_offset(node_id);
-        out << i << "\t" << node_id << "\t" << offset << "\t" << coverage_civ[i];
+        out << i << "\t" << node_id << "\t" << offset << "\t" << coverage_at_position(i);
         if (show_edits) {
-            out << "\t" << count(edit_csas[bin_for_position(i)], pos_key(i));
+            out << "\t" << (edit_csas.empty() ? 0 : count(edit_csas[bin_for_position(i)], pos_key(i)));
             for (auto& edit : edits_at_position(i)) out << " " << pb2json(edit);
         }
         out << endl;
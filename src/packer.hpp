@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <map>
+#include <deque>
 #include <chrono>
 #include <ctime>
 #include <mutex>
@@ -35,6 +36,7 @@ public:
     static size_t estimate_data_width(size_t expected_coverage);
     static size_t estimate_batch_size(size_t num_threads);
     static size_t estimate_bin_count(size_t num_threads);
+    static size_t estimate_coverage_buffer_size(size_t num_threads);
 
     /// Create a Packer (to read from a file)
     Packer(const HandleGraph* graph = nullptr);
@@ -49,8 +51,10 @@ public:
     /// coverage_bins : Use this many coverage objects.  Using one / thread allows faster merge
     /// coverage_locks : Number of mutexes to use for each of node and edge coverage.
     /// data_width : Number of bits per entry in the dynamic coverage vector.  Higher values get stored in a map
+    /// coverage_buffer_size : If nonzero, each thread buffers up to about this many coverage increments and applies
+    ///                        them in sorted batches, taking each bin's mutex once per batch instead of once per base
     Packer(const HandleGraph* graph, bool record_bases, bool record_edges, bool record_edits, bool record_qualities,
-           size_t bin_size = 0, size_t coverage_bins = 1, size_t data_width = 8);
+           size_t bin_size = 0, size_t coverage_bins = 1, size_t data_width = 8, size_t coverage_buffer_size = 0);
     ~Packer();
     void clear();
 
@@ -61,6 +65,22 @@ public:
     /// trim_ends : ignore first and last <trim_ends> bases
     void add(const Alignment& aln, int min_mapq = 0, int min_baseq = 0, int trim_ends = 0);
 
+    /// Apply any coverage increments still held in the per-thread buffers.
+    /// The dynamic coverage accessors only see buffered increments after this
+    /// is called (make_compact() calls it). Must not run concurrently with add().
+    void flush_coverage_buffers();
+
+    /// Write compressed coverage to the given stream as alignments are add()ed, keeping only
+    /// a window of base coverage in memory instead of a counter for every base in the graph.
+    /// Alignments must be added from one thread in the order vg gamsort sorts them, on a graph
+    /// whose node ranks follow its node IDs (see node_ranks_follow_ids()); add() throws if an
+    /// alignment covers a base whose coverage was already written. Edits can't be recorded this way.
+    /// The output loads like any other pack file.
+    void start_streaming(ostream& out, size_t block_size = 1 << 20);
+    /// Write out all remaining coverage after the last add(). The Packer can't be used
+    /// for anything else afterward.
+    void finish_streaming();
+
     void merge_from_files(const vector<string>& file_names);
     void merge_from_dynamic(vector<Packer*>& packers);
     void load_from_file(const string& file_name);
@@ -109,6 +129,8 @@ public:
     size_t node_index(nid_t node_id) const;
     /// and back
     nid_t index_to_node(size_t i) const;
+    /// are the graph's node ranks in the same order as its node IDs, as streaming requires?
+    bool node_ranks_follow_ids() const;
     void increment_node_quality(size_t i, size_t v);
     /// return true if there's at least one nonzero quality in the structure
     bool has_qualities() const;
@@ -126,6 +148,16 @@ private:
     void init_coverage_bin(size_t i);
     void init_edge_coverage_bin(size_t i);
     void init_node_quality_bin(size_t i);
+    /// apply and clear one thread's buffered increments
+    void flush_coverage_buffer(size_t thread);
+    /// add one to the base coverage in the streaming window
+    void increment_stream_coverage(size_t i);
+    /// write out all streaming blocks that end at or before the given position
+    void advance_stream(size_t i);
+    /// write out the first streaming block in the window
+    void flush_stream_block();
+    /// finish the node quality of the current streaming node and move to the next one
+    void next_stream_node();
     
     void ensure_edit_tmpfiles_open(void);
     void close_edit_tmpfiles(void);
@@ -164,6 +196,15 @@ private:
     size_t num_nodes_dynamic;
     // one mutex per element of node_quality_dynamic
     std::mutex* node_quality_locks;
+
+    // buffered increments (one buffer per thread), used if coverage_buffer_size is nonzero
+    size_t coverage_buffer_size = 0;
+    // base coverage positions, one entry per increment
+    vector<vector<size_t>> base_buffers;
+    // edge indexes, one entry per increment
+    vector<vector<size_t>> edge_buffers;
+    // (node rank, quality) pairs
+    vector<vector<pair<size_t, size_t>>> node_quality_buffers;
     
     vector<string> edit_tmpfile_names;
     vector<ofstream*> tmpfstreams;
@@ -175,6 +216,11 @@ private:
     size_t edit_length = 0;
     size_t edit_count = 0;
     dac_vector<> coverage_civ; // graph coverage (compacted coverage_dynamic)
+    // streamed packs store the graph coverage in fixed-size blocks instead of coverage_civ
+    static const size_t blocked_format_tag;
+    size_t coverage_block_size = 0;
+    size_t num_bases_blocked = 0;
+    vector<dac_vector<>> coverage_blocks;
     vlc_vector<> edge_coverage_civ; // edge coverage (compacted edge_coverage_dynamic)
     vlc_vector<> node_quality_civ; // averge mapq for each node rank (compacted node_quality_dynamic)
     // edits
@@ -195,6 +241,16 @@ private:
     bool record_edits;
     bool record_qualities;
     
+    // streaming state: the output, and the coverage of the blocks not yet written
+    ostream* stream_out = nullptr;
+    size_t stream_first_block = 0;
+    deque<vector<uint32_t>> stream_blocks;
+    // node whose average quality we're accumulating coverage for, by rank
+    size_t stream_node_rank = 0;
+    size_t stream_node_end = 0;
+    size_t stream_node_coverage = 0;
+    int_vector<> stream_node_quality;
+    
     // Combine the MAPQ and base quality (if available) for a given position in the read
     int compute_quality(const Alignment& aln, size_t position_in_read) const;
     int combine_qualities(int map_quality, int base_quality) const;
@@ -0,0 +1,238 @@
+/**
+ * \file path_position_cache.cpp
+ * Implements the node to path position lookup table used to speed up surjection.
+ */
+
+#include "path_position_cache.hpp"
+
+#include <omp.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace vg {
+
+using namespace std;
+
+    static const char path_position_cache_magic[8] = {'v', 'g', 'p', 'a', 't', 'h', 'p', '2'};
+
+    PathPositionCache::PathPositionCache(const PathPositionHandleGraph& graph, const vector<path_handle_t>& paths) :
+        paths(paths), graph_node_count(graph.get_node_count()), graph_max_id(graph.max_node_id()) {
+
+        for (size_t i = 0; i < paths.size(); ++i) {
+            path_ranks[paths[i]] = i;
+            path_names.push_back(graph.get_path_name(paths[i]));
+            path_lengths.push_back(graph.get_path_length(paths[i]));
+            path_step_counts.push_back(graph.get_step_count(paths[i]));
+        }
+
+        // walk each path in parallel, recording its visits
+        vector<vector<pair<uint64_t, Visit>>> path_visits(paths.size());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < paths.size(); ++i) {
+            auto& visits_here = path_visits[i];
+            visits_here.reserve(graph.get_step_count(paths[i]));
+            graph.for_each_step_in_path(paths[i], [&](const step_handle_t& step) {
+                handle_t handle = graph.get_handle_of_step(step);
+                Visit visit;
+                visit.path_rank = i;
+                visit.offset = graph.get_position_of_step(step);
+                visits_here.emplace_back(graph.get_id(handle), visit);
+            });
+        }
+
+        // collect the visited nodes
+        size_t visit_count = 0;
+        for (const auto& visits_here : path_visits) {
+            visit_count += visits_here.size();
+            for (const auto& visit : visits_here) {
+                owned_node_ids.push_back(visit.first);
+            }
+        }
+        sort(owned_node_ids.begin(), owned_node_ids.end());
+        owned_node_ids.erase(unique(owned_node_ids.begin(), owned_node_ids.end()), owned_node_ids.end());
+        owned_node_ids.shrink_to_fit();
+
+        // replace the node IDs with their ranks
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < path_visits.size(); ++i) {
+            for (auto& visit : path_visits[i]) {
+                visit.first = lower_bound(owned_node_ids.begin(), owned_node_ids.end(), visit.first) - owned_node_ids.begin();
+            }
+        }
+
+        // lay out the visits of each node contiguously, keeping them in path rank and then path order
+        owned_node_starts.resize(owned_node_ids.size() + 1, 0);
+        for (const auto& visits_here : path_visits) {
+            for (const auto& visit : visits_here) {
+                ++owned_node_starts[visit.first + 1];
+            }
+        }
+        for (size_t i = 1; i < owned_node_starts.size(); ++i) {
+            owned_node_starts[i] += owned_node_starts[i - 1];
+        }
+        owned_visits.resize(visit_count);
+        vector<uint64_t> next_visit(owned_node_starts.begin(), owned_node_starts.end() - 1);
+        for (auto& visits_here : path_visits) {
+            for (const auto& visit : visits_here) {
+                owned_visits[next_visit[visit.first]++] = visit.second;
+            }
+            // free as we go, so we don't hold two copies of all the visits
+            vector<pair<uint64_t, Visit>>().swap(visits_here);
+        }
+
+        node_count = owned_node_ids.size();
+        node_ids = owned_node_ids.data();
+        node_starts = owned_node_starts.data();
+        visits = owned_visits.data();
+    }
+
+    PathPositionCache::PathPositionCache(const PathPositionHandleGraph& graph, const string& filename) {
+        std::error_code error;
+        mapping.map(filename, error);
+        if (error) {
+            throw runtime_error("error[PathPositionCache]: unable to map " + filename + ": " + error.message());
+        }
+        const char* data = mapping.data();
+        size_t size = mapping.size();
+        if (size < sizeof(path_position_cache_magic) ||
+            memcmp(data, path_position_cache_magic, sizeof(path_position_cache_magic)) != 0) {
+            throw runtime_error("error[PathPositionCache]: " + filename + " is not a path position cache");
+        }
+
+        size_t cursor = sizeof(path_position_cache_magic);
+        auto read_word = [&]() {
+            if (cursor + sizeof(uint64_t) > size) {
+                throw runtime_error("error[PathPositionCache]: " + filename + " is truncated");
+            }
+            uint64_t word;
+            memcpy(&word, data + cursor, sizeof(word));
+            cursor += sizeof(word);
+            return word;
+        };
+
+        // make sure the cache is for this version of the graph
+        graph_node_count = read_word();
+        graph_max_id = read_word();
+        if (graph_node_count != graph.get_node_count() || graph_max_id != (uint64_t)graph.max_node_id()) {
+            throw runtime_error("error[PathPositionCache]: " + filename + " was built for a graph with "
+                                + to_string(graph_node_count) + " nodes and maximum ID " + to_string(graph_max_id)
+                                + ", but the graph has " + to_string(graph.get_node_count()) + " nodes and maximum ID "
+                                + to_string(graph.max_node_id()));
+        }
+
+        size_t path_count = read_word();
+        for (size_t i = 0; i < path_count; ++i) {
+            size_t name_length = read_word();
+            if (cursor + name_length > size) {
+                throw runtime_error("error[PathPositionCache]: " + filename + " is truncated");
+            }
+            string path_name(data + cursor, name_length);
+            cursor += (name_length + 7) / 8 * 8;
+            if (!graph.has_path(path_name)) {
+                throw runtime_error("error[PathPositionCache]: path " + path_name + " from " + filename + " is not in the graph");
+            }
+            paths.push_back(graph.get_path_handle(path_name));
+            path_ranks[paths.back()] = i;
+            path_names.push_back(path_name);
+            path_lengths.push_back(read_word());
+            path_step_counts.push_back(read_word());
+            if (path_lengths.back() != graph.get_path_length(paths.back()) ||
+                path_step_counts.back() != graph.get_step_count(paths.back())) {
+                throw runtime_error("error[PathPositionCache]: path " + path_name + " in " + filename
+                                    + " has a different length or step count than in the graph");
+            }
+        }
+
+        // leave the arrays in the mapping
+        node_count = read_word();
+        size_t visit_count = read_word();
+        if (cursor + node_count * sizeof(uint64_t) + (node_count + 1) * sizeof(uint64_t)
+            + visit_count * sizeof(Visit) > size) {
+            throw runtime_error("error[PathPositionCache]: " + filename + " is truncated");
+        }
+        node_ids = (const uint64_t*)(data + cursor);
+        cursor += node_count * sizeof(uint64_t);
+        node_starts = (const uint64_t*)(data + cursor);
+        cursor += (node_count + 1) * sizeof(uint64_t);
+        visits = (const Visit*)(data + cursor);
+        if (node_starts[node_count] != visit_count) {
+            throw runtime_error("error[PathPositionCache]: " + filename + " is corrupt");
+        }
+    }
+
+    void PathPositionCache::save(const string& filename) const {
+        ofstream out(filename, std::ios_base::binary);
+        if (!out) {
+            throw runtime_error("error[PathPositionCache]: unable to write " + filename);
+        }
+        auto write_word = [&](uint64_t word) {
+            out.write((const char*)&word, sizeof(word));
+        };
+        out.write(path_position_cache_magic, sizeof(path_position_cache_magic));
+        write_word(graph_node_count);
+        write_word(graph_max_id);
+        write_word(path_names.size());
+        for (size_t i = 0; i < path_names.size(); ++i) {
+            write_word(path_names[i].size());
+            // pad the name out to keep the words aligned
+            string padded_name = path_names[i];
+            padded_name.resize((padded_name.size() + 7) / 8 * 8, '\0');
+            out.write(padded_name.data(), padded_name.size());
+            write_word(path_lengths[i]);
+            write_word(path_step_counts[i]);
+        }
+        write_word(node_count);
+        write_word(get_visit_count());
+        out.write((const char*)node_ids, node_count * sizeof(uint64_t));
+        out.write((const char*)node_starts, (node_count + 1) * sizeof(uint64_t));
+        out.write((const char*)visits, get_visit_count() * sizeof(Visit));
+        if (!out) {
+            throw runtime_error("error[PathPositionCache]: failed writing " + filename);
+        }
+    }
+
+    const vector<path_handle_t>& PathPositionCache::get_paths() const {
+        return paths;
+    }
+
+    bool PathPositionCache::has_path(const path_handle_t& path_handle) const {
+        return path_ranks.count(path_handle);
+    }
+
+    size_t PathPositionCache::get_node_count() const {
+        return node_count;
+    }
+
+    size_t PathPositionCache::get_visit_count() const {
+        return node_starts == nullptr ? 0 : node_starts[node_count];
+    }
+
+    pair<const PathPositionCache::Visit*, const PathPositionCache::Visit*>
+    PathPositionCache::visits_of_node(nid_t node_id) const {
+        const uint64_t* found = lower_bound(node_ids, node_ids + node_count, (uint64_t)node_id);
+        if (found == node_ids + node_count || *found != (uint64_t)node_id) {
+            return make_pair(visits, visits);
+        }
+        size_t rank = found - node_ids;
+        return make_pair(visits + node_starts[rank], visits + node_starts[rank + 1]);
+    }
+
+    void PathPositionCache::for_each_step_on_handle(const PathPositionHandleGraph& graph, const handle_t& handle,
+                                                    const function<void(const step_handle_t&)>& iteratee) const {
+        nid_t node_id = graph.get_id(handle);
+        auto range = visits_of_node(node_id);
+        for (const Visit* visit = range.first; visit != range.second; ++visit) {
+            step_handle_t step = graph.get_step_at_position(paths[visit->path_rank], visit->offset);
+            if (graph.get_id(graph.get_handle_of_step(step)) != node_id) {
+                throw runtime_error("error[PathPositionCache]: cached step of path " + path_names[visit->path_rank]
+                                    + " at offset " + to_string(visit->offset) + " is not on node " + to_string(node_id)
+                                    + "; the cache does not match the graph");
+            }
+            iteratee(step);
+        }
+    }
+
+}
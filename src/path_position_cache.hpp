@@ -0,0 +1,116 @@
+#ifndef VG_PATH_POSITION_CACHE_HPP_INCLUDED
+#define VG_PATH_POSITION_CACHE_HPP_INCLUDED
+
+/** \file
+ *
+ *  A precomputed index from nodes to the visits of a chosen set of paths, so that finding the
+ *  steps of those paths on a node doesn't require looking at every path on the node
+ */
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include <mio/mmap.hpp>
+
+#include "handle.hpp"
+
+namespace vg {
+
+using namespace std;
+
+    /**
+     * Node -> (path, offset) lookup table for a subset of the paths in a graph, stored
+     * as sorted arrays. It can be built in memory, or saved to a file and memory-mapped back, in
+     * which case the arrays are used straight out of the mapping.
+     *
+     * Paths are stored by name, so a saved cache can be used with any graph that has the same
+     * paths at the same positions (e.g. the GBZ and XG for the same pangenome). To catch a cache
+     * that is stale because the graph was rebuilt, the file records the graph's node count and
+     * maximum node ID and the length and step count of each cached path, and these must match.
+     */
+    class PathPositionCache {
+    public:
+
+        /// Build a cache of the given paths in the graph, in parallel.
+        PathPositionCache(const PathPositionHandleGraph& graph, const vector<path_handle_t>& paths);
+
+        /// Map a cache saved with save(), and resolve its paths in the graph. Throws runtime_error
+        /// if the file isn't a path position cache, refers to paths the graph doesn't have, or was
+        /// built for a graph with a different node count, maximum node ID, or cached path lengths
+        /// or step counts.
+        PathPositionCache(const PathPositionHandleGraph& graph, const string& filename);
+
+        /// The arrays may point into our own storage, so we can't be copied
+        PathPositionCache(const PathPositionCache& other) = delete;
+        PathPositionCache& operator=(const PathPositionCache& other) = delete;
+
+        /// Write the cache to a file that can be mapped with the constructor above.
+        void save(const string& filename) const;
+
+        /// The paths that are in the cache
+        const vector<path_handle_t>& get_paths() const;
+
+        /// Is this path in the cache?
+        bool has_path(const path_handle_t& path_handle) const;
+
+        /// Number of nodes that are visited by at least one cached path
+        size_t get_node_count() const;
+
+        /// Number of steps of cached paths
+        size_t get_visit_count() const;
+
+        /// Execute a function on the step of each cached path that visits the node of the handle,
+        /// in the same order as the paths were given to the constructor and then in path order.
+        /// The steps are retrieved from the graph by position, so it must have the cached paths.
+        /// Throws runtime_error if a retrieved step isn't on the handle's node.
+        void for_each_step_on_handle(const PathPositionHandleGraph& graph, const handle_t& handle,
+                                     const function<void(const step_handle_t&)>& iteratee) const;
+
+    private:
+
+        /// A step of a cached path
+        struct Visit {
+            /// index of the path in paths
+            uint64_t path_rank;
+            /// the position of the start of the step on the path
+            uint64_t offset;
+        };
+
+        /// find the range of visits to a node
+        pair<const Visit*, const Visit*> visits_of_node(nid_t node_id) const;
+
+        /// cached paths, in rank order
+        vector<path_handle_t> paths;
+        /// and their names, for saving
+        vector<string> path_names;
+        /// and their lengths and step counts, to check that the graph still matches
+        vector<uint64_t> path_lengths;
+        vector<uint64_t> path_step_counts;
+        /// the node count and maximum node ID of the graph the cache was built for
+        uint64_t graph_node_count = 0;
+        uint64_t graph_max_id = 0;
+        /// ranks of the cached paths
+        unordered_map<path_handle_t, size_t> path_ranks;
+
+        /// the arrays we query, either in the owned vectors or in the mapping
+        size_t node_count = 0;
+        /// sorted IDs of visited nodes
+        const uint64_t* node_ids = nullptr;
+        /// start of each node's visits, plus a past-the-end entry
+        const uint64_t* node_starts = nullptr;
+        const Visit* visits = nullptr;
+
+        /// storage for a cache we built
+        vector<uint64_t> owned_node_ids;
+        vector<uint64_t> owned_node_starts;
+        vector<Visit> owned_visits;
+
+        /// storage for a cache we mapped
+        mio::mmap_source mapping;
+    };
+
+}
+
+#endif
@@ -17,19 +17,54 @@ PhaseUnfolder::PhaseUnfolder(const PathHandleGraph& path_graph, const gbwt::GBWT
 void PhaseUnfolder::unfold(MutableHandleGraph& graph, bool show_progress) {
     
     std::list<bdsg::HashGraph> components = this->complement_components(graph, show_progress);
+    std::vector<const HandleGraph*> component_ptrs;
+    for (const bdsg::HashGraph& component : components) {
+        component_ptrs.push_back(&component);
+    }
     
+    // Unfold the components in parallel. The duplicates in each component get
+    // temporary identifiers that are relocated when we know how many duplicates
+    // the earlier components created.
+    std::vector<ComponentData> component_data(component_ptrs.size());
     size_t haplotype_paths = 0;
-    bdsg::HashGraph unfolded;
-    for (MutableHandleGraph& component : components) {
-        haplotype_paths += this->unfold_component(component, graph, unfolded);
+#pragma omp parallel for schedule(dynamic, 1) reduction(+:haplotype_paths)
+    for (size_t i = 0; i < component_ptrs.size(); i++) {
+        component_data[i].first_duplicate = this->mapping.end();
+        haplotype_paths += this->unfold_component(*component_ptrs[i], graph, component_data[i]);
+    }
+    
+    // Reserve the identifiers in component order, so that the mapping is the
+    // same regardless of the number of threads.
+    std::vector<vg::id_t> offsets(component_data.size());
+    for (size_t i = 0; i < component_data.size(); i++) {
+        offsets[i] = this->mapping.end() - component_data[i].first_duplicate;
+        for (vg::id_t original : component_data[i].duplicates) {
+            this->mapping.insert(original);
+        }
+    }
+    
+    // Build the unfolded components into a graph for each thread.
+    std::vector<bdsg::HashGraph> unfolded(get_thread_count());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < component_data.size(); i++) {
+        this->insert_component(component_data[i], offsets[i], unfolded[omp_get_thread_num()]);
+        component_data[i] = ComponentData();
     }
+    
     if (show_progress) {
+        size_t node_count = 0, edge_count = 0;
+        for (const bdsg::HashGraph& thread_unfolded : unfolded) {
+            node_count += thread_unfolded.get_node_count();
+            edge_count += thread_unfolded.get_edge_count();
+        }
         std::cerr << "Unfolded graph: "
-                  << unfolded.get_node_count() << " nodes, " << unfolded.get_edge_count() << " edges on "
+                  << node_count << " nodes, " << edge_count << " edges on "
                   << haplotype_paths << " paths" << std::endl;
     }
     
-    handlealgs::extend(&unfolded, &graph);
+    for (bdsg::HashGraph& thread_unfolded : unfolded) {
+        handlealgs::extend(&thread_unfolded, &graph);
+    }
 }
 
 void PhaseUnfolder::restore_paths(MutableHandleGraph& graph, bool show_progress) const {
@@ -374,68 +409,81 @@ std::list<bdsg::HashGraph> PhaseUnfolder::complement_components(MutableHandleGra
     return components;
 }
 
-size_t PhaseUnfolder::unfold_component(MutableHandleGraph& component, MutableHandleGraph& graph, MutableHandleGraph& unfolded) {
+size_t PhaseUnfolder::unfold_component(const HandleGraph& component, const HandleGraph& graph, ComponentData& data) const {
     // Find the border nodes shared between the component and the graph.
     component.for_each_handle([&](const handle_t& handle) {
         vg::id_t id = component.get_id(handle);
         if (graph.has_node(id)) {
-            this->border.insert(id);
+            data.border.insert(id);
         }
     });
 
     // Generate the paths starting from each border node.
-    for (vg::id_t start_node : this->border) {
-        this->generate_paths(component, start_node);
+    for (vg::id_t start_node : data.border) {
+        this->generate_paths(component, start_node, data);
     }
 
     // Generate the threads for each node.
     component.for_each_handle([&](const handle_t& handle) {
-        this->generate_threads(component, component.get_id(handle));
+        this->generate_threads(component, component.get_id(handle), data);
     });
-    
+
+    // We only need the tries from now on.
+    data.border.clear();
+    data.reference_paths.clear();
+    return data.crossing_edges.size();
+}
+
+void PhaseUnfolder::insert_component(const ComponentData& data, vg::id_t offset, MutableHandleGraph& unfolded) const {
+
+    auto relocate = [&](gbwt::node_type node) -> gbwt::node_type {
+        if (node != gbwt::ENDMARKER && gbwt::Node::id(node) >= data.first_duplicate) {
+            return gbwt::Node::encode(gbwt::Node::id(node) + offset, gbwt::Node::is_reverse(node));
+        }
+        return node;
+    };
+
     auto insert_node = [&](gbwt::node_type node) {
         // create a new node
-        if (!unfolded.has_node(gbwt::Node::id(node))) {
-            handle_t temp = this->path_graph.get_handle(this->get_mapping(gbwt::Node::id(node)));;
-            unfolded.create_handle(this->path_graph.get_sequence(temp), gbwt::Node::id(node));
+        vg::id_t id = gbwt::Node::id(node);
+        if (!unfolded.has_node(gbwt::Node::id(relocate(node)))) {
+            vg::id_t original = (id >= data.first_duplicate ? data.duplicates[id - data.first_duplicate] : this->get_mapping(id));
+            handle_t temp = this->path_graph.get_handle(original);
+            unfolded.create_handle(this->path_graph.get_sequence(temp), gbwt::Node::id(relocate(node)));
         }
     };
 
+    auto insert_edge = [&](gbwt::node_type from, gbwt::node_type to) {
+        unfolded.create_edge(make_edge(unfolded, relocate(from), relocate(to)));
+    };
+
     // Create the unfolded component from the tries.
-    for (auto mapping : this->prefixes) {
+    for (auto mapping : data.prefixes) {
         gbwt::node_type from = mapping.first.first, to = mapping.second;
         if (from != gbwt::ENDMARKER) {
             insert_node(from);
         }
         insert_node(to);
         if (from != gbwt::ENDMARKER) {
-            unfolded.create_edge(make_edge(unfolded, from, to));
+            insert_edge(from, to);
         }
     }
-    for (auto mapping : this->suffixes) {
+    for (auto mapping : data.suffixes) {
         gbwt::node_type from = mapping.second, to = mapping.first.second;
         insert_node(from);
         if (to != gbwt::ENDMARKER) {
             insert_node(to);
-            unfolded.create_edge(make_edge(unfolded, from, to));
+            insert_edge(from, to);
         }
     }
-    for (auto edge : this->crossing_edges) {
+    for (auto edge : data.crossing_edges) {
         insert_node(edge.first);
         insert_node(edge.second);
-        unfolded.create_edge(make_edge(unfolded, edge.first, edge.second));
+        insert_edge(edge.first, edge.second);
     }
-
-    size_t haplotype_paths = this->crossing_edges.size();
-    this->border.clear();
-    this->reference_paths.clear();
-    this->prefixes.clear();
-    this->suffixes.clear();
-    this->crossing_edges.clear();
-    return haplotype_paths;
 }
 
-void PhaseUnfolder::generate_paths(MutableHandleGraph& component, vg::id_t from) {
+void PhaseUnfolder::generate_paths(const HandleGraph& component, vg::id_t from, ComponentData& data) const {
 
     handle_t from_handle = this->path_graph.get_handle(from);
     this->path_graph.for_each_step_on_handle(from_handle, [&](const step_handle_t& _step) {
@@ -461,15 +509,15 @@ void PhaseUnfolder::generate_paths(MutableHandleGraph& component, vg::id_t from)
                     break;  // Found a maximal path, no matching edge.
                 }
                 buffer.push_back(curr);
-                if (this->border.find(gbwt::Node::id(curr)) != this->border.end()) {
+                if (data.border.find(gbwt::Node::id(curr)) != data.border.end()) {
                     break;  // Found a border-to-border path.
                 }
                 prev = curr;
             }
             
-            bool to_border = (this->border.find(gbwt::Node::id(buffer.back())) != this->border.end());
-            this->reference_paths.push_back(buffer);
-            this->insert_path(buffer, true, to_border);
+            bool to_border = (data.border.find(gbwt::Node::id(buffer.back())) != data.border.end());
+            data.reference_paths.push_back(buffer);
+            this->insert_path(buffer, true, to_border, data);
         }
 
         // Backward.
@@ -494,34 +542,34 @@ void PhaseUnfolder::generate_paths(MutableHandleGraph& component, vg::id_t from)
                     break;  // Found a maximal path, no matching edge.
                 }
                 buffer.push_back(curr);
-                if (this->border.find(gbwt::Node::id(curr)) != this->border.end()) {
+                if (data.border.find(gbwt::Node::id(curr)) != data.border.end()) {
                     break;  // Found a border-to-border path.
                 }
                 prev = curr;
             }
             
-            bool to_border = (this->border.find(gbwt::Node::id(buffer.back())) != this->border.end());
-            this->reference_paths.push_back(buffer);
-            this->insert_path(buffer, true, to_border);
+            bool to_border = (data.border.find(gbwt::Node::id(buffer.back())) != data.border.end());
+            data.reference_paths.push_back(buffer);
+            this->insert_path(buffer, true, to_border, data);
         }
 
     });
 }
 
-void PhaseUnfolder::generate_threads(MutableHandleGraph& component, vg::id_t from) {
+void PhaseUnfolder::generate_threads(const HandleGraph& component, vg::id_t from, ComponentData& data) const {
 
-    bool is_internal = (this->border.find(from) == this->border.end());
-    this->create_state(from, false, is_internal);
-    this->create_state(from, true, is_internal);
+    bool is_internal = (data.border.find(from) == data.border.end());
+    this->create_state(from, false, is_internal, data);
+    this->create_state(from, true, is_internal, data);
 
-    while (!this->states.empty()) {
-        state_type state = this->states.top(); this->states.pop();
+    while (!data.states.empty()) {
+        state_type state = data.states.top(); data.states.pop();
         vg::id_t node = gbwt::Node::id(state.first.node);
         bool is_reverse = gbwt::Node::is_reverse(state.first.node);
 
-        if (state.second.size() >= 2 && this->border.find(node) != this->border.end()) {
+        if (state.second.size() >= 2 && data.border.find(node) != data.border.end()) {
             if (!is_internal) {
-                this->extend_path(state.second);
+                this->extend_path(state.second, data);
             }
             continue;   // The path reached a border.
         }
@@ -529,33 +577,33 @@ void PhaseUnfolder::generate_threads(MutableHandleGraph& component, vg::id_t fro
         bool was_extended = false;
         handle_t from = component.get_handle(node, is_reverse);
         component.follow_edges(from, false, [&](const handle_t& handle) {
-                was_extended |= this->extend_state(state, component.get_id(handle), component.get_is_reverse(handle));
+                was_extended |= this->extend_state(state, component.get_id(handle), component.get_is_reverse(handle), data);
             });
         component.follow_edges(from, true, [&](const handle_t& handle) {
-                was_extended |= this->extend_state(state, component.get_id(handle), !component.get_is_reverse(handle));
+                was_extended |= this->extend_state(state, component.get_id(handle), !component.get_is_reverse(handle), data);
             });
         if (!was_extended) {
-            this->extend_path(state.second);    // Maximal path.
+            this->extend_path(state.second, data);    // Maximal path.
         }
     }
 }
 
-void PhaseUnfolder::create_state(vg::id_t node, bool is_reverse, bool starting) {
+void PhaseUnfolder::create_state(vg::id_t node, bool is_reverse, bool starting, ComponentData& data) const {
     gbwt::node_type gbwt_node = gbwt::Node::encode(node, is_reverse);
     search_type search = (starting ? this->gbwt_index.prefix(gbwt_node) : this->gbwt_index.find(gbwt_node));
     if (search.empty()) {
         return;
     }
-    this->states.push(std::make_pair(search, path_type(1, search.node)));
+    data.states.push(std::make_pair(search, path_type(1, search.node)));
 }
 
-bool PhaseUnfolder::extend_state(state_type state, vg::id_t node, bool is_reverse) {
+bool PhaseUnfolder::extend_state(state_type state, vg::id_t node, bool is_reverse, ComponentData& data) const {
     state.first = this->gbwt_index.extend(state.first, gbwt::Node::encode(node, is_reverse));
     if (state.first.empty()) {
         return false;
     }
     state.second.push_back(state.first.node);
-    this->states.push(state);
+    data.states.push(state);
     return true;
 }
 
@@ -571,14 +619,14 @@ PhaseUnfolder::path_type canonical_orientation(const PhaseUnfolder::path_type& p
     return path;
 }
 
-void PhaseUnfolder::extend_path(const path_type& path) {
+void PhaseUnfolder::extend_path(const path_type& path, ComponentData& data) const {
     if (path.size() < 2) {
         return;
     }
-    bool from_border = (this->border.find(gbwt::Node::id(path.front())) != this->border.end());
-    bool to_border = (this->border.find(gbwt::Node::id(path.back())) != this->border.end());
+    bool from_border = (data.border.find(gbwt::Node::id(path.front())) != data.border.end());
+    bool to_border = (data.border.find(gbwt::Node::id(path.back())) != data.border.end());
     if (from_border && to_border) {
-        this->insert_path(path, from_border, to_border);
+        this->insert_path(path, from_border, to_border, data);
         return;
     }
 
@@ -590,8 +638,8 @@ void PhaseUnfolder::extend_path(const path_type& path) {
     // Note that the reverse complement of a reference path is also a
     // reference path.
     if (!from_border) {
-        for (size_t ref = 0; ref < this->reference_paths.size(); ref++) {
-            const path_type& reference = this->reference_paths[ref];
+        for (size_t ref = 0; ref < data.reference_paths.size(); ref++) {
+            const path_type& reference = data.reference_paths[ref];
             bool found = false;
             for (size_t i = 0; i < reference.size(); i++) {
                 edge_t candidate = make_edge(path_graph, reference[i], to_extend.front());
@@ -610,8 +658,8 @@ void PhaseUnfolder::extend_path(const path_type& path) {
 
     // Try adding a suffix of a reference path to the end of the path.
     if (!to_border) {
-        for (size_t ref = 0; ref < this->reference_paths.size(); ref++) {
-            const path_type& reference = this->reference_paths[ref];
+        for (size_t ref = 0; ref < data.reference_paths.size(); ref++) {
+            const path_type& reference = data.reference_paths[ref];
             bool found = false;
             for (size_t i = 0; i < reference.size(); i++) {
                 edge_t candidate = make_edge(path_graph, to_extend.back(), reference[i]);
@@ -628,10 +676,10 @@ void PhaseUnfolder::extend_path(const path_type& path) {
         }
     }
 
-    this->insert_path(to_extend, from_border, to_border);
+    this->insert_path(to_extend, from_border, to_border, data);
 }
 
-void PhaseUnfolder::insert_path(const path_type& path, bool from_border, bool to_border) {
+void PhaseUnfolder::insert_path(const path_type& path, bool from_border, bool to_border, ComponentData& data) const {
 
     if (path.size() < 2) {
         return;
@@ -648,42 +696,46 @@ void PhaseUnfolder::insert_path(const path_type& path, bool from_border, bool to
     // Prefixes.
     gbwt::node_type from = to_insert.front();
     if (!from_border) {
-        from = this->get_prefix(gbwt::ENDMARKER, from);
+        from = this->get_prefix(gbwt::ENDMARKER, from, data);
     }
     for (size_t i = 1; i < (to_insert.size() + 1) / 2; i++) {
-        from = this->get_prefix(from, to_insert[i]);
+        from = this->get_prefix(from, to_insert[i], data);
     }
 
     // Suffixes.
     gbwt::node_type to = to_insert.back();
     if (!to_border) {
-        to = this->get_suffix(to, gbwt::ENDMARKER);
+        to = this->get_suffix(to, gbwt::ENDMARKER, data);
     }
     for (size_t i = to_insert.size() - 2; i >= (to_insert.size() + 1) / 2; i--) {
-        to = this->get_suffix(to_insert[i], to);
+        to = this->get_suffix(to_insert[i], to, data);
     }
 
     // Crossing edge.
-    this->crossing_edges.insert(std::make_pair(from, to));
+    data.crossing_edges.insert(std::make_pair(from, to));
 }
 
 
-gbwt::node_type PhaseUnfolder::get_prefix(gbwt::node_type from, gbwt::node_type node) {
+gbwt::node_type PhaseUnfolder::get_prefix(gbwt::node_type from, gbwt::node_type node, ComponentData& data) const {
     std::pair<gbwt::node_type, gbwt::node_type> key(from, node);
-    if (this->prefixes.find(key) == this->prefixes.end()) {
-        gbwt::size_type new_id = this->mapping.insert(gbwt::Node::id(node));
-        this->prefixes[key] = gbwt::Node::encode(new_id, gbwt::Node::is_reverse(node));
+    if (data.prefixes.find(key) == data.prefixes.end()) {
+        data.prefixes[key] = this->create_duplicate(node, data);
     }
-    return this->prefixes[key];
+    return data.prefixes[key];
 }
 
-gbwt::node_type PhaseUnfolder::get_suffix(gbwt::node_type node, gbwt::node_type to) {
+gbwt::node_type PhaseUnfolder::get_suffix(gbwt::node_type node, gbwt::node_type to, ComponentData& data) const {
     std::pair<gbwt::node_type, gbwt::node_type> key(node, to);
-    if (this->suffixes.find(key) == this->suffixes.end()) {
-        gbwt::size_type new_id = this->mapping.insert(gbwt::Node::id(node));
-        this->suffixes[key] = gbwt::Node::encode(new_id, gbwt::Node::is_reverse(node));
+    if (data.suffixes.find(key) == data.suffixes.end()) {
+        data.suffixes[key] = this->create_duplicate(node, data);
     }
-    return this->suffixes[key];
+    return data.suffixes[key];
 }
 
-} 
+gbwt::node_type PhaseUnfolder::create_duplicate(gbwt::node_type node, ComponentData& data) const {
+    vg::id_t new_id = data.first_duplicate + data.duplicates.size();
+    data.duplicates.push_back(gbwt::Node::id(node));
+    return gbwt::Node::encode(new_id, gbwt::Node::is_reverse(node));
+}
+
+}
@@ -56,6 +56,9 @@ public:
      * and suffixes.
      *
      * - Extend the input graph with the unfolded components.
+     *
+     * The components are unfolded in parallel using OMP threads. The node
+     * mapping does not depend on the number of threads.
      */
     void unfold(MutableHandleGraph& graph, bool show_progress = false);
 
@@ -101,6 +104,28 @@ public:
     }
 
 private:
+    /**
+     * Internal data structures for unfolding a single component. Components
+     * are unfolded in parallel, so each one gets its own.
+     */
+    struct ComponentData {
+        /// Duplicates are given temporary identifiers starting from this, and
+        /// they are relocated when the component is inserted into the graph.
+        vg::id_t first_duplicate = 0;
+        /// Original ids for the duplicates, in the order they were created.
+        std::vector<vg::id_t> duplicates;
+
+        hash_set<vg::id_t>     border;
+        std::stack<state_type> states;
+        std::vector<path_type> reference_paths;
+
+        /// Tries for the unfolded prefixes and reverse suffixes.
+        /// prefixes[(from, to)] is the mapping for to, and
+        /// suffixes[(from, to)] is the mapping for from.
+        pair_hash_map<std::pair<gbwt::node_type, gbwt::node_type>, gbwt::node_type> prefixes, suffixes;
+        pair_hash_set<std::pair<gbwt::node_type, gbwt::node_type>> crossing_edges;
+    };
+
     /**
      * Generate a complement graph consisting of the edges that are in the
      * GBWT index but not in the input graph. Split the complement into
@@ -112,8 +137,15 @@ private:
      * Generate all border-to-border paths in the component supported by the
      * indexes. Unfold the paths by duplicating the inner nodes so that the
      * paths become disjoint, except for their shared prefixes/suffixes.
+     * Returns the number of haplotype paths.
+     */
+    size_t unfold_component(const HandleGraph& component, const HandleGraph& graph, ComponentData& data) const;
+
+    /**
+     * Insert the unfolded component into the graph, adding 'offset' to the
+     * temporary identifiers of the duplicated nodes.
      */
-    size_t unfold_component(MutableHandleGraph& component, MutableHandleGraph& graph, MutableHandleGraph& unfolded);
+    void insert_component(const ComponentData& data, vg::id_t offset, MutableHandleGraph& unfolded) const;
 
     /**
      * Generate all paths supported by the XG index passing through the given
@@ -121,7 +153,7 @@ private:
      * paths into the set in the canonical orientation, and use them as
      * reference paths for extending threads.
      */
-    void generate_paths(MutableHandleGraph& component, vg::id_t from);
+    void generate_paths(const HandleGraph& component, vg::id_t from, ComponentData& data) const;
 
    /**
     * Generate all paths supported by the GBWT index from the given node until
@@ -130,7 +162,7 @@ private:
     * passing through it. Otherwise consider only the threads starting from
     * it, and do not output threads reaching a border.
     */
-    void generate_threads(MutableHandleGraph& component, vg::id_t from);
+    void generate_threads(const HandleGraph& component, vg::id_t from, ComponentData& data) const;
 
     /**
      * Create or extend the state with the given node orientation, and insert
@@ -138,24 +170,27 @@ private:
      * to determine whether the initial state is for the threads starting at
      * the node or for the threads passing through the node.
      */
-    void create_state(vg::id_t node, bool is_reverse, bool starting);
-    bool extend_state(state_type state, vg::id_t node, bool is_reverse);
+    void create_state(vg::id_t node, bool is_reverse, bool starting, ComponentData& data) const;
+    bool extend_state(state_type state, vg::id_t node, bool is_reverse, ComponentData& data) const;
 
     /**
      * Try to extend the path at both ends until the border by using the
      * reference paths. Insert the extended path into the set in the canonical
      * orientation.
      */
-    void extend_path(const path_type& path);
+    void extend_path(const path_type& path, ComponentData& data) const;
 
     /// Insert the path into the set in the canonical orientation.
-    void insert_path(const path_type& path, bool from_border, bool to_border);
+    void insert_path(const path_type& path, bool from_border, bool to_border, ComponentData& data) const;
 
     /// Get the id for the duplicate of 'node' after 'from'.
-    gbwt::node_type get_prefix(gbwt::node_type from, gbwt::node_type node);
+    gbwt::node_type get_prefix(gbwt::node_type from, gbwt::node_type node, ComponentData& data) const;
 
     /// Get the id for the duplicate of 'node' before 'to'.
-    gbwt::node_type get_suffix(gbwt::node_type node, gbwt::node_type to);
+    gbwt::node_type get_suffix(gbwt::node_type node, gbwt::node_type to, ComponentData& data) const;
+
+    /// Create a temporary identifier for a new duplicate of the node.
+    gbwt::node_type create_duplicate(gbwt::node_type node, ComponentData& data) const;
 
     /// XG and GBWT indexes for the original graph.
     const PathHandleGraph& path_graph;
@@ -163,17 +198,6 @@ private:
 
     /// Mapping from duplicated nodes to original ids.
     gcsa::NodeMapping mapping;
-
-    /// Internal data structures for the current component.
-    hash_set<vg::id_t>     border;
-    std::stack<state_type> states;
-    std::vector<path_type> reference_paths;
-
-    /// Tries for the unfolded prefixes and reverse suffixes.
-    /// prefixes[(from, to)] is the mapping for to, and
-    /// suffixes[(from, to)] is the mapping for from.
-    pair_hash_map<std::pair<gbwt::node_type, gbwt::node_type>, gbwt::node_type> prefixes, suffixes;
-    pair_hash_set<std::pair<gbwt::node_type, gbwt::node_type>> crossing_edges;
 };
 
 }
@@ -1,12 +1,17 @@
 #include "recombinator.hpp"
 
+#include "alignment.hpp"
 #include "kff.hpp"
+#include "utility.hpp"
 
 #include <algorithm>
 #include <cmath>
 #include <map>
 #include <random>
 
+#include <omp.h>
+#include <vg/io/stream.hpp>
+
 namespace vg {
 
 //------------------------------------------------------------------------------
@@ -23,6 +28,7 @@ constexpr size_t HaplotypePartitioner::APPROXIMATE_JOBS;
 constexpr size_t Recombinator::NUM_HAPLOTYPES;
 constexpr size_t Recombinator::COVERAGE;
 constexpr size_t Recombinator::KFF_BLOCK_SIZE;
+constexpr size_t Recombinator::READ_BUFFER_SIZE;
 constexpr double Recombinator::PRESENT_DISCOUNT;
 constexpr double Recombinator::HET_ADJUSTMENT;
 
@@ -44,18 +50,15 @@ find_kmer(hash_map<Haplotypes::Subchain::kmer_type, size_t>& counts, Haplotypes:
     return (forward != counts.end() ? forward : reverse);
 }
 
-hash_map<Haplotypes::Subchain::kmer_type, size_t> Haplotypes::kmer_counts(const std::string& kff_file, bool verbose) const {
-    // Open and validate the kmer count file.
-    ParallelKFFReader reader(kff_file);
-
-    // Populate the map with the kmers we are interested in.
+// Returns a hash map with all kmers in the haplotype information and zero counts.
+hash_map<Haplotypes::Subchain::kmer_type, size_t> empty_kmer_counts(const Haplotypes& haplotypes, bool verbose) {
     double checkpoint = gbwt::readTimer();
-    hash_map<Subchain::kmer_type, size_t> result;
-    result.reserve(this->header.total_kmers);
-    for (size_t chain_id = 0; chain_id < this->chains.size(); chain_id++) {
-        const TopLevelChain& chain = this->chains[chain_id];
+    hash_map<Haplotypes::Subchain::kmer_type, size_t> result;
+    result.reserve(haplotypes.header.total_kmers);
+    for (size_t chain_id = 0; chain_id < haplotypes.chains.size(); chain_id++) {
+        const Haplotypes::TopLevelChain& chain = haplotypes.chains[chain_id];
         for (size_t subchain_id = 0; subchain_id < chain.subchains.size(); subchain_id++) {
-            const Subchain& subchain = chain.subchains[subchain_id];
+            const Haplotypes::Subchain& subchain = chain.subchains[subchain_id];
             for (size_t kmer_id = 0; kmer_id < subchain.kmers.size(); kmer_id++) {
                 result[subchain.kmers[kmer_id].first] = 0;
             }
@@ -65,9 +68,56 @@ hash_map<Haplotypes::Subchain::kmer_type, size_t> Haplotypes::kmer_counts(const
         double seconds = gbwt::readTimer() - checkpoint;
         std::cerr << "Initialized the hash map with " << result.size() << " kmers in " << seconds << " seconds" << std::endl;
     }
+    return result;
+}
+
+size_t find_read_kmers(hash_map<Haplotypes::Subchain::kmer_type, size_t>& counts, const std::string& sequence, size_t k,
+                       std::vector<hash_map<Haplotypes::Subchain::kmer_type, size_t>::iterator>& buffer) {
+    typedef Haplotypes::Subchain::kmer_type kmer_type;
+    if (k == 0 || sequence.length() < k) {
+        return 0;
+    }
+
+    // Kmers are packed as in the minimizer index, with the last base in the low bits.
+    kmer_type mask = (kmer_type(1) << (2 * k)) - 1;
+    size_t shift = 2 * (k - 1);
+    kmer_type forward = 0, reverse = 0;
+    size_t valid_chars = 0, kmers = 0;
+    for (char c : sequence) {
+        auto packed = gbwtgraph::CHAR_TO_PACK[static_cast<std::uint8_t>(c)];
+        if (packed > 3) {
+            // Kmers cannot span an invalid character.
+            valid_chars = 0;
+            forward = 0; reverse = 0;
+            continue;
+        }
+        forward = ((forward << 2) | packed) & mask;
+        reverse = (reverse >> 2) | (kmer_type(3 - packed) << shift);
+        valid_chars++;
+        if (valid_chars >= k) {
+            kmers++;
+            auto iter = counts.find(forward);
+            if (iter == counts.end()) {
+                iter = counts.find(reverse);
+            }
+            if (iter != counts.end()) {
+                buffer.push_back(iter);
+            }
+        }
+    }
+
+    return kmers;
+}
+
+hash_map<Haplotypes::Subchain::kmer_type, size_t> Haplotypes::kmer_counts(const std::string& kff_file, bool verbose) const {
+    // Open and validate the kmer count file.
+    ParallelKFFReader reader(kff_file);
+
+    // Populate the map with the kmers we are interested in.
+    hash_map<Subchain::kmer_type, size_t> result = empty_kmer_counts(*this, verbose);
 
     // Read the KFF file and add the counts using multiple threads.
-    checkpoint = gbwt::readTimer();
+    double checkpoint = gbwt::readTimer();
     size_t kmer_count = 0;
     #pragma omp parallel
     {
@@ -97,7 +147,65 @@ hash_map<Haplotypes::Subchain::kmer_type, size_t> Haplotypes::kmer_counts(const
     }
     if (verbose) {
         double seconds = gbwt::readTimer() - checkpoint;
-        std::cerr << "Read " << kmer_count << " kmers in " << seconds << " seconds" << std::endl;
+        std::cerr << "Read " << kmer_count << " kmers in " << seconds << " seconds (" << (kmer_count / seconds) << " kmers/second)" << std::endl;
+    }
+
+    return result;
+}
+
+hash_map<Haplotypes::Subchain::kmer_type, size_t> Haplotypes::kmer_counts_from_reads(const std::vector<std::string>& read_files, bool verbose) const {
+    // Populate the map with the kmers we are interested in. We never insert
+    // anything after this, so the iterators remain valid.
+    hash_map<Subchain::kmer_type, size_t> result = empty_kmer_counts(*this, verbose);
+
+    // Each thread buffers the kmer hits and applies them in a critical section.
+    typedef hash_map<Subchain::kmer_type, size_t>::iterator iterator_type;
+    double checkpoint = gbwt::readTimer();
+    size_t threads = omp_get_max_threads();
+    std::vector<std::vector<iterator_type>> buffers(threads);
+    std::vector<size_t> read_counts(threads, 0), read_kmers(threads, 0);
+    auto flush = [&](std::vector<iterator_type>& buffer) {
+        #pragma omp critical
+        {
+            for (auto iter : buffer) {
+                iter->second++;
+            }
+        }
+        buffer.clear();
+    };
+    auto count_read = [&](Alignment& aln) {
+        size_t thread = omp_get_thread_num();
+        read_counts[thread]++;
+        read_kmers[thread] += find_read_kmers(result, aln.sequence(), this->k(), buffers[thread]);
+        if (buffers[thread].size() >= Recombinator::READ_BUFFER_SIZE) {
+            flush(buffers[thread]);
+        }
+    };
+
+    for (const std::string& filename : read_files) {
+        if (verbose) {
+            std::cerr << "Counting kmers in " << filename << std::endl;
+        }
+        if (filename.length() >= 4 && filename.substr(filename.length() - 4) == ".gam") {
+            get_input_file(filename, [&](std::istream& in) {
+                vg::io::for_each_parallel<Alignment>(in, count_read);
+            });
+        } else {
+            fastq_unpaired_for_each_parallel(filename, count_read);
+        }
+    }
+    for (auto& buffer : buffers) {
+        flush(buffer);
+    }
+
+    if (verbose) {
+        double seconds = gbwt::readTimer() - checkpoint;
+        size_t total_reads = 0, total_kmers = 0;
+        for (size_t thread = 0; thread < threads; thread++) {
+            total_reads += read_counts[thread];
+            total_kmers += read_kmers[thread];
+        }
+        std::cerr << "Counted " << total_kmers << " kmers in " << total_reads << " reads in " << seconds << " seconds (" << (total_kmers / seconds) << " kmers/second)" << std::endl;
     }
 
     return result;
@@ -898,8 +1006,6 @@ void add_path(const gbwt::GBWT& source, gbwt::size_type path_id, gbwt::GBWTBuild
 
 gbwt::GBWT Recombinator::generate_haplotypes(const Haplotypes& haplotypes, const std::string& kff_file, const Parameters& parameters) const {
 
-    // FIXME sanity checks for parameters
-
     // Get kmer counts.
     double start = gbwt::readTimer();
     if (this->verbosity >= HaplotypePartitioner::verbosity_basic) {
@@ -917,7 +1023,42 @@ gbwt::GBWT Recombinator::generate_haplotypes(const Haplotypes& haplotypes, const
         std::cerr << "Read the kmer counts in " << seconds << " seconds" << std::endl;
     }
 
-    start = gbwt::readTimer();
+    return this->generate_haplotypes(haplotypes, counts, parameters);
+}
+
+gbwt::GBWT Recombinator::generate_haplotypes(const Haplotypes& haplotypes, const std::vector<std::string>& read_files, const Parameters& parameters,
+    const std::string& kff_output) const {
+
+    // Count the kmers in the reads.
+    double start = gbwt::readTimer();
+    if (this->verbosity >= HaplotypePartitioner::verbosity_basic) {
+        std::cerr << "Counting kmers in " << read_files.size() << " read files" << std::endl;
+    }
+    hash_map<Haplotypes::Subchain::kmer_type, size_t> counts = haplotypes.kmer_counts_from_reads(read_files, this->verbosity >= HaplotypePartitioner::verbosity_detailed);
+    if (this->verbosity >= HaplotypePartitioner::verbosity_basic) {
+        double seconds = gbwt::readTimer() - start;
+        std::cerr << "Counted the kmers in " << seconds << " seconds" << std::endl;
+    }
+    if (!kff_output.empty()) {
+        std::vector<std::pair<Haplotypes::Subchain::kmer_type, size_t>> nonzero;
+        for (auto& kmer : counts) {
+            if (kmer.second > 0) {
+                nonzero.push_back(kmer);
+            }
+        }
+        kff_write_counts(kff_output, haplotypes.k(), nonzero);
+    }
+
+    return this->generate_haplotypes(haplotypes, counts, parameters);
+}
+
+gbwt::GBWT Recombinator::generate_haplotypes(const Haplotypes& haplotypes,
+    const hash_map<Haplotypes::Subchain::kmer_type, size_t>& counts,
+    const Parameters& parameters) const {
+
+    // FIXME sanity checks for parameters
+
+    double start = gbwt::readTimer();
     if (this->verbosity >= HaplotypePartitioner::verbosity_basic) {
         if (parameters.random_sampling) {
             std::cerr << "Building GBWT (random sampling)" << std::endl;
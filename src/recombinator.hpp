@@ -177,6 +177,19 @@ public:
      */
     hash_map<Subchain::kmer_type, size_t> kmer_counts(const std::string& kff_file, bool verbose) const;
 
+    /**
+      * Returns a mapping from kmers to their counts in the given read files.
+      * The counts include both the kmer and the reverse complement, as with
+      * `kmer_counts()`, but only the kmers in the haplotype information are
+      * counted. Memory usage is therefore bounded by the number of kmers in
+      * this object instead of by the reads.
+      *
+      * Files ending with `.gam` are read as GAM and other files as FASTQ,
+      * which may be gzip-compressed. Reads are processed using OpenMP threads.
+      * Exits if a file cannot be opened.
+     */
+    hash_map<Subchain::kmer_type, size_t> kmer_counts_from_reads(const std::vector<std::string>& read_files, bool verbose) const;
+
     /// Serializes the object to a stream in the simple-sds format.
     void simple_sds_serialize(std::ostream& out) const;
 
@@ -187,6 +200,17 @@ public:
     size_t simple_sds_size() const;
 };
 
+/**
+ * Finds the kmers of the sequence that are in the map, in either orientation,
+ * and appends iterators to them to the buffer. Kmers do not span characters
+ * other than `ACGT`. Returns the total number of kmers in the sequence.
+ *
+ * This is used for counting kmers in reads with
+ * `Haplotypes::kmer_counts_from_reads()`.
+ */
+size_t find_read_kmers(hash_map<Haplotypes::Subchain::kmer_type, size_t>& counts, const std::string& sequence, size_t k,
+                       std::vector<hash_map<Haplotypes::Subchain::kmer_type, size_t>::iterator>& buffer);
+
 //------------------------------------------------------------------------------
 
 /**
@@ -348,6 +372,9 @@ public:
     /// Block size (in kmers) for reading KFF files.
     constexpr static size_t KFF_BLOCK_SIZE = 1000000;
 
+    /// Buffer size (in kmer occurrences) for counting kmers in reads.
+    constexpr static size_t READ_BUFFER_SIZE = 1000000;
+
     /// Multiplier to the score of a present kmer every time a haplotype with that
     /// kmer is selected.
     constexpr static double PRESENT_DISCOUNT = 0.7;
@@ -520,10 +547,24 @@ public:
      */
     gbwt::GBWT generate_haplotypes(const Haplotypes& haplotypes, const std::string& kff_file, const Parameters& parameters) const;
 
+    /**
+     * Generates haplotypes as above, but counts the kmers directly in the
+     * given FASTQ / GAM files instead of reading them from a KFF file. See
+     * `Haplotypes::kmer_counts_from_reads()`. If `kff_output` is not empty,
+     * also writes the nonzero counts to that KFF file.
+     */
+    gbwt::GBWT generate_haplotypes(const Haplotypes& haplotypes, const std::vector<std::string>& read_files, const Parameters& parameters,
+        const std::string& kff_output = "") const;
+
     const gbwtgraph::GBZ& gbz;
     HaplotypePartitioner::Verbosity verbosity;
 
 private:
+    // Generate haplotypes using the given kmer counts.
+    gbwt::GBWT generate_haplotypes(const Haplotypes& haplotypes,
+        const hash_map<Haplotypes::Subchain::kmer_type, size_t>& kmer_counts,
+        const Parameters& parameters) const;
+
     // Generate haplotypes for the given chain.
     Statistics generate_haplotypes(const Haplotypes::TopLevelChain& chain,
         const hash_map<Haplotypes::Subchain::kmer_type, size_t>& kmer_counts,
@@ -4,12 +4,19 @@
 #include <vg/vg.pb.h>
 #include <vg/io/protobuf_emitter.hpp>
 #include <vg/io/protobuf_iterator.hpp>
+#include <vg/io/message_iterator.hpp>
 #include <vg/io/stream.hpp>
 #include "types.hpp"
 #include "progressive.hpp"
 #include "stream_index.hpp"
 #include "utility.hpp"
 #include "vg/io/json2pb.h"
+#include "ips4o.hpp"
+#include <omp.h>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
 #include <string>
 #include <queue>
 #include <sstream>
@@ -59,19 +66,45 @@ public:
     /// Sort a stream of VPKG-format Protobuf data, using temporary files,
     /// limiting the number of simultaneously open input files and the size of
     /// in-memory data. Optionally index the sorted file into the given index.
+    ///
+    /// Sorted runs are decoded, sorted, and written on all OMP threads, and
+    /// are merged with a tournament tree while run files are decoded ahead
+    /// of the merge in OMP tasks.
     void stream_sort(istream& stream_in, ostream& stream_out, StreamIndex<Message>* index_to = nullptr);
     
+    /// Sort messages from an arbitrary source, such as a GAF file, using
+    /// temporary files, and send them in order to an arbitrary destination.
+    /// iterate_input is called with a function to call with each message in
+    /// turn, from one thread. emit is called with each sorted message, from
+    /// one thread.
+    void stream_sort(const function<void(const function<void(Message&)>&)>& iterate_input,
+                     const function<void(Message&&)>& emit);
+    
     /// Sort a stream of VPKG-format Protobuf data, loading it all into memory and
     /// doing a single giant sort operation. Optionally index the sorted file
     /// into the given index.
     void easy_sort(istream& stream_in, ostream& stream_out, StreamIndex<Message>* index_to = nullptr);
     
+    /// Sort messages from an arbitrary source in memory, and send them in
+    /// order to an arbitrary destination.
+    void easy_sort(const function<void(const function<void(Message&)>&)>& iterate_input,
+                   const function<void(Message&&)>& emit);
+    
     //////////////////
     // Supporting API
     //////////////////
 
-    /// Sort a vector of messages, in place.
+    /// If true, sort() and parallel_sort() find each message's sort key once
+    /// and sort the keys, and then put the messages in order, instead of
+    /// finding positions again for every comparison. Equal messages then keep
+    /// their input order.
+    bool use_sort_keys = true;
+
+    /// Sort a vector of messages, in place, on the calling thread.
     void sort(vector<Message>& msgs) const;
+    
+    /// Sort a vector of messages, in place, using all OMP threads.
+    void parallel_sort(vector<Message>& msgs) const;
 
     /// Return true if out of Messages a and b, a must come before b, and false otherwise.
     bool less_than(const Message& a, const Message& b) const;
@@ -98,16 +131,84 @@ public:
     /// This will be computed based on the max file descriptor limit from the OS.
     size_t max_fan_in;
     
+    /// What's the smallest amount of serialized data to decode ahead from
+    /// each run file at a time during merging?
+    size_t min_prefetch_size = (64 * 1024);
+    
     using cursor_t = vg::io::ProtobufIterator<Message>;
     using emitter_t = vg::io::ProtobufEmitter<Message>;
     
-    /// Open all the given input files, keeping the streams and cursors in the given lists.
-    /// We use lists because none of these should be allowed to move after creation.
-    void open_all(const vector<string>& filenames, list<ifstream>& streams, list<cursor_t>& cursors);
+    /**
+     * The min position of a message, flattened out, along with the message's
+     * index in the input to break ties.
+     */
+    struct SortKey {
+        int64_t node_id;
+        int64_t offset;
+        size_t index;
+        bool is_reverse;
+        
+        /// Order the same way as less_than() on Positions, and then by index.
+        inline bool operator<(const SortKey& other) const {
+            return std::tie(node_id, is_reverse, offset, index) <
+                std::tie(other.node_id, other.is_reverse, other.offset, other.index);
+        }
+    };
     
-    /// Merge all the messages from the given list of cursors into the given emitter.
-    /// The total expected number of messages can be passed for progress bar purposes.
-    void streaming_merge(list<cursor_t>& cursors, emitter_t& emitter, size_t expected_messages = 0);
+    /// Sort a vector of messages by sort keys, in place, either on the
+    /// calling thread or using all OMP threads.
+    void sort_by_keys(vector<Message>& msgs, bool in_parallel) const;
+    
+    /**
+     * A sorted run file being merged. Messages are consumed from one block
+     * while the next block is decoded in an OMP task.
+     */
+    struct MergeRun {
+        /// The open run file. Must not move while the cursor exists.
+        ifstream stream;
+        /// The cursor reading the file, only used by one prefetch task at a time.
+        unique_ptr<cursor_t> cursor;
+        /// The block we are taking messages from
+        vector<Message> block;
+        /// The next message in the block to take
+        size_t next_in_block = 0;
+        /// The block being filled in the background
+        vector<Message> prefetched;
+        /// Set by whoever takes on filling the prefetched block: the prefetch
+        /// task, or the merging thread if it needs the block before the task
+        /// has started.
+        atomic<bool> prefetch_claimed;
+        /// Set when the background fill is done
+        atomic<bool> prefetch_done;
+        /// Any error from filling the prefetched block
+        exception_ptr prefetch_error;
+        /// The min position of the next message, computed once
+        Position head_position;
+        /// True when there are no more messages
+        bool exhausted = false;
+    };
+    
+    /// Save the given messages, which must be sorted, to a new temp file and
+    /// return its name.
+    string write_run(vector<Message>& sorted_messages) const;
+    
+    /// Start decoding the next block of the given run in an OMP task, taking
+    /// up to the given number of serialized bytes.
+    void start_prefetch(MergeRun* run, size_t prefetch_size) const;
+    
+    /// Fill the given run's prefetched block, unless someone else has already
+    /// claimed the job.
+    void fill_prefetch(MergeRun* run, size_t prefetch_size) const;
+    
+    /// Wait for the given run's prefetched block and start on it, prefetching
+    /// the next one. Only waits on the given run's prefetch. Must be called
+    /// from inside an OMP parallel region.
+    void advance_block(MergeRun* run, size_t prefetch_size) const;
+    
+    /// Merge all the messages from the given sorted run files into the given
+    /// function, which is called on one thread. The total expected number of
+    /// messages can be passed for progress bar purposes.
+    void merge_runs(const vector<string>& filenames, const function<void(Message&&)>& emit, size_t expected_messages = 0);
     
     /// Merge all the given temp input files into one or more temp output
     /// files, opening no more than max_fan_in input files at a time. The input
@@ -116,6 +217,11 @@ public:
     /// If messages_per_file is specified, it will be used to show progress bars,
     /// and will be updated for newly-created files.
     vector<string> streaming_merge(const vector<string>& temp_names_in, unordered_map<string, size_t>* messages_per_file = nullptr);
+    
+    /// Merge sorted temp files until there are few enough to merge at once,
+    /// and then merge those into the given function.
+    void merge_all(vector<string> temp_names_in, unordered_map<string, size_t>& messages_per_file,
+                   size_t expected_messages, const function<void(Message&&)>& emit);
 };
 
 using GAMSorter = StreamSorter<Alignment>;
@@ -173,11 +279,55 @@ StreamSorter<Message>::StreamSorter(bool show_progress) {
 
 template<typename Message>
 void StreamSorter<Message>::sort(vector<Message>& msgs) const {
-    std::sort(msgs.begin(), msgs.end(), [&](const Message& a, const Message& b) {
+    if (use_sort_keys) {
+        sort_by_keys(msgs, false);
+        return;
+    }
+    ips4o::sort(msgs.begin(), msgs.end(), [&](const Message& a, const Message& b) {
+        return this->less_than(a, b);
+    });
+}
+
+template<typename Message>
+void StreamSorter<Message>::parallel_sort(vector<Message>& msgs) const {
+    if (use_sort_keys) {
+        sort_by_keys(msgs, true);
+        return;
+    }
+    ips4o::parallel::sort(msgs.begin(), msgs.end(), [&](const Message& a, const Message& b) {
         return this->less_than(a, b);
     });
 }
 
+template<typename Message>
+void StreamSorter<Message>::sort_by_keys(vector<Message>& msgs, bool in_parallel) const {
+    // Find all the keys
+    vector<SortKey> keys(msgs.size());
+    #pragma omp parallel for if (in_parallel)
+    for (size_t i = 0; i < msgs.size(); i++) {
+        Position min_pos = get_min_position(msgs[i]);
+        keys[i].node_id = min_pos.node_id();
+        keys[i].offset = min_pos.offset();
+        keys[i].index = i;
+        keys[i].is_reverse = min_pos.is_reverse();
+    }
+    
+    // Sort just the keys
+    if (in_parallel) {
+        ips4o::parallel::sort(keys.begin(), keys.end());
+    } else {
+        ips4o::sort(keys.begin(), keys.end());
+    }
+    
+    // Move each message once, into its sorted place
+    vector<Message> sorted(msgs.size());
+    #pragma omp parallel for if (in_parallel)
+    for (size_t i = 0; i < keys.size(); i++) {
+        sorted[i] = std::move(msgs[keys[i].index]);
+    }
+    msgs.swap(sorted);
+}
+
 template<typename Message>
 void StreamSorter<Message>::easy_sort(istream& stream_in, ostream& stream_out, StreamIndex<Message>* index_to) {
     std::vector<Message> sort_buffer;
@@ -186,7 +336,7 @@ void StreamSorter<Message>::easy_sort(istream& stream_in, ostream& stream_out, S
         sort_buffer.push_back(msg);
     });
 
-    this->sort(sort_buffer);
+    this->parallel_sort(sort_buffer);
     
     // Maintain our own group buffer at a higher scope than the emitter.
     vector<Message> group_buffer;
@@ -218,6 +368,31 @@ void StreamSorter<Message>::easy_sort(istream& stream_in, ostream& stream_out, S
     }
 }
 
+template<typename Message>
+void StreamSorter<Message>::easy_sort(const function<void(const function<void(Message&)>&)>& iterate_input,
+                                      const function<void(Message&&)>& emit) {
+    std::vector<Message> sort_buffer;
+    
+    iterate_input([&](Message& msg) {
+        sort_buffer.emplace_back(std::move(msg));
+    });
+    
+    this->parallel_sort(sort_buffer);
+    
+    for (auto& msg : sort_buffer) {
+        emit(std::move(msg));
+    }
+}
+
+template<typename Message>
+string StreamSorter<Message>::write_run(vector<Message>& sorted_messages) const {
+    string temp_name = temp_file::create();
+    ofstream temp_stream(temp_name);
+    // OK to save as one massive group here.
+    vg::io::write_buffered(temp_stream, sorted_messages, 0);
+    return temp_name;
+}
+
 template<typename Message>
 void StreamSorter<Message>::stream_sort(istream& stream_in, ostream& stream_out, StreamIndex<Message>* index_to) {
 
@@ -254,45 +429,82 @@ void StreamSorter<Message>::stream_sort(istream& stream_in, ostream& stream_out,
     // This tracks the total messages observed on input
     size_t total_messages_read = 0;
     
-    // This cursor will read in the input file.
-    cursor_t input_cursor(stream_in);
+    // This iterator will read in the input file. We only decompress and
+    // split out the serialized messages while holding the input, and leave
+    // decoding them to each thread.
+    vg::io::MessageIterator input_iterator(stream_in);
+    
+    // Exceptions can't leave the parallel region, so the first one is kept
+    // here and thrown once all the threads have stopped.
+    exception_ptr run_error;
+    atomic<bool> run_failed(false);
     
-    #pragma omp parallel shared(stream_in, input_cursor, outstanding_temp_files, messages_per_file, total_messages_read)
+    #pragma omp parallel shared(stream_in, input_iterator, outstanding_temp_files, messages_per_file, total_messages_read)
     {
     
-        while(true) {
+        while(!run_failed.load()) {
     
-            vector<Message> thread_buffer;
+            vector<string> serialized_buffer;
         
             #pragma omp critical (input_cursor)
             {
                 // Each thread fights for the file and the winner takes some data
                 size_t buffered_message_bytes = 0;
-                while (input_cursor.has_current() && buffered_message_bytes < max_buf_size) {
-                    // Until we run out of input messages or space, buffer each, recording its size.
-                    thread_buffer.emplace_back(std::move(input_cursor.take()));
-                    // Note that the message has to be small enough for its size to fit in a signed int
-                    buffered_message_bytes += thread_buffer.back().ByteSize();
+                try {
+                    while (input_iterator.has_current() && buffered_message_bytes < max_buf_size) {
+                        // Until we run out of input messages or space, buffer each, recording its size.
+                        auto tagged = input_iterator.take();
+                        if (tagged.second) {
+                            // Skip over tags with no message attached
+                            buffered_message_bytes += tagged.second->size();
+                            serialized_buffer.emplace_back(std::move(*tagged.second));
+                        }
+                    }
+                } catch (...) {
+                    #pragma omp critical (run_error)
+                    {
+                        if (!run_error) {
+                            run_error = current_exception();
+                        }
+                    }
+                    run_failed.store(true);
+                    serialized_buffer.clear();
                 }
             
                 // Update the progress bar
                 update_progress(stream_in.tellg());
             }
             
-            if (thread_buffer.empty()) {
+            if (serialized_buffer.empty()) {
                 // No data was found
                 break;
             }
             
-            // Do a sort of the data we grabbed
-            this->sort(thread_buffer);
-            
-            // Save it to a temp file.
-            string temp_name = temp_file::create();
-            ofstream temp_stream(temp_name);
-            // OK to save as one massive group here.
-            // TODO: This write could also be in a thread.
-            vg::io::write_buffered(temp_stream, thread_buffer, 0);
+            vector<Message> thread_buffer(serialized_buffer.size());
+            string temp_name;
+            try {
+                // Decode the data we grabbed
+                for (size_t i = 0; i < serialized_buffer.size(); i++) {
+                    if (!thread_buffer[i].ParseFromString(serialized_buffer[i])) {
+                        throw runtime_error("Could not parse " + Message::descriptor()->full_name() + " message to sort");
+                    }
+                }
+                serialized_buffer.clear();
+                serialized_buffer.shrink_to_fit();
+                
+                // Do a sort of the data we grabbed, and save it to a temp file.
+                this->sort(thread_buffer);
+                temp_name = write_run(thread_buffer);
+            } catch (...) {
+                #pragma omp critical (run_error)
+                {
+                    if (!run_error) {
+                        run_error = current_exception();
+                    }
+                }
+                run_failed.store(true);
+                break;
+            }
             
             #pragma omp critical (outstanding_temp_files)
             {
@@ -306,22 +518,17 @@ void StreamSorter<Message>::stream_sort(istream& stream_in, ostream& stream_out,
         }
     }
     
-    // Now we know the reader thmessages have taken care of the input, and all the data is in temp files.
+    // Now we know the reader threads have taken care of the input, and all the data is in temp files.
     
     destroy_progress();
     
-    while (outstanding_temp_files.size() > max_fan_in) {
-        // We can't merge them all at once, so merge subsets of them.
-        outstanding_temp_files = streaming_merge(outstanding_temp_files, &messages_per_file);
+    if (run_error) {
+        for (auto& temp_name : outstanding_temp_files) {
+            temp_file::remove(temp_name);
+        }
+        rethrow_exception(run_error);
     }
     
-    // Now we can merge (and maybe index) the final layer of the tree.
-    
-    // Open up cursors into all the files.
-    list<ifstream> temp_ifstreams;
-    list<cursor_t> temp_cursors;
-    open_all(outstanding_temp_files, temp_ifstreams, temp_cursors);
-    
     // Maintain our own group buffer at a higher scope than the emitter.
     vector<Message> group_buffer;
     {
@@ -342,89 +549,317 @@ void StreamSorter<Message>::stream_sort(istream& stream_in, ostream& stream_out,
             });
         }
     
-        // Merge the cursors into the emitter
-        streaming_merge(temp_cursors, emitter, total_messages_read);
-        
+        // Merge the runs into the emitter
+        merge_all(outstanding_temp_files, messages_per_file, total_messages_read, [&](Message&& msg) {
+            emitter.write(std::move(msg));
+        });
     }
+}
+
+template<typename Message>
+void StreamSorter<Message>::stream_sort(const function<void(const function<void(Message&)>&)>& iterate_input,
+                                        const function<void(Message&&)>& emit) {
+
+    create_progress("break into sorted chunks", 1);
+
+    // Eventually we put sorted chunks of data in temp files and put their names here
+    vector<string> outstanding_temp_files;
+    // This tracks the number of messages in each file, by file name
+    unordered_map<string, size_t> messages_per_file;
+    // This tracks the total messages observed on input
+    size_t total_messages_read = 0;
+    
+    // Exceptions can't leave the parallel region, so the first one is kept
+    // here and thrown once all the tasks are done.
+    exception_ptr run_error;
+    atomic<bool> run_failed(false);
+    auto record_error = [&]() {
+        #pragma omp critical (run_error)
+        {
+            if (!run_error) {
+                run_error = current_exception();
+            }
+        }
+        run_failed.store(true);
+    };
+    
+    #pragma omp parallel
+    {
+        #pragma omp single
+        {
+            // We read on this thread, and hand off full buffers to be sorted
+            // and saved in tasks. Each buffer can be up to max_buf_size, so
+            // we only let as many be in flight as there are threads, and
+            // beyond that sort and save the buffer here.
+            size_t max_in_flight = omp_get_num_threads();
+            atomic<size_t> in_flight(0);
+            vector<Message>* buffer = new vector<Message>();
+            size_t buffered_message_bytes = 0;
+            
+            auto save_buffer = [&](vector<Message>* to_save) {
+                if (!run_failed.load()) {
+                    try {
+                        this->sort(*to_save);
+                        string temp_name = write_run(*to_save);
+                        #pragma omp critical (outstanding_temp_files)
+                        {
+                            outstanding_temp_files.push_back(temp_name);
+                            messages_per_file[temp_name] = to_save->size();
+                            total_messages_read += to_save->size();
+                        }
+                    } catch (...) {
+                        record_error();
+                    }
+                }
+                delete to_save;
+            };
+            
+            auto ship_buffer = [&]() {
+                if (in_flight.load() >= max_in_flight) {
+                    save_buffer(buffer);
+                } else {
+                    ++in_flight;
+                    #pragma omp task firstprivate(buffer) shared(save_buffer, in_flight)
+                    {
+                        save_buffer(buffer);
+                        --in_flight;
+                    }
+                }
+            };
+            
+            try {
+                iterate_input([&](Message& msg) {
+                    if (run_failed.load()) {
+                        // Don't bother keeping anything.
+                        return;
+                    }
+                    buffered_message_bytes += msg.ByteSizeLong();
+                    buffer->emplace_back(std::move(msg));
+                    if (buffered_message_bytes >= max_buf_size) {
+                        ship_buffer();
+                        buffer = new vector<Message>();
+                        buffered_message_bytes = 0;
+                    }
+                });
+            } catch (...) {
+                record_error();
+            }
+            
+            if (!buffer->empty()) {
+                ship_buffer();
+            } else {
+                delete buffer;
+            }
+            
+            #pragma omp taskwait
+        }
+    }
+    
+    update_progress(1);
+    destroy_progress();
+    
+    if (run_error) {
+        for (auto& temp_name : outstanding_temp_files) {
+            temp_file::remove(temp_name);
+        }
+        rethrow_exception(run_error);
+    }
+    
+    merge_all(outstanding_temp_files, messages_per_file, total_messages_read, emit);
+}
+
+template<typename Message>
+void StreamSorter<Message>::merge_all(vector<string> temp_names_in, unordered_map<string, size_t>& messages_per_file,
+                                      size_t expected_messages, const function<void(Message&&)>& emit) {
+    while (temp_names_in.size() > max_fan_in) {
+        // We can't merge them all at once, so merge subsets of them.
+        temp_names_in = streaming_merge(temp_names_in, &messages_per_file);
+    }
+    
+    // Now we can merge the final layer of the tree.
+    merge_runs(temp_names_in, emit, expected_messages);
     
     // Clean up
-    temp_cursors.clear();
-    temp_ifstreams.clear();
-    for (auto& filename : outstanding_temp_files) {
+    for (auto& filename : temp_names_in) {
         temp_file::remove(filename);
     }
-            
 }
 
 template<typename Message>
-void StreamSorter<Message>::open_all(const vector<string>& filenames, list<ifstream>& streams, list<cursor_t>& cursors) {
-    // The open files need to live in a collection; the cursors don't own them.
-    // They also can't be allowed to move since we reference them.
-    // The cursors also need to live in a collection, because we don't want to be
-    // moving/copying them and their internal buffers and streams.
-    // And they can't move after creation either.
-    
-    // So everything lives in caller-passed lists.
-    
-    for (auto& filename : filenames) {
-        // Open each file
-        streams.emplace_back();
-        streams.back().open(filename);
-        // Make a cursor for it
-        cursors.emplace_back(streams.back());
+void StreamSorter<Message>::start_prefetch(MergeRun* run, size_t prefetch_size) const {
+    run->prefetch_done.store(false);
+    run->prefetch_claimed.store(false, std::memory_order_release);
+    #pragma omp task firstprivate(run, prefetch_size)
+    {
+        fill_prefetch(run, prefetch_size);
     }
+}
 
+template<typename Message>
+void StreamSorter<Message>::fill_prefetch(MergeRun* run, size_t prefetch_size) const {
+    bool unclaimed = false;
+    if (!run->prefetch_claimed.compare_exchange_strong(unclaimed, true, std::memory_order_acq_rel)) {
+        // Someone else is filling it.
+        return;
+    }
+    try {
+        run->prefetched.clear();
+        size_t prefetched_bytes = 0;
+        while (run->cursor->has_current() && prefetched_bytes < prefetch_size) {
+            run->prefetched.emplace_back(std::move(run->cursor->take()));
+            prefetched_bytes += run->prefetched.back().ByteSizeLong();
+        }
+    } catch (...) {
+        run->prefetch_error = current_exception();
+    }
+    run->prefetch_done.store(true, std::memory_order_release);
 }
 
 template<typename Message>
-void StreamSorter<Message>::streaming_merge(list<cursor_t>& cursors, emitter_t& emitter, size_t expected_messages) {
+void StreamSorter<Message>::advance_block(MergeRun* run, size_t prefetch_size) const {
+    if (!run->prefetch_done.load(std::memory_order_acquire)) {
+        // The block we need isn't decoded yet. If its task hasn't started,
+        // decode it here. Otherwise, wait for just that task to finish.
+        fill_prefetch(run, prefetch_size);
+        while (!run->prefetch_done.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    if (run->prefetch_error) {
+        rethrow_exception(run->prefetch_error);
+    }
+    
+    // Start on the prefetched block
+    std::swap(run->block, run->prefetched);
+    run->next_in_block = 0;
+    
+    if (run->block.empty()) {
+        // There is no more data
+        run->exhausted = true;
+    } else {
+        run->head_position = get_min_position(run->block.front());
+        // Decode the next block while this one is used.
+        start_prefetch(run, prefetch_size);
+    }
+}
+
+template<typename Message>
+void StreamSorter<Message>::merge_runs(const vector<string>& filenames, const function<void(Message&&)>& emit, size_t expected_messages) {
 
-    create_progress("merge " + to_string(cursors.size()) + " files", expected_messages == 0 ? 1 : expected_messages);
+    create_progress("merge " + to_string(filenames.size()) + " files", expected_messages == 0 ? 1 : expected_messages);
     // Count the messages we actually see
     size_t observed_messages = 0;
-
-    // Put all the files in a priority queue based on which has a message that comes first.
-    // We work with pointers to cursors because we don't want to be copying the actual cursors around the heap.
-    // We also *reverse* the order, because priority queues put the "greatest" element first
-    auto cursor_order = [&](cursor_t*& a, cursor_t*& b) {
-        if (b->has_current()) {
-            if(!a->has_current()) {
-                // Cursors that aren't empty come first
-                return true;
-            }
-            return less_than(*(*b), *(*a));
+    
+    // Split the in-memory budget between the two blocks of each run
+    size_t prefetch_size = max(min_prefetch_size, max_buf_size / max<size_t>(1, 2 * filenames.size()));
+    
+    // Runs can't move once their prefetch tasks are going.
+    vector<unique_ptr<MergeRun>> runs;
+    runs.reserve(filenames.size());
+    
+    // Work out how many leaves the tournament tree needs
+    size_t leaf_count = 1;
+    while (leaf_count < filenames.size()) {
+        leaf_count *= 2;
+    }
+    
+    // Return true if the run at leaf a should be taken from before the run at leaf b.
+    // Exhausted and nonexistent runs come last, and ties go to the earlier run.
+    auto leaf_order = [&](size_t a, size_t b) {
+        bool a_empty = a >= runs.size() || runs[a]->exhausted;
+        bool b_empty = b >= runs.size() || runs[b]->exhausted;
+        if (a_empty || b_empty) {
+            return !a_empty || (a_empty && b_empty && a < b);
         }
-        return false;
+        if (less_than(runs[a]->head_position, runs[b]->head_position)) {
+            return true;
+        }
+        if (less_than(runs[b]->head_position, runs[a]->head_position)) {
+            return false;
+        }
+        return a < b;
     };
-    priority_queue<cursor_t*, vector<cursor_t*>, decltype(cursor_order)> cursor_queue(cursor_order);
-
-    for (auto& cursor : cursors) {
-        // Put the cursor pointers in the queue
-        cursor_queue.push(&cursor);
-    }
     
-    while(!cursor_queue.empty() && cursor_queue.top()->has_current()) {
-        // Until we have run out of data in all the temp files
-        
-        // Pop off the winning cursor
-        cursor_t* winner = cursor_queue.top();
-        cursor_queue.pop();
-        
-        // Grab and emit its message, and advance it
-        emitter.write(std::move(winner->take()));
-        
-        // Put it back in the heap if it is not depleted
-        if (winner->has_current()) {
-            cursor_queue.push(winner);
+    // A tournament tree, stored as a heap, holding the leaf that wins at each
+    // internal node. Leaf i lives at tree[leaf_count + i], and the overall
+    // winner is at tree[1].
+    vector<size_t> tree(2 * leaf_count);
+    
+    // Recompute the winners from the given tree position up to the root.
+    auto replay = [&](size_t position) {
+        for (position /= 2; position >= 1; position /= 2) {
+            size_t left = tree[2 * position];
+            size_t right = tree[2 * position + 1];
+            tree[position] = leaf_order(left, right) ? left : right;
         }
-        // TODO: Maybe keep it off the heap for the next loop somehow if it still wins
-        
-        observed_messages++;
-        if (expected_messages != 0) {
-            update_progress(observed_messages);
+    };
+    
+    // Exceptions can't leave the parallel region, so we keep any we get here.
+    exception_ptr merge_error;
+    
+    #pragma omp parallel
+    {
+        #pragma omp single
+        {
+            try {
+                for (auto& filename : filenames) {
+                    // Open each run and start decoding it.
+                    runs.emplace_back(new MergeRun());
+                    runs.back()->stream.open(filename);
+                    runs.back()->cursor.reset(new cursor_t(runs.back()->stream));
+                    start_prefetch(runs.back().get(), prefetch_size);
+                }
+                for (auto& run : runs) {
+                    // Get the first block of each run
+                    advance_block(run.get(), prefetch_size);
+                }
+            
+                // Build the tree from the bottom up
+                for (size_t i = 0; i < leaf_count; i++) {
+                    tree[leaf_count + i] = i;
+                }
+                for (size_t position = leaf_count - 1; position >= 1; position--) {
+                    size_t left = tree[2 * position];
+                    size_t right = tree[2 * position + 1];
+                    tree[position] = leaf_order(left, right) ? left : right;
+                }
+            
+                while (!runs.empty() && tree[1] < runs.size() && !runs[tree[1]]->exhausted) {
+                    // Until we have run out of data in all the runs, take from the winner
+                    MergeRun* winner = runs[tree[1]].get();
+                    emit(std::move(winner->block[winner->next_in_block]));
+                    winner->next_in_block++;
+                
+                    if (winner->next_in_block == winner->block.size()) {
+                        // We need the next block
+                        advance_block(winner, prefetch_size);
+                    } else {
+                        winner->head_position = get_min_position(winner->block[winner->next_in_block]);
+                    }
+                
+                    // Find the new winner
+                    replay(leaf_count + tree[1]);
+                
+                    observed_messages++;
+                    if (expected_messages != 0) {
+                        update_progress(observed_messages);
+                    }
+                }
+            } catch (...) {
+                merge_error = current_exception();
+            }
+            
+            // Close everything before the tasks' data goes away
+            #pragma omp taskwait
+            runs.clear();
         }
     }
     
+    if (merge_error) {
+        destroy_progress();
+        rethrow_exception(merge_error);
+    }
+    
     // We finished the files, so say we're done.
     // TODO: Should we warn/fail if we expected the wrong number of messages?
     update_progress(expected_messages == 0 ? 1 : expected_messages);
@@ -442,38 +877,36 @@ vector<string> StreamSorter<Message>::streaming_merge(const vector<string>& temp
     for (size_t start_file = 0; start_file < temp_files_in.size(); start_file += max_fan_in) {
         // For each range of sufficiently few files, starting at start_file and running for file_count
         size_t file_count = min(max_fan_in, temp_files_in.size() - start_file);
-    
-        // Open up cursors into all the files.
-        list<ifstream> temp_ifstreams;
-        list<cursor_t> temp_cursors;
-        open_all(vector<string>(&temp_files_out[start_file], &temp_files_out[start_file + file_count]), temp_ifstreams, temp_cursors);
+        vector<string> files_to_merge(temp_files_in.begin() + start_file, temp_files_in.begin() + start_file + file_count);
         
         // Work out how many messages to expect
         size_t expected_messages = 0;
         if (messages_per_file != nullptr) {
-            for (size_t i = start_file; i < start_file + file_count; i++) {
-                expected_messages += messages_per_file->at(temp_files_in.at(i));
+            for (auto& filename : files_to_merge) {
+                expected_messages += messages_per_file->at(filename);
             }
         }
         
         // Open an output file
         string out_file_name = temp_file::create();
-        ofstream out_stream(out_file_name);
         temp_files_out.push_back(out_file_name);
         
-        // Make an output emitter
-        emitter_t emitter(out_stream);
-        
-        // Merge the cursors into the emitter
-        streaming_merge(temp_cursors, emitter, expected_messages);
-        
-        // The output file will be flushed and finished automatically when the emitter goes away.
+        {
+            ofstream out_stream(out_file_name);
+            // Make an output emitter
+            emitter_t emitter(out_stream);
+            
+            // Merge the runs into the emitter
+            merge_runs(files_to_merge, [&](Message&& msg) {
+                emitter.write(std::move(msg));
+            }, expected_messages);
+            
+            // The output file will be flushed and finished automatically when the emitter goes away.
+        }
         
         // Clean up the input files we used
-        temp_cursors.clear();
-        temp_ifstreams.clear();
-        for (size_t i = start_file; i < file_count; i++) {
-            temp_file::remove(temp_files_in.at(i));
+        for (auto& filename : files_to_merge) {
+            temp_file::remove(filename);
         }
         
         if (messages_per_file != nullptr) {
@@ -60,7 +60,7 @@ void help_augment(char** argv, ConfigurableParser& parser) {
          << "    -h, --help                  print this help message" << endl
          << "    -p, --progress              show progress" << endl
          << "    -v, --verbose               print information and warnings about vcf generation" << endl
-         << "    -t, --threads N             number of threads (only 1st pass with -m or -q option is multithreaded)" << endl
+         << "    -t, --threads N             number of threads to use" << endl
          << "loci file options:" << endl
          << "    -l, --include-loci FILE     merge all alleles in loci into the graph" << endl       
          << "    -L, --include-gt FILE       merge only the alleles in called genotypes into the graph" << endl;
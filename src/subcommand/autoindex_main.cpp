@@ -4,6 +4,7 @@
  */
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <algorithm>
 #include <cctype>
 #include <unistd.h>
@@ -115,6 +116,8 @@ void help_autoindex(char** argv) {
     << "    -a, --gff-tx-tag STR   GTF/GFF tag (in col. 9) for transcript ID (default: " << IndexingParameters::gff_transcript_tag << ")" << endl
     << "  logging and computation:" << endl
     << "    -T, --tmp-dir DIR      temporary directory to use for intermediate files" << endl
+    << "    --checkpoint-dir DIR   keep intermediate files in DIR, and resume from them if a previous" << endl
+    << "                           run with the same DIR and inputs did not finish" << endl
     << "    -M, --target-mem MEM   target max memory usage (not exact, formatted INT[kMG])" << endl
     << "                           (default: 1/2 of available)" << endl
 // TODO: hiding this now that we have rewinding options, since detailed args aren't really in the spirit of this subcommand
@@ -123,6 +126,7 @@ void help_autoindex(char** argv) {
 //    << "    --gcsa-size-limit NUM  limit on size of GCSA2 temporary files on disk in bytes" << endl
     << "    -t, --threads NUM      number of threads (default: all available)" << endl
     << "    -V, --verbosity NUM    log to stderr (0 = none, 1 = basic, 2 = debug; default " << (int) IndexingParameters::verbosity << ")" << endl
+    << "    --timeline FILE        write a table of when each indexing step ran to FILE" << endl
     //<< "    -d, --dot              print the dot-formatted graph of index recipes and exit" << endl
     << "    -h, --help             print this help message to stderr and exit" << endl;
 }
@@ -139,6 +143,8 @@ int main_autoindex(int argc, char** argv) {
 #define OPT_FORCE_PHASED 1002
 #define OPT_GBWT_BUFFER_SIZE 1003
 #define OPT_GCSA_SIZE_LIMIT 1004
+#define OPT_TIMELINE 1005
+#define OPT_CHECKPOINT_DIR 1006
     
     // load the registry
     IndexRegistry registry = VGIndexes::get_vg_index_registry();
@@ -150,6 +156,7 @@ int main_autoindex(int argc, char** argv) {
     int64_t target_mem_usage = IndexRegistry::get_system_memory() / 2;
     
     string gfa_name;
+    string timeline_name;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -178,6 +185,8 @@ int main_autoindex(int argc, char** argv) {
             {"keep-intermediate", no_argument, 0, OPT_KEEP_INTERMEDIATE},
             {"force-unphased", no_argument, 0, OPT_FORCE_UNPHASED},
             {"force-phased", no_argument, 0, OPT_FORCE_PHASED},
+            {"timeline", required_argument, 0, OPT_TIMELINE},
+            {"checkpoint-dir", required_argument, 0, OPT_CHECKPOINT_DIR},
             {0, 0, 0, 0}
         };
 
@@ -287,6 +296,12 @@ int main_autoindex(int argc, char** argv) {
             case OPT_GCSA_SIZE_LIMIT:
                 IndexingParameters::gcsa_size_limit = parse<int64_t>(optarg);
                 break;
+            case OPT_TIMELINE:
+                timeline_name = optarg;
+                break;
+            case OPT_CHECKPOINT_DIR:
+                registry.set_checkpoint_directory(optarg);
+                break;
             case 'h':
                 help_autoindex(argv);
                 return 0;
@@ -360,6 +375,15 @@ int main_autoindex(int argc, char** argv) {
         return 1;
     }
     
+    if (!timeline_name.empty()) {
+        ofstream timeline_out(timeline_name);
+        if (!timeline_out) {
+            cerr << "error:[vg autoindex] Could not open timeline file " << timeline_name << endl;
+            return 1;
+        }
+        registry.write_timeline(timeline_out);
+    }
+    
     return 0;
 
 }
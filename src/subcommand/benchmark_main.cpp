@@ -7,7 +7,9 @@
 #include <unistd.h>
 #include <getopt.h>
 
+#include <fstream>
 #include <iostream>
+#include <unordered_map>
 
 #include "subcommand.hpp"
 
@@ -16,6 +18,14 @@
 
 #include "../gbwt_extender.hpp"
 #include "../gbwt_helper.hpp"
+#include "../algorithms/chain_items.hpp"
+#include "../integrated_snarl_finder.hpp"
+#include "../stream_sorter.hpp"
+#include "../recombinator.hpp"
+#include "../kff.hpp"
+#include "../utility.hpp"
+
+#include <bdsg/hash_graph.hpp>
 
 
 
@@ -36,6 +46,9 @@ int main_benchmark(int argc, char** argv) {
     // Which experiments should we run?
     bool sort_and_order_experiment = false;
     bool get_sequence_experiment = true;
+    bool chaining_experiment = true;
+    bool gam_sort_experiment = true;
+    bool read_kmer_counting_experiment = true;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -173,6 +186,171 @@ int main_benchmark(int argc, char** argv) {
         }));
     }
         
+    // Remember how many anchors each chaining benchmark chains, so we can
+    // report throughput.
+    vector<pair<size_t, size_t>> anchors_by_result;
+    
+    if (chaining_experiment) {
+        // Chain anchors along a long linear graph, as for a long read.
+        size_t chain_node_length = 32;
+        size_t chain_node_count = 2000;
+        bdsg::HashGraph graph;
+        for (size_t i = 0; i < chain_node_count; i++) {
+            graph.create_handle(std::string(chain_node_length, 'A'), (nid_t) (i + 1));
+            if (i > 0) {
+                graph.create_edge(graph.get_handle((nid_t) i, false), graph.get_handle((nid_t) (i + 1), false));
+            }
+        }
+        IntegratedSnarlFinder snarl_finder(graph);
+        SnarlDistanceIndex distance_index;
+        fill_in_distance_index(&distance_index, &graph, &snarl_finder);
+        
+        uint32_t bits = 0xcafebebe;
+        auto step_rng = [&bits]() {
+            bits = (bits * 73 + 1375) % 477218579;
+        };
+        
+        for (size_t anchor_count = 1000; anchor_count <= 16000; anchor_count *= 4) {
+            // Make anchors mostly on the main diagonal, with some off it.
+            size_t graph_length = chain_node_length * chain_node_count;
+            size_t anchor_length = 15;
+            vector<algorithms::Anchor> anchors;
+            for (size_t i = 0; i < anchor_count; i++) {
+                size_t read_start = (i * (graph_length - anchor_length)) / anchor_count;
+                size_t graph_start = read_start;
+                if ((bits & 0x7) == 0) {
+                    // Make a spurious anchor off the diagonal
+                    step_rng();
+                    graph_start = bits % (graph_length - anchor_length);
+                }
+                step_rng();
+                pos_t graph_pos = make_pos_t(graph_start / chain_node_length + 1, false, graph_start % chain_node_length);
+                // Don't let anchors run off their nodes.
+                size_t length = std::min(anchor_length, chain_node_length - (size_t) offset(graph_pos));
+                anchors.emplace_back(read_start, graph_pos, length, length);
+            }
+            algorithms::sort_and_shadow(anchors);
+            
+            vector<pair<algorithms::ChainingEngine, std::string>> engines {
+                {algorithms::ChainingEngine::LOOKBACK, "scalar"},
+                {algorithms::ChainingEngine::BATCHED_LOOKBACK, "batched"},
+                {algorithms::ChainingEngine::SPARSE, "sparse"}
+            };
+            for (auto& engine : engines) {
+                anchors_by_result.emplace_back(results.size(), anchors.size());
+                results.push_back(run_benchmark(engine.second + " find_best_chain() on " + std::to_string(anchors.size()) + " anchors", 5, [&]() {
+                    auto chain = algorithms::find_best_chain(anchors, distance_index, graph, 6, 1,
+                                                             100, 1, 15, 10, 2.0, -0.1, 0, 50, engine.first);
+                    assert(!chain.second.empty());
+                }));
+            }
+        }
+    }
+    
+    if (gam_sort_experiment) {
+        // Sort reads with a few mappings each, in a random order, as easy_sort would.
+        uint32_t bits = 0xcafebebe;
+        auto step_rng = [&bits]() {
+            bits = (bits * 73 + 1375) % 477218579;
+        };
+        
+        vector<Alignment> unsorted(20000);
+        for (auto& aln : unsorted) {
+            nid_t start_node = bits % 1000000 + 1;
+            step_rng();
+            bool is_reverse = bits & 0x1;
+            step_rng();
+            for (size_t i = 0; i < 8; i++) {
+                Mapping* mapping = aln.mutable_path()->add_mapping();
+                mapping->mutable_position()->set_node_id(is_reverse ? start_node + 8 - i : start_node + i);
+                mapping->mutable_position()->set_is_reverse(is_reverse);
+                mapping->mutable_position()->set_offset(i == 0 ? bits % 32 : 0);
+                step_rng();
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(16);
+                edit->set_to_length(16);
+            }
+        }
+        
+        GAMSorter sorter;
+        vector<Alignment> to_sort;
+        for (bool use_sort_keys : {false, true}) {
+            sorter.use_sort_keys = use_sort_keys;
+            results.push_back(run_benchmark(string(use_sort_keys ? "keyed" : "comparison") + " sort of " + std::to_string(unsorted.size()) + " alignments", 5, [&]() {
+                to_sort = unsorted;
+            }, [&]() {
+                sorter.parallel_sort(to_sort);
+            }));
+        }
+    }
+    
+    if (read_kmer_counting_experiment) {
+        // Count the kmers of haplotype information in reads, as vg haplotypes
+        // would do instead of reading a KFF file, and compare with reading
+        // the counts of all the kmers in the reads from a KFF file, as KMC
+        // would have written.
+        uint32_t bits = 0xcafebebe;
+        auto step_rng = [&bits]() {
+            bits = (bits * 73 + 1375) % 477218579;
+        };
+        
+        string genome(100000, 'A');
+        for (auto& base : genome) {
+            base = "ACGT"[bits % 4];
+            step_rng();
+        }
+        
+        // Use every 16th kmer of the genome as the kmers of interest.
+        Haplotypes haplotypes;
+        haplotypes.header.k = 29;
+        haplotypes.chains.emplace_back();
+        haplotypes.chains.back().subchains.emplace_back();
+        auto& kmers = haplotypes.chains.back().subchains.back().kmers;
+        for (size_t i = 0; i + haplotypes.k() <= genome.size(); i += 16) {
+            Haplotypes::Subchain::kmer_type kmer = 0;
+            for (size_t j = i; j < i + haplotypes.k(); j++) {
+                kmer = (kmer << 2) | gbwtgraph::CHAR_TO_PACK[static_cast<uint8_t>(genome[j])];
+            }
+            kmers.emplace_back(kmer, 1);
+        }
+        haplotypes.header.total_kmers = kmers.size();
+        
+        // Write 150 bp reads at 30x coverage into a temporary FASTQ, and
+        // count the canonical kmers in them.
+        string fastq_name = temp_file::create("kmers");
+        size_t read_count = 0;
+        unordered_map<Haplotypes::Subchain::kmer_type, size_t> all_kmers;
+        {
+            ofstream fastq(fastq_name);
+            for (size_t i = 0; i < genome.size() * 30 / 150; i++) {
+                size_t start = bits % (genome.size() - 150);
+                step_rng();
+                string sequence = genome.substr(start, 150);
+                if (bits & 0x1) {
+                    sequence = reverse_complement(sequence);
+                }
+                step_rng();
+                fastq << "@read" << i << "\n" << sequence << "\n+\n" << string(sequence.size(), 'I') << "\n";
+                read_count++;
+                for (size_t j = 0; j + haplotypes.k() <= sequence.size(); j++) {
+                    Haplotypes::Subchain::kmer_type kmer = gbwtgraph::Key64::encode(sequence.substr(j, haplotypes.k())).get_key();
+                    all_kmers[min(kmer, minimizer_reverse_complement(kmer, haplotypes.k()))]++;
+                }
+            }
+        }
+        string kff_name = temp_file::create("kmers");
+        kff_write_counts(kff_name, haplotypes.k(), vector<pair<Haplotypes::Subchain::kmer_type, size_t>>(all_kmers.begin(), all_kmers.end()));
+        
+        results.push_back(run_benchmark("native kmer counting in " + std::to_string(read_count) + " reads", 5, [&]() {
+            haplotypes.kmer_counts_from_reads({ fastq_name }, false);
+        }));
+        results.push_back(run_benchmark("reading " + std::to_string(all_kmers.size()) + " kmer counts from KFF", 5, [&]() {
+            haplotypes.kmer_counts(kff_name, false);
+        }));
+        temp_file::remove(fastq_name);
+        temp_file::remove(kff_name);
+    }
+        
     // Do the control against itself
     results.push_back(run_benchmark("control", 1000, benchmark_control));
     
@@ -182,6 +360,11 @@ int main_benchmark(int argc, char** argv) {
     for (auto& result : results) {
         cout << result << endl;
     }
+    for (auto& result_and_anchors : anchors_by_result) {
+        auto& result = results.at(result_and_anchors.first);
+        double seconds = chrono::duration<double>(result.test_mean).count();
+        cout << "# " << result.name << ": " << result_and_anchors.second / seconds << " anchors/second" << endl;
+    }
     
     return 0;
 }
@@ -65,6 +65,7 @@ int main_convert(int argc, char** argv) {
     bool wline = true;
     algorithm_type gfa_output_algorithm = ALGORITHM_DEFAULT;
     int num_threads = omp_get_max_threads(); // For GBWTGraph to GFA.
+    bool show_progress = false;
 
     if (argc == 2) {
         help_convert(argv);
@@ -74,6 +75,7 @@ int main_convert(int argc, char** argv) {
     constexpr int OPT_REF_SAMPLE = 1000;
     constexpr int OPT_GBWTGRAPH_ALGORITHM = 1001;
     constexpr int OPT_VG_ALGORITHM = 1002;
+    constexpr int OPT_PROGRESS = 1003;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -101,6 +103,7 @@ int main_convert(int argc, char** argv) {
             {"gam-to-gaf", required_argument, 0, 'G'},
             {"gaf-to-gam", required_argument, 0, 'F'},
             {"threads", required_argument, 0, 't'},
+            {"progress", no_argument, 0, OPT_PROGRESS},
             {0, 0, 0, 0}
 
         };
@@ -173,6 +176,9 @@ int main_convert(int argc, char** argv) {
         case OPT_VG_ALGORITHM:
             gfa_output_algorithm = algorithm_vg;
             break;
+        case OPT_PROGRESS:
+            show_progress = true;
+            break;
         case 'G':
             no_multiple_inputs(input);
             input = input_gam;
@@ -291,7 +297,7 @@ int main_convert(int argc, char** argv) {
             bdsg::HashGraph intermediate;
             cerr << "warning [vg convert]: currently cannot convert GFA directly to XG; converting through another format" << endl;
             algorithms::gfa_to_path_handle_graph(input_stream_name, &intermediate,
-                                                 input_rgfa_rank, gfa_trans_path);
+                                                 input_rgfa_rank, gfa_trans_path, show_progress);
             graph_to_xg_adjusting_paths(&intermediate, xg_graph, ref_samples, drop_haplotypes);
         }
         else {
@@ -303,13 +309,13 @@ int main_convert(int argc, char** argv) {
                     MutablePathMutableHandleGraph* mutable_output_graph = dynamic_cast<MutablePathMutableHandleGraph*>(output_path_graph);
                     assert(mutable_output_graph != nullptr);
                     algorithms::gfa_to_path_handle_graph(input_stream_name, mutable_output_graph,
-                                                         input_rgfa_rank, gfa_trans_path);
+                                                         input_rgfa_rank, gfa_trans_path, show_progress);
                 }
                 else {
                     MutableHandleGraph* mutable_output_graph = dynamic_cast<MutableHandleGraph*>(output_graph.get());
                     assert(mutable_output_graph != nullptr);
                     algorithms::gfa_to_handle_graph(input_stream_name, mutable_output_graph,
-                                                    gfa_trans_path);
+                                                    gfa_trans_path, show_progress);
                 }
             } catch (algorithms::GFAFormatError& e) {
                 cerr << "error [vg convert]: Input GFA is not acceptable." << endl;
@@ -476,7 +482,8 @@ void help_convert(char** argv) {
          << "    -G, --gam-to-gaf FILE  convert GAM FILE to GAF" << endl
          << "    -F, --gaf-to-gam FILE  convert GAF FILE to GAM" << endl
          << "general options:" << endl
-         << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl;
+         << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl
+         << "        --progress         report GFA parsing throughput" << endl;
 }
 
 void no_multiple_inputs(input_type input) {
@@ -54,6 +54,8 @@ void help_deconstruct(char** argv){
          << "    -K, --keep-conflicted    Retain conflicted genotypes in output." << endl
          << "    -S, --strict-conflicts   Drop genotypes when we have more than one haplotype for any given phase (set by default when using GBWT input)." << endl
          << "    -t, --threads N          Use N threads" << endl
+         << "    --no-traversal-cache     Find the GBWT traversals of each nested snarl from scratch, not from its parent's" << endl
+         << "    --snarls-per-window N    Deconstruct at least N snarls before writing out finished variants (default: 65536)" << endl
          << "    -v, --verbose            Print some status messages" << endl
          << endl;
 }
@@ -81,7 +83,11 @@ int main_deconstruct(int argc, char** argv){
     int context_jaccard_window = 10000;
     bool untangle_traversals = false;
     string path_sep;
+    size_t snarls_per_window = 64 * 1024;
+    bool cache_gbwt_traversals = true;
     
+    #define OPT_SNARLS_PER_WINDOW 1000
+    #define OPT_NO_TRAVERSAL_CACHE 1001
     int c;
     optind = 2; // force optind past command positional argument
     while (true) {
@@ -104,6 +110,8 @@ int main_deconstruct(int argc, char** argv){
                 {"strict-conflicts", no_argument, 0, 'S'},
                 {"threads", required_argument, 0, 't'},
                 {"verbose", no_argument, 0, 'v'},
+                {"snarls-per-window", required_argument, 0, OPT_SNARLS_PER_WINDOW},
+                {"no-traversal-cache", no_argument, 0, OPT_NO_TRAVERSAL_CACHE},
                 {0, 0, 0, 0}
             };
 
@@ -166,6 +174,16 @@ int main_deconstruct(int argc, char** argv){
         case 'v':
             show_progress = true;
             break;
+        case OPT_SNARLS_PER_WINDOW:
+            snarls_per_window = parse<size_t>(optarg);
+            if (snarls_per_window == 0) {
+                cerr << "Error [vg deconstruct]: --snarls-per-window must be positive" << endl;
+                return 1;
+            }
+            break;
+        case OPT_NO_TRAVERSAL_CACHE:
+            cache_gbwt_traversals = false;
+            break;
         case '?':
         case 'h':
             help_deconstruct(argv);
@@ -452,6 +470,8 @@ int main_deconstruct(int argc, char** argv){
     }
     dd.set_translation(translation.get());
     dd.set_nested(all_snarls);
+    dd.set_snarls_per_window(snarls_per_window);
+    dd.set_cache_gbwt_traversals(cache_gbwt_traversals);
     dd.deconstruct(refpaths, graph, snarl_manager.get(), path_restricted_traversals, ploidy,
                    all_snarls,
                    context_jaccard_window,
@@ -461,6 +481,9 @@ int main_deconstruct(int argc, char** argv){
                    !alt_path_to_sample_phase.empty() ? &alt_path_to_sample_phase : nullptr,
                    &sample_ploidy,
                    gbwt_index);
+    if (show_progress && gbwt_index) {
+        dd.report_gbwt_traversal_cache(cerr);
+    }
     return 0;
 }
 
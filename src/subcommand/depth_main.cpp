@@ -19,6 +19,7 @@
 #include <bdsg/overlays/overlay_helper.hpp>
 #include "../utility.hpp"
 #include "../packer.hpp"
+#include "../region.hpp"
 #include "algorithms/coverage_depth.hpp"
 
 using namespace std;
@@ -31,6 +32,10 @@ void help_depth(char** argv) {
          << "  packed coverage depth (print 1-based positional depths along path):" << endl
          << "    -k, --pack FILE        supports created from vg pack for given input graph" << endl
          << "    -d, --count-dels       count deletion edges within the bin as covering reference positions" << endl
+         << "    -i, --write-index FILE write a binned depth index of the pack for the selected paths to FILE instead" << endl
+         << "  binned depth index queries (print <path> <start> <end> <mean> <stddev>; no graph needed):" << endl
+         << "    -I, --index FILE       look up depths in this index made with -i" << endl
+         << "    -r, --region PATH:S-E  1-based, inclusive region to look up (multiple allowed)" << endl
          << "  GAM/GAF coverage depth (print <mean> <stddev> for depth):" << endl
          << "    -g, --gam FILE         read alignments from this GAM file (could be '-' for stdin)" << endl
          << "    -a, --gaf FILE         read alignments from this GAF file (could be '-' for stdin)" << endl
@@ -60,6 +65,9 @@ int main_depth(int argc, char** argv) {
     vector<string> path_prefixes;
     size_t bin_size = 1;
     bool count_dels = false;
+    string index_out_filename;
+    string index_filename;
+    vector<string> regions;
     
     string gam_filename;
     string gaf_filename;
@@ -80,6 +88,9 @@ int main_depth(int argc, char** argv) {
             {"paths-by", required_argument, 0, 'P'}, 
             {"bin-size", required_argument, 0, 'b'},
             {"count-dels", no_argument, 0, 'd'},
+            {"write-index", required_argument, 0, 'i'},
+            {"index", required_argument, 0, 'I'},
+            {"region", required_argument, 0, 'r'},
             {"gam", required_argument, 0, 'g'},
             {"gaf", no_argument, 0, 'a'},
             {"max-nodes", required_argument, 0, 'n'},
@@ -93,7 +104,7 @@ int main_depth(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hk:p:P:b:dg:a:n:s:m:ct:",
+        c = getopt_long (argc, argv, "hk:p:P:b:di:I:r:g:a:n:s:m:ct:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -117,6 +128,15 @@ int main_depth(int argc, char** argv) {
         case 'd':
             count_dels = true;
             break;            
+        case 'i':
+            index_out_filename = optarg;
+            break;
+        case 'I':
+            index_filename = optarg;
+            break;
+        case 'r':
+            regions.push_back(optarg);
+            break;
         case 'g':
             gam_filename = optarg;
             break;
@@ -164,6 +184,41 @@ int main_depth(int argc, char** argv) {
         return 1;
     }
 
+    if (!index_filename.empty()) {
+        // Answer the queries from the index alone
+        if (regions.empty()) {
+            cerr << "error:[vg depth] At least one region (-r) must be given to query an index (-I)" << endl;
+            exit(1);
+        }
+        unique_ptr<algorithms::MappedBinnedDepthIndex> depth_index;
+        try {
+            depth_index = unique_ptr<algorithms::MappedBinnedDepthIndex>(new algorithms::MappedBinnedDepthIndex(index_filename));
+        } catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            exit(1);
+        }
+        for (const string& region_string : regions) {
+            Region region;
+            parse_region(region_string, region.seq, region.start, region.end);
+            if (region.start < 1 || region.end < 1) {
+                cerr << "error:[vg depth] Region \"" << region_string << "\" must be of the form PATH:START-END" << endl;
+                exit(1);
+            }
+            if (!depth_index->has_path(region.seq)) {
+                cerr << "error:[vg depth] Path \"" << region.seq << "\" not found in index" << endl;
+                exit(1);
+            }
+            pair<float, float> depth = algorithms::get_depth_from_index(*depth_index, region.seq, region.start - 1, region.end - 1);
+            cout << region.seq << "\t" << region.start << "\t" << region.end << "\t" << depth.first << "\t" << sqrt(depth.second) << endl;
+        }
+        return 0;
+    }
+
+    if (!index_out_filename.empty() && pack_filename.empty()) {
+        cerr << "error:[vg depth] A pack file (-k) is required to write an index (-i)" << endl;
+        exit(1);
+    }
+
     size_t input_count = pack_filename.empty() ? 0 : 1;
     if (!gam_filename.empty()) ++input_count;
     if (!gaf_filename.empty()) ++input_count;
@@ -230,26 +285,47 @@ int main_depth(int argc, char** argv) {
             }
         }
 
+        vector<string> ref_path_names;
         for (const auto& ref_coord_path : ref_paths) {
-            const string& ref_path = ref_coord_path.second;
-            const string& base_path = ref_coord_path.first.first;
-            const size_t subpath_offset = ref_coord_path.first.second;
-            
-            if (bin_size > 1) {
-                vector<tuple<size_t, size_t, double, double>> binned_depth;
-                if (!pack_filename.empty()) {
-                    binned_depth = algorithms::binned_packed_depth(*packer, ref_path, bin_size, min_coverage, count_dels);
-                } else {
-                    binned_depth = algorithms::binned_path_depth(*graph, ref_path, bin_size, min_coverage, count_cycles);
-                }
-                for (auto& bin_cov : binned_depth) {
+            ref_path_names.push_back(ref_coord_path.second);
+        }
+
+        if (!index_out_filename.empty()) {
+            // Use the same bin sizes as vg call
+            algorithms::BinnedDepthIndex depth_index = algorithms::binned_packed_depth_index(*packer, ref_path_names, 50, 50000000, 1.5,
+                                                                                             min_coverage, count_dels, false);
+            try {
+                algorithms::save_binned_depth_index(depth_index, index_out_filename);
+            } catch (const runtime_error& e) {
+                cerr << e.what() << endl;
+                exit(1);
+            }
+            return 0;
+        }
+
+        if (bin_size > 1) {
+            // compute the bins of all the paths together, so small paths don't leave threads idle
+            vector<vector<tuple<size_t, size_t, double, double>>> binned_depths;
+            if (!pack_filename.empty()) {
+                binned_depths = algorithms::binned_packed_depths(*packer, ref_path_names, bin_size, min_coverage, count_dels);
+            } else {
+                binned_depths = algorithms::binned_path_depths(*graph, ref_path_names, bin_size, min_coverage, count_cycles);
+            }
+            size_t i = 0;
+            for (const auto& ref_coord_path : ref_paths) {
+                const string& base_path = ref_coord_path.first.first;
+                const size_t subpath_offset = ref_coord_path.first.second;
+                for (auto& bin_cov : binned_depths[i++]) {
                     // bins can ben nan if min_coverage filters everything out.  just skip
                     if (!isnan(get<3>(bin_cov))) {
                         cout << base_path << "\t" << (get<0>(bin_cov) + 1 + subpath_offset)<< "\t" << (get<1>(bin_cov) + 1 + subpath_offset) << "\t" << get<2>(bin_cov)
                              << "\t" << sqrt(get<3>(bin_cov)) << endl;
                     }
                 }
-            } else {
+            }
+        } else {
+            for (const auto& ref_coord_path : ref_paths) {
+                const string& ref_path = ref_coord_path.second;
                 if (!pack_filename.empty()) {
                     algorithms::packed_depths(*packer, ref_path, min_coverage, cout);
                 } else {
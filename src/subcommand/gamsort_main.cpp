@@ -1,6 +1,8 @@
 #include "../stream_sorter.hpp"
 #include <vg/io/stream.hpp>
 #include "../stream_index.hpp"
+#include <vg/io/vpkg.hpp>
+#include <vg/io/alignment_io.hpp>
 #include <getopt.h>
 #include "subcommand.hpp"
 
@@ -13,11 +15,14 @@ using namespace vg;
 using namespace vg::subcommand;
 void help_gamsort(char **argv)
 {
-    cerr << "gamsort: sort a GAM file, or index a sorted GAM file" << endl
+    cerr << "gamsort: sort a GAM or GAF file, or index a sorted GAM file" << endl
          << "Usage: " << argv[1] << " [Options] gamfile" << endl
          << "Options:" << endl
          << "  -i / --index FILE       produce an index of the sorted GAM file" << endl
          << "  -d / --dumb-sort        use naive sorting algorithm (no tmp files, faster for small GAMs)" << endl
+         << "  -g / --gaf-input        input is GAF instead of GAM (requires -x)" << endl
+         << "  -G / --gaf-output       output GAF instead of GAM (requires -x)" << endl
+         << "  -x / --graph FILE       graph the GAF alignments are against" << endl
          << "  -p / --progress         Show progress." << endl
          << "  -t / --threads          Use the specified number of threads." << endl
          << endl;
@@ -28,10 +33,12 @@ int main_gamsort(int argc, char **argv)
     string index_filename;
     bool easy_sort = false;
     bool show_progress = false;
-    // We limit the max threads, and only allow thread count to be lowered, to
-    // prevent tcmalloc from giving each thread a very large heap for many
-    // threads.
-    // On my machine we can keep about 4 threads busy.
+    bool gaf_input = false;
+    bool gaf_output = false;
+    string graph_filename;
+    // We default to few threads, to prevent tcmalloc from giving each thread
+    // a very large heap for many threads. More can be asked for, since
+    // decoding and sorting runs both use all threads.
     size_t num_threads = 4;
     int c;
     optind = 2; // force optind past command positional argument
@@ -41,12 +48,15 @@ int main_gamsort(int argc, char **argv)
             {
                 {"index", required_argument, 0, 'i'},
                 {"dumb-sort", no_argument, 0, 'd'},
+                {"gaf-input", no_argument, 0, 'g'},
+                {"gaf-output", no_argument, 0, 'G'},
+                {"graph", required_argument, 0, 'x'},
                 {"rocks", required_argument, 0, 'r'},
                 {"progress", no_argument, 0, 'p'},
                 {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}};
         int option_index = 0;
-        c = getopt_long(argc, argv, "i:dhpt:",
+        c = getopt_long(argc, argv, "i:dgGx:hpt:",
                         long_options, &option_index);
 
         // Detect the end of the options.
@@ -61,11 +71,20 @@ int main_gamsort(int argc, char **argv)
         case 'd':
             easy_sort = true;
             break;
+        case 'g':
+            gaf_input = true;
+            break;
+        case 'G':
+            gaf_output = true;
+            break;
+        case 'x':
+            graph_filename = optarg;
+            break;
         case 'p':
             show_progress = true;
             break;
         case 't':
-            num_threads = min(parse<size_t>(optarg), num_threads);
+            num_threads = parse<size_t>(optarg);
             break;
         case 'h':
         case '?':
@@ -82,6 +101,56 @@ int main_gamsort(int argc, char **argv)
     }
     
     omp_set_num_threads(num_threads);
+    
+    if ((gaf_input || gaf_output) && graph_filename.empty()) {
+        cerr << "error:[vg gamsort] A graph (-x) is required to read or write GAF" << endl;
+        exit(1);
+    }
+    if (gaf_output && !index_filename.empty()) {
+        cerr << "error:[vg gamsort] Only GAM output can be indexed" << endl;
+        exit(1);
+    }
+    
+    if (gaf_input || gaf_output) {
+        // Sort through the general interface, converting on the way in and out.
+        unique_ptr<HandleGraph> graph = vg::io::VPKG::load_one<HandleGraph>(graph_filename);
+        string input_filename = get_input_file_name(optind, argc, argv);
+        
+        GAMSorter gs(show_progress);
+        
+        auto iterate_input = [&](const function<void(Alignment&)>& take) {
+            if (gaf_input) {
+                vg::io::gaf_unpaired_for_each(*graph, input_filename, take);
+            } else {
+                get_input_file(input_filename, [&](istream& gam_in) {
+                    vg::io::for_each<Alignment>(gam_in, take);
+                });
+            }
+        };
+        
+        unique_ptr<vg::io::ProtobufEmitter<Alignment>> gam_emitter;
+        if (!gaf_output) {
+            gam_emitter.reset(new vg::io::ProtobufEmitter<Alignment>(cout));
+        }
+        auto emit = [&](Alignment&& aln) {
+            if (gaf_output) {
+                cout << vg::io::alignment_to_gaf(*graph, aln) << "\n";
+            } else {
+                gam_emitter->write(std::move(aln));
+            }
+        };
+        
+        if (easy_sort) {
+            gs.easy_sort(iterate_input, emit);
+        } else {
+            gs.stream_sort(iterate_input, emit);
+        }
+        
+        // Finish the GAM if we are making one
+        gam_emitter.reset();
+        cout.flush();
+        return 0;
+    }
 
     get_input_file(optind, argc, argv, [&](istream& gam_in) {
 
@@ -13,10 +13,12 @@
 #include <vector>
 #include <unordered_set>
 #include <chrono>
+#include <future>
 #include <mutex>
 
 #include "subcommand.hpp"
 #include "options.hpp"
+#include "giraffe_main.hpp"
 
 #include "../snarl_seed_clusterer.hpp"
 #include "../mapper.hpp"
@@ -27,6 +29,7 @@
 #include "../minimizer_mapper.hpp"
 #include "../index_registry.hpp"
 #include "../watchdog.hpp"
+#include "../mapping_pipeline.hpp"
 #include "../crash.hpp"
 #include <bdsg/overlays/overlay_helper.hpp>
 
@@ -59,9 +62,18 @@ struct GiraffeMainOptions {
     /// How long should we wait while mapping a read before complaining, in seconds.
     static constexpr size_t default_watchdog_timeout = 10;
     size_t watchdog_timeout = default_watchdog_timeout;
+    /// How many dedicated output threads should we run in a read/map/emit
+    /// pipeline? 0 means map and emit on the same threads, without a
+    /// pipeline.
+    static constexpr size_t default_pipeline_emit_threads = 0;
+    size_t pipeline_emit_threads = default_pipeline_emit_threads;
+    /// How many batches may wait between pipeline stages? 0 means pick
+    /// automatically.
+    static constexpr size_t default_pipeline_queue_batches = 0;
+    size_t pipeline_queue_batches = default_pipeline_queue_batches;
 };
 
-static GroupedOptionGroup get_options() {
+GroupedOptionGroup vg::get_giraffe_options() {
     GroupedOptionGroup parser;
     
     // Configure Giraffe program settings
@@ -72,6 +84,18 @@ static GroupedOptionGroup get_options() {
         GiraffeMainOptions::default_watchdog_timeout,
         "complain after INT seconds working on a read or read pair"
     );
+    main_opts.add_range(
+        "pipeline-emit-threads",
+        &GiraffeMainOptions::pipeline_emit_threads,
+        GiraffeMainOptions::default_pipeline_emit_threads,
+        "read, map, and emit in separate pipeline stages, with INT extra output threads"
+    );
+    main_opts.add_range(
+        "pipeline-queue-batches",
+        &GiraffeMainOptions::pipeline_queue_batches,
+        GiraffeMainOptions::default_pipeline_queue_batches,
+        "allow INT batches to wait between pipeline stages (0 = 2 per mapping thread)"
+    );
     
     // Configure output settings on the MinimizerMapper
     auto& result_opts = parser.add_group<MinimizerMapper>("result options");
@@ -261,6 +285,18 @@ static GroupedOptionGroup get_options() {
         MinimizerMapper::default_lookback_item_hard_cap,
         "maximum items to consider coming from when chaining"
     );
+    chaining_opts.add_flag(
+        "batched-chaining",
+        &MinimizerMapper::batched_chaining,
+        MinimizerMapper::default_batched_chaining,
+        "score each chaining lookback window as a SIMD batch"
+    );
+    chaining_opts.add_flag(
+        "sparse-chaining",
+        &MinimizerMapper::sparse_chaining,
+        MinimizerMapper::default_sparse_chaining,
+        "chain with a range-max query structure, for reads with very many anchors"
+    );
     
     chaining_opts.add_range(
         "chain-score-threshold",
@@ -305,6 +341,31 @@ static GroupedOptionGroup get_options() {
     return parser;
 }
 
+std::map<std::string, Preset> vg::get_giraffe_presets() {
+    // Map preset names to presets
+    std::map<std::string, Preset> presets;
+    // We have a fast preset that sets a bunch of stuff
+    presets["fast"]
+        .add_entry<size_t>("hit-cap", 10)
+        .add_entry<size_t>("hard-hit-cap", 500)
+        .add_entry<double>("score-fraction", 0.5)
+        .add_entry<size_t>("max-multimaps", 1)
+        .add_entry<size_t>("max-extensions", 400)
+        .add_entry<size_t>("max-alignments", 8)
+        .add_entry<size_t>("cluster-score", 50)
+        .add_entry<size_t>("pad-cluster-score", 0)
+        .add_entry<double>("cluster-coverage", 0.2)
+        .add_entry<size_t>("extension-set", 20)
+        .add_entry<size_t>("extension-score", 1);
+    // And a default preset that doesn't.
+    presets["default"];
+    // And a chaining preset (TODO: make into PacBio and Nanopore)
+    presets["chaining"]
+        .add_entry<bool>("align-from-chains", true)
+        .add_entry<size_t>("watchdog-timeout", 30);
+    return presets;
+}
+
 // Try stripping all suffixes in the vector, one at a time, and return on failure.
 std::string strip_suffixes(std::string filename, const std::vector<std::string>& suffixes) {
     for (const std::string& suffix : suffixes) {
@@ -346,6 +407,7 @@ void help_giraffe(char** argv, const BaseOptionGroup& parser) {
     << "  --output-basename NAME        write output to a GAM file beginning with the given prefix for each setting combination" << endl
     << "  --report-name NAME            write a TSV of output file and mapping speed to the given file" << endl
     << "  --show-work                   log how the mapper comes to its conclusions about mapping locations" << endl
+    << "  --stage-latency FILE          write per-stage wall time histograms as JSON to the given file" << endl
     << "algorithm presets:" << endl
     << "  -b, --parameter-preset NAME   set computational parameters (fast / default) [default]" << endl;
     auto helps = parser.get_help();
@@ -366,7 +428,7 @@ int main_giraffe(int argc, char** argv) {
     std::chrono::time_point<std::chrono::system_clock> launch = std::chrono::system_clock::now();
 
     // Set up to parse options
-    GroupedOptionGroup parser = get_options();
+    GroupedOptionGroup parser = get_giraffe_options();
 
     if (argc == 2) {
         help_giraffe(argv, parser);
@@ -382,6 +444,7 @@ int main_giraffe(int argc, char** argv) {
     #define OPT_REF_PATHS 1010
     #define OPT_SHOW_WORK 1011
     #define OPT_NAMED_COORDINATES 1012
+    #define OPT_STAGE_LATENCY 1013
 
     // initialize parameters with their default options
     
@@ -389,6 +452,8 @@ int main_giraffe(int argc, char** argv) {
     IndexRegistry registry = VGIndexes::get_vg_index_registry();
     string output_basename;
     string report_name;
+    // Where should we write per-stage timing histograms, if anywhere?
+    string stage_latency_name;
     bool show_progress = false;
     
     // Main Giraffe program options struct
@@ -463,26 +528,7 @@ int main_giraffe(int argc, char** argv) {
     //TODO: Right now there can be two versions of the distance index. This ensures that the correct minimizer type gets built
     
     // Map preset names to presets
-    std::map<std::string, Preset> presets;
-    // We have a fast preset that sets a bunch of stuff
-    presets["fast"]
-        .add_entry<size_t>("hit-cap", 10)
-        .add_entry<size_t>("hard-hit-cap", 500)
-        .add_entry<double>("score-fraction", 0.5)
-        .add_entry<size_t>("max-multimaps", 1)
-        .add_entry<size_t>("max-extensions", 400)
-        .add_entry<size_t>("max-alignments", 8)
-        .add_entry<size_t>("cluster-score", 50)
-        .add_entry<size_t>("pad-cluster-score", 0)
-        .add_entry<double>("cluster-coverage", 0.2)
-        .add_entry<size_t>("extension-set", 20)
-        .add_entry<size_t>("extension-score", 1);
-    // And a default preset that doesn't.
-    presets["default"];
-    // And a chaining preset (TODO: make into PacBio and Nanopore)
-    presets["chaining"]
-        .add_entry<bool>("align-from-chains", true)
-        .add_entry<size_t>("watchdog-timeout", 30);
+    std::map<std::string, Preset> presets = get_giraffe_presets();
    
     std::vector<struct option> long_options =
     {
@@ -514,6 +560,7 @@ int main_giraffe(int argc, char** argv) {
         {"track-provenance", no_argument, 0, OPT_TRACK_PROVENANCE},
         {"track-correctness", no_argument, 0, OPT_TRACK_CORRECTNESS},
         {"show-work", no_argument, 0, OPT_SHOW_WORK},
+        {"stage-latency", required_argument, 0, OPT_STAGE_LATENCY},
         {"batch-size", required_argument, 0, 'B'},
         {"threads", required_argument, 0, 't'},
     };
@@ -769,6 +816,10 @@ int main_giraffe(int argc, char** argv) {
                 Explainer::save_explanations = true;
                 break;
                 
+            case OPT_STAGE_LATENCY:
+                stage_latency_name = optarg;
+                break;
+                
             case 'B':
                 batch_size = parse<uint64_t>(optarg);
                 break;
@@ -952,17 +1003,24 @@ int main_giraffe(int argc, char** argv) {
     }
 #endif
     
+    // The indexes don't depend on each other, so load them all at once. Each
+    // process still deserializes its own copy of each index.
+    
     // Grab the minimizer index
     if (show_progress) {
         cerr << "Loading Minimizer Index" << endl;
     }
-    auto minimizer_index = vg::io::VPKG::load_one<gbwtgraph::DefaultMinimizerIndex>(registry.require("Minimizers").at(0));
+    auto minimizer_index_future = std::async(std::launch::async, [&]() {
+        return vg::io::VPKG::load_one<gbwtgraph::DefaultMinimizerIndex>(registry.require("Minimizers").at(0));
+    });
 
     // Grab the GBZ
     if (show_progress) {
         cerr << "Loading GBZ" << endl;
     }
-    auto gbz = vg::io::VPKG::load_one<gbwtgraph::GBZ>(registry.require("Giraffe GBZ").at(0));
+    auto gbz_future = std::async(std::launch::async, [&]() {
+        return vg::io::VPKG::load_one<gbwtgraph::GBZ>(registry.require("Giraffe GBZ").at(0));
+    });
 
     // Grab the distance index
     if (show_progress) {
@@ -970,6 +1028,9 @@ int main_giraffe(int argc, char** argv) {
     }
     auto distance_index = vg::io::VPKG::load_one<SnarlDistanceIndex>(registry.require("Giraffe Distance Index").at(0));
     
+    auto minimizer_index = minimizer_index_future.get();
+    auto gbz = gbz_future.get();
+    
     if (show_progress) {
         cerr << "Paging in Distance Index v2" << endl;
     }
@@ -1035,6 +1096,21 @@ int main_giraffe(int argc, char** argv) {
         // Add a header
         report << "#file\treads/second/thread" << endl;
     }
+    
+    // Set up to time mapping stages if requested. This is cheap enough to
+    // leave on, unlike provenance tracking.
+    unique_ptr<StageLatencyRecorder> stage_latency_recorder;
+    ofstream stage_latency_file;
+    if (!stage_latency_name.empty()) {
+        stage_latency_file.open(stage_latency_name);
+        if (!stage_latency_file) {
+            cerr << "error[vg giraffe]: Could not open stage latency file " << stage_latency_name << endl;
+            exit(1);
+        }
+        // Pipeline reader and emit threads record too.
+        stage_latency_recorder.reset(new StageLatencyRecorder(omp_get_max_threads() + 1 + main_options.pipeline_emit_threads));
+        minimizer_mapper.stage_latency_recorder = stage_latency_recorder.get();
+    }
 
     // We need to loop over all the ranges...
     for_each_combo([&]() {
@@ -1113,6 +1189,12 @@ int main_giraffe(int argc, char** argv) {
         // Set up counters per-thread for total reads mapped
         vector<size_t> reads_mapped_by_thread(thread_count, 0);
         
+        // If we are pipelining, there is a reader thread and some emit
+        // threads on top of the mapping threads, and the emitter needs to be
+        // ready for all of them.
+        bool use_pipeline = main_options.pipeline_emit_threads > 0;
+        size_t emitter_thread_count = use_pipeline ? thread_count + 1 + main_options.pipeline_emit_threads : thread_count;
+        
         // For timing, we may run one thread first and then switch to all threads. So track both start times.
         std::chrono::time_point<std::chrono::system_clock> first_thread_start;
         std::chrono::time_point<std::chrono::system_clock> all_threads_start;
@@ -1204,7 +1286,7 @@ int main_giraffe(int argc, char** argv) {
                 const HandleGraph* emitter_graph = path_position_graph ? (const HandleGraph*)path_position_graph : (const HandleGraph*)&(gbz->graph);
                 
                 alignment_emitter = get_alignment_emitter(output_filename, output_format,
-                                                          paths, thread_count,
+                                                          paths, emitter_thread_count,
                                                           emitter_graph, flags);
             }
             
@@ -1221,6 +1303,23 @@ int main_giraffe(int argc, char** argv) {
             reset_perf_for_thread();
 #endif
 
+            // Send alignments to the emitter through these, so emitting can
+            // be timed as a stage too.
+            auto emit_mapped_pair = [&](vector<Alignment>&& alns1, vector<Alignment>&& alns2, int64_t tlen_limit) {
+                auto emit_start = std::chrono::high_resolution_clock::now();
+                alignment_emitter->emit_mapped_pair(std::move(alns1), std::move(alns2), tlen_limit);
+                if (stage_latency_recorder) {
+                    stage_latency_recorder->record("emit", std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - emit_start).count());
+                }
+            };
+            auto emit_mapped_single = [&](vector<Alignment>&& alns) {
+                auto emit_start = std::chrono::high_resolution_clock::now();
+                alignment_emitter->emit_mapped_single(std::move(alns));
+                if (stage_latency_recorder) {
+                    stage_latency_recorder->record("emit", std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - emit_start).count());
+                }
+            };
+
             if (interleaved || !fastq_filename_2.empty()) {
                 //Map paired end from either one gam or fastq file or two fastq files
 
@@ -1266,8 +1365,11 @@ int main_giraffe(int argc, char** argv) {
                     }
                 };
                 
-                // Define how to align and output a read pair, in a thread.
-                auto map_read_pair = [&](Alignment& aln1, Alignment& aln2) {
+                // Define how to align a read pair, in a thread, and send the
+                // results and the template length limit to emit them with
+                // somewhere.
+                using pair_sink_t = function<void(pair<vector<Alignment>, vector<Alignment>>&&, int64_t)>;
+                auto map_read_pair_to = [&](Alignment& aln1, Alignment& aln2, const pair_sink_t& sink) {
                     try {
                         set_crash_context(aln1.name() + ", " + aln2.name());
                         
@@ -1300,7 +1402,7 @@ int main_giraffe(int argc, char** argv) {
                                  tlen_limit = minimizer_mapper.get_fragment_length_mean() + 6 * minimizer_mapper.get_fragment_length_stdev();
                             }
                             // Emit it
-                            alignment_emitter->emit_mapped_pair(std::move(mapped_pairs.first), std::move(mapped_pairs.second), tlen_limit);
+                            sink(std::move(mapped_pairs), tlen_limit);
                             // Record that we mapped a read.
                             reads_mapped_by_thread.at(thread_num) += 2;
                         }
@@ -1323,8 +1425,71 @@ int main_giraffe(int argc, char** argv) {
                         report_exception(ex);
                     }
                 };
+                
+                // Define how to align and output a read pair, in a thread.
+                auto map_read_pair = [&](Alignment& aln1, Alignment& aln2) {
+                    map_read_pair_to(aln1, aln2, [&](pair<vector<Alignment>, vector<Alignment>>&& mapped_pairs, int64_t tlen_limit) {
+                        emit_mapped_pair(std::move(mapped_pairs.first), std::move(mapped_pairs.second), tlen_limit);
+                    });
+                };
 
-                if (!gam_filename.empty()) {
+                if (use_pipeline) {
+                    // Read, map, and emit on separate threads.
+                    
+                    // Results of mapping a pair, waiting to be emitted
+                    struct mapped_pair_t {
+                        pair<vector<Alignment>, vector<Alignment>> alignments;
+                        int64_t tlen_limit = 0;
+                    };
+                    MappingPipeline<pair<Alignment, Alignment>, mapped_pair_t> pipeline(thread_count, main_options.pipeline_emit_threads,
+                                                                                       batch_size, main_options.pipeline_queue_batches);
+                    
+                    auto read_all_pairs = [&](const function<void(pair<Alignment, Alignment>&)>& take_pair) {
+                        auto take_mates = [&](Alignment& aln1, Alignment& aln2) {
+                            pair<Alignment, Alignment> read_pair(std::move(aln1), std::move(aln2));
+                            take_pair(read_pair);
+                        };
+                        if (!gam_filename.empty()) {
+                            // GAM file to remap, with mates interleaved
+                            get_input_file(gam_filename, [&](istream& in) {
+                                Alignment first_mate;
+                                bool have_first_mate = false;
+                                vg::io::for_each<Alignment>(in, [&](Alignment& aln) {
+                                    if (have_first_mate) {
+                                        take_mates(first_mate, aln);
+                                    } else {
+                                        first_mate = std::move(aln);
+                                    }
+                                    have_first_mate = !have_first_mate;
+                                });
+                                if (have_first_mate) {
+                                    cerr << "warning[vg::giraffe]: Ignoring unpaired final read " << first_mate.name() << endl;
+                                }
+                            });
+                        } else if (!fastq_filename_2.empty()) {
+                            // A pair of FASTQ files to map
+                            fastq_paired_two_files_for_each(fastq_filename_1, fastq_filename_2, take_mates);
+                        } else if (!fastq_filename_1.empty()) {
+                            // An interleaved FASTQ file to map
+                            fastq_paired_interleaved_for_each(fastq_filename_1, take_mates);
+                        }
+                    };
+                    
+                    pipeline.run(read_all_pairs, [&](pair<Alignment, Alignment>& read_pair, mapped_pair_t& mapped) {
+                        map_read_pair_to(read_pair.first, read_pair.second, [&](pair<vector<Alignment>, vector<Alignment>>&& mapped_pairs, int64_t tlen_limit) {
+                            mapped.alignments = std::move(mapped_pairs);
+                            mapped.tlen_limit = tlen_limit;
+                        });
+                    }, [&](mapped_pair_t& mapped) {
+                        if (!mapped.alignments.first.empty() && !mapped.alignments.second.empty()) {
+                            emit_mapped_pair(std::move(mapped.alignments.first), std::move(mapped.alignments.second), mapped.tlen_limit);
+                        }
+                    }, distribution_is_ready);
+                    
+                    if (show_progress) {
+                        pipeline.report(cerr);
+                    }
+                } else if (!gam_filename.empty()) {
                     // GAM file to remap
                     get_input_file(gam_filename, [&](istream& in) {
                         // Map pairs of reads to the emitter
@@ -1353,7 +1518,7 @@ int main_giraffe(int argc, char** argv) {
                              tlen_limit = minimizer_mapper.get_fragment_length_mean() + 6 * minimizer_mapper.get_fragment_length_stdev();
                         }
                         // Emit the read
-                        alignment_emitter->emit_mapped_pair(std::move(mapped_pairs.first), std::move(mapped_pairs.second), tlen_limit);
+                        emit_mapped_pair(std::move(mapped_pairs.first), std::move(mapped_pairs.second), tlen_limit);
                         // Record that we mapped a read.
                         reads_mapped_by_thread.at(omp_get_thread_num()) += 2;
                         clear_crash_context();
@@ -1367,8 +1532,9 @@ int main_giraffe(int argc, char** argv) {
                 // All the threads start at once.
                 all_threads_start = first_thread_start;
             
-                // Define how to align and output a read, in a thread.
-                auto map_read = [&](Alignment& aln) {
+                // Define how to align a read, in a thread, and send the
+                // results somewhere.
+                auto map_read_to = [&](Alignment& aln, const function<void(vector<Alignment>&&)>& sink) {
                     try {
                         set_crash_context(aln.name());
                         auto thread_num = omp_get_thread_num();
@@ -1382,7 +1548,7 @@ int main_giraffe(int argc, char** argv) {
                         toUppercaseInPlace(*aln.mutable_sequence());
                     
                         // Map the read with the MinimizerMapper.
-                        minimizer_mapper.map(aln, *alignment_emitter);
+                        sink(minimizer_mapper.map(aln));
                         // Record that we mapped a read.
                         reads_mapped_by_thread.at(thread_num)++;
                         
@@ -1394,18 +1560,58 @@ int main_giraffe(int argc, char** argv) {
                         report_exception(ex);
                     }
                 };
-                    
-                if (!gam_filename.empty()) {
-                    // GAM file to remap
-                    get_input_file(gam_filename, [&](istream& in) {
-                        // Open it and map all the reads in parallel.
-                        vg::io::for_each_parallel<Alignment>(in, map_read, batch_size);
+                
+                // Define how to align and output a read, in a thread.
+                auto map_read = [&](Alignment& aln) {
+                    map_read_to(aln, [&](vector<Alignment>&& mapped) {
+                        emit_mapped_single(std::move(mapped));
                     });
-                }
+                };
                 
-                if (!fastq_filename_1.empty()) {
-                    // FASTQ file to map, map all its reads in parallel.
-                    fastq_unpaired_for_each_parallel(fastq_filename_1, map_read, batch_size);
+                if (use_pipeline) {
+                    // Read, map, and emit on separate threads.
+                    MappingPipeline<Alignment, vector<Alignment>> pipeline(thread_count, main_options.pipeline_emit_threads,
+                                                                           batch_size, main_options.pipeline_queue_batches);
+                    
+                    auto read_all = [&](const function<void(Alignment&)>& take_read) {
+                        if (!gam_filename.empty()) {
+                            // GAM file to remap
+                            get_input_file(gam_filename, [&](istream& in) {
+                                vg::io::for_each<Alignment>(in, take_read);
+                            });
+                        }
+                        if (!fastq_filename_1.empty()) {
+                            // FASTQ file to map
+                            fastq_unpaired_for_each(fastq_filename_1, take_read);
+                        }
+                    };
+                    
+                    pipeline.run(read_all, [&](Alignment& aln, vector<Alignment>& mapped) {
+                        map_read_to(aln, [&](vector<Alignment>&& mapped_alignments) {
+                            mapped = std::move(mapped_alignments);
+                        });
+                    }, [&](vector<Alignment>& mapped) {
+                        if (!mapped.empty()) {
+                            emit_mapped_single(std::move(mapped));
+                        }
+                    });
+                    
+                    if (show_progress) {
+                        pipeline.report(cerr);
+                    }
+                } else {
+                    if (!gam_filename.empty()) {
+                        // GAM file to remap
+                        get_input_file(gam_filename, [&](istream& in) {
+                            // Open it and map all the reads in parallel.
+                            vg::io::for_each_parallel<Alignment>(in, map_read, batch_size);
+                        });
+                    }
+                    
+                    if (!fastq_filename_1.empty()) {
+                        // FASTQ file to map, map all its reads in parallel.
+                        fastq_unpaired_for_each_parallel(fastq_filename_1, map_read, batch_size);
+                    }
                 }
             }
         
@@ -1486,6 +1692,12 @@ int main_giraffe(int argc, char** argv) {
         }
         
     });
+    
+    if (stage_latency_recorder) {
+        // Merge all the threads' histograms and save them.
+        stage_latency_recorder->to_json(stage_latency_file);
+        stage_latency_file << endl;
+    }
         
     return 0;
 }
@@ -0,0 +1,26 @@
+#ifndef VG_SUBCOMMAND_GIRAFFE_MAIN_HPP_INCLUDED
+#define VG_SUBCOMMAND_GIRAFFE_MAIN_HPP_INCLUDED
+
+/**
+ * \file giraffe_main.hpp
+ * Option parsing for Giraffe, shared with other subcommands that map reads
+ * the way Giraffe does.
+ */
+
+#include <map>
+#include <string>
+
+#include "options.hpp"
+
+namespace vg {
+
+/// Get the option parser for Giraffe's mapping parameters, with Giraffe's
+/// defaults. Applying it to a MinimizerMapper configures it like Giraffe.
+subcommand::GroupedOptionGroup get_giraffe_options();
+
+/// Get Giraffe's named parameter presets, to apply to the option parser.
+std::map<std::string, subcommand::Preset> get_giraffe_presets();
+
+}
+
+#endif
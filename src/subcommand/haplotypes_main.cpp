@@ -83,12 +83,14 @@ void help_haplotypes(char** argv) {
     std::cerr << usage << "-k kmers.kff -g output.gbz graph.gbz" << std::endl;
     std::cerr << usage << "-H output.hapl graph.gbz" << std::endl;
     std::cerr << usage << "-i graph.hapl -k kmers.kff -g output.gbz graph.gbz" << std::endl;
+    std::cerr << usage << "-i graph.hapl -R reads.fq.gz -g output.gbz graph.gbz" << std::endl;
     std::cerr << std::endl;
     std::cerr << "Haplotype sampling based on kmer counts." << std::endl;
     std::cerr << std::endl;
     std::cerr << "Output files:" << std::endl;
     std::cerr << "    -g, --gbz-output X        write the output GBZ to X" << std::endl;
     std::cerr << "    -H, --haplotype-output X  write haplotype information to X" << std::endl;
+    std::cerr << "        --kff-output X        write the kmer counts from --read-input to KFF file X" << std::endl;
     std::cerr << std::endl;
     std::cerr << "Input files:" << std::endl;
     std::cerr << "    -d, --distance-index X    use this distance index (default: <basename>.dist)" << std::endl;
@@ -96,12 +98,13 @@ void help_haplotypes(char** argv) {
     std::cerr << "    -r, --r-index X           use this r-index (default: <basename>.ri)" << std::endl;
     std::cerr << "    -i, --haplotype-input X   use this haplotype information (default: generate the information)" << std::endl;
     std::cerr << "    -k, --kmer-input X        use kmer counts from this KFF file (required for --gbz-output)" << std::endl;
+    std::cerr << "    -R, --read-input X        count kmers in this FASTQ / GAM file instead of using KFF (may repeat)" << std::endl;
     std::cerr << std::endl;
     std::cerr << "Computational parameters:" << std::endl;
     std::cerr << "        --kmer-length N       kmer length for building the minimizer index (default: " << haplotypes_default_k() << ")" << std::endl;
     std::cerr << "        --window-length N     window length for building the minimizer index (default: " << haplotypes_default_w() << ")" << std::endl;
     std::cerr << "        --subchain-length N   target length (in bp) for subchains (default: " << haplotypes_default_subchain_length() << ")" << std::endl;
-    std::cerr << "        --coverage N          read coverage in the KFF file (default: " << haplotypes_default_coverage() << ")" << std::endl;
+    std::cerr << "        --coverage N          read coverage in the kmer input (default: " << haplotypes_default_coverage() << ")" << std::endl;
     std::cerr << "        --num-haplotypes N    generate N haplotypes (default: " << haplotypes_default_n() << ")" << std::endl;
     std::cerr << "        --present-discount F  discount scores for present kmers by factor F (default: " << haplotypes_default_discount() << ")" << std::endl;
     std::cerr << "        --het-adjustment F    adjust scores for heterozygous kmers by F (default: " << haplotypes_default_adjustment() << ")" << std::endl;
@@ -160,7 +163,8 @@ int main_haplotypes(int argc, char** argv) {
 
     // Parse options into these.
     std::string graph_name, gbz_output, haplotype_output;
-    std::string distance_name, minimizer_name, r_index_name, haplotype_input, kmer_input;
+    std::string distance_name, minimizer_name, r_index_name, haplotype_input, kmer_input, kff_output;
+    std::vector<std::string> read_input;
     size_t k = haplotypes_default_k(), w = haplotypes_default_w();
     HaplotypePartitioner::Parameters partitioner_parameters;
     Recombinator::Parameters recombinator_parameters;
@@ -168,6 +172,7 @@ int main_haplotypes(int argc, char** argv) {
     size_t threads = haplotypes_default_threads();
     bool validate = false;
 
+    constexpr int OPT_KFF_OUTPUT = 1100;
     constexpr int OPT_KMER_LENGTH = 1200;
     constexpr int OPT_WINDOW_LENGTH = 1201;
     constexpr int OPT_SUBCHAIN_LENGTH = 1202;
@@ -183,11 +188,13 @@ int main_haplotypes(int argc, char** argv) {
     {
         { "gbz-output", required_argument, 0, 'g' },
         { "haplotype-output", required_argument, 0, 'H' },
+        { "kff-output", required_argument, 0, OPT_KFF_OUTPUT },
         { "distance-index", required_argument, 0, 'd' },
         { "minimizer-index", required_argument, 0, 'm' },
         { "r-index", required_argument, 0, 'r' },
         { "haplotype-input", required_argument, 0, 'i' },
         { "kmer-input", required_argument, 0, 'k' },
+        { "read-input", required_argument, 0, 'R' },
         { "kmer-length", required_argument, 0, OPT_KMER_LENGTH },
         { "window-length", required_argument, 0, OPT_WINDOW_LENGTH },
         { "subchain-length", required_argument, 0, OPT_SUBCHAIN_LENGTH },
@@ -208,7 +215,7 @@ int main_haplotypes(int argc, char** argv) {
     optind = 2; // force optind past command positional argument
     while (true) {
         int option_index = 0;
-        c = getopt_long(argc, argv, "g:H:d:m:r:i:k:v:t:h", long_options, &option_index);
+        c = getopt_long(argc, argv, "g:H:d:m:r:i:k:R:v:t:h", long_options, &option_index);
         if (c == -1) { break; } // End of options.
 
         switch (c)
@@ -235,6 +242,12 @@ int main_haplotypes(int argc, char** argv) {
         case 'k':
             kmer_input = optarg;
             break;
+        case 'R':
+            read_input.push_back(optarg);
+            break;
+        case OPT_KFF_OUTPUT:
+            kff_output = optarg;
+            break;
 
         case OPT_KMER_LENGTH:
             k = parse<size_t>(optarg);
@@ -329,8 +342,16 @@ int main_haplotypes(int argc, char** argv) {
         return 1;
     }
     graph_name = argv[optind];
-    if (!gbz_output.empty() && kmer_input.empty()) {
-        std::cerr << "error: [vg haplotypes] --gbz-output requires --kmer-input" << std::endl;
+    if (!gbz_output.empty() && kmer_input.empty() && read_input.empty()) {
+        std::cerr << "error: [vg haplotypes] --gbz-output requires --kmer-input or --read-input" << std::endl;
+        return 1;
+    }
+    if (!kmer_input.empty() && !read_input.empty()) {
+        std::cerr << "error: [vg haplotypes] cannot use both --kmer-input and --read-input" << std::endl;
+        return 1;
+    }
+    if (!kff_output.empty() && (read_input.empty() || gbz_output.empty())) {
+        std::cerr << "error: [vg haplotypes] --kff-output requires --read-input and --gbz-output" << std::endl;
         return 1;
     }
     if (gbz_output.empty() && haplotype_output.empty()) {
@@ -435,7 +456,9 @@ int main_haplotypes(int argc, char** argv) {
     // Generate haplotypes.
     omp_set_num_threads(threads_to_jobs(threads));
     Recombinator recombinator(gbz, verbosity);
-    gbwt::GBWT merged = recombinator.generate_haplotypes(haplotypes, kmer_input, recombinator_parameters);
+    gbwt::GBWT merged = (read_input.empty() ?
+        recombinator.generate_haplotypes(haplotypes, kmer_input, recombinator_parameters) :
+        recombinator.generate_haplotypes(haplotypes, read_input, recombinator_parameters, kff_output));
     omp_set_num_threads(threads); // Restore the number of threads.
 
     // Build and serialize GBWTGraph.
@@ -99,6 +99,9 @@ void help_mpmap(char** argv) {
     //<< "      --linear-index FILE      use this sublinear Li and Stephens index file for population-based MAPQs" << endl
     //<< "      --linear-path PATH       use the given path name as the path that the linear index is against" << endl
     << "  -s, --snarls FILE         align to alternate paths in these snarls (unnecessary if providing -d, see `vg snarls`)" << endl
+    << "  --calibration FILE        load mismapping calibration from FILE if it matches the indexes and mapping" << endl
+    << "                            parameters, otherwise calibrate and save it to FILE (`vg autoindex -w mpmap`" << endl
+    << "                            makes one for unpaired reads with the default options)" << endl
     << "input:" << endl
     << "  -f, --fastq FILE          input FASTQ (possibly gzipped), can be given twice for paired ends (for stdin use -)" << endl
     << "  -i, --interleaved         input contains interleaved paired ends" << endl
@@ -215,6 +218,7 @@ int main_mpmap(int argc, char** argv) {
     #define OPT_RESEED_LENGTH 1035
     #define OPT_MAX_MOTIF_PAIRS 1036
     #define OPT_SUPPRESS_MISMAPPING_DETECTION 1037
+    #define OPT_CALIBRATION 1038
     string matrix_file_name;
     string graph_name;
     string gcsa_name;
@@ -223,6 +227,7 @@ int main_mpmap(int argc, char** argv) {
     string sublinearLS_ref_path;
     string snarls_name;
     string distance_index_name;
+    string calibration_name;
     string fastq_name_1;
     string fastq_name_2;
     string gam_file_name;
@@ -317,8 +322,6 @@ int main_mpmap(int argc, char** argv) {
     bool auto_calibrate_mismapping_detection = true;
     double max_mapping_p_value = 0.0001;
     double max_rescue_p_value = 0.03;
-    size_t num_calibration_simulations = 100;
-    vector<size_t> calibration_read_lengths{50, 100, 150, 250, 450};
     size_t order_length_repeat_hit_max = 3000;
     size_t sub_mem_count_thinning = 4;
     size_t sub_mem_thinning_burn_in_diff = 1;
@@ -417,6 +420,7 @@ int main_mpmap(int argc, char** argv) {
             {"report-group-mapq", no_argument, 0, 'U'},
             {"report-allelic-mapq", no_argument, 0, OPT_REPORT_ALLELIC_MAPQ},
             {"suppress-mismapping", no_argument, 0, OPT_SUPPRESS_MISMAPPING_DETECTION},
+            {"calibration", required_argument, 0, OPT_CALIBRATION},
             {"padding-mult", required_argument, 0, OPT_BAND_PADDING_MULTIPLIER},
             {"map-attempts", required_argument, 0, 'u'},
             {"max-paths", required_argument, 0, OPT_MAX_PATHS},
@@ -618,6 +622,10 @@ int main_mpmap(int argc, char** argv) {
                 suppress_mismapping_detection = true;
                 break;
                 
+            case OPT_CALIBRATION:
+                calibration_name = optarg;
+                break;
+                
             case 'v':
                 use_tvs_clusterer = true;
                 use_min_dist_clusterer = false;
@@ -1887,136 +1895,128 @@ int main_mpmap(int argc, char** argv) {
         multipath_mapper.accelerator = mem_accelerator.get();
     }
     
-    // set alignment parameters
-    if (matrix_stream.is_open()) {
-        multipath_mapper.set_alignment_scores(matrix_stream, gap_open_score, gap_extension_score, full_length_bonus);
-    }
-    else if (match_score != default_match
-             || mismatch_score != default_mismatch
-             || gap_open_score != default_gap_open
-             || gap_extension_score != default_gap_extension
-             || full_length_bonus != default_full_length_bonus) {
-        multipath_mapper.set_alignment_scores(match_score, mismatch_score, gap_open_score, gap_extension_score, full_length_bonus);
-    }
-    multipath_mapper.adjust_alignments_for_base_quality = qual_adjusted;
-    multipath_mapper.strip_bonuses = strip_full_length_bonus;
-    multipath_mapper.band_padding_multiplier = band_padding_multiplier;
-    multipath_mapper.init_band_padding_memo();
-    
-    // set mem finding parameters
-    multipath_mapper.hit_max = hit_max;
-    multipath_mapper.hard_hit_max = hard_hit_max;
-    multipath_mapper.mem_reseed_length = reseed_length;
-    multipath_mapper.fast_reseed = true;
-    multipath_mapper.fast_reseed_length_diff = reseed_diff;
-    multipath_mapper.sub_mem_count_thinning = sub_mem_count_thinning;
-    multipath_mapper.sub_mem_thinning_burn_in = int(ceil(log(total_seq_length) / log(4.0))) + sub_mem_thinning_burn_in_diff;
-    multipath_mapper.order_length_repeat_hit_max = order_length_repeat_hit_max;
-    multipath_mapper.min_mem_length = min_mem_length;
-    multipath_mapper.stripped_match_alg_strip_length = stripped_match_alg_strip_length;
-    multipath_mapper.stripped_match_alg_max_length = stripped_match_alg_max_length;
-    multipath_mapper.stripped_match_alg_target_count = stripped_match_alg_target_count;
-    multipath_mapper.use_greedy_mem_restarts = use_greedy_mem_restarts;
-    multipath_mapper.greedy_restart_min_length = greedy_restart_min_length;
-    multipath_mapper.greedy_restart_max_count = greedy_restart_max_count;
-    multipath_mapper.greedy_restart_max_lcp = greedy_restart_max_lcp;
-    multipath_mapper.greedy_restart_assume_substitution = greedy_restart_assume_substitution;
-    multipath_mapper.use_stripped_match_alg = use_stripped_match_alg;
-    multipath_mapper.filter_short_mems = filter_short_mems;
-    multipath_mapper.short_mem_filter_factor = short_mem_filter_factor;
-    multipath_mapper.use_fanout_match_alg = use_fanout_match_alg;
-    multipath_mapper.max_fanout_base_quality = max_fanout_base_quality;
-    multipath_mapper.max_fans_out = max_fans_out;
-    multipath_mapper.fanout_length_threshold = int(ceil(log(total_seq_length) / log(4.0))) + fanout_pruning_diff;
-    multipath_mapper.adaptive_reseed_diff = use_adaptive_reseed;
-    multipath_mapper.adaptive_diff_exponent = reseed_exp;
-    multipath_mapper.use_approx_sub_mem_count = false;
-    multipath_mapper.prefilter_redundant_hits = prefilter_redundant_hits;
-    multipath_mapper.precollapse_order_length_hits = precollapse_order_length_hits;
-    multipath_mapper.max_sub_mem_recursion_depth = max_sub_mem_recursion_depth;
-    multipath_mapper.max_mapping_p_value = max_mapping_p_value;
-    multipath_mapper.max_rescue_p_value = max_rescue_p_value;
-    multipath_mapper.suppress_mismapping_detection = suppress_mismapping_detection;
-    if (min_clustering_mem_length) {
-        multipath_mapper.min_clustering_mem_length = min_clustering_mem_length;
-    }
-    else {
-        multipath_mapper.set_automatic_min_clustering_length();
-    }
-    
-    // set mapping quality parameters
-    multipath_mapper.mapping_quality_method = mapq_method;
-    multipath_mapper.max_mapping_quality = max_mapq;
-    multipath_mapper.mapq_scaling_factor = mapq_scaling_factor;
+    // collect the parameters we resolved from the presets and options
+    MultipathMapperSettings mapper_settings;
+    
+    // alignment parameters
+    mapper_settings.match_score = match_score;
+    mapper_settings.mismatch_score = mismatch_score;
+    mapper_settings.gap_open_score = gap_open_score;
+    mapper_settings.gap_extension_score = gap_extension_score;
+    mapper_settings.full_length_bonus = full_length_bonus;
+    mapper_settings.adjust_alignments_for_base_quality = qual_adjusted;
+    mapper_settings.strip_bonuses = strip_full_length_bonus;
+    mapper_settings.band_padding_multiplier = band_padding_multiplier;
+    
+    // mem finding parameters
+    mapper_settings.hit_max = hit_max;
+    mapper_settings.hard_hit_max = hard_hit_max;
+    mapper_settings.mem_reseed_length = reseed_length;
+    mapper_settings.fast_reseed_length_diff = reseed_diff;
+    mapper_settings.sub_mem_count_thinning = sub_mem_count_thinning;
+    mapper_settings.sub_mem_thinning_burn_in_diff = sub_mem_thinning_burn_in_diff;
+    mapper_settings.order_length_repeat_hit_max = order_length_repeat_hit_max;
+    mapper_settings.min_mem_length = min_mem_length;
+    mapper_settings.min_clustering_mem_length = min_clustering_mem_length;
+    mapper_settings.use_stripped_match_alg = use_stripped_match_alg;
+    mapper_settings.stripped_match_alg_strip_length = stripped_match_alg_strip_length;
+    mapper_settings.stripped_match_alg_max_length = stripped_match_alg_max_length;
+    mapper_settings.stripped_match_alg_target_count = stripped_match_alg_target_count;
+    mapper_settings.use_greedy_mem_restarts = use_greedy_mem_restarts;
+    mapper_settings.greedy_restart_min_length = greedy_restart_min_length;
+    mapper_settings.greedy_restart_max_count = greedy_restart_max_count;
+    mapper_settings.greedy_restart_max_lcp = greedy_restart_max_lcp;
+    mapper_settings.greedy_restart_assume_substitution = greedy_restart_assume_substitution;
+    mapper_settings.filter_short_mems = filter_short_mems;
+    mapper_settings.short_mem_filter_factor = short_mem_filter_factor;
+    mapper_settings.use_fanout_match_alg = use_fanout_match_alg;
+    mapper_settings.max_fanout_base_quality = max_fanout_base_quality;
+    mapper_settings.max_fans_out = max_fans_out;
+    mapper_settings.fanout_pruning_diff = fanout_pruning_diff;
+    mapper_settings.adaptive_reseed_diff = use_adaptive_reseed;
+    mapper_settings.adaptive_diff_exponent = reseed_exp;
+    mapper_settings.prefilter_redundant_hits = prefilter_redundant_hits;
+    mapper_settings.precollapse_order_length_hits = precollapse_order_length_hits;
+    mapper_settings.max_sub_mem_recursion_depth = max_sub_mem_recursion_depth;
+    mapper_settings.max_mapping_p_value = max_mapping_p_value;
+    mapper_settings.max_rescue_p_value = max_rescue_p_value;
+    mapper_settings.suppress_mismapping_detection = suppress_mismapping_detection;
+    
+    // mapping quality parameters
+    mapper_settings.mapping_quality_method = mapq_method;
+    mapper_settings.max_mapping_quality = max_mapq;
+    mapper_settings.mapq_scaling_factor = mapq_scaling_factor;
     // always report group MAPQ when we're reporting multimapped reads
-    multipath_mapper.report_group_mapq = report_group_mapq || (max_num_mappings > 1 && !agglomerate_multipath_alns);
-    multipath_mapper.report_allelic_mapq = report_allelic_mapq;
-    // Use population MAPQs when we have the right option combination to make that sensible.
-    multipath_mapper.use_population_mapqs = (haplo_score_provider != nullptr && population_max_paths > 0);
-    multipath_mapper.population_max_paths = population_max_paths;
-    multipath_mapper.population_paths_hard_cap = population_paths_hard_cap;
-    multipath_mapper.top_tracebacks = top_tracebacks;
-    multipath_mapper.recombination_penalty = recombination_penalty;
-    multipath_mapper.always_check_population = always_check_population;
-    multipath_mapper.force_haplotype_count = force_haplotype_count;
-    
-    // set pruning and clustering parameters
-    multipath_mapper.no_clustering = no_clustering;
-    multipath_mapper.use_tvs_clusterer = use_tvs_clusterer;
-    multipath_mapper.use_min_dist_clusterer = use_min_dist_clusterer;
-    multipath_mapper.greedy_min_dist = greedy_min_dist;
-    multipath_mapper.component_min_dist = component_min_dist;
-    multipath_mapper.max_expected_dist_approx_error = max_dist_error;
-    multipath_mapper.mem_coverage_min_ratio = cluster_ratio;
-    multipath_mapper.log_likelihood_approx_factor = likelihood_approx_exp;
-    multipath_mapper.num_mapping_attempts = max_map_attempts;
-    multipath_mapper.min_median_mem_coverage_for_split = min_median_mem_coverage_for_split;
-    multipath_mapper.suppress_cluster_merging = suppress_cluster_merging;
-    multipath_mapper.suppress_multicomponent_splitting = suppress_multicomponent_splitting;
-    multipath_mapper.use_tvs_clusterer = use_tvs_clusterer;
-    multipath_mapper.reversing_walk_length = reversing_walk_length;
-    multipath_mapper.max_alt_mappings = max_num_mappings;
-    multipath_mapper.max_alignment_gap = max_alignment_gap;
-    multipath_mapper.use_pessimistic_tail_alignment = use_pessimistic_tail_alignment;
-    multipath_mapper.pessimistic_gap_multiplier = pessimistic_gap_multiplier;
-    multipath_mapper.restrained_graph_extraction = restrained_graph_extraction;
-    
-    // set pair rescue parameters
-    multipath_mapper.max_rescue_attempts = max_rescue_attempts;
-    multipath_mapper.max_single_end_mappings_for_rescue = max(max_single_end_mappings_for_rescue, max_rescue_attempts);
-    multipath_mapper.secondary_rescue_subopt_diff = secondary_rescue_subopt_diff;
-    multipath_mapper.secondary_rescue_score_diff = secondary_rescue_score_diff;
-    multipath_mapper.secondary_rescue_attempts = secondary_rescue_attempts;
-    multipath_mapper.rescue_only_min = rescue_only_min;
-    multipath_mapper.rescue_only_anchor_max = rescue_only_anchor_max;
-    multipath_mapper.fragment_length_warning_factor = fragment_length_warning_factor;
-    multipath_mapper.get_rescue_graph_from_paths = get_rescue_graph_from_paths;
-    multipath_mapper.rescue_graph_std_devs = rescue_graph_std_devs;
-    
-    // set multipath alignment topology parameters
-    multipath_mapper.max_snarl_cut_size = snarl_cut_size;
-    multipath_mapper.max_branch_trim_length = max_branch_trim_length;
-    multipath_mapper.suppress_tail_anchors = !synthesize_tail_anchors;
-    multipath_mapper.num_alt_alns = num_alt_alns;
-    multipath_mapper.dynamic_max_alt_alns = dynamic_max_alt_alns;
-    multipath_mapper.simplify_topologies = simplify_topologies;
-    multipath_mapper.max_suboptimal_path_score_ratio = suboptimal_path_exponent;
-    multipath_mapper.agglomerate_multipath_alns = agglomerate_multipath_alns;
+    mapper_settings.report_group_mapq = report_group_mapq || (max_num_mappings > 1 && !agglomerate_multipath_alns);
+    mapper_settings.report_allelic_mapq = report_allelic_mapq;
+    mapper_settings.population_max_paths = population_max_paths;
+    mapper_settings.population_paths_hard_cap = population_paths_hard_cap;
+    mapper_settings.top_tracebacks = top_tracebacks;
+    mapper_settings.recombination_penalty = recombination_penalty;
+    mapper_settings.always_check_population = always_check_population;
+    mapper_settings.force_haplotype_count = force_haplotype_count;
+    
+    // pruning and clustering parameters
+    mapper_settings.no_clustering = no_clustering;
+    mapper_settings.use_tvs_clusterer = use_tvs_clusterer;
+    mapper_settings.use_min_dist_clusterer = use_min_dist_clusterer;
+    mapper_settings.greedy_min_dist = greedy_min_dist;
+    mapper_settings.component_min_dist = component_min_dist;
+    mapper_settings.max_expected_dist_approx_error = max_dist_error;
+    mapper_settings.mem_coverage_min_ratio = cluster_ratio;
+    mapper_settings.log_likelihood_approx_factor = likelihood_approx_exp;
+    mapper_settings.num_mapping_attempts = max_map_attempts;
+    mapper_settings.min_median_mem_coverage_for_split = min_median_mem_coverage_for_split;
+    mapper_settings.suppress_cluster_merging = suppress_cluster_merging;
+    mapper_settings.suppress_multicomponent_splitting = suppress_multicomponent_splitting;
+    mapper_settings.reversing_walk_length = reversing_walk_length;
+    mapper_settings.max_alt_mappings = max_num_mappings;
+    mapper_settings.max_alignment_gap = max_alignment_gap;
+    mapper_settings.use_pessimistic_tail_alignment = use_pessimistic_tail_alignment;
+    mapper_settings.pessimistic_gap_multiplier = pessimistic_gap_multiplier;
+    mapper_settings.restrained_graph_extraction = restrained_graph_extraction;
+    
+    // pair rescue parameters
+    mapper_settings.max_rescue_attempts = max_rescue_attempts;
+    mapper_settings.max_single_end_mappings_for_rescue = max_single_end_mappings_for_rescue;
+    mapper_settings.secondary_rescue_subopt_diff = secondary_rescue_subopt_diff;
+    mapper_settings.secondary_rescue_score_diff = secondary_rescue_score_diff;
+    mapper_settings.secondary_rescue_attempts = secondary_rescue_attempts;
+    mapper_settings.rescue_only_min = rescue_only_min;
+    mapper_settings.rescue_only_anchor_max = rescue_only_anchor_max;
+    mapper_settings.fragment_length_warning_factor = fragment_length_warning_factor;
+    mapper_settings.get_rescue_graph_from_paths = get_rescue_graph_from_paths;
+    mapper_settings.rescue_graph_std_devs = rescue_graph_std_devs;
+    
+    // multipath alignment topology parameters
+    mapper_settings.max_snarl_cut_size = snarl_cut_size;
+    mapper_settings.max_branch_trim_length = max_branch_trim_length;
+    mapper_settings.suppress_tail_anchors = !synthesize_tail_anchors;
+    mapper_settings.num_alt_alns = num_alt_alns;
+    mapper_settings.dynamic_max_alt_alns = dynamic_max_alt_alns;
+    mapper_settings.simplify_topologies = simplify_topologies;
+    mapper_settings.max_suboptimal_path_score_ratio = suboptimal_path_exponent;
+    mapper_settings.agglomerate_multipath_alns = agglomerate_multipath_alns;
     
     // splicing parameters
-    int64_t min_softclip_length_for_splice = max<int>(int(ceil(log(total_seq_length) / log(4.0)) - max_softclip_overlap) , 1);
-    multipath_mapper.set_min_softclip_length_for_splice(min_softclip_length_for_splice);
-    multipath_mapper.set_log_odds_against_splice(no_splice_log_odds);
-    multipath_mapper.max_softclip_overlap = max_softclip_overlap;
-    multipath_mapper.max_splice_overhang = max_splice_overhang;
-    multipath_mapper.splice_rescue_graph_std_devs = splice_rescue_graph_std_devs;
+    mapper_settings.max_softclip_overlap = max_softclip_overlap;
+    mapper_settings.max_splice_overhang = max_splice_overhang;
+    mapper_settings.no_splice_log_odds = no_splice_log_odds;
+    mapper_settings.splice_rescue_graph_std_devs = splice_rescue_graph_std_devs;
+    mapper_settings.max_motif_pairs = max_motif_pairs;
+    mapper_settings.read_1_adapter = read_1_adapter;
+    mapper_settings.read_2_adapter = read_2_adapter;
+    
+    mapper_settings.apply(multipath_mapper, total_seq_length);
+    
+    // the parameters that come from files
+    if (matrix_stream.is_open()) {
+        multipath_mapper.set_alignment_scores(matrix_stream, gap_open_score, gap_extension_score, full_length_bonus);
+    }
     multipath_mapper.ref_path_handles = move(ref_path_handles);
-    multipath_mapper.max_motif_pairs = max_motif_pairs;
     if (!intron_distr_name.empty()) {
         multipath_mapper.set_intron_length_distribution(intron_mixture_weights, intron_component_params);
     }
-    multipath_mapper.set_read_1_adapter(read_1_adapter);
-    multipath_mapper.set_read_2_adapter(read_2_adapter);
 
 #ifdef mpmap_instrument_mem_statistics
     multipath_mapper._mem_stats.open(MEM_STATS_FILE);
@@ -2027,8 +2027,44 @@ int main_mpmap(int argc, char** argv) {
     
     // if directed to, auto calibrate the mismapping detection to the graph
     if (auto_calibrate_mismapping_detection && !suppress_mismapping_detection) {
-        log_progress("Building null model to calibrate mismapping detection");
-        multipath_mapper.calibrate_mismapping_detection(num_calibration_simulations, calibration_read_lengths);
+        // the calibration depends on the indexes and other files it was made with (in the same
+        // order that vg autoindex uses for the indexes it builds the calibration from)
+        vector<string> calibration_index_names{graph_name, gcsa_name, lcp_name};
+        for (const string& file_name : {distance_index_name, snarls_name, gbwt_name, sublinearLS_name,
+                                        matrix_file_name, intron_distr_name}) {
+            if (!file_name.empty()) {
+                calibration_index_names.push_back(file_name);
+            }
+        }
+        string calibration_key;
+        bool loaded_calibration = false;
+        if (!calibration_name.empty()) {
+            calibration_key = mapper_settings.calibration_key(calibration_index_names);
+            ifstream calibration_stream(calibration_name);
+            if (calibration_stream) {
+                loaded_calibration = multipath_mapper.load_mismapping_calibration(calibration_stream, calibration_key);
+                if (loaded_calibration) {
+                    log_progress("Loaded mismapping detection calibration from " + calibration_name);
+                }
+                else {
+                    log_progress("Calibration in " + calibration_name + " was made with different indexes or parameters, recalibrating");
+                }
+            }
+        }
+        if (!loaded_calibration) {
+            log_progress("Building null model to calibrate mismapping detection");
+            multipath_mapper.calibrate_mismapping_detection(mapper_settings.calibration_simulations,
+                                                            mapper_settings.calibration_read_lengths);
+            if (!calibration_name.empty()) {
+                ofstream calibration_stream(calibration_name);
+                if (calibration_stream) {
+                    multipath_mapper.save_mismapping_calibration(calibration_stream, calibration_key);
+                }
+                else {
+                    cerr << "warning:[vg mpmap] Cannot write calibration file " << calibration_name << endl;
+                }
+            }
+        }
     }
     
     // now we can start doing spliced alignment
@@ -32,6 +32,9 @@ void help_pack(char** argv) {
          << "    -Q, --min-mapq N       ignore reads with MAPQ < N and positions with base quality < N [default: 0]" << endl
          << "    -c, --expected-cov N   expected coverage.  used only for memory tuning [default : 128]" << endl
          << "    -s, --trim-ends N      ignore the first and last N bases of each read" << endl 
+         << "    -S, --stream           write packs as alignments are read, in constant memory. input must be sorted" << endl
+         << "                           by vg gamsort and the graph's node IDs in rank order. only with -o and -g/-a" << endl
+         << "    -B, --buffer-size N    buffer N coverage increments per thread before applying them [default: 65536, 0 if 1 thread]" << endl
          << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl;
 }
 
@@ -54,6 +57,8 @@ int main_pack(int argc, char** argv) {
     int min_baseq = 0;
     size_t expected_coverage = 128;
     int trim_ends = 0;
+    int64_t coverage_buffer_size = -1;
+    bool stream = false;
 
     if (argc == 2) {
         help_pack(argv);
@@ -82,11 +87,13 @@ int main_pack(int argc, char** argv) {
             {"min-mapq", required_argument, 0, 'Q'},
             {"expected-cov", required_argument, 0, 'c'},
             {"trim-ends", required_argument, 0, 's'},
+            {"buffer-size", required_argument, 0, 'B'},
+            {"stream", no_argument, 0, 'S'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:o:i:g:a:dDut:eb:n:N:Q:c:s:",
+        c = getopt_long (argc, argv, "hx:o:i:g:a:dDut:eb:n:N:Q:c:s:B:S",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -156,6 +163,12 @@ int main_pack(int argc, char** argv) {
         case 's':
             trim_ends = parse<int>(optarg);
             break;
+        case 'B':
+            coverage_buffer_size = parse<int64_t>(optarg);
+            break;
+        case 'S':
+            stream = true;
+            break;
         default:
             abort();
         }
@@ -187,6 +200,12 @@ int main_pack(int argc, char** argv) {
         exit(1);
     }
 
+    if (stream && (packs_out.empty() || write_table || write_edge_table || write_qual_table ||
+                   !packs_in.empty() || record_edits || (gam_in.empty() && gaf_in.empty()))) {
+        cerr << "error [vg pack]: -S requires -o and -g or -a, and cannot be used with -d, -D, -u, -i or -e" << endl;
+        exit(1);
+    }
+
     // process input node list
     if (!node_list_file.empty()) {
         ifstream nli;
@@ -214,9 +233,44 @@ int main_pack(int argc, char** argv) {
     size_t num_threads = get_thread_count();
     size_t batch_size = Packer::estimate_batch_size(num_threads);
     size_t bin_count = Packer::estimate_bin_count(num_threads);
+    if (coverage_buffer_size < 0) {
+        coverage_buffer_size = Packer::estimate_coverage_buffer_size(num_threads);
+    }
 
     // create our packer
-    Packer packer(graph, true, true, record_edits, true, bin_size, bin_count, data_width);
+    Packer packer(graph, true, true, record_edits, true, bin_size, bin_count, data_width, stream ? 0 : coverage_buffer_size);
+
+    if (stream) {
+        // coverage gets written as we go, so we must see the reads one at a time and in order
+        if (!packer.node_ranks_follow_ids()) {
+            cerr << "error [vg pack]: -S requires a graph whose node ranks are in node ID order. "
+                 << "Sort the graph by ID (e.g. vg ids -s) or don't use -S" << endl;
+            exit(1);
+        }
+        ofstream out(packs_out);
+        if (!out) {
+            cerr << "error [vg pack]: unable to write to " << packs_out << endl;
+            exit(1);
+        }
+        packer.start_streaming(out);
+        std::function<void(Alignment&)> stream_lambda = [&](Alignment& aln) {
+            packer.add(aln, min_mapq, min_baseq, trim_ends);
+        };
+        try {
+            if (!gam_in.empty()) {
+                get_input_file(gam_in, [&](istream& in) {
+                        vg::io::for_each(in, stream_lambda);
+                    });
+            } else {
+                vg::io::gaf_unpaired_for_each(*graph, gaf_in, stream_lambda);
+            }
+        } catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            exit(1);
+        }
+        packer.finish_streaming();
+        return 0;
+    }
     
     // todo one packer per thread and merge
     if (packs_in.size() == 1) {
@@ -0,0 +1,656 @@
+/** \file serve_main.cpp
+ *
+ * Defines the "vg serve" subcommand, which keeps Giraffe's indexes loaded and
+ * maps reads submitted over a local Unix socket.
+ */
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include <zlib.h>
+
+#include "subcommand.hpp"
+#include "options.hpp"
+#include "giraffe_main.hpp"
+
+#include <vg/io/vpkg.hpp>
+#include <vg/io/stream.hpp>
+#include "../alignment.hpp"
+#include "../hts_alignment_emitter.hpp"
+#include "../minimizer_mapper.hpp"
+#include "../path.hpp"
+#include "../crash.hpp"
+#include "../utility.hpp"
+#include <bdsg/overlays/overlay_helper.hpp>
+
+#include <gbwtgraph/gbz.h>
+#include <gbwtgraph/minimizer.h>
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+/// Most pairs we will hold while learning the fragment length distribution.
+static constexpr size_t MAX_SERVE_BUFFERED_PAIRS = 100000;
+
+void help_serve(char** argv) {
+    cerr << "usage: " << argv[0] << " serve [options] -s SOCKET" << endl
+         << "Keep Giraffe indexes loaded and map reads submitted over a Unix socket." << endl
+         << endl
+         << "server options:" << endl
+         << "    -Z, --gbz-name FILE      map to this GBZ graph" << endl
+         << "    -m, --minimizer-name FILE use this minimizer index" << endl
+         << "    -d, --dist-name FILE     use this distance index" << endl
+         << "    -b, --parameter-preset NAME set computational parameters (fast / default / chaining) [default]" << endl
+         << "    -t, --threads INT        number of mapping threads to use" << endl
+         << "    -p, --progress           show progress" << endl
+         << "client options:" << endl
+         << "    -c, --client             submit reads to a running server instead of serving" << endl
+         << "    -f, --fastq-in FILE      map this FASTQ file (may repeat once for paired reads)" << endl
+         << "    -i, --interleaved        FASTQ has interleaved paired reads" << endl
+         << "    -o, --output-format NAME output format: GAM, GAF, JSON, TSV, SAM, BAM, or CRAM [GAF]" << endl
+         << "    -O, --output FILE        have the server write alignments here (it must be new or empty) [send to standard output]" << endl
+         << "    -k, --shutdown           ask the server to shut down" << endl
+         << "common options:" << endl
+         << "    -s, --socket FILE        Unix socket to serve on or connect to" << endl;
+}
+
+/**
+ * A mapping job, as sent over the socket. The wire format is one
+ * tab-separated key and value per line, ending with an empty line.
+ */
+struct ServeRequest {
+    vector<string> fastq_filenames;
+    bool interleaved = false;
+    string output_filename;
+    string output_format = "GAF";
+    bool shutdown = false;
+
+    /// Serialize to the wire format.
+    string to_wire() const {
+        stringstream s;
+        for (auto& filename : fastq_filenames) {
+            s << "fastq\t" << filename << "\n";
+        }
+        if (interleaved) {
+            s << "interleaved\t1\n";
+        }
+        s << "output\t" << output_filename << "\n";
+        s << "format\t" << output_format << "\n";
+        if (shutdown) {
+            s << "shutdown\t1\n";
+        }
+        s << "\n";
+        return s.str();
+    }
+
+    /// Parse one key and value from the wire format.
+    void parse_line(const string& line) {
+        size_t tab = line.find('\t');
+        if (tab == string::npos) {
+            throw runtime_error("malformed request line: " + line);
+        }
+        string key = line.substr(0, tab);
+        string value = line.substr(tab + 1);
+        if (key == "fastq") {
+            fastq_filenames.push_back(value);
+        } else if (key == "interleaved") {
+            interleaved = (value == "1");
+        } else if (key == "output") {
+            output_filename = value;
+        } else if (key == "format") {
+            output_format = value;
+        } else if (key == "shutdown") {
+            shutdown = (value == "1");
+        } else {
+            throw runtime_error("unknown request key: " + key);
+        }
+    }
+};
+
+/// Read a line from a socket, without the newline. Returns false on EOF.
+static bool read_socket_line(int fd, string& line) {
+    line.clear();
+    char c;
+    while (true) {
+        ssize_t got = read(fd, &c, 1);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return !line.empty();
+        }
+        if (c == '\n') {
+            return true;
+        }
+        line.push_back(c);
+    }
+}
+
+/// Write all of a string to a socket.
+static void write_socket(int fd, const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t put = write(fd, data.data() + written, data.size() - written);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            throw runtime_error(string("could not write to socket: ") + strerror(errno));
+        }
+        written += put;
+    }
+}
+
+/// Make a Unix socket address for the given path.
+static sockaddr_un make_socket_address(const string& socket_filename) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_filename.size() >= sizeof(address.sun_path)) {
+        cerr << "error:[vg serve] Socket path is too long: " << socket_filename << endl;
+        exit(1);
+    }
+    strncpy(address.sun_path, socket_filename.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+/// Make a relative path absolute, since the server may have a different working directory.
+static string make_absolute(const string& filename) {
+    if (filename.empty() || filename[0] == '/') {
+        return filename;
+    }
+    char* cwd = getcwd(nullptr, 0);
+    string absolute = string(cwd) + "/" + filename;
+    free(cwd);
+    return absolute;
+}
+
+/// Count the records in a FASTQ file, making sure it can be read and parsed.
+/// Throws if it can't, so that the readers used for mapping, which stop the
+/// process on bad input, only ever see good files.
+static size_t check_fastq(const string& filename) {
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || access(filename.c_str(), R_OK) != 0) {
+        throw runtime_error("cannot read FASTQ file " + filename);
+    }
+    gzFile fp = gzopen(filename.c_str(), "r");
+    if (!fp) {
+        throw runtime_error("cannot read FASTQ file " + filename);
+    }
+    size_t len = 2 << 22; // 4M, as much as any of the readers use
+    vector<char> buffer(len);
+    size_t records = 0;
+    try {
+        Alignment aln;
+        while (get_next_alignment_from_fastq(fp, buffer.data(), len, aln)) {
+            ++records;
+        }
+    } catch (const std::exception& ex) {
+        gzclose(fp);
+        throw runtime_error("cannot parse FASTQ file " + filename + ": " + ex.what());
+    }
+    gzclose(fp);
+    return records;
+}
+
+/// Make sure a request's output file can be written. The server only writes
+/// into files that already exist and are empty, which the client creates, so
+/// a request can't create files in arbitrary places or clobber existing data.
+static void check_output(const string& filename) {
+    struct stat file_stat;
+    if (filename.empty() || filename[0] != '/') {
+        throw runtime_error("output file must be an absolute path");
+    }
+    if (stat(filename.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        throw runtime_error("output file " + filename + " must be an existing regular file");
+    }
+    if (file_stat.st_size != 0) {
+        throw runtime_error("output file " + filename + " is not empty");
+    }
+    if (access(filename.c_str(), W_OK) != 0) {
+        throw runtime_error("cannot write output file " + filename);
+    }
+}
+
+/**
+ * Map all the reads for a request with the given loaded indexes, and return
+ * the number of reads mapped. Throws if the request is bad or mapping fails.
+ */
+static size_t serve_request(const ServeRequest& request,
+                            subcommand::GroupedOptionGroup& parser,
+                            const gbwtgraph::GBZ& gbz,
+                            const gbwtgraph::DefaultMinimizerIndex& minimizer_index,
+                            SnarlDistanceIndex& distance_index,
+                            const PathPositionHandleGraph* path_position_graph,
+                            const vector<tuple<path_handle_t, size_t, size_t>>* sequence_dictionary) {
+
+    if (request.fastq_filenames.empty() || request.fastq_filenames.size() > 2) {
+        throw runtime_error("request must have one or two FASTQ files");
+    }
+    static const set<string> output_formats = { "GAM", "GAF", "JSON", "TSV", "SAM", "BAM", "CRAM" };
+    if (!output_formats.count(request.output_format)) {
+        throw runtime_error("unknown output format " + request.output_format);
+    }
+    check_output(request.output_filename);
+    vector<size_t> fastq_records;
+    for (auto& filename : request.fastq_filenames) {
+        fastq_records.push_back(check_fastq(filename));
+    }
+    if (fastq_records.size() == 2 && fastq_records[0] != fastq_records[1]) {
+        throw runtime_error("paired FASTQ files have different numbers of reads");
+    }
+
+    bool paired = request.interleaved || request.fastq_filenames.size() == 2;
+    bool hts_output = (request.output_format == "SAM" || request.output_format == "BAM" || request.output_format == "CRAM");
+    if (hts_output && sequence_dictionary == nullptr) {
+        throw runtime_error("graph has no reference paths to surject to for " + request.output_format + " output");
+    }
+
+    // Each job gets its own mapper, so it learns its own fragment length distribution.
+    MinimizerMapper minimizer_mapper(gbz.graph, minimizer_index, &distance_index, path_position_graph);
+    // Set it up with the parameters the server was started with, like Giraffe does.
+    parser.apply(minimizer_mapper);
+
+    // Errors while mapping can't leave the parallel loops, so we keep the
+    // first one, skip the rest of the reads, and report it when the loops end.
+    exception_ptr mapping_error;
+    atomic<bool> mapping_failed(false);
+    mutex mapping_error_mutex;
+    auto record_error = [&]() {
+        lock_guard<mutex> lock(mapping_error_mutex);
+        if (!mapping_error) {
+            mapping_error = current_exception();
+        }
+        mapping_failed = true;
+    };
+
+    size_t thread_count = omp_get_max_threads();
+    vector<size_t> reads_mapped_by_thread(thread_count, 0);
+
+    vector<tuple<path_handle_t, size_t, size_t>> paths;
+    if (hts_output) {
+        paths = *sequence_dictionary;
+    }
+    const HandleGraph* emitter_graph = hts_output ? (const HandleGraph*) path_position_graph : (const HandleGraph*) &gbz.graph;
+    unique_ptr<AlignmentEmitter> alignment_emitter = get_alignment_emitter(request.output_filename, request.output_format,
+                                                                           paths, thread_count, emitter_graph);
+
+    if (paired) {
+        // Only touched while mapping on one thread, before the distribution is ready.
+        vector<pair<Alignment, Alignment>> ambiguous_pair_buffer;
+
+        auto tlen_limit = [&]() -> int64_t {
+            if (hts_output && minimizer_mapper.fragment_distr_is_finalized()) {
+                return minimizer_mapper.get_fragment_length_mean() + 6 * minimizer_mapper.get_fragment_length_stdev();
+            }
+            return 0;
+        };
+
+        auto map_read_pair = [&](Alignment& aln1, Alignment& aln2) {
+            if (mapping_failed) {
+                return;
+            }
+            try {
+                set_crash_context(aln1.name() + ", " + aln2.name());
+                toUppercaseInPlace(*aln1.mutable_sequence());
+                toUppercaseInPlace(*aln2.mutable_sequence());
+                auto mapped_pairs = minimizer_mapper.map_paired(aln1, aln2, ambiguous_pair_buffer);
+                if (!mapped_pairs.first.empty() && !mapped_pairs.second.empty()) {
+                    alignment_emitter->emit_mapped_pair(std::move(mapped_pairs.first), std::move(mapped_pairs.second), tlen_limit());
+                    reads_mapped_by_thread.at(omp_get_thread_num()) += 2;
+                }
+                if (!minimizer_mapper.fragment_distr_is_finalized() && ambiguous_pair_buffer.size() >= MAX_SERVE_BUFFERED_PAIRS) {
+                    minimizer_mapper.finalize_fragment_length_distr();
+                }
+                clear_crash_context();
+            } catch (...) {
+                clear_crash_context();
+                record_error();
+            }
+        };
+        auto distribution_is_ready = [&]() {
+            return minimizer_mapper.fragment_distr_is_finalized() || mapping_failed;
+        };
+
+        if (request.fastq_filenames.size() == 2) {
+            fastq_paired_two_files_for_each_parallel_after_wait(request.fastq_filenames[0], request.fastq_filenames[1],
+                                                                map_read_pair, distribution_is_ready);
+        } else {
+            fastq_paired_interleaved_for_each_parallel_after_wait(request.fastq_filenames[0], map_read_pair, distribution_is_ready);
+        }
+
+        if (mapping_error) {
+            rethrow_exception(mapping_error);
+        }
+
+        // Map whatever we had to hold back.
+        if (!minimizer_mapper.fragment_distr_is_finalized()) {
+            minimizer_mapper.finalize_fragment_length_distr();
+        }
+        for (auto& alignment_pair : ambiguous_pair_buffer) {
+            auto mapped_pairs = minimizer_mapper.map_paired(alignment_pair.first, alignment_pair.second);
+            alignment_emitter->emit_mapped_pair(std::move(mapped_pairs.first), std::move(mapped_pairs.second), tlen_limit());
+            reads_mapped_by_thread.at(omp_get_thread_num()) += 2;
+        }
+    } else {
+        fastq_unpaired_for_each_parallel(request.fastq_filenames[0], [&](Alignment& aln) {
+            if (mapping_failed) {
+                return;
+            }
+            try {
+                set_crash_context(aln.name());
+                toUppercaseInPlace(*aln.mutable_sequence());
+                minimizer_mapper.map(aln, *alignment_emitter);
+                reads_mapped_by_thread.at(omp_get_thread_num())++;
+                clear_crash_context();
+            } catch (...) {
+                clear_crash_context();
+                record_error();
+            }
+        });
+        if (mapping_error) {
+            rethrow_exception(mapping_error);
+        }
+    }
+
+    size_t total_reads_mapped = 0;
+    for (auto& reads_mapped : reads_mapped_by_thread) {
+        total_reads_mapped += reads_mapped;
+    }
+    return total_reads_mapped;
+}
+
+/// Run the client side: send a request and wait for the answer.
+static int run_client(const string& socket_filename, ServeRequest& request) {
+    // If no output file was asked for, have the server write to a temporary
+    // file that we then relay to standard output.
+    bool relay_output = !request.shutdown && request.output_filename.empty();
+    if (relay_output) {
+        request.output_filename = temp_file::create("vg-serve-");
+    }
+    request.output_filename = make_absolute(request.output_filename);
+    if (!request.shutdown && !relay_output) {
+        // The server only writes into empty files that already exist.
+        ofstream output(request.output_filename, std::ios::trunc);
+        if (!output) {
+            cerr << "error:[vg serve] Could not create output file " << request.output_filename << endl;
+            return 1;
+        }
+    }
+    for (auto& filename : request.fastq_filenames) {
+        filename = make_absolute(filename);
+    }
+
+    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = make_socket_address(socket_filename);
+    if (server_fd < 0 || connect(server_fd, (sockaddr*) &address, sizeof(address)) != 0) {
+        cerr << "error:[vg serve] Could not connect to server at " << socket_filename << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    write_socket(server_fd, request.to_wire());
+
+    string response;
+    if (!read_socket_line(server_fd, response)) {
+        cerr << "error:[vg serve] Server closed the connection without responding" << endl;
+        close(server_fd);
+        return 1;
+    }
+    close(server_fd);
+
+    if (response.substr(0, 3) != "OK\t") {
+        cerr << "error:[vg serve] Server could not map reads: " << response << endl;
+        if (relay_output) {
+            temp_file::remove(request.output_filename);
+        }
+        return 1;
+    }
+
+    if (relay_output) {
+        ifstream mapped(request.output_filename, std::ios::binary);
+        cout << mapped.rdbuf();
+        cout.flush();
+        temp_file::remove(request.output_filename);
+    }
+
+    return 0;
+}
+
+int main_serve(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_serve(argv);
+        return 1;
+    }
+
+    string socket_filename;
+    string gbz_filename;
+    string minimizer_filename;
+    string distance_filename;
+    bool show_progress = false;
+    bool client = false;
+    ServeRequest request;
+
+    // Map with Giraffe's parameters.
+    subcommand::GroupedOptionGroup parser = get_giraffe_options();
+    std::map<std::string, subcommand::Preset> presets = get_giraffe_presets();
+
+    int c;
+    optind = 2; // force optind past command positional argument
+    while (true) {
+        static struct option long_options[] =
+            {
+                {"socket", required_argument, 0, 's'},
+                {"gbz-name", required_argument, 0, 'Z'},
+                {"minimizer-name", required_argument, 0, 'm'},
+                {"dist-name", required_argument, 0, 'd'},
+                {"parameter-preset", required_argument, 0, 'b'},
+                {"threads", required_argument, 0, 't'},
+                {"progress", no_argument, 0, 'p'},
+                {"client", no_argument, 0, 'c'},
+                {"fastq-in", required_argument, 0, 'f'},
+                {"interleaved", no_argument, 0, 'i'},
+                {"output-format", required_argument, 0, 'o'},
+                {"output", required_argument, 0, 'O'},
+                {"shutdown", no_argument, 0, 'k'},
+                {"help", no_argument, 0, 'h'},
+                {0, 0, 0, 0}
+            };
+
+        int option_index = 0;
+        c = getopt_long (argc, argv, "s:Z:m:d:b:t:pcf:io:O:kh?",
+                         long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+        case 's':
+            socket_filename = optarg;
+            break;
+        case 'Z':
+            gbz_filename = optarg;
+            break;
+        case 'm':
+            minimizer_filename = optarg;
+            break;
+        case 'd':
+            distance_filename = optarg;
+            break;
+        case 'b':
+        {
+            auto found = presets.find(optarg);
+            if (found == presets.end()) {
+                cerr << "error:[vg serve] invalid parameter preset: " << optarg << endl;
+                exit(1);
+            }
+            found->second.apply(parser);
+        }
+            break;
+        case 't':
+        {
+            int num_threads = parse<int>(optarg);
+            if (num_threads <= 0) {
+                cerr << "error:[vg serve] Thread count (-t) set to " << num_threads << ", must set to a positive integer." << endl;
+                exit(1);
+            }
+            omp_set_num_threads(num_threads);
+        }
+            break;
+        case 'p':
+            show_progress = true;
+            break;
+        case 'c':
+            client = true;
+            break;
+        case 'f':
+            request.fastq_filenames.push_back(optarg);
+            break;
+        case 'i':
+            request.interleaved = true;
+            break;
+        case 'o':
+            request.output_format = optarg;
+            for (char& format_char : request.output_format) {
+                format_char = std::toupper(format_char);
+            }
+            break;
+        case 'O':
+            request.output_filename = optarg;
+            break;
+        case 'k':
+            request.shutdown = true;
+            client = true;
+            break;
+        case 'h':
+        case '?':
+            help_serve(argv);
+            exit(1);
+            break;
+        default:
+            abort ();
+        }
+    }
+
+    if (socket_filename.empty()) {
+        cerr << "error:[vg serve] A socket (-s) is required" << endl;
+        return 1;
+    }
+
+    if (client) {
+        return run_client(socket_filename, request);
+    }
+
+    if (gbz_filename.empty() || minimizer_filename.empty() || distance_filename.empty()) {
+        cerr << "error:[vg serve] A GBZ (-Z), minimizer index (-m), and distance index (-d) are required to serve" << endl;
+        return 1;
+    }
+
+    // Load everything once, up front.
+    if (show_progress) {
+        cerr << "Loading indexes" << endl;
+    }
+    auto gbz = vg::io::VPKG::load_one<gbwtgraph::GBZ>(gbz_filename);
+    auto minimizer_index = vg::io::VPKG::load_one<gbwtgraph::DefaultMinimizerIndex>(minimizer_filename);
+    auto distance_index = vg::io::VPKG::load_one<SnarlDistanceIndex>(distance_filename);
+    distance_index->preload(true);
+    // Surjection to SAM/BAM/CRAM needs positional paths.
+    bdsg::ReferencePathOverlayHelper overlay_helper;
+    PathPositionHandleGraph* path_position_graph = overlay_helper.apply(&gbz->graph);
+    // Work out what to surject to up front, if the graph has anything, so
+    // that requests can't run into problems with it.
+    unique_ptr<vector<tuple<path_handle_t, size_t, size_t>>> sequence_dictionary;
+    bool has_reference_paths = false;
+    path_position_graph->for_each_path_of_sense(PathSense::REFERENCE, [&](const path_handle_t& path) {
+        has_reference_paths = true;
+    });
+    path_position_graph->for_each_path_of_sense(PathSense::GENERIC, [&](const path_handle_t& path) {
+        has_reference_paths = has_reference_paths || !Paths::is_alt(path_position_graph->get_path_name(path));
+    });
+    if (has_reference_paths) {
+        sequence_dictionary.reset(new vector<tuple<path_handle_t, size_t, size_t>>(get_sequence_dictionary("", {}, *path_position_graph)));
+    }
+
+    // Clients going away shouldn't kill us.
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = make_socket_address(socket_filename);
+    unlink(socket_filename.c_str());
+    // Only our own user may submit jobs, since the server reads and writes files for them.
+    if (listen_fd < 0 || ::bind(listen_fd, (sockaddr*) &address, sizeof(address)) != 0 ||
+        chmod(socket_filename.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(listen_fd, 16) != 0) {
+        cerr << "error:[vg serve] Could not listen on " << socket_filename << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    if (show_progress) {
+        cerr << "Serving on " << socket_filename << endl;
+    }
+
+    bool keep_serving = true;
+    while (keep_serving) {
+        int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "error:[vg serve] Could not accept connection: " << strerror(errno) << endl;
+            break;
+        }
+
+        // Jobs run one at a time, each using all the threads.
+        string response;
+        try {
+            ServeRequest client_request;
+            string line;
+            while (read_socket_line(client_fd, line) && !line.empty()) {
+                client_request.parse_line(line);
+            }
+            if (client_request.shutdown) {
+                keep_serving = false;
+                response = "OK\t0\n";
+            } else {
+                if (show_progress && !client_request.fastq_filenames.empty()) {
+                    cerr << "Mapping " << client_request.fastq_filenames.front() << " to " << client_request.output_filename << endl;
+                }
+                size_t reads_mapped = serve_request(client_request, parser, *gbz, *minimizer_index, *distance_index, path_position_graph,
+                                                    sequence_dictionary.get());
+                response = "OK\t" + to_string(reads_mapped) + "\n";
+            }
+        } catch (const std::exception& ex) {
+            response = string("ERROR\t") + ex.what() + "\n";
+        }
+
+        try {
+            write_socket(client_fd, response);
+        } catch (const std::exception& ex) {
+            cerr << "warning:[vg serve] " << ex.what() << endl;
+        }
+        close(client_fd);
+    }
+
+    close(listen_fd);
+    unlink(socket_filename.c_str());
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_serve("serve", "keep Giraffe indexes loaded and map reads sent over a socket", DEVELOPMENT, main_serve);
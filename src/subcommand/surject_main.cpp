@@ -20,6 +20,7 @@
 #include <vg/io/vpkg.hpp>
 #include "../utility.hpp"
 #include "../surjector.hpp"
+#include "../path_position_cache.hpp"
 #include "../hts_alignment_emitter.hpp"
 #include "../multipath_alignment_emitter.hpp"
 #include "../crash.hpp"
@@ -56,7 +57,10 @@ void help_surject(char** argv) {
          << "  -L, --list-all-paths     annotate SAM records with a list of all attempted re-alignments to paths in SS tag" << endl
          << "  -C, --compression N      level for compression [0-9]" << endl
          << "  -V, --no-validate        skip checking whether alignments plausibly are against the provided graph" << endl
-         << "  -w, --watchdog-timeout N warn when reads take more than the given number of seconds to surject" << endl;
+         << "  -w, --watchdog-timeout N warn when reads take more than the given number of seconds to surject" << endl
+         << "  --path-cache FILE        look up the paths on each node in this node to path position cache, creating" << endl
+         << "                           it for the selected paths if it doesn't exist (speeds up surjecting to a few" << endl
+         << "                           of many paths)" << endl;
 }
 
 /// If the given alignment doesn't make sense against the given graph (i.e.
@@ -100,6 +104,9 @@ int main_surject(int argc, char** argv) {
     bool annotate_with_all_path_scores = false;
     bool multimap = false;
     bool validate = true;
+    string path_cache_name;
+
+    #define OPT_PATH_CACHE 1000
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -130,6 +137,7 @@ int main_surject(int argc, char** argv) {
             {"compress", required_argument, 0, 'C'},
             {"no-validate", required_argument, 0, 'V'},
             {"watchdog-timeout", required_argument, 0, 'w'},
+            {"path-cache", required_argument, 0, OPT_PATH_CACHE},
             {0, 0, 0, 0}
         };
 
@@ -232,6 +240,10 @@ int main_surject(int argc, char** argv) {
         case 'L':
             annotate_with_all_path_scores = true;
             break;
+            
+        case OPT_PATH_CACHE:
+            path_cache_name = optarg;
+            break;
 
         case 'h':
         case '?':
@@ -297,6 +309,35 @@ int main_surject(int argc, char** argv) {
     }
     surjector.annotate_with_all_path_scores = annotate_with_all_path_scores;
     
+    unique_ptr<PathPositionCache> path_cache;
+    if (!path_cache_name.empty()) {
+        try {
+            if (file_exists(path_cache_name)) {
+                path_cache.reset(new PathPositionCache(*xgidx, path_cache_name));
+                for (const path_handle_t& path : paths) {
+                    if (!path_cache->has_path(path)) {
+                        cerr << "error[vg surject] path " << xgidx->get_path_name(path) << " is not in the path cache "
+                             << path_cache_name << ", remove it to recreate it for these paths" << endl;
+                        exit(1);
+                    }
+                }
+            }
+            else {
+                vector<path_handle_t> cache_paths;
+                for (auto& entry : sequence_dictionary) {
+                    cache_paths.push_back(get<0>(entry));
+                }
+                path_cache.reset(new PathPositionCache(*xgidx, cache_paths));
+                path_cache->save(path_cache_name);
+            }
+        }
+        catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            exit(1);
+        }
+        surjector.path_position_cache = path_cache.get();
+    }
+    
     // Count our threads
     int thread_count = vg::get_thread_count();
     
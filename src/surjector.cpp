@@ -3224,7 +3224,7 @@ using namespace std;
                 const auto& mapping = path.mapping(j);
                 const auto& pos = mapping.position();
                 handle_t handle = graph->get_handle(pos.node_id(), pos.is_reverse());
-                graph->for_each_step_on_handle(handle, [&](const step_handle_t& step) {
+                for_each_surjection_step(graph, handle, [&](const step_handle_t& step) {
                     
                     path_handle_t path_handle = graph->get_path_handle_of_step(step);
                     
@@ -3515,7 +3515,7 @@ using namespace std;
             
             unordered_map<pair<step_handle_t, bool>, size_t> next_extending_steps;
             
-            for (const step_handle_t& step : graph->steps_of_handle(handle)) {
+            for_each_surjection_step(graph, handle, [&](const step_handle_t& step) {
                 
 #ifdef debug_anchored_surject
                 cerr << "found a step on " << graph->get_path_name(graph->get_path_handle_of_step(step)) << endl;
@@ -3527,7 +3527,7 @@ using namespace std;
 #ifdef debug_anchored_surject
                     cerr << "not surjecting to this path, skipping" << endl;
 #endif
-                    continue;
+                    return;
                 }
                 
                 // We always see paths on the forward strand, so we need to
@@ -3613,7 +3613,7 @@ using namespace std;
                     cerr << "no preceeding chunk so start new chunk " << path_chunks.first.size() - 1 << endl;
 #endif
                 }
-            }
+            });
             
             // we've finished extending the steps from the previous mapping, so we replace them
             // with the steps we found in this iteration that we want to extend on the next one
@@ -3623,6 +3623,19 @@ using namespace std;
         return to_return;
     }
 
+    void Surjector::for_each_surjection_step(const PathPositionHandleGraph* graph, const handle_t& handle,
+                                             const function<void(const step_handle_t&)>& iteratee) const {
+        if (path_position_cache) {
+            // only look at the paths we might surject to
+            path_position_cache->for_each_step_on_handle(*graph, handle, iteratee);
+        }
+        else {
+            graph->for_each_step_on_handle(handle, [&](const step_handle_t& step) {
+                iteratee(step);
+            });
+        }
+    }
+
     void Surjector::filter_redundant_path_chunks(bool path_rev, vector<path_chunk_t>& path_chunks,
                                                  vector<pair<step_handle_t, step_handle_t>>& ref_chunks,
                                                  vector<tuple<size_t, size_t, int32_t>>& connections) const {
@@ -16,6 +16,7 @@
 #include "handle.hpp"
 #include <vg/vg.pb.h>
 #include "multipath_alignment.hpp"
+#include "path_position_cache.hpp"
 
 
 namespace vg {
@@ -127,6 +128,11 @@ using namespace std;
         
         bool annotate_with_all_path_scores = false;
         
+        /// If set, find the steps of the surjection paths on each node with this cache instead
+        /// of the graph, so that we don't have to look at all of the other paths on the node.
+        /// It must contain all of the paths that we surject to.
+        const PathPositionCache* path_position_cache = nullptr;
+        
     protected:
         
         void surject_internal(const Alignment* source_aln, const multipath_alignment_t* source_mp_aln,
@@ -174,6 +180,11 @@ using namespace std;
                                   const unordered_set<path_handle_t>& surjection_paths,
                                   unordered_map<pair<path_handle_t, bool>, vector<tuple<size_t, size_t, int32_t>>>& connections_out) const;
         
+        /// execute a function on the steps on a handle that could be on a surjection path, using
+        /// the path position cache if there is one
+        void for_each_surjection_step(const PathPositionHandleGraph* graph, const handle_t& handle,
+                                      const function<void(const step_handle_t&)>& iteratee) const;
+        
         /// remove any path chunks and corresponding ref chunks that are identical to a longer
         /// path chunk over the region where they overlap
         void filter_redundant_path_chunks(bool path_rev, vector<path_chunk_t>& path_chunks,
@@ -0,0 +1,128 @@
+/// \file arena_subgraph.cpp
+///
+/// Unit tests for the ArenaSubgraph
+///
+
+#include <iostream>
+#include <set>
+#include <algorithm>
+
+#include "../arena_subgraph.hpp"
+#include "../handle.hpp"
+#include "catch.hpp"
+
+#include <bdsg/hash_graph.hpp>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+using bdsg::HashGraph;
+
+TEST_CASE("ArenaSubgraph behaves like a HashGraph", "[handle][multipath]") {
+
+    // build the same graph in both, including both kinds of self loops
+    auto build = [](MutableHandleGraph& graph) {
+        handle_t h1 = graph.create_handle("ACGT", 10);
+        handle_t h2 = graph.create_handle("GGA", 3);
+        handle_t h3 = graph.create_handle("TTTCA", 11);
+        graph.create_edge(h1, h2);
+        graph.create_edge(h1, h2);
+        graph.create_edge(h2, graph.flip(h3));
+        graph.create_edge(h3, graph.flip(h3));
+        graph.create_edge(graph.flip(h1), h1);
+        graph.create_edge(h3, h3);
+    };
+
+    // check that they have the same nodes and edges
+    auto require_same = [](const HandleGraph& graph, const HandleGraph& expected) {
+        REQUIRE(graph.get_node_count() == expected.get_node_count());
+        REQUIRE(graph.get_edge_count() == expected.get_edge_count());
+        REQUIRE(graph.min_node_id() == expected.min_node_id());
+        REQUIRE(graph.max_node_id() == expected.max_node_id());
+        expected.for_each_handle([&](const handle_t& expected_handle) {
+            REQUIRE(graph.has_node(expected.get_id(expected_handle)));
+            for (bool is_reverse : {false, true}) {
+                handle_t handle = graph.get_handle(expected.get_id(expected_handle), is_reverse);
+                handle_t other = expected.get_handle(expected.get_id(expected_handle), is_reverse);
+                REQUIRE(graph.get_sequence(handle) == expected.get_sequence(other));
+                REQUIRE(graph.get_subsequence(handle, 1, 2) == expected.get_subsequence(other, 1, 2));
+                REQUIRE(graph.get_base(handle, 0) == expected.get_base(other, 0));
+                for (bool go_left : {false, true}) {
+                    set<pair<nid_t, bool>> found, wanted;
+                    graph.follow_edges(handle, go_left, [&](const handle_t& next) {
+                        found.emplace(graph.get_id(next), graph.get_is_reverse(next));
+                    });
+                    expected.follow_edges(other, go_left, [&](const handle_t& next) {
+                        wanted.emplace(expected.get_id(next), expected.get_is_reverse(next));
+                    });
+                    REQUIRE(found == wanted);
+                }
+            }
+        });
+    };
+
+    auto graph = ArenaSubgraph::make();
+    HashGraph expected;
+    build(*graph);
+    build(expected);
+
+    SECTION("Construction matches") {
+        REQUIRE(graph->get_edge_count() == 5);
+        require_same(*graph, expected);
+    }
+
+    SECTION("New IDs come after the maximum") {
+        REQUIRE(graph->get_id(graph->create_handle("A")) == 12);
+    }
+
+    SECTION("Orientation can be applied") {
+        graph->apply_orientation(graph->get_handle(11, true));
+        expected.apply_orientation(expected.get_handle(11, true));
+        require_same(*graph, expected);
+    }
+
+    SECTION("Handles can be divided") {
+        auto parts = graph->divide_handle(graph->get_handle(10, true), {1, 3});
+        REQUIRE(parts.size() == 3);
+        REQUIRE(graph->get_sequence(parts[0]) == "A");
+        REQUIRE(graph->get_sequence(parts[1]) == "CG");
+        REQUIRE(graph->get_sequence(parts[2]) == "T");
+        REQUIRE(graph->get_id(parts[2]) == 10);
+        REQUIRE(graph->has_edge(parts[0], parts[1]));
+        REQUIRE(graph->has_edge(parts[1], parts[2]));
+        REQUIRE(graph->has_edge(graph->flip(parts[0]), graph->get_handle(3)));
+        REQUIRE(graph->has_edge(parts[2], graph->flip(parts[2])));
+        REQUIRE(graph->get_edge_count() == 7);
+    }
+
+    SECTION("IDs can be changed") {
+        graph->increment_node_ids(100);
+        expected.increment_node_ids(100);
+        require_same(*graph, expected);
+
+        vector<handle_t> order;
+        graph->for_each_handle([&](const handle_t& handle) {
+            order.push_back(handle);
+        });
+        reverse(order.begin(), order.end());
+        graph->apply_ordering(order, true);
+        REQUIRE(graph->get_id(graph->get_handle(1)) == 1);
+        REQUIRE(graph->get_sequence(graph->get_handle(1)) == "TTTCA");
+        REQUIRE(graph->get_sequence(graph->get_handle(3)) == "ACGT");
+        REQUIRE(graph->get_edge_count() == 5);
+    }
+
+    SECTION("Recycled graphs come back empty") {
+        graph.reset();
+        auto recycled = ArenaSubgraph::make();
+        REQUIRE(recycled->get_node_count() == 0);
+        REQUIRE(recycled->get_edge_count() == 0);
+        REQUIRE(!recycled->has_node(10));
+        build(*recycled);
+        require_same(*recycled, expected);
+    }
+}
+
+}
+}
@@ -152,7 +152,113 @@ TEST_CASE("find_best_chain is willing to leave the main diagonal if the items su
     REQUIRE(result.second == std::vector<size_t>{0, 1, 2, 3});
 }
 
+TEST_CASE("find_best_chain finds the same chains with batched lookback", "[chain_items][find_best_chain]") {
+    // Set up graph fixture
+    HashGraph graph = make_long_graph(10, 10);
+    auto h = get_handles(graph);
+    
+    IntegratedSnarlFinder snarl_finder(graph);
+    SnarlDistanceIndex distance_index;
+    fill_in_distance_index(&distance_index, &graph, &snarl_finder);
+
+    SECTION("Abutting items chain") {
+        auto to_score = make_anchors({{1, h[1], 1, 9, 9},
+                                      {10, h[2], 0, 9, 9}}, graph);
+        auto scalar = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1);
+        auto batched = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 100, algorithms::ChainingEngine::BATCHED_LOOKBACK);
+        REQUIRE(batched.first == (9 + 9));
+        REQUIRE(batched == scalar);
+    }
+    
+    SECTION("Items off the diagonal chain with indels") {
+        auto to_score = make_anchors({{10, h[1], 0, 10, 10},
+                                      {41, h[4], 0, 10, 10},
+                                      {61, h[6], 0, 10, 10},
+                                      {100, h[10], 0, 10, 10}}, graph);
+        auto scalar = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1);
+        auto batched = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 100, algorithms::ChainingEngine::BATCHED_LOOKBACK);
+        REQUIRE(batched.second == std::vector<size_t>{0, 1, 2, 3});
+        REQUIRE(batched == scalar);
+    }
+    
+    SECTION("Items too far apart in the graph don't chain") {
+        auto to_score = make_anchors({{1, h[1], 1, 9, 9},
+                                      {10, h[9], 0, 9, 9}}, graph);
+        auto batched = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 20, algorithms::ChainingEngine::BATCHED_LOOKBACK);
+        REQUIRE(batched.first == 9);
+        REQUIRE(batched.second.size() == 1);
+    }
+}
+
+TEST_CASE("find_best_chain finds the same chains with the sparse engine", "[chain_items][find_best_chain]") {
+    // Set up graph fixture
+    HashGraph graph = make_long_graph(10, 10);
+    auto h = get_handles(graph);
+    
+    IntegratedSnarlFinder snarl_finder(graph);
+    SnarlDistanceIndex distance_index;
+    fill_in_distance_index(&distance_index, &graph, &snarl_finder);
+
+    SECTION("Items off the diagonal chain with indels") {
+        auto to_score = make_anchors({{10, h[1], 0, 10, 10},
+                                      {41, h[4], 0, 10, 10},
+                                      {61, h[6], 0, 10, 10},
+                                      {100, h[10], 0, 10, 10}}, graph);
+        auto scalar = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1);
+        auto sparse = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 100, algorithms::ChainingEngine::SPARSE);
+        REQUIRE(sparse.second == std::vector<size_t>{0, 1, 2, 3});
+        REQUIRE(sparse == scalar);
+    }
+    
+    SECTION("A spurious high-scoring item off the diagonal is not used") {
+        auto to_score = make_anchors({{0, h[1], 0, 10, 10},
+                                      {10, h[8], 0, 10, 25},
+                                      {20, h[3], 0, 10, 10},
+                                      {30, h[4], 0, 10, 10}}, graph);
+        auto scalar = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 20);
+        auto sparse = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 20, algorithms::ChainingEngine::SPARSE);
+        // The spurious item can't be connected to the others, which are worth
+        // more together.
+        REQUIRE(sparse.first == 30);
+        REQUIRE(sparse.second == std::vector<size_t>{0, 2, 3});
+        REQUIRE(sparse == scalar);
+    }
+    
+    SECTION("An item off the diagonal worth more than the diagonal chain is used alone") {
+        auto to_score = make_anchors({{0, h[1], 0, 10, 10},
+                                      {10, h[8], 0, 10, 40},
+                                      {20, h[3], 0, 10, 10},
+                                      {30, h[4], 0, 10, 10}}, graph);
+        auto scalar = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 20);
+        auto sparse = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 20, algorithms::ChainingEngine::SPARSE);
+        REQUIRE(sparse.first == 40);
+        REQUIRE(sparse.second == std::vector<size_t>{1});
+        REQUIRE(sparse == scalar);
+    }
+    
+    SECTION("Predecessors that can't be connected don't use up the lookback cap") {
+        auto to_score = make_anchors({{0, h[1], 0, 10, 15},
+                                      {10, h[8], 0, 10, 25},
+                                      {11, h[9], 0, 9, 25},
+                                      {20, h[3], 0, 10, 15}}, graph);
+        auto scalar = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 100, 10, 2.0, -0.1, 0, 20);
+        // The two spurious items are the best-scoring predecessors of the
+        // last item, but with a cap of 1 we still get to the first item.
+        auto sparse = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 150, 0, 1, 10, 2.0, -0.1, 0, 20, algorithms::ChainingEngine::SPARSE);
+        REQUIRE(sparse.first == 30);
+        REQUIRE(sparse.second == std::vector<size_t>{0, 3});
+        REQUIRE(sparse == scalar);
+    }
+    
+    SECTION("Predecessors past the lookback limit are not used") {
+        auto to_score = make_anchors({{0, h[1], 0, 10, 10},
+                                      {90, h[10], 0, 10, 10}}, graph);
+        auto sparse = algorithms::find_best_chain(to_score, distance_index, graph, 6, 1, 50, 0, 100, 10, 2.0, -0.1, 0, 100, algorithms::ChainingEngine::SPARSE);
+        REQUIRE(sparse.first == 10);
+        REQUIRE(sparse.second.size() == 1);
+    }
 }
 
 }
 
+}
@@ -0,0 +1,69 @@
+/// \file funnel.cpp
+///
+/// unit tests for Funnel stage timing
+///
+
+#include <sstream>
+#include "../funnel.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE("LatencyHistogram reports quantiles within its precision", "[funnel]") {
+    LatencyHistogram histogram;
+    REQUIRE(histogram.count() == 0);
+    REQUIRE(histogram.quantile(0.5) == 0);
+
+    // Record 1 to 1000 microseconds
+    for (size_t i = 1; i <= 1000; i++) {
+        histogram.record(i * 1E-6);
+    }
+    REQUIRE(histogram.count() == 1000);
+    REQUIRE(histogram.max() == Approx(1E-3));
+    REQUIRE(histogram.total() == Approx(500500 * 1E-6));
+    // Buckets are 1/16 of a power of 2 wide
+    REQUIRE(histogram.quantile(0.5) == Approx(500E-6).epsilon(1.0 / 16));
+    REQUIRE(histogram.quantile(0.9) == Approx(900E-6).epsilon(1.0 / 16));
+    REQUIRE(histogram.quantile(1.0) <= histogram.max());
+
+    SECTION("Merging adds counts") {
+        LatencyHistogram other;
+        other.record(2.0);
+        histogram.merge(other);
+        REQUIRE(histogram.count() == 1001);
+        REQUIRE(histogram.max() == Approx(2.0));
+        REQUIRE(histogram.quantile(1.0) == Approx(2.0).epsilon(1.0 / 16));
+    }
+}
+
+TEST_CASE("Funnel can time stages without tracking items", "[funnel]") {
+    StageLatencyRecorder recorder(1);
+
+    for (size_t i = 0; i < 3; i++) {
+        Funnel funnel;
+        funnel.set_latency_recorder(&recorder, false);
+        funnel.start("read");
+        funnel.stage("minimizer");
+        funnel.stage("seed");
+        funnel.substage("lookup");
+        funnel.stage("cluster");
+        funnel.stop();
+    }
+
+    auto merged = recorder.merged();
+    REQUIRE(merged.size() == 3);
+    REQUIRE(merged[0].first == "minimizer");
+    REQUIRE(merged[1].first == "seed");
+    REQUIRE(merged[2].first == "cluster");
+    for (auto& stage : merged) {
+        REQUIRE(stage.second.count() == 3);
+    }
+
+    std::stringstream json;
+    recorder.to_json(json);
+    REQUIRE(json.str().find("\"seed\":{\"count\":3") != std::string::npos);
+}
+
+}
+}
@@ -3,9 +3,12 @@
 #include "../xg.hpp"
 #include "../gfa.hpp"
 #include "../algorithms/gfa_to_handle.hpp"
+#include "../utility.hpp"
 
 #include <bdsg/hash_graph.hpp>
 
+#include <omp.h>
+
 namespace vg {
 namespace unittest {
 
@@ -502,6 +505,183 @@ P	chr1	1+,3+	8M,1M
 }
 
 
+TEST_CASE("Memory-mapped GFA parsing matches stream parsing", "[gfa]") {
+
+    // One file has everything in order, and one has to be handled in two passes.
+    vector<string> graph_gfas {
+        R"(H	VN:Z:1.0	RS:Z:GRCh38
+S	1	CAAATAAG	SN:Z:chr1	SO:i:0	SR:i:0
+S	2	ATTACA
+S	3	G	SN:Z:chr1	SO:i:8	SR:i:0
+L	1	+	2	+	0M
+L	1	+	3	-	0M
+L	2	+	3	+	0M
+P	GRCh38#0#chr1	1+,3+	8M,1M
+W	sample	1	chr1	0	15	>1>2>3
+P	other	1+,2+	*
+)",
+        R"(H	VN:Z:1.0
+S	1	CAAATAAG
+L	1	+	2	+	0M
+P	other	1+,2+	*
+S	2	ATTACA
+S	3	G
+L	1	+	3	-	0M
+L	2	+	3	+	0M
+W	sample	1	chr1	0	15	>1>2>3
+)"
+    };
+    
+    for (auto& graph_gfa : graph_gfas) {
+        string filename = temp_file::create();
+        {
+            ofstream out(filename);
+            out << graph_gfa;
+        }
+        
+        bdsg::HashGraph from_stream;
+        stringstream in(graph_gfa);
+        algorithms::gfa_to_path_handle_graph(in, &from_stream);
+        
+        bdsg::HashGraph from_file;
+        algorithms::gfa_to_path_handle_graph(filename, &from_file);
+        temp_file::remove(filename);
         
+        REQUIRE(from_file.get_node_count() == from_stream.get_node_count());
+        REQUIRE(from_file.get_edge_count() == from_stream.get_edge_count());
+        from_stream.for_each_handle([&](const handle_t& handle) {
+            nid_t id = from_stream.get_id(handle);
+            REQUIRE(from_file.has_node(id));
+            REQUIRE(from_file.get_sequence(from_file.get_handle(id)) == from_stream.get_sequence(handle));
+        });
+        
+        // Paths must come out in the same order with the same steps.
+        vector<string> stream_paths, file_paths;
+        from_stream.for_each_path_matching(nullptr, nullptr, nullptr, [&](const path_handle_t& path) {
+            stream_paths.push_back(from_stream.get_path_name(path));
+        });
+        from_file.for_each_path_matching(nullptr, nullptr, nullptr, [&](const path_handle_t& path) {
+            file_paths.push_back(from_file.get_path_name(path));
+        });
+        REQUIRE(file_paths == stream_paths);
+        for (auto& path_name : stream_paths) {
+            vector<handle_t> stream_steps, file_steps;
+            from_stream.for_each_step_in_path(from_stream.get_path_handle(path_name), [&](const step_handle_t& step) {
+                stream_steps.push_back(from_stream.get_handle_of_step(step));
+            });
+            from_file.for_each_step_in_path(from_file.get_path_handle(path_name), [&](const step_handle_t& step) {
+                file_steps.push_back(from_file.get_handle_of_step(step));
+            });
+            REQUIRE(file_steps == stream_steps);
+        }
+    }
+}
+
+
+/// Attach listeners to the parser that record everything it reports, in order.
+static void record_gfa_events(algorithms::GFAParser& parser, vector<string>& events) {
+    using GFAParser = algorithms::GFAParser;
+    auto join_tags = [](const GFAParser::tag_list_t& tags) {
+        string joined;
+        for (auto& tag : tags) {
+            joined += " " + tag;
+        }
+        return joined;
+    };
+    parser.header_listeners.push_back([&events, join_tags](const GFAParser::tag_list_t& tags) {
+        events.push_back("H" + join_tags(tags));
+    });
+    parser.node_listeners.push_back([&events, join_tags](nid_t id, const GFAParser::chars_t& sequence, const GFAParser::tag_list_t& tags) {
+        events.push_back("S " + std::to_string(id) + " " + GFAParser::extract(sequence) + join_tags(tags));
+    });
+    parser.edge_listeners.push_back([&events, join_tags](nid_t from, bool from_is_reverse, nid_t to, bool to_is_reverse,
+                                                         const GFAParser::chars_t& overlap, const GFAParser::tag_list_t& tags) {
+        events.push_back("L " + std::to_string(from) + (from_is_reverse ? "-" : "+") + " " +
+                         std::to_string(to) + (to_is_reverse ? "-" : "+") + " " + GFAParser::extract(overlap) + join_tags(tags));
+    });
+    parser.path_listeners.push_back([&events, join_tags](const string& name, const GFAParser::chars_t& visits,
+                                                         const GFAParser::chars_t& overlaps, const GFAParser::tag_list_t& tags) {
+        events.push_back("P " + name + " " + GFAParser::extract(visits) + " " + GFAParser::extract(overlaps) + join_tags(tags));
+    });
+    parser.walk_listeners.push_back([&events, join_tags](const string& sample_name, int64_t haplotype, const string& contig_name,
+                                                         const pair<int64_t, int64_t>& subrange, const GFAParser::chars_t& visits,
+                                                         const GFAParser::tag_list_t& tags) {
+        events.push_back("W " + sample_name + " " + std::to_string(haplotype) + " " + contig_name + " " +
+                         std::to_string(subrange.first) + " " + std::to_string(subrange.second) + " " +
+                         GFAParser::extract(visits) + join_tags(tags));
+    });
+    parser.rgfa_listeners.push_back([&events](nid_t id, int64_t offset, size_t length, const string& path_name, int64_t path_rank) {
+        events.push_back("rGFA " + path_name + " " + std::to_string(path_rank) + " " + std::to_string(offset) + " " +
+                         std::to_string(id) + " " + std::to_string(length));
+    });
+    parser.max_rgfa_rank = numeric_limits<int64_t>::max();
+}
+
+TEST_CASE("Memory-mapped GFA parsing matches stream parsing with small chunks", "[gfa]") {
+
+    // One file has everything in order and no final newline, and one has to
+    // be handled in two passes.
+    vector<string> graph_gfas {
+        "H\tVN:Z:1.0\tRS:Z:GRCh38\n"
+        "S\t1\tCAAATAAG\tSN:Z:chr1\tSO:i:0\tSR:i:0\n"
+        "S\t2\tATTACA\n"
+        "S\t3\tG\tSN:Z:chr1\tSO:i:8\tSR:i:0\n"
+        "S\t4\tTTT\tSN:Z:alt\tSO:i:0\tSR:i:1\n"
+        "L\t1\t+\t2\t+\t0M\n"
+        "L\t1\t+\t3\t-\t0M\n"
+        "L\t2\t+\t3\t+\t0M\n"
+        "L\t3\t+\t4\t+\t0M\n"
+        "P\tGRCh38#0#chr1\t1+,3+\t8M,1M\n"
+        "W\tsample\t1\tchr1\t0\t15\t>1>2>3\n"
+        "W\tsample\t2\tchr1\t0\t18\t>1>2>3>4\n"
+        "P\tother\t1+,2+\t*",
+        "H\tVN:Z:1.0\n"
+        "S\t1\tCAAATAAG\n"
+        "L\t1\t+\t2\t+\t0M\n"
+        "P\tother\t1+,2+\t*\n"
+        "S\t2\tATTACA\n"
+        "S\t3\tG\n"
+        "L\t1\t+\t3\t-\t0M\n"
+        "L\t2\t+\t3\t+\t0M\n"
+        "W\tsample\t1\tchr1\t0\t15\t>1>2>3\n"
+    };
+    
+    // Use few threads, so that small chunks are tokenized in several batches.
+    int thread_count_pre = omp_get_max_threads();
+    omp_set_num_threads(2);
+    
+    for (auto& graph_gfa : graph_gfas) {
+        string filename = temp_file::create();
+        {
+            ofstream out(filename);
+            out << graph_gfa;
+        }
+        
+        vector<string> stream_events;
+        {
+            algorithms::GFAParser parser;
+            record_gfa_events(parser, stream_events);
+            stringstream in(graph_gfa);
+            parser.parse(in);
+        }
+        REQUIRE(!stream_events.empty());
+        
+        // Try every chunk size up to the whole file, so that every line
+        // boundary falls at a chunk boundary for some chunk size.
+        for (size_t chunk_size = 1; chunk_size <= graph_gfa.size(); chunk_size++) {
+            vector<string> mapped_events;
+            algorithms::GFAParser parser;
+            record_gfa_events(parser, mapped_events);
+            parser.mapped_chunk_size = chunk_size;
+            parser.parse_mapped(filename);
+            REQUIRE(mapped_events == stream_events);
+        }
+        
+        temp_file::remove(filename);
+    }
+    
+    omp_set_num_threads(thread_count_pre);
+}
+
 }
 }
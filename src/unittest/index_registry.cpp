@@ -3,6 +3,10 @@
 /// unit tests for the vg-file-backed handle graph implementation
 
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <omp.h>
 #include "../index_registry.hpp"
 #include "catch.hpp"
 
@@ -277,5 +281,202 @@ TEST_CASE("IndexRegistry can make plans on a dummy recipe graph", "[indexregistr
 //    }
 }
 
+
+TEST_CASE("IndexRegistry executes independent recipes concurrently", "[indexregistry]") {
+    
+    IndexRegistry registry;
+    
+    registry.register_index("VG", "vg");
+    registry.register_index("XG", "xg");
+    registry.register_index("Pruned VG", "pruned.vg");
+    registry.register_index("GCSA", "gcsa");
+    registry.register_index("LCP", "gcsa.lcp");
+    
+    // the XG and pruning recipes each wait to see the other one start
+    atomic<int> num_started(0);
+    atomic<bool> saw_other(true);
+    auto rendezvous = [&]() {
+        ++num_started;
+        auto start = chrono::steady_clock::now();
+        while (num_started.load() < 2) {
+            if (chrono::steady_clock::now() - start > chrono::seconds(10)) {
+                saw_other.store(false);
+                break;
+            }
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    };
+    
+    registry.register_recipe({"XG"}, {"VG"},
+                             [&] (const vector<const IndexFile*>& inputs,
+                                  const IndexingPlan* plan,
+                                  AliasGraph& alias_graph,
+                                  const IndexGroup& constructing) {
+        rendezvous();
+        return vector<vector<string>>(1, vector<string>(1, "xg-file"));
+    });
+    registry.register_recipe({"Pruned VG"}, {"VG"},
+                             [&] (const vector<const IndexFile*>& inputs,
+                                  const IndexingPlan* plan,
+                                  AliasGraph& alias_graph,
+                                  const IndexGroup& constructing) {
+        rendezvous();
+        return vector<vector<string>>(1, vector<string>(1, "pruned-vg-file"));
+    });
+    registry.register_recipe({"GCSA", "LCP"}, {"Pruned VG"},
+                             [&] (const vector<const IndexFile*>& inputs,
+                                  const IndexingPlan* plan,
+                                  AliasGraph& alias_graph,
+                                  const IndexGroup& constructing) {
+        vector<vector<string>> filenames(2);
+        filenames[0].push_back("gcsa-file");
+        filenames[1].push_back("lcp-file");
+        return filenames;
+    });
+    
+    registry.provide("VG", "vg-name");
+    registry.set_target_memory_usage(1000);
+    
+    int prev_threads = omp_get_max_threads();
+    omp_set_num_threads(2);
+    registry.make_indexes({"XG", "GCSA", "LCP"});
+    omp_set_num_threads(prev_threads);
+    
+    REQUIRE(saw_other.load());
+    REQUIRE(registry.require("XG") == vector<string>(1, "xg-file"));
+    REQUIRE(registry.require("GCSA") == vector<string>(1, "gcsa-file"));
+    REQUIRE(registry.require("LCP") == vector<string>(1, "lcp-file"));
+    
+    // the GCSA and LCP are also unboxed from their group
+    const auto& timeline = registry.get_timeline();
+    REQUIRE(timeline.size() == 5);
+    double pruning_end = 0.0;
+    for (const auto& execution : timeline) {
+        REQUIRE(!execution.rewound);
+        REQUIRE(execution.end >= execution.start);
+        if (execution.recipe.first.count("XG") || execution.recipe.first.count("Pruned VG")) {
+            // these shared the threads and the memory
+            REQUIRE(execution.threads == 1);
+            REQUIRE(execution.memory <= 1000 / 2);
+            if (execution.recipe.first.count("Pruned VG")) {
+                pruning_end = execution.end;
+            }
+        }
+        else {
+            // these had to wait for the pruning, which started earlier
+            REQUIRE(execution.start >= pruning_end);
+        }
+    }
+}
+
+
+TEST_CASE("IndexRegistry executes recipes that fork alone", "[indexregistry]") {
+    
+    IndexRegistry registry;
+    
+    registry.register_index("VG", "vg");
+    registry.register_index("XG", "xg");
+    registry.register_index("Pruned VG", "pruned.vg");
+    
+    // count how many recipes are executing at once
+    atomic<int> num_executing(0);
+    atomic<int> max_executing(0);
+    auto execute = [&]() {
+        int executing = ++num_executing;
+        int prev_max = max_executing.load();
+        while (executing > prev_max && !max_executing.compare_exchange_weak(prev_max, executing)) {
+            // try again
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+        --num_executing;
+    };
+    
+    registry.register_recipe({"XG"}, {"VG"},
+                             [&] (const vector<const IndexFile*>& inputs,
+                                  const IndexingPlan* plan,
+                                  AliasGraph& alias_graph,
+                                  const IndexGroup& constructing) {
+        execute();
+        return vector<vector<string>>(1, vector<string>(1, "xg-file"));
+    }, true);
+    registry.register_recipe({"Pruned VG"}, {"VG"},
+                             [&] (const vector<const IndexFile*>& inputs,
+                                  const IndexingPlan* plan,
+                                  AliasGraph& alias_graph,
+                                  const IndexGroup& constructing) {
+        execute();
+        return vector<vector<string>>(1, vector<string>(1, "pruned-vg-file"));
+    });
+    
+    registry.provide("VG", "vg-name");
+    
+    int prev_threads = omp_get_max_threads();
+    omp_set_num_threads(2);
+    registry.make_indexes({"XG", "Pruned VG"});
+    omp_set_num_threads(prev_threads);
+    
+    REQUIRE(max_executing.load() == 1);
+    REQUIRE(registry.require("XG") == vector<string>(1, "xg-file"));
+    REQUIRE(registry.require("Pruned VG") == vector<string>(1, "pruned-vg-file"));
+    for (const auto& execution : registry.get_timeline()) {
+        if (execution.recipe.first.count("XG")) {
+            // the forking recipe gets all of the threads
+            REQUIRE(execution.threads == 2);
+        }
+    }
+}
+
+
+TEST_CASE("IndexRegistry updates parameters for a rewind after the other recipes finish", "[indexregistry]") {
+    
+    IndexRegistry registry;
+    
+    registry.register_index("VG", "vg");
+    registry.register_index("XG", "xg");
+    registry.register_index("Pruned VG", "pruned.vg");
+    
+    atomic<int> num_executing(0);
+    int executing_at_update = -1;
+    atomic<int> num_attempts(0);
+    
+    registry.register_recipe({"XG"}, {"VG"},
+                             [&] (const vector<const IndexFile*>& inputs,
+                                  const IndexingPlan* plan,
+                                  AliasGraph& alias_graph,
+                                  const IndexGroup& constructing) {
+        if (++num_attempts == 1) {
+            throw RewindPlanException("rewinding", {"XG"}, [&]() {
+                executing_at_update = num_executing.load();
+            });
+        }
+        return vector<vector<string>>(1, vector<string>(1, "xg-file"));
+    });
+    registry.register_recipe({"Pruned VG"}, {"VG"},
+                             [&] (const vector<const IndexFile*>& inputs,
+                                  const IndexingPlan* plan,
+                                  AliasGraph& alias_graph,
+                                  const IndexGroup& constructing) {
+        ++num_executing;
+        this_thread::sleep_for(chrono::milliseconds(50));
+        --num_executing;
+        return vector<vector<string>>(1, vector<string>(1, "pruned-vg-file"));
+    });
+    
+    registry.provide("VG", "vg-name");
+    
+    int prev_threads = omp_get_max_threads();
+    omp_set_num_threads(2);
+    auto prev_verbosity = IndexingParameters::verbosity;
+    IndexingParameters::verbosity = IndexingParameters::None;
+    registry.make_indexes({"XG", "Pruned VG"});
+    IndexingParameters::verbosity = prev_verbosity;
+    omp_set_num_threads(prev_threads);
+    
+    REQUIRE(num_attempts == 2);
+    REQUIRE(executing_at_update == 0);
+    REQUIRE(registry.require("XG") == vector<string>(1, "xg-file"));
+    REQUIRE(registry.require("Pruned VG") == vector<string>(1, "pruned-vg-file"));
+}
+
 }
 }
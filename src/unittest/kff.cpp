@@ -211,6 +211,53 @@ TEST_CASE("Recode blocks", "[kff]") {
     }
 }
 
+TEST_CASE("Write and read kmer counts", "[kff]") {
+    size_t k = 6;
+    std::vector<std::pair<gbwtgraph::Key64::value_type, size_t>> counts {
+        { gbwtgraph::Key64::encode("GATTAC").get_key(), 1 },
+        { gbwtgraph::Key64::encode("CATTAC").get_key(), 300 },
+        { gbwtgraph::Key64::encode("ATTACA").get_key(), 70000 },
+    };
+
+    std::string filename = temp_file::create("kff");
+    kff_write_counts(filename, k, counts);
+
+    ParallelKFFReader reader(filename);
+    REQUIRE(reader.k == k);
+    std::vector<std::pair<ParallelKFFReader::kmer_type, size_t>> read_counts = reader.read(counts.size() + 1);
+    std::sort(counts.begin(), counts.end());
+    std::sort(read_counts.begin(), read_counts.end());
+    REQUIRE(read_counts == counts);
+
+    temp_file::remove(filename);
+}
+
+TEST_CASE("Kmer counts are written in canonical form", "[kff]") {
+    size_t k = 6;
+    std::vector<std::pair<gbwtgraph::Key64::value_type, size_t>> counts {
+        { gbwtgraph::Key64::encode("GTAATC").get_key(), 1 }, // Reverse complement of GATTAC.
+        { gbwtgraph::Key64::encode("CATTAC").get_key(), 300 },
+        { gbwtgraph::Key64::encode("GATTAC").get_key(), 2 },
+        { gbwtgraph::Key64::encode("TGTAAT").get_key(), 70000 }, // Reverse complement of ATTACA.
+    };
+    std::vector<std::pair<gbwtgraph::Key64::value_type, size_t>> truth {
+        { gbwtgraph::Key64::encode("GATTAC").get_key(), 3 },
+        { gbwtgraph::Key64::encode("CATTAC").get_key(), 300 },
+        { gbwtgraph::Key64::encode("ATTACA").get_key(), 70000 },
+    };
+
+    std::string filename = temp_file::create("kff");
+    kff_write_counts(filename, k, counts);
+
+    ParallelKFFReader reader(filename);
+    std::vector<std::pair<ParallelKFFReader::kmer_type, size_t>> read_counts = reader.read(counts.size() + 1);
+    std::sort(truth.begin(), truth.end());
+    std::sort(read_counts.begin(), read_counts.end());
+    REQUIRE(read_counts == truth);
+
+    temp_file::remove(filename);
+}
+
 //------------------------------------------------------------------------------
 
 }
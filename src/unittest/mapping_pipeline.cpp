@@ -0,0 +1,89 @@
+/// \file mapping_pipeline.cpp
+///
+/// unit tests for the read/map/emit pipeline
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include "../mapping_pipeline.hpp"
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE("MappingPipeline maps and emits every record exactly once", "[mapping_pipeline]") {
+
+    for (size_t batch_size : {1, 7, 256}) {
+        MappingPipeline<size_t, size_t> pipeline(3, 2, batch_size, 4);
+        REQUIRE(pipeline.get_total_threads() == 6);
+
+        size_t record_count = 10000;
+        vector<atomic<size_t>> seen(record_count);
+        for (auto& count : seen) {
+            count.store(0);
+        }
+        // Catch assertions aren't thread safe, so note problems here.
+        atomic<bool> wrong_thread(false);
+
+        pipeline.run([&](const function<void(size_t&)>& take) {
+            for (size_t i = 0; i < record_count; i++) {
+                size_t record = i;
+                take(record);
+            }
+        }, [&](size_t& in, size_t& out) {
+            // Mapping threads come first.
+            if (omp_get_thread_num() >= 3) {
+                wrong_thread.store(true);
+            }
+            out = in * 2;
+        }, [&](size_t& out) {
+            // Emit threads come after the reader.
+            if (omp_get_thread_num() <= 3) {
+                wrong_thread.store(true);
+            }
+            seen.at(out / 2)++;
+        });
+
+        REQUIRE(!wrong_thread.load());
+        for (auto& count : seen) {
+            REQUIRE(count.load() == 1);
+        }
+
+        stringstream report;
+        pipeline.report(report);
+        REQUIRE(report.str().find("records on") != string::npos);
+    }
+}
+
+TEST_CASE("MappingPipeline maps on one thread until told otherwise", "[mapping_pipeline]") {
+
+    MappingPipeline<size_t, size_t> pipeline(4, 1, 10);
+
+    // We will allow parallel mapping after this many records.
+    size_t serial_records = 100;
+    atomic<size_t> mapped(0);
+    atomic<bool> saw_other_thread_early(false);
+
+    pipeline.run([&](const function<void(size_t&)>& take) {
+        for (size_t i = 0; i < 1000; i++) {
+            size_t record = i;
+            take(record);
+        }
+    }, [&](size_t& in, size_t& out) {
+        if (omp_get_thread_num() != 0 && mapped.load() < serial_records) {
+            saw_other_thread_early.store(true);
+        }
+        mapped++;
+        out = in;
+    }, [&](size_t& out) {
+        // Nothing to do
+    }, [&]() {
+        return mapped.load() >= serial_records;
+    });
+
+    REQUIRE(mapped.load() == 1000);
+    REQUIRE(!saw_other_thread_early.load());
+}
+
+}
+}
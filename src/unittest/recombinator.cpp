@@ -0,0 +1,95 @@
+/** \file
+ *
+ * Unit tests for recombinator.cpp, which generates synthetic haplotypes.
+ */
+
+#include "../recombinator.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+
+namespace unittest {
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+typedef hash_map<Haplotypes::Subchain::kmer_type, size_t> kmer_map;
+
+Haplotypes::Subchain::kmer_type encode_kmer(const std::string& kmer) {
+    return gbwtgraph::Key64::encode(kmer).get_key();
+}
+
+// Counts the kmers of the reads in the map and returns the total number of
+// kmers in the reads.
+size_t count_kmers(kmer_map& counts, const std::vector<std::string>& reads, size_t k) {
+    std::vector<kmer_map::iterator> buffer;
+    size_t total = 0;
+    for (const std::string& read : reads) {
+        total += find_read_kmers(counts, read, k, buffer);
+    }
+    for (auto iter : buffer) {
+        iter->second++;
+    }
+    return total;
+}
+
+void check_counts(const kmer_map& counts, const std::vector<std::pair<std::string, size_t>>& truth) {
+    REQUIRE(counts.size() == truth.size());
+    for (auto& kmer : truth) {
+        auto iter = counts.find(encode_kmer(kmer.first));
+        REQUIRE(iter != counts.end());
+        REQUIRE(iter->second == kmer.second);
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE("Count kmers in reads", "[recombinator][haplotypes]") {
+    size_t k = 3;
+    kmer_map counts;
+    for (std::string kmer : { "GAT", "ACA", "TTT" }) {
+        counts[encode_kmer(kmer)] = 0;
+    }
+
+    SECTION("forward orientation") {
+        // GAT, ATT, TTA, TAC, ACA
+        size_t total = count_kmers(counts, { "GATTACA" }, k);
+        REQUIRE(total == 5);
+        check_counts(counts, { { "GAT", 1 }, { "ACA", 1 }, { "TTT", 0 } });
+    }
+
+    SECTION("reverse complement") {
+        // TGT, GTA, TAA, AAT, ATC
+        size_t total = count_kmers(counts, { "TGTAATC" }, k);
+        REQUIRE(total == 5);
+        check_counts(counts, { { "GAT", 1 }, { "ACA", 1 }, { "TTT", 0 } });
+    }
+
+    SECTION("kmers do not span invalid characters") {
+        // GAT, AAA; ATN, TNA, NAA are skipped.
+        size_t total = count_kmers(counts, { "GATNAAA" }, k);
+        REQUIRE(total == 2);
+        check_counts(counts, { { "GAT", 1 }, { "ACA", 0 }, { "TTT", 1 } });
+    }
+
+    SECTION("reads shorter than k have no kmers") {
+        size_t total = count_kmers(counts, { "GA", "" }, k);
+        REQUIRE(total == 0);
+        check_counts(counts, { { "GAT", 0 }, { "ACA", 0 }, { "TTT", 0 } });
+    }
+
+    SECTION("multiple reads") {
+        // The second read contains TTT twice and the third one AAA (reverse
+        // complement of TTT) once.
+        size_t total = count_kmers(counts, { "GATTACA", "GTTTTC", "TGTAATCAAA" }, k);
+        REQUIRE(total == 5 + 4 + 8);
+        check_counts(counts, { { "GAT", 2 }, { "ACA", 2 }, { "TTT", 3 } });
+    }
+}
+
+//------------------------------------------------------------------------------
+
+}
+}
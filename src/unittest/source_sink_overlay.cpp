@@ -13,7 +13,10 @@
 #include "vg/io/json2pb.h"
 
 #include <iostream>
+#include <sstream>
 #include <vector>
+#include <set>
+#include <tuple>
 #include <unordered_set>
 
 namespace vg {
@@ -226,6 +229,129 @@ TEST_CASE("SourceSinkOverlay agrees with VG::add_start_end_markers in a tiny gra
         temp_file::remove(write_gcsa_kmers_to_tmpfile(overlay, 10, size_limit, start_id, end_id));
     }
     
+    SECTION("kmer generation reports kmers per partition") {
+        size_t size_limit = 10000;
+        vector<KmerPartitionCount> partition_counts;
+        stringstream kmer_stream;
+        write_gcsa_kmers(overlay, 10, kmer_stream, size_limit, start_id, end_id, &partition_counts);
+        
+        // the graph is small enough to be a single partition, which is written as one run
+        REQUIRE(partition_counts.size() == 1);
+        REQUIRE(partition_counts.front().first_id == overlay.min_node_id());
+        REQUIRE(partition_counts.front().last_id == overlay.max_node_id());
+        REQUIRE(partition_counts.front().kmer_count > 0);
+        REQUIRE(size_limit == partition_counts.front().kmer_count * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader));
+        REQUIRE(!kmer_stream.str().empty());
+        
+        // when the limit is too small, we still find out where the kmers came from
+        size_limit = 100;
+        partition_counts.clear();
+        stringstream small_stream;
+        REQUIRE_THROWS_AS(write_gcsa_kmers(overlay, 10, small_stream, size_limit, start_id, end_id, &partition_counts),
+                          SizeLimitExceededException);
+        REQUIRE(partition_counts.size() == 1);
+        REQUIRE(partition_counts.front().kmer_count > 0);
+    }
+    
+    SECTION("kmer generation finds the same kmers with small partitions") {
+        
+        // the distinct kmers we should get
+        set<tuple<gcsa::key_type, gcsa::node_type, gcsa::node_type>> expected;
+        gcsa::Alphabet alpha;
+        for_each_kmer(overlay, 10, [&](const kmer_t& kmer) {
+            kmer_to_gcsa_kmers(kmer, alpha, [&](const gcsa::KMer& k) {
+#pragma omp critical
+                expected.emplace(k.key, k.from, k.to);
+            });
+        }, start_id, end_id);
+        REQUIRE(!expected.empty());
+        
+        for (size_t partition_size : {1, 3}) {
+            size_t size_limit = 100000;
+            vector<KmerPartitionCount> partition_counts;
+            stringstream kmer_stream;
+            write_gcsa_kmers(overlay, 10, kmer_stream, size_limit, start_id, end_id, &partition_counts, partition_size);
+            
+            REQUIRE(partition_counts.size() == (overlay.get_node_count() + partition_size - 1) / partition_size);
+            
+            // read the runs back
+            set<tuple<gcsa::key_type, gcsa::node_type, gcsa::node_type>> found;
+            size_t num_kmers = 0;
+            gcsa::GraphFileHeader header;
+            while (kmer_stream.read((char*) &header, sizeof(header))) {
+                vector<gcsa::KMer> run(header.kmer_count);
+                kmer_stream.read((char*) run.data(), run.size() * sizeof(gcsa::KMer));
+                for (const auto& k : run) {
+                    found.emplace(k.key, k.from, k.to);
+                }
+                num_kmers += run.size();
+            }
+            
+            REQUIRE(found == expected);
+            // a kmer can only start in one partition, so they are all distinct
+            REQUIRE(num_kmers == expected.size());
+        }
+    }
+    
+    SECTION("kmer generation finds the same kmers when partitions are split into small runs") {
+        
+        // the distinct kmers we should get
+        set<tuple<gcsa::key_type, gcsa::node_type, gcsa::node_type>> expected;
+        gcsa::Alphabet alpha;
+        for_each_kmer(overlay, 10, [&](const kmer_t& kmer) {
+            kmer_to_gcsa_kmers(kmer, alpha, [&](const gcsa::KMer& k) {
+#pragma omp critical
+                expected.emplace(k.key, k.from, k.to);
+            });
+        }, start_id, end_id);
+        REQUIRE(!expected.empty());
+        
+        for (size_t run_size : {1, 4, 16}) {
+            // one partition for the whole graph, so anything past the first run comes from splitting it
+            // or flushing it partway through
+            size_t size_limit = 1000000;
+            vector<KmerPartitionCount> partition_counts;
+            stringstream kmer_stream;
+            write_gcsa_kmers(overlay, 10, kmer_stream, size_limit, start_id, end_id, &partition_counts,
+                             overlay.get_node_count(), run_size);
+            
+            // the partition handed off some of its nodes to other tasks
+            REQUIRE(partition_counts.size() > 1);
+            REQUIRE(partition_counts.front().first_id == overlay.min_node_id());
+            REQUIRE(partition_counts.back().last_id == overlay.max_node_id());
+            for (size_t i = 1; i < partition_counts.size(); ++i) {
+                REQUIRE(partition_counts[i].first_id > partition_counts[i - 1].last_id);
+            }
+            
+            // read the runs back
+            set<tuple<gcsa::key_type, gcsa::node_type, gcsa::node_type>> found;
+            size_t num_kmers = 0;
+            size_t num_runs = 0;
+            gcsa::GraphFileHeader header;
+            while (kmer_stream.read((char*) &header, sizeof(header))) {
+                vector<gcsa::KMer> run(header.kmer_count);
+                kmer_stream.read((char*) run.data(), run.size() * sizeof(gcsa::KMer));
+                for (const auto& k : run) {
+                    found.emplace(k.key, k.from, k.to);
+                }
+                num_kmers += run.size();
+                ++num_runs;
+            }
+            
+            REQUIRE(found == expected);
+            // at least one of the partitions was written in several runs
+            REQUIRE(num_runs > partition_counts.size());
+            // runs are only deduplicated internally, so the same kmer can be in more than one
+            REQUIRE(num_kmers >= expected.size());
+            size_t total_count = 0;
+            for (const auto& count : partition_counts) {
+                total_count += count.kmer_count;
+            }
+            REQUIRE(total_count == num_kmers);
+            REQUIRE(size_limit == num_kmers * sizeof(gcsa::KMer) + num_runs * sizeof(gcsa::GraphFileHeader));
+        }
+    }
+    
     SECTION("for_each_handle works in parallel mode") {
     
         size_t found = 0;
@@ -0,0 +1,73 @@
+/// \file stream_sorter.cpp
+///
+/// unit tests for sorting GAM records
+///
+
+#include <iostream>
+#include "catch.hpp"
+#include "../stream_sorter.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("StreamSorter sorts the same way with and without sort keys", "[gam][gamsort]") {
+
+    // Make some reads, including ties and an unplaced read
+    vector<Alignment> reads;
+    vector<tuple<nid_t, bool, int64_t>> starts {
+        {5, false, 3}, {2, true, 1}, {5, false, 3}, {2, false, 7}, {0, false, 0}, {9, true, 0}, {2, false, 1}, {5, true, 2}
+    };
+    for (size_t i = 0; i < starts.size(); i++) {
+        reads.emplace_back();
+        reads.back().set_name("read" + to_string(i));
+        if (get<0>(starts[i]) != 0) {
+            for (size_t j = 0; j < 3; j++) {
+                Mapping* mapping = reads.back().mutable_path()->add_mapping();
+                mapping->mutable_position()->set_node_id(get<0>(starts[i]) + j);
+                mapping->mutable_position()->set_is_reverse(get<1>(starts[i]));
+                mapping->mutable_position()->set_offset(j == 0 ? get<2>(starts[i]) : 0);
+            }
+        }
+    }
+
+    GAMSorter sorter;
+
+    vector<Alignment> by_comparison = reads;
+    sorter.use_sort_keys = false;
+    sorter.sort(by_comparison);
+
+    vector<Alignment> by_key = reads;
+    sorter.use_sort_keys = true;
+    sorter.sort(by_key);
+
+    vector<Alignment> by_key_in_parallel = reads;
+    sorter.parallel_sort(by_key_in_parallel);
+
+    REQUIRE(by_key.size() == reads.size());
+    REQUIRE(by_key_in_parallel.size() == reads.size());
+    for (size_t i = 0; i < reads.size(); i++) {
+        // Everything should be in the same position order
+        Position expected = sorter.get_min_position(by_comparison[i]);
+        REQUIRE(sorter.get_min_position(by_key[i]).node_id() == expected.node_id());
+        REQUIRE(sorter.get_min_position(by_key[i]).is_reverse() == expected.is_reverse());
+        REQUIRE(sorter.get_min_position(by_key[i]).offset() == expected.offset());
+        REQUIRE(by_key_in_parallel[i].name() == by_key[i].name());
+        if (i > 0) {
+            REQUIRE(!sorter.less_than(by_key[i], by_key[i - 1]));
+        }
+    }
+
+    // The unplaced read comes first
+    REQUIRE(by_key.front().name() == "read4");
+    // Ties keep their input order when sorting by keys
+    REQUIRE(by_key.back().name() == "read5");
+    size_t first_tie = 0;
+    while (by_key[first_tie].name() != "read0") {
+        first_tie++;
+    }
+    REQUIRE(by_key[first_tie + 1].name() == "read2");
+}
+
+}
+}
@@ -7,10 +7,13 @@
 #include "catch.hpp"
 #include "surjector.hpp"
 #include "aligner.hpp"
+#include "path_position_cache.hpp"
+#include "utility.hpp"
 
 #include "bdsg/hash_graph.hpp"
 #include "bdsg/overlays/path_position_overlays.hpp"
 #include <vg/vg.pb.h>
+#include "vg/io/json2pb.h"
 
 namespace vg {
 namespace unittest {
@@ -797,5 +800,124 @@ TEST_CASE("Duplicate path chunks can be detected", "[surject][multipath]") {
     REQUIRE(path_chunks.size() == 2);
     
 }
+
+TEST_CASE("Path position cache finds the same steps as the graph", "[surject]") {
+    
+    bdsg::HashGraph graph;
+    handle_t h1 = graph.create_handle("GATTACA");
+    handle_t h2 = graph.create_handle("CAT");
+    handle_t h3 = graph.create_handle("TTAGGC");
+    handle_t h4 = graph.create_handle("A");
+    
+    graph.create_edge(h1, h2);
+    graph.create_edge(h2, h3);
+    graph.create_edge(h3, h2);
+    graph.create_edge(h1, h4);
+    graph.create_edge(h4, h3);
+    
+    // p visits h2 twice, q visits it backward, and r doesn't visit it
+    path_handle_t p = graph.create_path_handle("p");
+    graph.append_step(p, h1);
+    graph.append_step(p, h2);
+    graph.append_step(p, h3);
+    graph.append_step(p, h2);
+    path_handle_t q = graph.create_path_handle("q");
+    graph.append_step(q, graph.flip(h3));
+    graph.append_step(q, graph.flip(h2));
+    graph.append_step(q, graph.flip(h1));
+    path_handle_t r = graph.create_path_handle("r");
+    graph.append_step(r, h1);
+    graph.append_step(r, h4);
+    graph.append_step(r, h3);
+    
+    bdsg::PositionOverlay pos_graph(&graph);
+    
+    auto check_cache = [&](const PathPositionCache& cache) {
+        REQUIRE(cache.get_paths() == vector<path_handle_t>{p, q});
+        REQUIRE(cache.has_path(p));
+        REQUIRE(!cache.has_path(r));
+        REQUIRE(cache.get_node_count() == 3);
+        REQUIRE(cache.get_visit_count() == 7);
+        pos_graph.for_each_handle([&](const handle_t& h) {
+            vector<step_handle_t> expected;
+            pos_graph.for_each_step_on_handle(h, [&](const step_handle_t& step) {
+                if (pos_graph.get_path_handle_of_step(step) != r) {
+                    expected.push_back(step);
+                }
+            });
+            vector<step_handle_t> found;
+            cache.for_each_step_on_handle(pos_graph, h, [&](const step_handle_t& step) {
+                found.push_back(step);
+            });
+            sort(expected.begin(), expected.end());
+            sort(found.begin(), found.end());
+            REQUIRE(found == expected);
+        });
+    };
+    
+    PathPositionCache cache(pos_graph, vector<path_handle_t>{p, q});
+    check_cache(cache);
+    
+    SECTION("A saved cache can be mapped") {
+        string filename = temp_file::create();
+        cache.save(filename);
+        PathPositionCache mapped(pos_graph, filename);
+        check_cache(mapped);
+        temp_file::remove(filename);
+    }
+    
+    SECTION("A saved cache is rejected if the graph has changed") {
+        string filename = temp_file::create();
+        cache.save(filename);
+        
+        SECTION("A node was added") {
+            graph.create_handle("GG");
+        }
+        
+        SECTION("A cached path was extended") {
+            graph.append_step(p, h3);
+        }
+        
+        SECTION("A cached path was rebuilt with the same number of steps") {
+            graph.destroy_path(q);
+            q = graph.create_path_handle("q");
+            graph.append_step(q, h1);
+            graph.append_step(q, h4);
+            graph.append_step(q, h3);
+        }
+        
+        bdsg::PositionOverlay changed_graph(&graph);
+        REQUIRE_THROWS_AS(PathPositionCache(changed_graph, filename), std::runtime_error);
+        temp_file::remove(filename);
+    }
+    
+    SECTION("Surjection gives the same result with a cache") {
+        Alignment read;
+        string seq;
+        Path* rpath = read.mutable_path();
+        for (handle_t h : {h1, h2, h3}) {
+            Mapping* m = rpath->add_mapping();
+            m->set_rank(rpath->mapping_size());
+            m->mutable_position()->set_node_id(pos_graph.get_id(h));
+            Edit* e = m->add_edit();
+            e->set_from_length(pos_graph.get_length(h));
+            e->set_to_length(pos_graph.get_length(h));
+            seq += pos_graph.get_sequence(h);
+        }
+        read.set_sequence(seq);
+        read.set_score(Aligner().score_contiguous_alignment(read));
+        
+        unordered_set<path_handle_t> paths{p, q};
+        Surjector surjector(&pos_graph);
+        Alignment uncached = surjector.surject(read, paths);
+        surjector.path_position_cache = &cache;
+        Alignment cached = surjector.surject(read, paths);
+        
+        REQUIRE(pb2json(cached) == pb2json(uncached));
+        REQUIRE(cached.refpos_size() == 1);
+        REQUIRE(cached.refpos(0).name() == uncached.refpos(0).name());
+    }
+}
+
 }
 }
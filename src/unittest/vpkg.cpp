@@ -13,8 +13,12 @@
 #include "xg.hpp"
 #include "../vg.hpp"
 #include "../snarl_seed_clusterer.hpp"
+#include "../gbwt_helper.hpp"
+#include "../utility.hpp"
 #include "vg/io/json2pb.h"
 #include <gcsa/gcsa.h>
+#include <gbwtgraph/index.h>
+#include <fstream>
 #include <sstream>
 #include <tuple>
 #include <memory>
@@ -269,6 +273,61 @@ TEST_CASE("We prefer to read a graph as the first provided type that matches", "
     REQUIRE(get<1>(loaded)->get_sequence(get<1>(loaded)->get_handle(1, false)) == "GATT");
 }
 
+TEST_CASE("We can read a minimizer index from a file and from a stream", "[vpkg][minimizer]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATTACA"},
+    {"id":2,"sequence":"CATTAG"},
+    {"id":3,"sequence":"GGACT"},
+    {"id":4,"sequence":"TTGCAA"}],
+    "edge":[{"from":1,"to":2},{"from":1,"to":3},{"from":2,"to":4},{"from":3,"to":4}]}
+    )";
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG vg_graph(proto_graph);
+    
+    vector<gbwt::vector_type> haplotypes;
+    for (nid_t middle : {2, 3}) {
+        haplotypes.emplace_back();
+        for (nid_t id : {(nid_t) 1, middle, (nid_t) 4}) {
+            haplotypes.back().push_back(static_cast<gbwt::vector_type::value_type>(gbwt::Node::encode(id, false)));
+        }
+    }
+    gbwt::GBWT gbwt_index = get_gbwt(haplotypes);
+    gbwtgraph::GBWTGraph gbwt_graph(gbwt_index, vg_graph);
+    
+    gbwtgraph::DefaultMinimizerIndex index(5, 3, false);
+    gbwtgraph::index_haplotypes(gbwt_graph, index, [](const pos_t&) -> gbwtgraph::payload_type {
+        return gbwtgraph::DefaultMinimizerIndex::DEFAULT_PAYLOAD;
+    });
+    REQUIRE(index.size() != 0);
+    
+    string filename = temp_file::create();
+    {
+        ofstream out(filename);
+        vg::io::VPKG::save(index, out);
+    }
+    
+    unique_ptr<gbwtgraph::DefaultMinimizerIndex> from_file = vg::io::VPKG::load_one<gbwtgraph::DefaultMinimizerIndex>(filename);
+    ifstream in(filename);
+    unique_ptr<gbwtgraph::DefaultMinimizerIndex> from_stream = vg::io::VPKG::load_one<gbwtgraph::DefaultMinimizerIndex>(in);
+    
+    for (auto* loaded : {from_file.get(), from_stream.get()}) {
+        REQUIRE(loaded != nullptr);
+        REQUIRE(loaded->k() == index.k());
+        REQUIRE(loaded->w() == index.w());
+        REQUIRE(loaded->size() == index.size());
+        REQUIRE(loaded->values() == index.values());
+        for (string sequence : {"GATTACACATTAGTTGCAA", "GATTACAGGACTTTGCAA"}) {
+            for (auto& minimizer : index.minimizers(sequence)) {
+                REQUIRE(loaded->count(minimizer) == index.count(minimizer));
+            }
+        }
+    }
+    
+    temp_file::remove(filename);
+}
+
 TEST_CASE("We can send more than 2 GB of data through the bare-to-encapsulated conversion", "[vpkg]") {
     size_t DATA_SIZE = 3L * 1024 * 1024 * 1024;
     
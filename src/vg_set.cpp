@@ -284,7 +284,8 @@ void VGset::write_gcsa_kmers_binary(ostream& out, int kmer_size, size_t& size_li
 
 // writes to a set of temp files and returns their names
 vector<string> VGset::write_gcsa_kmers_binary(int kmer_size, size_t& size_limit,
-                                              nid_t head_id, nid_t tail_id) {
+                                              nid_t head_id, nid_t tail_id,
+                                              vector<KmerPartitionCount>* partition_counts) {
     if (filenames.size() > 1 && (head_id == 0 || tail_id == 0)) {
         // Detect head and tail IDs in advance if we have multiple graphs
         nid_t max_id = max_node_id(); // expensive, as we'll stream through all the files
@@ -304,10 +305,18 @@ vector<string> VGset::write_gcsa_kmers_binary(int kmer_size, size_t& size_limit,
         tail_id = overlay.get_id(overlay.get_sink_handle());
         
         size_t current_bytes = size_limit - total_size;
+        vector<KmerPartitionCount> graph_partition_counts;
         try {
-            tmpnames.push_back(write_gcsa_kmers_to_tmpfile(overlay, kmer_size, current_bytes, head_id, tail_id));
+            tmpnames.push_back(write_gcsa_kmers_to_tmpfile(overlay, kmer_size, current_bytes, head_id, tail_id,
+                                                           "vg-kmers-tmp-", &graph_partition_counts));
+            if (partition_counts) {
+                partition_counts->insert(partition_counts->end(), graph_partition_counts.begin(), graph_partition_counts.end());
+            }
         }
         catch (SizeLimitExceededException& ex) {
+            if (partition_counts) {
+                partition_counts->insert(partition_counts->end(), graph_partition_counts.begin(), graph_partition_counts.end());
+            }
             // clean up the temporary files before continuing to throw the exception
             for (const auto& tmpname : tmpnames) {
                 temp_file::remove(tmpname);
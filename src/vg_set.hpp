@@ -52,14 +52,16 @@ public:
      * size_limit is the maximum space usage for the kmer files in bytes. When the
      * function returns, size_limit is the total size of the kmer files in bytes. If the size
      * limit is exceeded, throws SizeLimitExceededException, and (if relevant) deletes
-     * temporary files
+     * temporary files. If partition_counts is given, the kmer counts for the node ranges
+     * of all the graphs are added to it.
      */
     void write_gcsa_kmers_ascii(ostream& out, int kmer_size,
                                 nid_t head_id=0, nid_t tail_id=0);
     void write_gcsa_kmers_binary(ostream& out, int kmer_size, size_t& size_limit,
                                  nid_t head_id=0, nid_t tail_id=0);
     vector<string> write_gcsa_kmers_binary(int kmer_size, size_t& size_limit,
-                                           nid_t head_id=0, nid_t tail_id=0);
+                                           nid_t head_id=0, nid_t tail_id=0,
+                                           vector<KmerPartitionCount>* partition_counts = nullptr);
 
     // Should we show our progress running through each graph?             
     bool show_progress = false;
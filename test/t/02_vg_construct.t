@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="C" # force a consistent sort order 
 
-plan tests 30
+plan tests 31
 
 is $(vg construct -m 1000 -r small/x.fa -v small/x.vcf.gz | vg stats -z - | grep nodes | cut -f 2) 210 "construction produces the right number of nodes"
 
@@ -71,6 +71,12 @@ x3=$(for i in $(seq 100); do
 
 is $x3 1 "the number of threads and regions used in construction has no effect on the graph"
 
+vg construct -r small/x.fa -v small/x.vcf.gz -z 10 -t 1 > x.serial.vg
+vg construct -r small/x.fa -v small/x.vcf.gz -z 10 -t 8 > x.parallel.vg
+cmp x.serial.vg x.parallel.vg
+is $? 0 "construction output is byte-identical regardless of the number of threads"
+rm -f x.serial.vg x.parallel.vg
+
 vg construct -r 1mb1kgp/z.fa -v 1mb1kgp/z.vcf.gz -R z:10-20 >/dev/null
 is $? 0 "construction of a graph with two head nodes succeeds"
 
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 46
+plan tests 49
 
 vg construct -r small/x.fa >j.vg
 vg index -x j.xg j.vg
@@ -56,6 +56,16 @@ is $(vg surject -S -p x -x x.xg -t 1 x.gam | vg view -a - | wc -l) \
 is $(vg surject -p x -x x.xg -s x.gam | grep -v ^@ | wc -l) \
     100 "vg surject produces valid SAM output"
 
+vg surject -p x -x x.xg -t 1 -s x.gam > uncached.sam
+vg surject -p x -x x.xg -t 1 -s --path-cache x.ppc x.gam > cached.sam
+is "$(md5sum < cached.sam)" "$(md5sum < uncached.sam)" "vg surject gives the same output when building a path cache"
+vg surject -p x -x x.xg -t 1 -s --path-cache x.ppc x.gam > cached.sam
+is "$(md5sum < cached.sam)" "$(md5sum < uncached.sam)" "vg surject gives the same output when using a saved path cache"
+vg surject -p x -x j.xg -t 1 -s --path-cache x.ppc j.gam > cached.sam 2> /dev/null
+is "$?" 1 "vg surject rejects a path cache built for a different graph"
+
+rm -f uncached.sam cached.sam x.ppc
+
 is $(vg map -G <(vg sim -a -n 100 -x x.xg) -g x.gcsa -x x.xg --surject-to sam | grep -v ^@ | wc -l) \
     100 "vg map may surject reads to produce valid SAM output"
 
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 39
+plan tests 40
 
 vg view -J -v pileup/tiny.json > tiny.vg
 
@@ -129,7 +129,12 @@ vg augment flat.hg 2snp.gam | vg convert -v - | vg view - | grep S | awk '{print
 diff vg_augment.nodes hash_graph_augment.nodes
 is "$?" 0 "augmenting a hash graph produces same results as a vg graph"
 
-rm -f flat.vg flat.gcsa flat.xg flat.pg flat.hg 2snp.vg 2snp.xg 2snp.sim 2snp.gam vg_augment.nodes packed_graph_augment.nodes hash_graph_augment.nodes
+vg augment flat.vg 2snp.gam -t 1 | vg view - > vg_augment.t1.gfa
+vg augment flat.vg 2snp.gam -t 4 | vg view - > vg_augment.t4.gfa
+diff vg_augment.t1.gfa vg_augment.t4.gfa
+is "$?" 0 "augmenting produces the same graph regardless of thread count"
+
+rm -f flat.vg flat.gcsa flat.xg flat.pg flat.hg 2snp.vg 2snp.xg 2snp.sim 2snp.gam vg_augment.nodes packed_graph_augment.nodes hash_graph_augment.nodes vg_augment.t1.gfa vg_augment.t4.gfa
 rm -f 2err.sim 2err.gam 4edits.gam 2snp_default.nodes 2snp_m1.nodes 4edits_m11.nodes 2qual.gam qual.fq
 
 vg construct -m 10 -r tiny/tiny.fa >t.vg
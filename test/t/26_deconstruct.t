@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 24
+plan tests 30
 
 vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz > tiny.vg
 vg index tiny.vg -x tiny.xg
@@ -154,6 +154,25 @@ gzip -dc x.decon.vcf.gz > x.decon.vcf
 diff x.decon.vcf x.gbz.decon.vcf
 is "$?" 0 "gbz deconstruction gives same output as gbwt deconstruction"
 
+vg deconstruct x.xg -p x -a -t 4 | grep -v "^#" | sort -c -k1,1 -k2,2n
+is "$?" 0 "nested deconstruction output is written in sorted order"
+
+vg deconstruct x.xg -p x -a > x.nested.vcf
+vg deconstruct x.xg -p x -a --snarls-per-window 1 | diff - x.nested.vcf
+is "$?" 0 "nested deconstruction output doesn't depend on the window size"
+vg deconstruct x.giraffe.gbz -a --snarls-per-window 1 > x.gbz.window.vcf
+vg deconstruct x.giraffe.gbz -a | diff - x.gbz.window.vcf
+is "$?" 0 "nested gbz deconstruction output doesn't depend on the window size"
+rm -f x.nested.vcf x.gbz.window.vcf
+
+vg deconstruct x.giraffe.gbz -a > x.gbz.nested.vcf 2> /dev/null
+vg deconstruct x.giraffe.gbz -a -t 1 -v 2> x.gbz.log | diff - x.gbz.nested.vcf
+is "$?" 0 "nested gbz deconstruction output doesn't depend on the order snarls are done in"
+is "$(grep -c '^GBWT traversals of [1-9]' x.gbz.log)" "1" "nested gbz deconstruction takes some traversals from parent snarls"
+vg deconstruct x.giraffe.gbz -a --no-traversal-cache | diff - x.gbz.nested.vcf
+is "$?" 0 "nested gbz deconstruction output doesn't depend on taking traversals from parent snarls"
+rm -f x.gbz.nested.vcf x.gbz.log
+
 rm -f x.vg x.xg x.gbwt x.decon.vcf.gz x.decon.vcf.gz.tbi x.decon.vcf x.gbz.decon.vcf x.giraffe.gbz x.min x.dist small.s1.h1.fa small.s1.h2.fa decon.s1.h1.fa decon.s1.h2.fa
 
 
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 21
+plan tests 24
 
 
 # Exercise the GBWT
@@ -129,7 +129,14 @@ is "$(vg mpmap -x s.xg -d s.dist -g s.gcsa -B -n rna -f s.fq -i -I 530 -D 10 | v
 
 is "$(vg mpmap -x s.xg -d s.dist -g s.gcsa -B -n rna -f s.fq -i -I 530 -D 10 -F SAM --report-group-mapq | grep GM:i: | wc -l)" "2" "HTS output contains group mapq annotation"
 
-rm s.vg s.xg s.gcsa s.gcsa.lcp s.dist s.snarls s.fq
+vg mpmap -x s.xg -d s.dist -g s.gcsa -n rna -f s.fq -i -I 530 -D 10 -t 1 --calibration s.calib > s1.gamp 2> /dev/null
+vg mpmap -x s.xg -d s.dist -g s.gcsa -n rna -f s.fq -i -I 530 -D 10 -t 1 --calibration s.calib > s2.gamp 2> s.log
+is "$(grep -c "Loaded mismapping detection calibration" s.log)" "1" "mismapping detection calibration can be saved and reloaded"
+is "$(cmp s1.gamp s2.gamp && echo same)" "same" "mapping with a reloaded calibration gives the same results"
+vg mpmap -x s.xg -d s.dist -g s.gcsa -n dna -f s.fq -i -I 530 -D 10 -t 1 --calibration s.calib > s3.gamp 2> s.log
+is "$(grep -c "recalibrating" s.log)" "1" "mismapping detection calibration is redone when the mapping parameters change"
+
+rm s.vg s.xg s.gcsa s.gcsa.lcp s.dist s.snarls s.fq s.calib s1.gamp s2.gamp s3.gamp s.log
 
 # Now make sure we randomly choose between equivalent mappings
 vg construct -r small/x.fa > x.vg
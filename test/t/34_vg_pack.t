@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 20
+plan tests 26
 
 vg construct -m 1000 -r tiny/tiny.fa >flat.vg
 vg view flat.vg| sed 's/CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTG/CAAATAAGGCTTGGAAATTTTCTGGAGATCTATTATACTCCAACTCTCTG/' | vg view -Fv - >2snp.vg
@@ -93,6 +93,32 @@ vg pack -x x.vg -g sim.gam -D -t 2 | sort > edge-table.vg.t3.tsv
 diff edge-table.vg.tsv edge-table.vg.t3.tsv
 is "$?" 0 "edge packs same on vg when using 2 threads as when using 1"
 
+vg pack -x x.vg -g sim.gam -o x.vg.buffered.cx -t 4 -B 7
+vg pack -x x.vg -i x.vg.buffered.cx -d | awk '!($1="")' | sort > node-table.vg.buffered.tsv
+diff node-table.vg.tsv node-table.vg.buffered.tsv
+is "$?" 0 "node packs same with small coverage buffers as without"
+
+vg pack -x x.vg -i x.vg.buffered.cx -D | sort > edge-table.vg.buffered.tsv
+diff edge-table.vg.tsv edge-table.vg.buffered.tsv
+is "$?" 0 "edge packs same with small coverage buffers as without"
+
+vg gamsort sim.gam > sim.sorted.gam
+vg pack -x x.vg -g sim.sorted.gam -o x.vg.streamed.cx -S
+vg pack -x x.vg -i x.vg.streamed.cx -d | awk '!($1="")' | sort > node-table.vg.streamed.tsv
+diff node-table.vg.tsv node-table.vg.streamed.tsv
+is "$?" 0 "node packs same when streamed from sorted reads"
+
+vg pack -x x.vg -i x.vg.streamed.cx -D | sort > edge-table.vg.streamed.tsv
+diff edge-table.vg.tsv edge-table.vg.streamed.tsv
+is "$?" 0 "edge packs same when streamed from sorted reads"
+
+printf "H\tVN:Z:1.0\nS\t2\tGATTACA\nS\t1\tCAT\nL\t1\t+\t2\t+\t0M\n" > unordered.gfa
+vg convert -g unordered.gfa -p > unordered.vg
+vg pack -x unordered.vg -g sim.sorted.gam -o unordered.cx -S 2> unordered.err
+is "$?" 1 "streaming refuses a graph whose node ranks aren't in ID order"
+is "$(grep -c 'node ID order' unordered.err)" 1 "streaming explains why it refuses an unordered graph"
+rm -f unordered.gfa unordered.vg unordered.cx unordered.err
+
 vg convert x.vg -G sim.gam | bgzip | vg pack -x x.vg -a - -o x.vg.gaf.cx
 vg pack -x x.vg -i x.vg.gaf.cx -d | awk '!($1="")' | sort > node-table.vg.gaf.tsv
 diff node-table.vg.gaf.tsv node-table.vg.tsv
@@ -102,7 +128,7 @@ vg pack -x x.vg -i x.vg.gaf.cx -D | sort > edge-table.vg.gaf.tsv
 diff edge-table.vg.gaf.tsv edge-table.vg.tsv
 is "$?" 0 "edge packs on gaf same as gam"
 
-rm -f x.vg x.xg sim.gam x.xg.cx x.vg.cx node-table.vg.tsv node-table.xg.tsv edge-table.vg.tsv edge-table.xg.tsv edge-table.vg.t3.tsv node-table.vg.t3.tsv x.vg.gaf.cx node-table.vg.gaf.tsv edge-table.vg.gaf.tsv
+rm -f x.vg x.xg sim.gam x.xg.cx x.vg.cx node-table.vg.tsv node-table.xg.tsv edge-table.vg.tsv edge-table.xg.tsv edge-table.vg.t3.tsv node-table.vg.t3.tsv x.vg.gaf.cx node-table.vg.gaf.tsv edge-table.vg.gaf.tsv x.vg.buffered.cx node-table.vg.buffered.tsv edge-table.vg.buffered.tsv sim.sorted.gam x.vg.streamed.cx node-table.vg.streamed.tsv edge-table.vg.streamed.tsv
 
 vg construct -m 5 -r tiny/tiny.fa >flat.vg
 vg index flat.vg -g flat.gcsa
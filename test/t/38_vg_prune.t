@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 21
+plan tests 23
 
 
 # Build a graph with one path and two threads
@@ -24,7 +24,11 @@ vg prune -e 1 -M 3 x.vg > y.vg
 is $(vg stats -s y.vg | wc -l) 6 "pruning without high-degree nodes produces the correct number of components"
 is $(vg stats -N y.vg) 50 "pruning without high-degree nodes leaves the correct number of nodes"
 is $(vg stats -E y.vg) 47 "pruning without high-degree nodes leaves the correct number of edges"
-rm -f y.vg
+vg prune -e 1 -M 3 -s 40 -t 1 x.vg | vg view - | sort > single.gfa
+vg prune -e 1 -M 3 -s 40 -t 4 x.vg | vg view - | sort > multi.gfa
+diff single.gfa multi.gfa
+is $? 0 "pruning produces the same graph with one and multiple threads"
+rm -f y.vg single.gfa multi.gfa
 
 # Restore paths: 1 component, 64 nodes, 68 edges
 vg prune -r -e 1 x.vg > y.vg
@@ -38,7 +42,11 @@ vg prune -u -m x.mapping -g x.gbwt -e 1 x.vg > y.vg
 is $(vg stats -s y.vg | wc -l) 1 "pruning with path/thread unfolding produces the correct number of components"
 is $(vg stats -N y.vg) 80 "pruning with path/thread unfolding produces the correct number of nodes"
 is $(vg stats -E y.vg) 92 "pruning with path/thread unfolding produces the correct number of edges"
-rm -f x.mapping y.vg
+vg prune -u -m single.mapping -g x.gbwt -e 1 -t 1 x.vg | vg view - | sort > single.gfa
+vg prune -u -m multi.mapping -g x.gbwt -e 1 -t 4 x.vg | vg view - | sort > multi.gfa
+cmp single.mapping multi.mapping && diff single.gfa multi.gfa
+is $? 0 "unfolding produces the same graph and mapping with one and multiple threads"
+rm -f x.mapping y.vg single.mapping multi.mapping single.gfa multi.gfa
 
 # Unfold only paths: 1 component, 64 nodes, 68 edges
 vg prune -u -m x.mapping -e 1 x.vg > y.vg
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 2
+plan tests 4
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg  x.vg
@@ -22,5 +22,12 @@ is "$(md5sum <min_ids.gamsorted.txt)" "$(md5sum <min_ids.sorted.txt)" "Sorting a
 vg gamsort x.gam -i x.sorted.gam.gai >x.sorted.gam
 is "$?" "0" "sorted GAMs can be indexed during the sort"
 
+vg convert -G x.gam x.xg >x.gaf
+vg gamsort -g -G -x x.xg x.gaf >x.sorted.gaf
+is "$(wc -l <x.sorted.gaf)" "1000" "GAF files can be sorted"
+# Get the min node ID in each GAF line's path
+cut -f 6 x.sorted.gaf | tr '<>' '  ' | awk '{min = $1; for (i = 2; i <= NF; i++) { if ($i < min) { min = $i } } print min}' >min_ids.gafsorted.txt
+is "$(md5sum <min_ids.gafsorted.txt)" "$(md5sum <min_ids.sorted.txt)" "Sorting a GAF orders the alignments by min node ID"
 
-rm -f x.vg x.xg x.gam x.sorted.gam x.sorted.2.gam min_ids.gamsorted.txt min_ids.sorted.txt x.sorted.gam.gai x.sorted.2.gam.gai
+
+rm -f x.vg x.xg x.gam x.gaf x.sorted.gaf x.sorted.gam x.sorted.2.gam min_ids.gamsorted.txt min_ids.gafsorted.txt min_ids.sorted.txt x.sorted.gam.gai x.sorted.2.gam.gai
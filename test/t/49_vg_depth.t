@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 6
+plan tests 8
 
 vg construct -m 10 -r tiny/tiny.fa >flat.vg
 vg view flat.vg| sed 's/CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTG/CAAATAAGGCTTGGAAATTTTCTGGAGATCTATTATACTCCAACTCTCTG/' | vg view -Fv - >2snp.vg
@@ -17,9 +17,12 @@ vg pack -x flat.xg -o 2snp.gam.cx -g 2snp.gam
 is $(vg depth flat.vg -g 2snp.gam | awk '{print $1}') 18 "vg depth gets correct depth from gam"
 is $(vg depth flat.xg -k 2snp.gam.cx -b 100000 | awk '{print int($4)}') 18 "vg depth gets correct depth from pack"
 is $(vg depth flat.xg -k 2snp.gam.cx -b 10 | wc -l) 5 "vg depth gets correct number of bins"
+vg depth flat.xg -k 2snp.gam.cx -i 2snp.depth.idx
+is $(vg depth -I 2snp.depth.idx -r x:1-50 | awk '{print int($4)}') 18 "vg depth gets correct depth from a binned depth index"
+is $(vg depth -I 2snp.depth.idx -r x:1-10 -r x:20-30 | wc -l) 2 "vg depth answers each region query from a binned depth index"
 vg convert flat.vg -G 2snp.gam | gzip > 2snp.gaf.gz
 is $(vg depth flat.vg -a 2snp.gaf.gz | awk '{print $1}') 18 "vg depth gets correct depth from gaf"
 vg augment flat.vg 2snp.gam -i > flat-aug.vg
 is $(vg depth flat-aug.vg | awk '{print $1}' | uniq | wc -l) $(vg paths -Lv flat-aug.vg | wc -l) "vg depth of paths reports all paths"
 is $(vg depth flat-aug.vg -P x | awk '{print $1}' | uniq | wc -l) 1 "vg depth of paths reports just path with selected prefix"
-rm -f flat.vg flat.gcsa flat.xg 2snp.vg 2snp.sim 2snp.gam 2snp.gam.cx 2snp.gaf.gz flat-aug.vg
+rm -f flat.vg flat.gcsa flat.xg 2snp.vg 2snp.sim 2snp.gam 2snp.gam.cx 2snp.gaf.gz flat-aug.vg 2snp.depth.idx
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 45
+plan tests 48
 
 vg construct -a -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg x.vg
@@ -86,6 +86,19 @@ is "$(vg view -aj single.gam | jq -c 'select((.fragment_next | not) and (.fragme
 vg giraffe x.fa x.vcf.gz -f small/x.fa_1.fastq -f small/x.fa_1.fastq --fragment-mean 300 --fragment-stdev 100 > paired.gam
 is "$(vg view -aj paired.gam | jq -c 'select((.fragment_next | not) and (.fragment_prev | not))' | wc -l)" "0" "paired reads have cross-references"
 
+vg giraffe x.fa x.vcf.gz -f small/x.fa_1.fastq -t 2 --pipeline-emit-threads 1 > single.pipeline.gam
+is "$(vg view -aj single.pipeline.gam | jq -r '.name' | sort | uniq | wc -l)" "1000" "pipelined single-end mapping emits every read"
+
+vg giraffe x.fa x.vcf.gz -f small/x.fa_1.fastq -f small/x.fa_1.fastq --fragment-mean 300 --fragment-stdev 100 -t 2 --pipeline-emit-threads 1 > paired.pipeline.gam
+is "$(vg view -aj paired.pipeline.gam | wc -l)" "$(vg view -aj paired.gam | wc -l)" "pipelined paired-end mapping emits every read"
+
+rm -f single.pipeline.gam paired.pipeline.gam
+
+vg giraffe x.fa x.vcf.gz -f small/x.fa_1.fastq --stage-latency latency.json > /dev/null
+is "$(jq -r '.seed.count' latency.json)" "1000" "stage latency histograms count every read"
+
+rm -f latency.json
+
 # Test paired surjected mapping
 vg giraffe x.fa x.vcf.gz -iG <(vg view -a small/x-s13241-n1-p500-v300.gam | sed 's%_1%/1%' | sed 's%_2%/2%' | vg view -JaG - ) --output-format SAM >surjected.sam
 is "$(cat surjected.sam | grep -v '^@' | sort -k4 | cut -f 4)" "$(printf '321\n762')" "surjection of paired reads to SAM yields correct positions"
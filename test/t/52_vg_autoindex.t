@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 34
+plan tests 41
 
 rm auto.*
 
@@ -19,8 +19,31 @@ is $(echo $?) 0 "basic autoindexing results can be used by vg map"
 
 rm auto.*
 
-vg autoindex -p auto -w map -r small/x.fa -v small/x.vcf.gz -r small/y.fa -v small/y.vcf.gz 
+vg autoindex -p auto -w map -r tiny/tiny.fa -v tiny/tiny.vcf.gz --force-unphased --checkpoint-dir checkpoint
+md5sum auto.xg > xg.md5
+vg autoindex -p auto -w map -r tiny/tiny.fa -v tiny/tiny.vcf.gz --force-unphased --checkpoint-dir checkpoint 2> log.txt
+grep -q "from checkpoint" log.txt
+is $? 0 "autoindexing reuses the completed indexes in a checkpoint directory"
+md5sum -c xg.md5 > /dev/null
+is $? 0 "autoindexing from a checkpoint directory produces the same results"
+
+# simulate being killed while writing the last record, after an output was removed
+rm auto.xg
+head -n -1 checkpoint/checkpoint_manifest.tsv > manifest.tsv
+printf 'XG\t1\tauto.xg\t12' >> manifest.tsv
+mv manifest.tsv checkpoint/checkpoint_manifest.tsv
+vg autoindex -p auto -w map -r tiny/tiny.fa -v tiny/tiny.vcf.gz --force-unphased --checkpoint-dir checkpoint 2> log.txt
+is $? 0 "autoindexing resumes from an interrupted checkpoint"
+grep -q "from checkpoint" log.txt
+is $? 0 "autoindexing reuses the completed indexes from an interrupted checkpoint"
+md5sum -c xg.md5 > /dev/null
+is $? 0 "autoindexing resumed from an interrupted checkpoint produces the same results"
+
+rm -r auto.* checkpoint xg.md5 log.txt
+
+vg autoindex -p auto -w map -r small/x.fa -v small/x.vcf.gz -r small/y.fa -v small/y.vcf.gz --timeline timeline.tsv
 is $(echo $?) 0 "autoindexing successfully completes indexing for vg map with chunked input"
+is "$(tail -n +2 timeline.tsv | cut -f 7 | sort -u)" "completed" "autoindexing can report a timeline of the recipes it executed"
 vg sim -x auto.xg -n 20 -a -l 10 | vg map -d auto -t 1 -G - > /dev/null
 is $(echo $?) 0 "chunked autoindexing results can be used by vg map"
 
@@ -37,9 +60,12 @@ rm auto.*
 
 vg autoindex -p auto -w mpmap -w rpvg -r tiny/tiny.fa -v tiny/tiny.vcf.gz -x tiny/tiny.gtf
 is $(echo $?) 0 "autoindexing successfully completes indexing for vg mpmap with unchunked input"
-is $(ls auto.* | wc -l) 6 "autoindexing creates 6 files for mpmap/rpvg"
+is $(ls auto.* | wc -l) 7 "autoindexing creates 7 files for mpmap/rpvg"
 vg sim -x auto.spliced.xg -n 20 -a -l 10 | vg mpmap -x auto.spliced.xg -g auto.spliced.gcsa -d auto.spliced.dist -B -t 1 -G - > /dev/null
 is $(echo $?) 0 "basic autoindexing results can be used by vg mpmap"
+vg sim -x auto.spliced.xg -n 20 -a -l 10 | vg mpmap -x auto.spliced.xg -g auto.spliced.gcsa -d auto.spliced.dist --calibration auto.mpmap.calib -t 1 -G - 2>&1 > /dev/null | grep -c "Loaded mismapping detection calibration" > calib.txt
+is "$(cat calib.txt)" "1" "vg mpmap with default options uses the mismapping calibration made by autoindexing"
+rm calib.txt
 is $(vg paths -g auto.haplotx.gbwt -L | wc -l) 6 "haplotype transcript GBWT made by autoindex is valid"
 is $(cat auto.txorigin.tsv | wc -l) 7 "transcript origin table has expected number of rows" 
 
@@ -47,13 +73,13 @@ rm auto.*
 
 vg autoindex -p auto -w mpmap -r tiny/tiny.fa -x tiny/tiny.gtf
 is $(echo $?) 0 "autoindexing successfully completes indexing for vg mpmap without variants"
-is $(ls auto.* | wc -l) 4 "autoindexing creates 4 files for mpmap/rpvg without variants"
+is $(ls auto.* | wc -l) 5 "autoindexing creates 5 files for mpmap/rpvg without variants"
 
 rm auto.*
 
 vg autoindex -p auto -w mpmap -w rpvg -r small/x.fa -r small/y.fa -v small/x.vcf.gz -v small/y.vcf.gz -x small/x.gtf -x small/y.gtf
 is $(echo $?) 0 "autoindexing successfully completes indexing for vg mpmap with chunked input"
-is $(ls auto.* | wc -l) 6 "autoindexing creates 6 files for mpmap/rpvg with chunked input"
+is $(ls auto.* | wc -l) 7 "autoindexing creates 7 files for mpmap/rpvg with chunked input"
 
 rm auto.*
 
@@ -112,4 +138,4 @@ is "$(vg autoindex -p auto -w map --gcsa-size-limit 2000000 -g graphs/linked_cyc
 is "$(echo $?)" 0 "Indexing is successful after rewinding from GCSA2 indexing"
 
 rm auto.*
-rm read.fq read.gam
+rm read.fq read.gam timeline.tsv
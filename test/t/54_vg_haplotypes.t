@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 4
+plan tests 8
 
 # Build the indexes for the two-chromosome (1+1 kbp) test case
 vg construct -r small/xy.fa -v small/xy.vcf.gz -a > small.vg 2> /dev/null
@@ -24,8 +24,24 @@ is $? 0 "sampling the haplotypes directly"
 cmp indirect.gbz direct.gbz
 is $? 0 "the outputs are identical"
 
+# Count the kmers directly in reads simulated from the same sample at the same
+# coverage as the checked-in KFF file. Counting the kmers should select the
+# same haplotypes as reading them from the KFF file.
+vg gbwt -v small/xy.vcf.gz -x small.vg -o small.gbwt
+vg sim -x small.vg -g small.gbwt -m 1 -n 3100 -l 150 -s 54 -a > reads.gam
+vg haplotypes --validate --num-haplotypes 1 --coverage 200 -i small.hapl -R reads.gam --kff-output from_reads.kff -g from_reads.gbz small.gbz
+is $? 0 "sampling the haplotypes using kmers counted from reads"
+cmp from_reads.gbz indirect.gbz
+is $? 0 "kmers counted from reads and the KFF file give identical outputs"
+
+# The kmer counts written from the reads can be used in place of the reads.
+vg haplotypes --validate --num-haplotypes 1 --coverage 200 -i small.hapl -k from_reads.kff -g from_kff.gbz small.gbz
+is $? 0 "sampling the haplotypes using the kmer counts from reads in KFF"
+cmp from_reads.gbz from_kff.gbz
+is $? 0 "kmer counts written from reads give identical outputs"
+
 # FIXME: Test --include-reference with both named and reference paths.
 
 # Cleanup
-rm -r small.vg small.gbz small.ri small.dist
-rm -f small.hapl indirect.gbz direct.gbz
+rm -r small.vg small.gbz small.gbwt small.ri small.dist
+rm -f small.hapl indirect.gbz direct.gbz reads.gam from_reads.gbz from_reads.kff from_kff.gbz
@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+
+BASH_TAP_ROOT=../deps/bash-tap
+. ../deps/bash-tap/bash-tap-bootstrap
+
+PATH=../bin:$PATH # for vg
+
+plan tests 6
+
+vg autoindex -w giraffe -r small/x.fa -v small/x.vcf.gz -p x
+
+vg serve -Z x.giraffe.gbz -m x.min -d x.dist -s serve.sock &
+SERVER_PID=$!
+for i in $(seq 1 60) ; do
+    if [ -S serve.sock ] ; then
+        break
+    fi
+    sleep 1
+done
+
+printf '@read\nGATTACA\n+\n' > truncated.fq
+vg serve -c -s serve.sock -f truncated.fq > /dev/null 2> serve.err
+isnt "${?}" "0" "a request with a truncated FASTQ fails"
+is "$(grep -c 'missing base quality' serve.err)" "1" "the server reports what was wrong with the FASTQ"
+
+vg serve -c -s serve.sock -f nonexistent.fq > /dev/null 2> /dev/null
+isnt "${?}" "0" "a request with a missing FASTQ fails"
+
+vg serve -c -s serve.sock -f small/x.fa_1.fastq -o GAM > served.gam
+is "${?}" "0" "the server still maps reads after bad requests"
+
+vg giraffe -Z x.giraffe.gbz -m x.min -d x.dist -f small/x.fa_1.fastq -t 1 > direct.gam
+is "$(vg view -aj served.gam | jq -c '[.name, .path]' | sort | md5sum)" "$(vg view -aj direct.gam | jq -c '[.name, .path]' | sort | md5sum)" "the server maps reads like giraffe"
+
+vg serve -k -s serve.sock
+wait ${SERVER_PID}
+is "${?}" "0" "the server shuts down cleanly"
+
+rm -f x.giraffe.gbz x.min x.dist x.gbz serve.sock truncated.fq serve.err served.gam direct.gam